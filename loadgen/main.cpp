@@ -0,0 +1,213 @@
+#include <Exceptions.hpp>
+#include <IngestClient.hpp>
+#include <SharedRing.hpp>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+
+// For testing environments generating a pseudo-random private key is okay
+iotbc::PrivateKey generatePseudoRandomPrivateKey() {
+    iotbc::PrivateKey key;
+    for (size_t i = 0; i < key.size(); i++) {
+        key[i] = rand() % 256;
+    }
+
+    return key;
+}
+
+struct ProducerStats {
+    size_t verified = 0;
+    size_t invalid = 0;
+    size_t duplicates = 0;
+    size_t full = 0;
+    // Times a ring producer found the ring full and had to retry
+    size_t retries = 0;
+};
+
+// Submits pre-signed batches, keeping at most window transactions waiting for their result
+ProducerStats runProducer(const std::string &path, std::vector<std::vector<iotbc::Transaction>> batches, size_t window) {
+    iotbc::IngestClient client(path);
+    ProducerStats stats;
+
+    size_t total = 0;
+    for (const auto &batch : batches) {
+        total += batch.size();
+    }
+
+    std::atomic<size_t> answered = 0;
+    std::atomic<bool> disconnected = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::thread receiver([&]() {
+        while (answered < total) {
+            std::vector<iotbc::IngestResult> results;
+
+            try {
+                results = client.receive();
+            } catch (const std::exception &e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                disconnected = true;
+                cv.notify_all();
+                return;
+            }
+
+            for (const auto &result : results) {
+                switch (result.status) {
+                    case iotbc::IngestStatus::Verified: stats.verified++; break;
+                    case iotbc::IngestStatus::Invalid: stats.invalid++; break;
+                    case iotbc::IngestStatus::Duplicate: stats.duplicates++; break;
+                    case iotbc::IngestStatus::Full: stats.full++; break;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            answered += results.size();
+            cv.notify_all();
+        }
+    });
+
+    size_t submitted = 0;
+    for (auto &batch : batches) {
+        size_t size = batch.size();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return disconnected || submitted - answered + size <= std::max(window, size); });
+        }
+
+        if (disconnected) {
+            break;
+        }
+
+        try {
+            client.submit(std::move(batch));
+        } catch (const iotbc::NetworkError &e) {
+            // The receiver stops too, the server closed the connection
+            disconnected = true;
+            break;
+        }
+        submitted += size;
+    }
+
+    receiver.join();
+
+    if (disconnected) {
+        throw iotbc::NetworkError("Ingest server disconnected");
+    }
+
+    return stats;
+}
+
+// Pushes pre-signed transactions into a shared memory ring, retrying while it is full. The ring gives no results
+ProducerStats runRingProducer(const std::string &name, const std::vector<std::vector<iotbc::Transaction>> &batches) {
+    iotbc::SharedRing ring(name);
+    ProducerStats stats;
+
+    std::vector<unsigned char> buf;
+    for (const auto &batch : batches) {
+        for (const auto &tx : batch) {
+            buf.clear();
+            tx.serializeInto(buf, iotbc::WireFormat::V2);
+
+            while (!ring.push(buf)) {
+                stats.retries++;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    return stats;
+}
+
+int main(int ac, char **av) {
+    // With --ring, producers write to the shared memory ring of the daemon instead of its socket
+    bool useRing = ac > 2 && std::string(av[1]) == "--ring";
+    int first = useRing ? 2 : 1;
+
+    if (ac <= first) {
+        std::cerr << "Usage: " << av[0] << " [--ring] <socket or ring name> [producers] [transactions per producer] [batch size] [window]" << std::endl;
+        return 1;
+    }
+
+    std::string path = av[first];
+    size_t producers = ac > first + 1 ? std::stoul(av[first + 1]) : 4;
+    size_t perProducer = ac > first + 2 ? std::stoul(av[first + 2]) : 10000;
+    size_t batchSize = ac > first + 3 ? std::stoul(av[first + 3]) : 64;
+    size_t window = ac > first + 4 ? std::stoul(av[first + 4]) : 1024;
+
+    srand(std::random_device()());
+
+    // Signed beforehand, only the submission is measured. Every producer signs with its own key and
+    // reports under its own sensor id, like separate sensor processes
+    std::vector<std::vector<std::vector<iotbc::Transaction>>> work(producers);
+    for (size_t p = 0; p < producers; p++) {
+        iotbc::Signer signer(generatePseudoRandomPrivateKey());
+        std::string sensor = std::to_string(rand());
+
+        for (size_t i = 0; i < perProducer; i += batchSize) {
+            std::vector<iotbc::Transaction> batch;
+
+            for (size_t j = i; j < std::min(perProducer, i + batchSize); j++) {
+                std::string reading = "{\"sensor\":" + sensor + ",\"temperature\":" + std::to_string(20 + j % 10) + "}";
+                iotbc::Transaction tx(signer, j, {reading.begin(), reading.end()});
+                tx.sign(signer);
+                batch.push_back(std::move(tx));
+            }
+
+            work[p].push_back(std::move(batch));
+        }
+    }
+
+    std::vector<ProducerStats> stats(producers);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            try {
+                stats[p] = useRing ? runRingProducer(path, work[p]) : runProducer(path, std::move(work[p]), window);
+            } catch (const std::runtime_error &e) {
+                std::cerr << "Producer " << p << ": " << e.what() << std::endl;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    ProducerStats total;
+    for (const auto &s : stats) {
+        total.verified += s.verified;
+        total.invalid += s.invalid;
+        total.duplicates += s.duplicates;
+        total.full += s.full;
+        total.retries += s.retries;
+    }
+
+    std::chrono::duration<double> elapsed = end - start;
+
+    if (useRing) {
+        std::cout << "Producers: " << producers << ", shared memory ring " << path << std::endl;
+        std::cout << "Pushed " << producers * perProducer << " transactions in " << elapsed.count() * 1000 << "ms ("
+            << producers * perProducer / elapsed.count() << " tx/s)" << std::endl;
+        std::cout << "Retries on a full ring: " << total.retries << std::endl;
+        return 0;
+    }
+
+    std::cout << "Producers: " << producers << ", batches of " << batchSize << ", window of " << window << std::endl;
+    std::cout << "Submitted " << producers * perProducer << " transactions in " << elapsed.count() * 1000 << "ms" << std::endl;
+    std::cout << "Verified: " << total.verified << " (" << total.verified / elapsed.count() << " tx/s)" << std::endl;
+    std::cout << "Invalid: " << total.invalid << ", duplicates: " << total.duplicates << ", full: " << total.full << std::endl;
+
+    return 0;
+}
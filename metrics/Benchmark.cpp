@@ -0,0 +1,189 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+/// @brief Fill the summary of a result from its samples
+static void summarize(BenchmarkResult &result) {
+    std::vector<double> sorted = result.samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    size_t count = sorted.size();
+    result.min = sorted.front();
+    result.max = sorted.back();
+    result.median = count % 2 == 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+    result.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / count;
+
+    double squares = 0;
+    for (double sample : sorted) {
+        squares += (sample - result.mean) * (sample - result.mean);
+    }
+    result.stddev = count > 1 ? std::sqrt(squares / (count - 1)) : 0;
+}
+
+/// @brief Every combination of the parameter values a benchmark depends on
+static std::vector<BenchmarkParams> combinations(unsigned params, const BenchmarkOptions &options) {
+    std::vector<size_t> none = {0};
+    const std::vector<size_t> &payloads = params & BenchmarkParam::Payload ? options.payloads : none;
+    const std::vector<size_t> &txs = params & BenchmarkParam::Txs ? options.txs : none;
+    const std::vector<size_t> &chains = params & BenchmarkParam::Chain ? options.chains : none;
+
+    std::vector<BenchmarkParams> result;
+    for (size_t chain : chains) {
+        for (size_t tx : txs) {
+            for (size_t payload : payloads) {
+                result.push_back({payload, tx, chain});
+            }
+        }
+    }
+
+    return result;
+}
+
+/// @brief Human readable form of a duration in nanoseconds
+static std::string formatTime(double ns) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+
+    if (ns >= 1e9) {
+        out << ns / 1e9 << "s";
+    } else if (ns >= 1e6) {
+        out << ns / 1e6 << "ms";
+    } else if (ns >= 1e3) {
+        out << ns / 1e3 << "us";
+    } else {
+        out << ns << "ns";
+    }
+
+    return out.str();
+}
+
+void BenchmarkSuite::add(Benchmark benchmark) {
+    benchmarks.push_back(std::move(benchmark));
+}
+
+std::vector<std::string> BenchmarkSuite::names() const {
+    std::vector<std::string> result;
+    for (const auto &benchmark : benchmarks) {
+        result.push_back(benchmark.name);
+    }
+    return result;
+}
+
+std::vector<BenchmarkResult> BenchmarkSuite::run(const BenchmarkOptions &options, std::ostream &log) const {
+    std::vector<BenchmarkResult> results;
+
+    for (const auto &benchmark : benchmarks) {
+        if (!options.filter.empty()
+            && std::find(options.filter.begin(), options.filter.end(), benchmark.name) == options.filter.end()) {
+            continue;
+        }
+
+        for (const auto &params : combinations(benchmark.params, options)) {
+            BenchmarkRun work = benchmark.setup(params);
+
+            for (size_t i = 0; i < options.warmup; i++) {
+                work();
+                if (benchmark.setupEachRun) {
+                    work = benchmark.setup(params);
+                }
+            }
+
+            BenchmarkResult result;
+            result.name = benchmark.name;
+            result.unit = benchmark.unit;
+            result.params = params;
+
+            for (size_t i = 0; i < options.repetitions; i++) {
+                auto start = std::chrono::steady_clock::now();
+                size_t operations = work();
+                std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+                result.operations = operations;
+                result.samples.push_back(elapsed.count() / std::max<size_t>(operations, 1));
+
+                if (benchmark.setupEachRun && i + 1 < options.repetitions) {
+                    work = benchmark.setup(params);
+                }
+            }
+
+            if (result.samples.empty()) {
+                continue;
+            }
+            summarize(result);
+
+            log << std::left << std::setw(20) << benchmark.name;
+            if (params.payload > 0) {
+                log << " payload=" << std::setw(6) << params.payload;
+            }
+            if (params.txs > 0) {
+                log << " txs=" << std::setw(5) << params.txs;
+            }
+            if (params.chain > 0) {
+                log << " chain=" << std::setw(4) << params.chain;
+            }
+            log << " " << formatTime(result.median) << "/" << benchmark.unit
+                << " (min " << formatTime(result.min) << ", stddev " << formatTime(result.stddev) << ")" << std::endl;
+
+            results.push_back(std::move(result));
+        }
+    }
+
+    return results;
+}
+
+json BenchmarkSuite::toJson(const std::vector<BenchmarkResult> &results, const BenchmarkOptions &options) {
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    json context = {
+        {"date", date},
+        {"compiler", __VERSION__},
+#ifdef __OPTIMIZE__
+        {"optimized", true},
+#else
+        {"optimized", false},
+#endif
+        {"threads", std::thread::hardware_concurrency()},
+        {"warmup", options.warmup},
+        {"repetitions", options.repetitions},
+    };
+
+    json benchmarks = json::array();
+    for (const auto &result : results) {
+        json params = json::object();
+        if (result.params.payload > 0) {
+            params["payload"] = result.params.payload;
+        }
+        if (result.params.txs > 0) {
+            params["txs"] = result.params.txs;
+        }
+        if (result.params.chain > 0) {
+            params["chain"] = result.params.chain;
+        }
+
+        benchmarks.push_back({
+            {"name", result.name},
+            {"unit", result.unit},
+            {"params", params},
+            {"operations", result.operations},
+            {"ns_per_op", {
+                {"min", result.min},
+                {"median", result.median},
+                {"mean", result.mean},
+                {"stddev", result.stddev},
+                {"max", result.max},
+            }},
+            {"samples", result.samples},
+        });
+    }
+
+    return {{"context", context}, {"benchmarks", benchmarks}};
+}
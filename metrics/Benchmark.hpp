@@ -0,0 +1,93 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <json.hpp>
+
+using json = nlohmann::json;
+
+/// @brief Sizes a benchmark runs with, those it does not depend on stay at 0
+struct BenchmarkParams {
+    /// Size of the transaction payloads in bytes
+    size_t payload = 0;
+    /// Number of transactions per block
+    size_t txs = 0;
+    /// Number of blocks of the chain
+    size_t chain = 0;
+};
+
+/// @brief Parameters a benchmark is run over, combined as flags
+enum BenchmarkParam : unsigned {
+    Payload = 1,
+    Txs = 2,
+    Chain = 4,
+};
+
+/// @brief Measured work of a benchmark, returns the number of operations it did
+using BenchmarkRun = std::function<size_t()>;
+
+/// @brief Named micro-benchmark
+struct Benchmark {
+    std::string name;
+    /// What one operation is, such as a transaction or a block, times are reported per operation
+    std::string unit;
+    /// The parameters the benchmark depends on, see BenchmarkParam
+    unsigned params;
+    /// Prepares the inputs for a set of parameters, outside of the measurement, and returns the measured work
+    std::function<BenchmarkRun(const BenchmarkParams &params)> setup;
+    /// Call setup again before every run, for work consuming its inputs
+    bool setupEachRun = false;
+};
+
+/// @brief Settings of a benchmark suite run
+struct BenchmarkOptions {
+    /// Names of the benchmarks to run, all of them if empty
+    std::vector<std::string> filter;
+    /// Unmeasured runs before the measured ones, to warm caches and allocators up
+    size_t warmup = 2;
+    /// Measured runs of each benchmark and set of parameters
+    size_t repetitions = 10;
+    std::vector<size_t> payloads = {64, 4096};
+    std::vector<size_t> txs = {16, 128};
+    std::vector<size_t> chains = {8, 32};
+};
+
+/// @brief Measurements of a benchmark for one set of parameters
+struct BenchmarkResult {
+    std::string name;
+    std::string unit;
+    BenchmarkParams params;
+    /// Number of operations of each repetition
+    size_t operations = 0;
+    /// Time per operation of each repetition, in nanoseconds
+    std::vector<double> samples;
+    double min = 0;
+    double median = 0;
+    double mean = 0;
+    double stddev = 0;
+    double max = 0;
+};
+
+/// @brief Set of named benchmarks, run over every combination of the parameters they depend on
+class BenchmarkSuite {
+public:
+    /// @brief Register a benchmark
+    void add(Benchmark benchmark);
+
+    /// @brief Get the names of the registered benchmarks
+    std::vector<std::string> names() const;
+
+    /// @brief Run the benchmarks the options select
+    /// @param options The settings
+    /// @param log Stream the results are printed to as they come
+    /// @return The results, in the order they ran
+    std::vector<BenchmarkResult> run(const BenchmarkOptions &options, std::ostream &log) const;
+
+    /// @brief Machine readable form of results, with the settings and build they come from
+    static json toJson(const std::vector<BenchmarkResult> &results, const BenchmarkOptions &options);
+
+private:
+    std::vector<Benchmark> benchmarks;
+};
@@ -1,6 +1,9 @@
 #include <Block.hpp>
 #include <Blockchain.hpp>
+#include <CompactBlock.hpp>
 #include <Exceptions.hpp>
+#include <Latency.hpp>
+#include <Node.hpp>
 
 #include <iostream>
 #include <fstream>
@@ -8,12 +11,15 @@
 #include <thread>
 #include <vector>
 #include <string>
-#include <random>
-#include <cmath>
 #include <chrono>
-#include <numeric>
-#include <iomanip>
-#include <algorithm>
+
+#include "Benchmark.hpp"
+
+/// Folder the storage benchmarks save their chains to
+static const std::string BENCHMARK_FOLDER = "./metrics_blocks";
+
+/// Difficulty of the chains built for the benchmarks, low enough for their setup to stay quick
+static constexpr uint32_t CHAIN_DIFFICULTY = 8;
 
 // For testing environments generating a pseudo-random private key is okay
 iotbc::PrivateKey generatePseudoRandomPrivateKey() {
@@ -41,179 +47,356 @@ iotbc::PrivateKey readPKeyFromFile(const std::string &path) {
     return key;
 }
 
-void savePKeyToFile(const iotbc::PrivateKey &key, const std::string &path) {
-    std::ofstream file(path, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Unable to open file: " + path);
-    }
-
-    file.write(reinterpret_cast<const char*>(key.data()), key.size());
+size_t getMaxMemoryUsage() {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    size_t memoryUsage = 0;
 
-    if (!file) {
-        throw std::runtime_error("Error writing file: " + path);
+    while (std::getline(file, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {  // Line starts with "VmHWM:"
+            std::sscanf(line.c_str(), "VmHWM: %zu", &memoryUsage);
+            return memoryUsage; // Peak memory usage in KB
+        }
     }
+    return 0; // Failed to read memory usage
+}
+
+/// @brief Keep a value alive, so the compiler cannot drop the work computing it
+template <typename T>
+void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
 }
 
-std::ostream &operator<<(std::ostream &os, const iotbc::Hash &hash) {
-    for (const auto &byte : hash) {
-        os << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+std::vector<unsigned char> randomPayload(size_t size) {
+    std::vector<unsigned char> data(size);
+    for (auto &byte : data) {
+        byte = rand() % 256;
     }
-    return os;
+    return data;
 }
 
-void printBlock(const iotbc::Block &block) {
-    std::cout << "PrevHash: " << block.prevHash << std::endl;
-    std::cout << "Block: " << block.blockHash() << std::endl;
+std::vector<iotbc::Transaction> signedTransactions(const iotbc::Signer &signer, size_t count, size_t payload, iotbc::Nonce &nonce) {
+    std::vector<iotbc::Transaction> txs;
+    std::vector<unsigned char> data = randomPayload(payload);
 
-    for (const auto &tx : block.transactions) {
-        std::cout << "  Tx: " << tx.txHash() << std::endl;
-        std::cout << "  From: " << iotbc::Address::fromPublicKey(tx.from).toString() << std::endl;
-        std::string dataAsString(tx.data.begin(), tx.data.end());
-        std::cout << "  Data (as UTF-8): " << dataAsString << std::endl;
+    for (size_t i = 0; i < count; i++) {
+        iotbc::Transaction tx(signer, nonce++, data);
+        tx.sign(signer);
+        txs.push_back(tx);
     }
+
+    return txs;
 }
 
-void printCurrentChain(const iotbc::Blockchain &chain) {
-    for (const auto &block : chain.chain) {
-        printBlock(block);
-        std::cout << std::endl;
-    }
+iotbc::ChainParams chainParams() {
+    iotbc::ChainParams params;
+    params.initialDifficulty = CHAIN_DIFFICULTY;
+    return params;
 }
 
-size_t getMemoryUsage() {
-    std::ifstream file("/proc/self/status");
-    std::string line;
-    size_t memoryUsage = 0;
+/// @brief Build a chain of params.chain blocks holding params.txs transactions of params.payload bytes each
+iotbc::Blockchain buildChain(const iotbc::Signer &signer, const BenchmarkParams &params) {
+    iotbc::Blockchain chain(chainParams());
+    iotbc::Nonce nonce = 0;
 
-    while (std::getline(file, line)) {
-        if (line.rfind("VmRSS:", 0) == 0) {  // Line starts with "VmRSS:"
-            std::sscanf(line.c_str(), "VmRSS: %zu", &memoryUsage);
-            return memoryUsage; // Memory usage in KB
+    for (size_t i = 0; i < params.chain; i++) {
+        iotbc::Block block(chain.chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash(), chain.chain.size());
+        for (const auto &tx : signedTransactions(signer, params.txs, params.payload, nonce)) {
+            block.addTransaction(tx);
         }
+        block.mine(chain.requiredDifficulty());
+        chain.addBlock(block);
     }
-    return 0; // Failed to read memory usage
+
+    return chain;
 }
 
-int main(int ac, char **av) {
-    if (ac == 2 && std::string(av[1]) == "keygen") {
-        iotbc::PrivateKey key = generatePseudoRandomPrivateKey();
-        savePKeyToFile(key, "./private_key");
-        return 0;
+iotbc::Block buildBlock(const iotbc::Signer &signer, const BenchmarkParams &params) {
+    iotbc::Block block(iotbc::NULL_HASH);
+    iotbc::Nonce nonce = 0;
+
+    for (const auto &tx : signedTransactions(signer, params.txs, params.payload, nonce)) {
+        block.addTransaction(tx);
     }
 
-    int difficulty = 12;
+    return block;
+}
+
+void registerBenchmarks(BenchmarkSuite &suite, const iotbc::Signer &signer) {
+    suite.add({"txHash", "tx", BenchmarkParam::Payload, [&signer](const BenchmarkParams &params) {
+        iotbc::Nonce nonce = 0;
+        auto txs = std::make_shared<std::vector<iotbc::Transaction>>(signedTransactions(signer, 256, params.payload, nonce));
+        return [txs]() {
+            for (const auto &tx : *txs) {
+                keep(tx.txHash());
+            }
+            return txs->size();
+        };
+    }});
+
+    suite.add({"sign", "tx", BenchmarkParam::Payload, [&signer](const BenchmarkParams &params) {
+        iotbc::Nonce nonce = 0;
+        auto txs = std::make_shared<std::vector<iotbc::Transaction>>(signedTransactions(signer, 64, params.payload, nonce));
+        return [txs, &signer]() {
+            for (auto &tx : *txs) {
+                tx.sign(signer);
+            }
+            return txs->size();
+        };
+    }});
+
+    suite.add({"verify", "tx", BenchmarkParam::Payload, [&signer](const BenchmarkParams &params) {
+        iotbc::Nonce nonce = 0;
+        auto txs = std::make_shared<std::vector<iotbc::Transaction>>(signedTransactions(signer, 64, params.payload, nonce));
+        return [txs]() {
+            for (const auto &tx : *txs) {
+                tx.verify();
+            }
+            return txs->size();
+        };
+    }});
+
+    suite.add({"merkle", "block", BenchmarkParam::Payload | BenchmarkParam::Txs, [&signer](const BenchmarkParams &params) {
+        auto block = std::make_shared<iotbc::Block>(buildBlock(signer, params));
+        return [block]() {
+            keep(block->hasValidMerkleRoot());
+            return size_t(1);
+        };
+    }});
+
+    // Hashes tried by the mining loop within a fixed time, at a difficulty it never reaches
+    suite.add({"mine-per-nonce", "nonce", BenchmarkParam::Txs, [&signer](const BenchmarkParams &params) {
+        auto block = std::make_shared<iotbc::Block>(buildBlock(signer, {64, params.txs, 0}));
+        return [block]() {
+            iotbc::MiningHandle job = block->mineAsync(255, std::chrono::steady_clock::now() + std::chrono::milliseconds(50));
+            job.wait();
+            return static_cast<size_t>(job.hashesTried());
+        };
+    }});
+
+    suite.add({"serialize", "block", BenchmarkParam::Payload | BenchmarkParam::Txs, [&signer](const BenchmarkParams &params) {
+        auto block = std::make_shared<iotbc::Block>(buildBlock(signer, params));
+        return [block]() {
+            keep(block->serialize());
+            return size_t(1);
+        };
+    }});
+
+    suite.add({"deserialize", "block", BenchmarkParam::Payload | BenchmarkParam::Txs, [&signer](const BenchmarkParams &params) {
+        auto bytes = std::make_shared<std::vector<unsigned char>>(buildBlock(signer, params).serialize());
+        return [bytes]() {
+            keep(iotbc::Block::deserialize(*bytes));
+            return size_t(1);
+        };
+    }});
+
+    suite.add({"compact", "block", BenchmarkParam::Payload | BenchmarkParam::Txs, [&signer](const BenchmarkParams &params) {
+        auto block = std::make_shared<iotbc::Block>(buildBlock(signer, params));
+        return [block]() {
+            keep(iotbc::CompactBlock::fromBlock(*block, block->height).serialize());
+            return size_t(1);
+        };
+    }});
+
+    suite.add({"save", "block", BenchmarkParam::Payload | BenchmarkParam::Txs | BenchmarkParam::Chain, [&signer](const BenchmarkParams &params) {
+        auto chain = std::make_shared<iotbc::Blockchain>(buildChain(signer, params));
+        std::filesystem::remove_all(BENCHMARK_FOLDER);
+        return [chain]() {
+            chain->saveBlocks(BENCHMARK_FOLDER);
+            return chain->chain.size();
+        };
+    }});
+
+    suite.add({"load", "block", BenchmarkParam::Payload | BenchmarkParam::Txs | BenchmarkParam::Chain, [&signer](const BenchmarkParams &params) {
+        std::filesystem::remove_all(BENCHMARK_FOLDER);
+        buildChain(signer, params).saveBlocks(BENCHMARK_FOLDER);
+        return []() {
+            iotbc::Blockchain loaded(chainParams());
+            iotbc::LoadOptions options;
+            options.verify = true;
+            return loaded.loadExistingBlocks(BENCHMARK_FOLDER, options).blocks;
+        };
+    }});
+
+    suite.add({"verifyExistingChain", "block", BenchmarkParam::Payload | BenchmarkParam::Txs | BenchmarkParam::Chain, [&signer](const BenchmarkParams &params) {
+        auto chain = std::make_shared<iotbc::Blockchain>(buildChain(signer, params));
+        return [chain]() {
+            chain->verifyExistingChain();
+            return chain->chain.size();
+        };
+    }});
+
+    // Chain synced over loopback from two peers serving it, into an empty chain
+    suite.add({"sync", "block", BenchmarkParam::Txs | BenchmarkParam::Chain, [&signer](const BenchmarkParams &params) {
+        auto chain = std::make_shared<iotbc::Blockchain>(buildChain(signer, {64, params.txs, params.chain}));
+        auto mirror = std::make_shared<iotbc::Blockchain>(*chain);
+        auto source = std::make_shared<iotbc::Node>(*chain);
+        auto mirrorSource = std::make_shared<iotbc::Node>(*mirror);
+        return [chain, mirror, source, mirrorSource]() {
+            iotbc::Blockchain synced(chainParams());
+            iotbc::Node node(synced);
+            node.connect("127.0.0.1", source->port());
+            node.connect("127.0.0.1", mirrorSource->port());
+            return node.sync().blocks;
+        };
+    }});
+
+    // Sensor sized readings gossiped between two loopback nodes, until the second mempool holds them all
+    suite.add({"gossip", "tx", 0, [&signer](const BenchmarkParams &) {
+        struct Network {
+            iotbc::Mempool gatewayMempool, minerMempool;
+            iotbc::Blockchain gatewayChain, minerChain;
+            std::unique_ptr<iotbc::Node> gateway, miner;
+            std::vector<iotbc::Transaction> readings;
+        };
+
+        auto network = std::make_shared<Network>();
+        iotbc::NodeOptions options;
+        options.maxTransactionsPerSecond = 1e6;
+        network->gateway = std::make_unique<iotbc::Node>(network->gatewayChain, network->gatewayMempool, options);
+        network->miner = std::make_unique<iotbc::Node>(network->minerChain, network->minerMempool, options);
+        network->miner->connect("127.0.0.1", network->gateway->port());
+
+        while (network->gateway->peerCount() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-    iotbc::PrivateKey key = readPKeyFromFile("./private_key");
+        iotbc::Nonce nonce = 0;
+        network->readings = signedTransactions(signer, 2000, 60, nonce);
+
+        return [network]() {
+            for (const auto &tx : network->readings) {
+                network->gatewayMempool.submit(tx);
+            }
+            while (network->minerMempool.size() < network->readings.size()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return network->readings.size();
+        };
+    }, true});
+}
 
-    iotbc::Blockchain chain;
-    // chain.loadExistingBlocks("./blocks");
-    // chain.verifyExistingChain();
+std::vector<size_t> parseSizes(const std::string &list) {
+    std::vector<size_t> sizes;
+    size_t start = 0;
 
-    std::vector<unsigned char> data;
-    data.reserve(4096);
-    for (int i = 0; i < 4096; i++) {
-        data.push_back(rand() % 256);
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        sizes.push_back(std::stoul(list.substr(start, end - start)));
+        start = end + 1;
     }
 
-    size_t blockCount = 24;
-    size_t txPerBlock = 128;
-
-    std::vector<std::chrono::duration<double>> miningTimes;
-    std::vector<std::chrono::duration<double>> verificationTimes;
-    std::vector<size_t> memoryUsageWhileRunning;
+    return sizes;
+}
 
-    for(size_t i = 0; i < blockCount; i++) {
-        iotbc::Block block(chain.chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash());
+std::vector<std::string> parseNames(const std::string &list) {
+    std::vector<std::string> names;
+    size_t start = 0;
 
-        iotbc::Transaction tx(key, 0, {data.begin(), data.end()});
-        tx.sign(key);
-        for (size_t i = 0; i < txPerBlock; i++) {
-            auto start = std::chrono::high_resolution_clock::now();
-            block.addTransaction(tx);
-            auto end = std::chrono::high_resolution_clock::now();
-            verificationTimes.push_back(end - start);
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
         }
+        names.push_back(list.substr(start, end - start));
+        start = end + 1;
+    }
 
-        auto start = std::chrono::high_resolution_clock::now();
-        block.mine(difficulty);
-        auto end = std::chrono::high_resolution_clock::now();
-        miningTimes.push_back(end - start);
-        chain.addBlock(block);
+    return names;
+}
 
-        memoryUsageWhileRunning.push_back(getMemoryUsage());
+void printUsage(const char *name, const BenchmarkSuite &suite) {
+    std::cerr << "Usage: " << name << " [--filter name,...] [--warmup n] [--repetitions n]" << std::endl
+        << "    [--payload bytes,...] [--txs count,...] [--chain blocks,...] [--json path]" << std::endl
+        << "Benchmarks:";
+    for (const auto &benchmarkName : suite.names()) {
+        std::cerr << " " << benchmarkName;
     }
+    std::cerr << std::endl;
+}
 
-    std::cout << "Blocks mined: " << blockCount << std::endl;
-    std::cout << "Transaction size: " << data.size() << " bytes" << std::endl;
-    std::cout << "Transactions per block: " << txPerBlock << std::endl;
-
-    std::cout << std::endl;
-
-    std::chrono::duration<double> totalMiningTime = std::accumulate(miningTimes.begin(), miningTimes.end(), std::chrono::duration<double>(0));
-    std::chrono::duration<double> averageMiningTime = totalMiningTime / blockCount;
-    std::sort(miningTimes.begin(), miningTimes.end());
-    std::chrono::duration<double> medianMiningTime = miningTimes[blockCount / 2];
-
-    double miningTimeSum = std::accumulate(miningTimes.begin(), miningTimes.end(), 0.0, [](double sum, const std::chrono::duration<double>& d) {
-        return sum + d.count();
-    });
-    double miningTimeMean = miningTimeSum / miningTimes.size();
-    double miningTimeSqSum = std::accumulate(miningTimes.begin(), miningTimes.end(), 0.0, [miningTimeMean](double sum, const std::chrono::duration<double>& d) {
-        return sum + (d.count() - miningTimeMean) * (d.count() - miningTimeMean);
-    });
-    double miningTimeStdDev = std::sqrt(miningTimeSqSum / miningTimes.size());
-
-    std::cout << "Average mining time: " << averageMiningTime.count() * 1000 << "ms" << std::endl;
-    std::cout << "Median mining time: " << medianMiningTime.count() * 1000 << "ms" << std::endl;
-    std::cout << "Mining time stddev: " << miningTimeStdDev * 1000 << "ms" << std::endl;
-
-    std::chrono::duration<double> totalVerificationTime = std::accumulate(verificationTimes.begin(), verificationTimes.end(), std::chrono::duration<double>(0));
-    std::chrono::duration<double> averageVerificationTime = totalVerificationTime / (blockCount * txPerBlock);
-    std::sort(verificationTimes.begin(), verificationTimes.end());
-    std::chrono::duration<double> medianVerificationTime = verificationTimes[verificationTimes.size() / 2];
-
-    double verificationTimeSum = std::accumulate(verificationTimes.begin(), verificationTimes.end(), 0.0, [](double sum, const std::chrono::duration<double>& d) {
-        return sum + d.count();
-    });
-    double verificationTimeMean = verificationTimeSum / verificationTimes.size();
-    double verificationTimeSqSum = std::accumulate(verificationTimes.begin(), verificationTimes.end(), 0.0, [verificationTimeMean](double sum, const std::chrono::duration<double>& d) {
-        return sum + (d.count() - verificationTimeMean) * (d.count() - verificationTimeMean);
-    });
-    double verificationTimeStdDev = std::sqrt(verificationTimeSqSum / verificationTimes.size());
-
-    std::cout << std::endl;
-
-    std::cout << "Average verification time: " << averageVerificationTime.count() * 1000 << "ms" << std::endl;
-    std::cout << "Median verification time: " << medianVerificationTime.count() * 1000 << "ms" << std::endl;
-    std::cout << "Verification time stddev: " << verificationTimeStdDev * 1000 << "ms" << std::endl;
-
-    size_t chainByteSize = 0;
-    size_t txCount = 0;
-    for (const auto &block : chain.chain) {
-        chainByteSize += block.serialize().size();
-        txCount += block.transactions.size();
+int main(int ac, char **av) {
+    // The key of ./private_key if there is one, see run_simulation keygen
+    iotbc::PrivateKey key = std::filesystem::exists("./private_key")
+        ? readPKeyFromFile("./private_key") : generatePseudoRandomPrivateKey();
+    iotbc::Signer signer(key);
+
+    BenchmarkSuite suite;
+    registerBenchmarks(suite, signer);
+
+    BenchmarkOptions options;
+    std::string jsonPath;
+
+    try {
+        for (int i = 1; i < ac; i++) {
+            std::string arg = av[i];
+
+            if (arg == "--help" || i + 1 >= ac) {
+                printUsage(av[0], suite);
+                return arg == "--help" ? 0 : 1;
+            }
+
+            std::string value = av[++i];
+            if (arg == "--filter") {
+                options.filter = parseNames(value);
+            } else if (arg == "--warmup") {
+                options.warmup = std::stoul(value);
+            } else if (arg == "--repetitions") {
+                options.repetitions = std::stoul(value);
+            } else if (arg == "--payload") {
+                options.payloads = parseSizes(value);
+            } else if (arg == "--txs") {
+                options.txs = parseSizes(value);
+            } else if (arg == "--chain") {
+                options.chains = parseSizes(value);
+            } else if (arg == "--json") {
+                jsonPath = value;
+            } else {
+                printUsage(av[0], suite);
+                return 1;
+            }
+        }
+    } catch (const std::logic_error &e) {
+        printUsage(av[0], suite);
+        return 1;
     }
 
-    double memoryUsageMean = std::accumulate(memoryUsageWhileRunning.begin(), memoryUsageWhileRunning.end(), 0.0) / memoryUsageWhileRunning.size();
-    double memoryUsageSqSum = std::accumulate(memoryUsageWhileRunning.begin(), memoryUsageWhileRunning.end(), 0.0, [memoryUsageMean](double sum, size_t mem) {
-        return sum + (mem - memoryUsageMean) * (mem - memoryUsageMean);
-    });
-    double memoryUsageStdDev = std::sqrt(memoryUsageSqSum / memoryUsageWhileRunning.size());
-    double minMemoryUsage = *std::min_element(memoryUsageWhileRunning.begin(), memoryUsageWhileRunning.end());
-    double maxMemoryUsage = *std::max_element(memoryUsageWhileRunning.begin(), memoryUsageWhileRunning.end());
-
-    std::cout << std::endl;
-
-    std::cout << "Average memory usage: " << memoryUsageMean << "KB" << std::endl;
-    std::cout << "Memory usage stddev: " << memoryUsageStdDev << "KB" << std::endl;
-    std::cout << "Min memory usage: " << minMemoryUsage << "KB" << std::endl;
-    std::cout << "Max memory usage: " << maxMemoryUsage << "KB" << std::endl;
-
-
-    std::cout << std::endl;
+    std::vector<BenchmarkResult> results = suite.run(options, std::cout);
+    std::filesystem::remove_all(BENCHMARK_FOLDER);
+
+    // Stage latencies the library recorded while the benchmarks ran, warmups included
+    std::cout << std::endl << iotbc::pipelineMetrics().report();
+
+    if (!jsonPath.empty()) {
+        json output = BenchmarkSuite::toJson(results, options);
+        output["context"]["max_memory_kb"] = getMaxMemoryUsage();
+
+        json pipeline = json::object();
+        for (size_t i = 0; i < static_cast<size_t>(iotbc::PipelineStage::Count); i++) {
+            auto stage = static_cast<iotbc::PipelineStage>(i);
+            iotbc::LatencySummary summary = iotbc::pipelineMetrics().stage(stage).summary();
+            pipeline[iotbc::stageName(stage)] = {
+                {"count", summary.count},
+                {"mean", summary.mean},
+                {"p50", summary.p50},
+                {"p90", summary.p90},
+                {"p99", summary.p99},
+                {"p999", summary.p999},
+                {"max", summary.max},
+            };
+        }
+        output["pipeline_ns"] = pipeline;
 
-    std::cout << "Total transactions: " << txCount << std::endl;
-    std::cout << "Chain size: " << chainByteSize << " bytes" << std::endl;
+        std::ofstream file(jsonPath);
+        if (!file) {
+            std::cerr << "Unable to open file: " << jsonPath << std::endl;
+            return 1;
+        }
+        file << output.dump(2) << std::endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,164 @@
+#include "GatewayPublisher.hpp"
+
+#include <chrono>
+#include <iostream>
+
+/// Topic of the gateway telemetry, each message carries entries of several devices
+static const std::string TELEMETRY_TOPIC = "v1/gateway/telemetry";
+
+/// How long the destructor waits for the messages in flight
+static constexpr std::chrono::seconds FLUSH_TIMEOUT(5);
+
+/// How long sent telemetry may wait for window slots and acknowledgements before it counts as not delivered
+static constexpr std::chrono::seconds DELIVERY_TIMEOUT(30);
+
+GatewayPublisher::GatewayPublisher(const std::string &host, const std::string &id, const std::string &accessToken,
+    size_t maxInflight, size_t maxMessageSize):
+    client(host, id),
+    conn_opts(),
+    host(host),
+    connectListener(*this),
+    listener(*this),
+    maxInflight(maxInflight),
+    maxMessageSize(maxMessageSize),
+    mutex(),
+    answered(),
+    inflight(0),
+    failures(0),
+    connecting(false),
+    established(false),
+    connection()
+{
+    conn_opts.set_keep_alive_interval(20);
+    conn_opts.set_clean_session(false);
+    conn_opts.set_user_name(accessToken);
+    conn_opts.set_automatic_reconnect(1, 30);
+    conn_opts.set_max_inflight(static_cast<int>(maxInflight));
+
+    // The broker may come up later, telemetry is kept by the callers until then
+    connect();
+}
+
+GatewayPublisher::~GatewayPublisher() {
+    flush(FLUSH_TIMEOUT);
+
+    try {
+        // The attempt reports to this publisher, it must be over before the publisher goes
+        if (connection) {
+            connection->wait_for(FLUSH_TIMEOUT);
+        }
+        client.disconnect()->wait();
+    } catch (const mqtt::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
+
+bool GatewayPublisher::sendTelemetry(const json &devices) {
+    if (!client.is_connected()) {
+        // Automatic reconnection only covers lost connections, a failed first attempt is retried here
+        connect();
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + DELIVERY_TIMEOUT;
+    size_t failedBefore = failures;
+    json message = json::object();
+    size_t size = 2;
+
+    for (const auto &[device, entries] : devices.items()) {
+        for (const auto &entry : entries) {
+            // Quoted name, colon, brackets and separating comma around the entry
+            size_t entrySize = entry.dump().size() + device.size() + 6;
+
+            if (size + entrySize > maxMessageSize && !message.empty()) {
+                if (!publish(TELEMETRY_TOPIC, message.dump(), deadline)) {
+                    return false;
+                }
+                message = json::object();
+                size = 2;
+            }
+
+            message[device].push_back(entry);
+            size += entrySize;
+        }
+    }
+
+    if (!message.empty() && !publish(TELEMETRY_TOPIC, message.dump(), deadline)) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    return answered.wait_until(lock, deadline, [this]() { return inflight == 0; }) && failures == failedBefore;
+}
+
+bool GatewayPublisher::flush(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return answered.wait_for(lock, timeout, [this]() { return inflight == 0; });
+}
+
+void GatewayPublisher::connect() {
+    if (established || connecting.exchange(true)) {
+        return;
+    }
+
+    try {
+        connection = client.connect(conn_opts, nullptr, connectListener);
+    } catch (const mqtt::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        connecting = false;
+    }
+}
+
+bool GatewayPublisher::publish(const std::string &topic, const std::string &payload,
+    std::chrono::steady_clock::time_point deadline) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!answered.wait_until(lock, deadline, [this]() { return inflight < maxInflight; })) {
+            std::cerr << "Error: Broker did not acknowledge the telemetry in time" << std::endl;
+            return false;
+        }
+        inflight++;
+    }
+
+    try {
+        mqtt::message_ptr pubmsg = mqtt::make_message(topic, payload);
+        pubmsg->set_qos(1);
+        client.publish(pubmsg, nullptr, listener);
+    } catch (const mqtt::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        failures++;
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void GatewayPublisher::release() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inflight--;
+    }
+    answered.notify_all();
+}
+
+void GatewayPublisher::ConnectListener::on_success(const mqtt::token &) {
+    std::cout << "Connected to MQTT gateway at " << publisher.host << std::endl;
+    publisher.established = true;
+    publisher.connecting = false;
+}
+
+void GatewayPublisher::ConnectListener::on_failure(const mqtt::token &token) {
+    std::cerr << "Error: Could not connect to MQTT gateway at " << publisher.host << ", code " << token.get_return_code() << std::endl;
+    publisher.connecting = false;
+}
+
+void GatewayPublisher::DeliveryListener::on_success(const mqtt::token &) {
+    publisher.release();
+}
+
+void GatewayPublisher::DeliveryListener::on_failure(const mqtt::token &token) {
+    std::cerr << "Error: Telemetry not delivered, code " << token.get_return_code() << std::endl;
+    publisher.failures++;
+    publisher.release();
+}
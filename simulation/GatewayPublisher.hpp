@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <json.hpp>
+#include <mqtt/async_client.h>
+
+using json = nlohmann::json;
+
+/// @brief Publishes the telemetry of many devices over one connection, with ThingsBoard's gateway API
+/// @note The connection is made in the background. Messages are published asynchronously with QoS 1.
+/// At most maxInflight of them wait for their acknowledgement, publishing more blocks until the broker
+/// catches up or the delivery timeout passes. Nothing is published while the connection is down,
+/// callers keep the telemetry and retry
+class GatewayPublisher {
+public:
+    /// @brief Start connecting to the broker as a gateway device, without waiting for the connection
+    /// @param host The broker address, e.g. tcp://localhost:1883
+    /// @param id The MQTT client id
+    /// @param accessToken The access token of the gateway device
+    /// @param maxInflight Maximum number of messages waiting for their acknowledgement
+    /// @param maxMessageSize Payload size after which telemetry is split across messages
+    GatewayPublisher(const std::string &host, const std::string &id, const std::string &accessToken,
+        size_t maxInflight = 64, size_t maxMessageSize = 64 << 10);
+
+    /// @brief Wait for the messages in flight, then disconnect
+    ~GatewayPublisher();
+
+    GatewayPublisher(const GatewayPublisher&) = delete;
+    GatewayPublisher(GatewayPublisher&&) = delete;
+    GatewayPublisher& operator=(const GatewayPublisher&) = delete;
+    GatewayPublisher& operator=(GatewayPublisher&&) = delete;
+
+    /// @brief Publish telemetry of many devices, split in as few messages as the size limit allows
+    /// @param devices Entries by device name, as {"device": [{"ts": ..., "values": {...}}, ...]}
+    /// @return True once the broker acknowledged every message, false if one failed or timed out,
+    /// or if the gateway is not connected yet
+    bool sendTelemetry(const json &devices);
+
+    /// @brief Wait until every published message is acknowledged or failed
+    /// @param timeout The maximum time to wait
+    /// @return False if messages are still in flight
+    bool flush(std::chrono::milliseconds timeout);
+
+    /// @brief Number of messages the broker did not acknowledge
+    inline size_t failed() const
+    {
+        return failures;
+    }
+
+private:
+    /// @brief Reports the outcome of a connection attempt
+    class ConnectListener : public mqtt::iaction_listener {
+    public:
+        ConnectListener(GatewayPublisher &publisher): publisher(publisher) {}
+
+        void on_success(const mqtt::token &) override;
+        void on_failure(const mqtt::token &) override;
+
+    private:
+        GatewayPublisher &publisher;
+    };
+
+    /// @brief Releases the window slot of a message once the broker answered
+    class DeliveryListener : public mqtt::iaction_listener {
+    public:
+        DeliveryListener(GatewayPublisher &publisher): publisher(publisher) {}
+
+        void on_success(const mqtt::token &) override;
+        void on_failure(const mqtt::token &) override;
+
+    private:
+        GatewayPublisher &publisher;
+    };
+
+    /// @brief Start a connection attempt, unless one is running or the client reconnects by itself
+    void connect();
+
+    /// @brief Publish a message once a window slot is free
+    /// @param deadline The time after which the message is not published anymore
+    /// @return False if no slot got free before the deadline
+    bool publish(const std::string &topic, const std::string &payload, std::chrono::steady_clock::time_point deadline);
+
+    /// @brief Give back the window slot of an answered message
+    void release();
+
+    mqtt::async_client client;
+    mqtt::connect_options conn_opts;
+    std::string host;
+    ConnectListener connectListener;
+    DeliveryListener listener;
+    size_t maxInflight;
+    size_t maxMessageSize;
+
+    std::mutex mutex;
+    std::condition_variable answered;
+    size_t inflight;
+    std::atomic<size_t> failures;
+    /// Set while a connection attempt runs
+    std::atomic<bool> connecting;
+    /// Set once connected, lost connections are then restored by the client itself
+    std::atomic<bool> established;
+    /// The last connection attempt
+    mqtt::token_ptr connection;
+};
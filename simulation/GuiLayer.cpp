@@ -1,20 +1,99 @@
 #include "GuiLayer.hpp"
 
-GuiLayer::GuiLayer(const std::string &configPath) {
+#include <chrono>
+
+#include <Exceptions.hpp>
+
+/// Name of the ThingsBoard cursor in the spool
+static const std::string SPOOL_DESTINATION = "thingsboard";
+
+GuiLayer::GuiLayer(const std::string &configPath, const iotbc::SensorDictionary &dictionary):
+    dictionary(dictionary)
+{
     std::ifstream configFile(configPath);
     if (!configFile) {
         throw std::runtime_error("Unable to open sensors configuration file.");
     }
     json config;
     configFile >> config;
-    for (const auto &c : config["telemetry"]) {
-        sensors.emplace(c["id"], std::make_unique<ThingsBoardClient>("tcp://localhost:1883", c["id"], c["access_token"]));
-    }
+
+    json &gateway = config["gateway"];
+    publisher = std::make_unique<GatewayPublisher>(gateway.value("host", "tcp://localhost:1883"), gateway["id"],
+        gateway["access_token"], gateway.value("max_inflight", 64));
+
+    // Readings left over by the last run are published first
+    spool = std::make_unique<iotbc::Spool>(gateway.value("spool", "./spool"));
+    drain = std::make_unique<iotbc::SpoolDrain>(*spool, SPOOL_DESTINATION,
+        [this](const std::vector<iotbc::SpoolEntry> &entries) { return publish(entries); });
 }
 
 void GuiLayer::processBlock(const iotbc::Block &block) {
-    for (const auto &tx : block.transactions) {
-        json blockData = json::parse(tx.data.begin(), tx.data.end());
-        sensors.at(blockData["id"])->sendTelemetry(blockData["data"]);
+    uint64_t timestamp = block.timestamp;
+    if (timestamp == 0) {
+        timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::vector<iotbc::SpoolEntry> entries;
+    std::unordered_map<std::string, uint64_t> readings;
+
+    auto addReading = [&](uint32_t index, const std::string &device, const json &values) {
+        iotbc::SpoolEntry entry;
+        entry.height = block.height;
+        entry.index = index;
+        // ThingsBoard keeps one value per key and timestamp, so readings of a sensor in the same block
+        // are spaced a millisecond apart
+        entry.timestamp = timestamp + readings[device]++;
+        entry.key = device;
+        entry.value = values.dump();
+        entries.push_back(std::move(entry));
+    };
+
+    for (uint32_t i = 0; i < block.transactions.size(); i++) {
+        const auto &tx = block.transactions[i];
+        iotbc::SensorIndex index = 0;
+        size_t offset = 0;
+
+        // Payloads come from any local producer, the ones that are not readings are skipped
+        try {
+            if (iotbc::SensorDictionary::parseReading(tx.data, index, offset)) {
+                if (index >= dictionary.size()) {
+                    std::cerr << "Warning: Reading from unregistered sensor index " << index << std::endl;
+                    continue;
+                }
+                addReading(i, dictionary.name(index), json::parse(tx.data.begin() + offset, tx.data.end()));
+                continue;
+            }
+
+            if (tx.data.empty() || tx.data[0] == iotbc::SensorDictionary::REGISTRATION_TAG) {
+                continue;
+            }
+
+            json blockData = json::parse(tx.data.begin(), tx.data.end());
+            addReading(i, blockData.at("id").get<std::string>(), blockData.at("data"));
+        } catch (const json::exception &e) {
+            std::cerr << "Warning: Skipping transaction " << i << " of block " << block.height << ", " << e.what() << std::endl;
+        }
+    }
+
+    // The block is in the chain whatever happens here, its readings are lost if they cannot be spooled
+    try {
+        spool->append(entries);
+    } catch (const iotbc::IoError &e) {
+        std::cerr << "Error: Readings of block " << block.height << " not spooled, " << e.what() << std::endl;
     }
 }
+
+void GuiLayer::disconnectBlock(const iotbc::Block &) {
+    // Telemetry already sent stays on the dashboard
+}
+
+bool GuiLayer::publish(const std::vector<iotbc::SpoolEntry> &entries) {
+    json devices = json::object();
+
+    for (const auto &entry : entries) {
+        devices[entry.key].push_back({{"ts", entry.timestamp}, {"values", json::parse(entry.value)}});
+    }
+
+    return publisher->sendTelemetry(devices);
+}
@@ -4,18 +4,30 @@
 
 #include <Block.hpp>
 #include <ILayer.hpp>
+#include <SensorDictionary.hpp>
+#include <Spool.hpp>
 #include <json.hpp>
-#include "ThingsBoardClient.hpp"
+#include "GatewayPublisher.hpp"
 
 using json = nlohmann::json;
-using sensorId = std::string;
-using clientPtr = std::unique_ptr<ThingsBoardClient>;
 
+/// @brief Sends the readings of every added block to ThingsBoard, through one gateway connection
+/// @note Each sensor is a device of the gateway, named after its id and created by ThingsBoard on its
+/// first reading. Readings are appended to an on-disk spool and published from it by a background
+/// drain, so blocks never wait for the broker, and readings published while it is down are kept
+/// until it comes back
 class GuiLayer: public iotbc::ILayer {
 public:
-    GuiLayer(const std::string &configPath);
+    GuiLayer(const std::string &configPath, const iotbc::SensorDictionary &dictionary);
     virtual void processBlock(const iotbc::Block &block) override final;
+    virtual void disconnectBlock(const iotbc::Block &block) override final;
 
 private:
-    std::unordered_map<sensorId, clientPtr> sensors;
+    /// @brief Publish spooled readings, those of a device grouped in one entry of the message
+    bool publish(const std::vector<iotbc::SpoolEntry> &entries);
+
+    std::unique_ptr<GatewayPublisher> publisher;
+    const iotbc::SensorDictionary &dictionary;
+    std::unique_ptr<iotbc::Spool> spool;
+    std::unique_ptr<iotbc::SpoolDrain> drain;
 };
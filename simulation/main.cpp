@@ -1,7 +1,13 @@
 #include <Block.hpp>
 #include <Blockchain.hpp>
+#include <Consensus.hpp>
 #include <Exceptions.hpp>
+#include <IngestServer.hpp>
+#include <Latency.hpp>
+#include <Mempool.hpp>
+#include <RingIngest.hpp>
 
+#include <csignal>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -18,6 +24,21 @@
 #include "sensors/Thermostat.hpp"
 #include "sensors/Window.hpp"
 
+// Number of blocks between two checkpoints of the local chain
+constexpr size_t CHECKPOINT_INTERVAL = 64;
+
+// Number of most recent blocks keeping their body on the device, older blocks only keep their header
+constexpr size_t RETAINED_BLOCKS = 1024;
+
+// Time the producer waits before submitting a reading again to a full mempool
+constexpr std::chrono::milliseconds FULL_MEMPOOL_BACKOFF(100);
+
+// Socket external sensor processes submit their signed readings to, in ingest mode
+const std::string INGEST_SOCKET = "./ingest.sock";
+
+// Shared memory ring sensor processes on the same device write their signed readings to, in ingest mode
+const std::string INGEST_RING = "/iotbc-ingest";
+
 // For testing environments generating a pseudo-random private key is okay
 iotbc::PrivateKey generatePseudoRandomPrivateKey() {
     iotbc::PrivateKey key;
@@ -83,10 +104,11 @@ void printCurrentChain(const iotbc::Blockchain &chain) {
     }
 }
 
-void sendBlockchainAttributes(ThingsBoardClient &client, const iotbc::Blockchain &chain) {
+void sendBlockchainAttributes(ThingsBoardClient &client, iotbc::Blockchain &chain) {
     bool valid = true;
     try {
-        chain.verifyExistingChain();
+        // Only the blocks added since the last report are verified
+        chain.verifyNewBlocks();
     } catch(const iotbc::InvalidBlockchainSave &e) {
         valid = false;
     }
@@ -106,41 +128,140 @@ int main(int ac, char **av) {
         return 0;
     }
 
-    int difficulty = 12;
+    // `kill -USR1 <pid>` prints the latency percentiles of each pipeline stage. The signal is blocked
+    // before any other thread starts, so only this one receives it
+    sigset_t dumpSignals;
+    sigemptyset(&dumpSignals);
+    sigaddset(&dumpSignals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &dumpSignals, nullptr);
+    std::thread latencyDump([dumpSignals]() {
+        int signal;
+        while (sigwait(&dumpSignals, &signal) == 0) {
+            std::cout << iotbc::pipelineMetrics().report() << std::flush;
+        }
+    });
+    latencyDump.detach();
 
     ConfigLoader loader("config.json");
     auto sensors = loader.getSensors();
     json attributes = loader.getAttributes();
     iotbc::PrivateKey key = readPKeyFromFile("./private_key");
+    iotbc::Signer signer(key);
+
+    // Difficulty follows the hash rate of the device so a block comes every 5 seconds, readings
+    // wait at most 1 second in the mempool and mining gets the rest of the interval
+    iotbc::ChainParams params;
+    params.initialDifficulty = 12;
+    params.targetBlockInterval = std::chrono::seconds(5);
 
-    iotbc::Blockchain chain;
-    chain.loadExistingBlocks("./blocks");
-    chain.verifyExistingChain();
-    chain.addLayer(std::make_unique<GuiLayer>("config.json"));
+    iotbc::Blockchain chain(params);
+    chain.compression = {iotbc::Codec::Lz, 6};
+
+    // On a private deployment the device seals its blocks as the only authority instead of mining them
+    if (ac == 2 && std::string(av[1]) == "poa") {
+        chain.consensus = std::make_shared<iotbc::ProofOfAuthority>(std::vector<iotbc::Address>{signer.address}, signer);
+    }
+
+    chain.pruning.keepBlocks = RETAINED_BLOCKS;
+
+    iotbc::LoadOptions loadOptions;
+    loadOptions.verify = true;
+    // The only checkpoints in ./blocks are the unsigned ones this device writes itself
+    loadOptions.trustUnsignedCheckpoint = true;
+    iotbc::LoadStats loadStats = chain.loadExistingBlocks("./blocks", loadOptions);
+    if (loadStats.checkpointHeight.has_value()) {
+        std::cout << "Trusted checkpoint at height " << loadStats.checkpointHeight.value() << std::endl;
+    }
+    std::cout << "Loaded " << loadStats.blocks << " blocks in "
+        << (loadStats.io + loadStats.decode + loadStats.link + loadStats.verify + loadStats.replay).count() * 1000 << "ms" << std::endl;
+    chain.addLayer(std::make_unique<GuiLayer>("config.json", chain.sensorDictionary));
 
     // printCurrentChain(chain);
     ThingsBoardClient client("tcp://localhost:1883", attributes["id"], attributes["access_token"]);
 
-    while (true) {
-        iotbc::Block block(chain.chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash());
+    iotbc::Nonce nonce = chain.nextNonce(signer.address);
+
+    // Register the sensors missing from the dictionary, so readings can be dictionary-encoded
+    iotbc::Block registrations(chain.chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash(), chain.chain.size());
+    for (const auto &sensor : sensors) {
+        if (!chain.sensorDictionary.find(sensor->getId()).has_value()) {
+            iotbc::Transaction registration(signer, nonce++, iotbc::SensorDictionary::registrationPayload(sensor->getId()));
+            registration.sign(signer);
+            registrations.addTransaction(registration);
+        }
+    }
+
+    if (!registrations.transactions.empty()) {
+        chain.sealBlock(registrations);
+        chain.addBlock(registrations);
+        chain.saveBlocks("./blocks");
+    }
+
+    std::vector<iotbc::SensorIndex> indices;
+    for (const auto &sensor : sensors) {
+        indices.push_back(chain.sensorDictionary.find(sensor->getId()).value());
+    }
 
-        for (const auto &sensor : sensors) {
-            std::string data = sensor->genData().dump();
-            iotbc::Transaction tx(key, 0, {data.begin(), data.end()});
-            tx.sign(key);
-            block.addTransaction(tx);
+    iotbc::MempoolPolicy policy;
+    policy.maxAge = std::chrono::seconds(1);
+    iotbc::Mempool mempool(policy);
+
+    // In ingest mode sensor processes sign and submit their own readings, see run_loadgen. Otherwise the
+    // sensors feed the mempool on their own cadence. Blocks are assembled whenever the policy allows it
+    std::unique_ptr<iotbc::IngestServer> ingest;
+    std::unique_ptr<iotbc::RingIngest> ringIngest;
+    if (ac == 2 && std::string(av[1]) == "ingest") {
+        ingest = std::make_unique<iotbc::IngestServer>(mempool, INGEST_SOCKET);
+        ringIngest = std::make_unique<iotbc::RingIngest>(mempool, INGEST_RING);
+        std::cout << "Ingesting transactions on " << INGEST_SOCKET << " and " << INGEST_RING << std::endl;
+    } else {
+        std::thread producer([&sensors, &indices, &signer, &mempool, nonce]() mutable {
+            while (true) {
+                for (size_t i = 0; i < sensors.size(); i++) {
+                    auto payload = iotbc::SensorDictionary::readingPayload(indices[i], sensors[i]->genData()["data"].dump());
+                    iotbc::Transaction tx(signer, nonce, payload);
+                    tx.sign(signer);
+
+                    // A refused reading would leave a nonce gap, holding back every later one until it expires
+                    iotbc::SubmitResult result;
+                    while ((result = mempool.submit(tx)) == iotbc::SubmitResult::Full) {
+                        std::this_thread::sleep_for(FULL_MEMPOOL_BACKOFF);
+                    }
+
+                    if (result == iotbc::SubmitResult::Accepted) {
+                        nonce++;
+                    }
+                }
+
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        });
+        producer.detach();
+    }
+
+    while (true) {
+        if (!mempool.waitForTemplate(std::chrono::seconds(1), chain.nonceIndex)) {
+            continue;
         }
 
-        block.mine(difficulty);
+        iotbc::Block block = mempool.takeBlockTemplate(chain.chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash(), chain.chain.size(), chain.nonceIndex);
+
+        chain.sealBlock(block);
         chain.addBlock(block);
         std::cout << "Added block to chain:" << std::endl;
         printBlock(block);
         chain.saveBlocks("./blocks");
 
+        // A fresh checkpoint bounds the part of the chain verified again on the next start
+        if (chain.chain.size() % CHECKPOINT_INTERVAL == 0) {
+            chain.saveCheckpoint("./blocks");
+        }
+
+        chain.pruneBlocks("./blocks");
+
         sendBlockchainAttributes(client, chain);
 
         std::cout << std::endl;
-        std::this_thread::sleep_for(std::chrono::seconds(5));
     }
 
     // std::string userInput = "";
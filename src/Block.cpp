@@ -1,10 +1,17 @@
 #include <limits>
 #include <bit>
+#include <memory>
 
 #include <Block.hpp>
 #include <Exceptions.hpp>
+#include <Latency.hpp>
+#include <Wire.hpp>
+#include <Utils.hpp>
 
 namespace iotbc {
+    /// Number of nonces tried between two checks of the cancellation, the deadline and the progress
+    static constexpr uint64_t MINING_CHECK_INTERVAL = 1024;
+
     static bool hasLeadingZeroBits(const Hash& hash, int difficulty) {
         int zeroBits = 0;
 
@@ -59,7 +66,7 @@ namespace iotbc {
         return result;
     }
 
-    Block::Block(Hash prevHash) : prevHash(prevHash), transactions(), merkleRoot(NULL_HASH), nonce(0) {
+    Block::Block(Hash prevHash, uint64_t height) : version(BLOCK_VERSION), prevHash(prevHash), transactions(), merkleRoot(NULL_HASH), nonce(0), difficulty(0), timestamp(currentTimestamp()), sealer(), seal(), height(height) {
         
     }
 
@@ -68,33 +75,105 @@ namespace iotbc {
         transactions.push_back(tx);
     }
 
-    Hash Block::blockHash() const {
-        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-
-        if (ctx == nullptr) {
-            throw EvpError("Failed to create EVP_MD_CTX");
-        }
-
+    void Block::hashHeaderPrefix(EVP_MD_CTX *ctx) const {
         if (EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1) {
-            EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to initialize digest");
         }
 
+        // Legacy headers keep their original hash, newer ones also cover the version and the difficulty
+        if (version >= BLOCK_VERSION_DIFFICULTY) {
+            unsigned char version_bytes[sizeof(uint32_t)];
+            for (size_t i = 0; i < sizeof(uint32_t); i++) {
+                version_bytes[i] = (version >> (i * 8)) & 0xFF;
+            }
+
+            if (EVP_DigestUpdate(ctx, version_bytes, sizeof(version_bytes)) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+        }
+
         if (EVP_DigestUpdate(ctx, prevHash.data(), sizeof(Hash)) != 1) {
-            EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to update digest");
         }
 
         if (EVP_DigestUpdate(ctx, merkleRoot.data(), sizeof(Hash)) != 1) {
-            EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to update digest");
         }
 
+        if (version >= BLOCK_VERSION_DIFFICULTY) {
+            unsigned char difficulty_bytes[sizeof(uint32_t)];
+            for (size_t i = 0; i < sizeof(uint32_t); i++) {
+                difficulty_bytes[i] = (difficulty >> (i * 8)) & 0xFF;
+            }
+
+            if (EVP_DigestUpdate(ctx, difficulty_bytes, sizeof(difficulty_bytes)) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+        }
+
+        if (version >= BLOCK_VERSION_TIMESTAMP) {
+            unsigned char timestamp_bytes[sizeof(uint64_t)];
+            for (size_t i = 0; i < sizeof(uint64_t); i++) {
+                timestamp_bytes[i] = (timestamp >> (i * 8)) & 0xFF;
+            }
+
+            if (EVP_DigestUpdate(ctx, timestamp_bytes, sizeof(timestamp_bytes)) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+        }
+
+        // The sealer is covered so a seal cannot be moved to another key, the seal itself signs this hash
+        if (version >= BLOCK_VERSION_SEAL) {
+            unsigned char sealed = sealer.has_value() ? 1 : 0;
+
+            if (EVP_DigestUpdate(ctx, &sealed, sizeof(sealed)) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+
+            if (sealer.has_value() && EVP_DigestUpdate(ctx, sealer->data(), sealer->size()) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+        }
+
+        if (version >= BLOCK_VERSION_HEIGHT) {
+            unsigned char height_bytes[sizeof(uint64_t)];
+            for (size_t i = 0; i < sizeof(uint64_t); i++) {
+                height_bytes[i] = (height >> (i * 8)) & 0xFF;
+            }
+
+            if (EVP_DigestUpdate(ctx, height_bytes, sizeof(height_bytes)) != 1) {
+                throw EvpError("Failed to update digest");
+            }
+        }
+    }
+
+    Hash Block::blockHash() const {
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+
+        if (ctx == nullptr) {
+            throw EvpError("Failed to create EVP_MD_CTX");
+        }
+
+        Hash result;
+
+        try {
+            hashHeaderPrefix(ctx);
+            result = finishHeaderHash(ctx, nonce);
+        } catch (...) {
+            EVP_MD_CTX_free(ctx);
+            throw;
+        }
+
+        EVP_MD_CTX_free(ctx);
+
+        return result;
+    }
+
+    Hash Block::finishHeaderHash(EVP_MD_CTX *ctx, Nonce nonce) {
         unsigned char nonce_bytes[sizeof(Nonce)];
         std::memcpy(nonce_bytes, &nonce, sizeof(Nonce));
 
         if (EVP_DigestUpdate(ctx, nonce_bytes, sizeof(Nonce)) != 1) {
-            EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to update digest");
         }
 
@@ -102,138 +181,547 @@ namespace iotbc {
         unsigned int result_len = sizeof(Hash);
 
         if (EVP_DigestFinal_ex(ctx, result.data(), &result_len) != 1) {
-            EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to finalize digest");
         }
 
-        EVP_MD_CTX_free(ctx);
-
-        return result;   
+        return result;
     }
 
     void Block::mine(int difficulty) {
+        this->difficulty = static_cast<uint32_t>(difficulty);
         merkleRoot = calculateMerkleRoot();
 
-        std::array<unsigned char, sizeof(Hash) + sizeof(Hash) + sizeof(Nonce)> data;
-        std::copy(prevHash.data(), prevHash.data() + sizeof(Hash), data.begin());
-        std::copy(merkleRoot.data(), merkleRoot.data() + sizeof(Hash), data.begin() + sizeof(Hash));
+        if (searchNonce(difficulty, std::stop_token(), std::chrono::steady_clock::time_point::max(), nullptr) != MiningStatus::Found) {
+            throw std::runtime_error("Failed to mine block");
+        }
+    }
+
+    MiningStatus Block::searchNonce(int difficulty, std::stop_token stop, std::chrono::steady_clock::time_point deadline, std::atomic<uint64_t> *hashes) {
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> base(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> attempt(EVP_MD_CTX_new(), EVP_MD_CTX_free);
 
-        while (nonce < std::numeric_limits<Nonce>::max()) {
-            Hash computedHash = blockHash();
+        if (base == nullptr || attempt == nullptr) {
+            throw EvpError("Failed to create EVP_MD_CTX");
+        }
+
+        auto start = std::chrono::steady_clock::now();
 
-            bool valid = hasLeadingZeroBits(computedHash, difficulty);
+        // The nonce comes last, so the rest of the header is hashed once and every attempt resumes from there
+        hashHeaderPrefix(base.get());
 
-            if (valid) {
-                return;
+        uint64_t tried = 0;
+
+        while (true) {
+            if (EVP_MD_CTX_copy_ex(attempt.get(), base.get()) != 1) {
+                throw EvpError("Failed to copy digest");
+            }
+
+            tried++;
+
+            if (hasLeadingZeroBits(finishHeaderHash(attempt.get(), nonce), difficulty)) {
+                break;
+            }
+
+            if (nonce == std::numeric_limits<Nonce>::max()) {
+                if (hashes != nullptr) {
+                    hashes->store(tried, std::memory_order_relaxed);
+                }
+                return MiningStatus::Exhausted;
             }
 
             nonce++;
+
+            if (tried % MINING_CHECK_INTERVAL == 0) {
+                if (hashes != nullptr) {
+                    hashes->store(tried, std::memory_order_relaxed);
+                }
+
+                if (stop.stop_requested()) {
+                    return MiningStatus::Cancelled;
+                }
+
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return MiningStatus::DeadlineExceeded;
+                }
+            }
+        }
+
+        if (hashes != nullptr) {
+            hashes->store(tried, std::memory_order_relaxed);
+        }
+
+        // Only searches that found a nonce, cancelled ones say nothing about the time to mine a block
+        pipelineMetrics().stage(PipelineStage::Mining).record(std::chrono::steady_clock::now() - start);
+
+        return MiningStatus::Found;
+    }
+
+    struct MiningHandle::State {
+        Block block;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        std::atomic<uint64_t> hashes;
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+        MiningStatus status;
+        std::exception_ptr error;
+
+        State(const Block &block)
+            : block(block), start(std::chrono::steady_clock::now()), end(), hashes(0), mutex(), cv(),
+            status(MiningStatus::Running), error() {
+        }
+    };
+
+    MiningHandle Block::mineAsync(int difficulty, std::chrono::steady_clock::time_point deadline) const {
+        auto state = std::make_shared<MiningHandle::State>(*this);
+
+        std::jthread thread([state, difficulty, deadline](std::stop_token stop) {
+            MiningStatus status = MiningStatus::Failed;
+            std::exception_ptr error;
+
+            try {
+                state->block.difficulty = static_cast<uint32_t>(difficulty);
+                state->block.merkleRoot = state->block.calculateMerkleRoot();
+                status = state->block.searchNonce(difficulty, stop, deadline, &state->hashes);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->end = std::chrono::steady_clock::now();
+                state->status = status;
+                state->error = error;
+            }
+
+            state->cv.notify_all();
+        });
+
+        return MiningHandle(std::move(state), std::move(thread));
+    }
+
+    MiningHandle::MiningHandle(std::shared_ptr<State> state, std::jthread thread)
+        : state(std::move(state)), thread(std::move(thread)) {
+    }
+
+    MiningHandle::MiningHandle(MiningHandle &&other) noexcept = default;
+
+    MiningHandle &MiningHandle::operator=(MiningHandle &&other) noexcept = default;
+
+    MiningHandle::~MiningHandle() = default;
+
+    void MiningHandle::cancel() {
+        thread.request_stop();
+    }
+
+    MiningStatus MiningHandle::status() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        return state->status;
+    }
+
+    MiningStatus MiningHandle::wait() {
+        std::unique_lock<std::mutex> lock(state->mutex);
+
+        state->cv.wait(lock, [this]() { return state->status != MiningStatus::Running; });
+
+        return state->status;
+    }
+
+    bool MiningHandle::waitFor(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(state->mutex);
+
+        return state->cv.wait_for(lock, timeout, [this]() { return state->status != MiningStatus::Running; });
+    }
+
+    uint64_t MiningHandle::hashesTried() const {
+        return state->hashes.load(std::memory_order_relaxed);
+    }
+
+    double MiningHandle::hashRate() const {
+        std::chrono::steady_clock::time_point end;
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            end = state->status == MiningStatus::Running ? std::chrono::steady_clock::now() : state->end;
+        }
+
+        std::chrono::duration<double> elapsed = end - state->start;
+
+        if (elapsed.count() <= 0) {
+            return 0;
+        }
+
+        return hashesTried() / elapsed.count();
+    }
+
+    Block MiningHandle::takeBlock() {
+        MiningStatus result = wait();
+
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+
+        if (result != MiningStatus::Found) {
+            throw InvalidBlock("Mining stopped before finding a valid nonce");
+        }
+
+        return std::move(state->block);
+    }
+
+    void Block::sealWith(const Signer &signer) {
+        if (version < BLOCK_VERSION_SEAL) {
+            throw InvalidBlock("Block header version does not support seals");
+        }
+
+        difficulty = 0;
+        nonce = 0;
+        merkleRoot = calculateMerkleRoot();
+        sealer = signer.public_key;
+        seal = signer.sign(blockHash());
+    }
+
+    bool Block::hasValidSeal() const {
+        if (!sealer.has_value()) {
+            return false;
+        }
+
+        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+
+        if (ctx == nullptr) {
+            throw Secp256k1Error("Failed to create secp256k1 context");
         }
 
-        throw std::runtime_error("Failed to mine block");
+        bool valid = true;
+
+        try {
+            verifyHashSignature(ctx, blockHash(), sealer.value(), seal);
+        } catch (const InvalidSignature &e) {
+            valid = false;
+        } catch (const Secp256k1Error &e) {
+            valid = false;
+        }
+
+        secp256k1_context_destroy(ctx);
+
+        return valid;
+    }
+
+    bool Block::hasValidProofOfWork() const {
+        return hasLeadingZeroBits(blockHash(), difficulty);
+    }
+
+    bool Block::hasValidMerkleRoot() const {
+        return calculateMerkleRoot() == merkleRoot;
     }
 
     void Block::verifyTransactions() const {
-        for (const Transaction &tx : transactions) {
-            tx.verify();
+        if (transactions.empty()) {
+            return;
         }
+
+        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+
+        if (ctx == nullptr) {
+            throw Secp256k1Error("Failed to create secp256k1 context");
+        }
+
+        try {
+            for (const Transaction &tx : transactions) {
+                tx.verify(ctx);
+            }
+        } catch (...) {
+            secp256k1_context_destroy(ctx);
+            throw;
+        }
+
+        secp256k1_context_destroy(ctx);
     }
 
-    std::vector<unsigned char> Block::serialize() const {
+    std::vector<unsigned char> Block::serialize(WireFormat format) const {
         std::vector<unsigned char> buf;
 
-        buf.insert(buf.end(), prevHash.data(), prevHash.data() + sizeof(Hash));
+        if (format == WireFormat::V1) {
+            if (version != BLOCK_VERSION_LEGACY) {
+                throw InvalidBlock("Only legacy block headers can be serialized in the V1 wire format");
+            }
 
-        size_t txCount = transactions.size();
-        for (size_t i = 0; i < sizeof(size_t); i++) {
-            buf.push_back((txCount >> (i * sizeof(size_t)) & 0xFF));
-        }
+            buf.insert(buf.end(), prevHash.data(), prevHash.data() + sizeof(Hash));
 
-        for (const Transaction &tx : transactions) {
-            size_t txSize = tx.size();
+            size_t txCount = transactions.size();
             for (size_t i = 0; i < sizeof(size_t); i++) {
-                buf.push_back((txSize >> (i * sizeof(size_t)) & 0xFF));
+                buf.push_back((txCount >> (i * sizeof(size_t)) & 0xFF));
             }
 
-            std::vector<unsigned char> txData = tx.serialize();
-            for (size_t i = 0; i < txData.size(); i++) {
-                buf.push_back(txData[i]);
+            for (const Transaction &tx : transactions) {
+                size_t txSize = tx.size();
+                for (size_t i = 0; i < sizeof(size_t); i++) {
+                    buf.push_back((txSize >> (i * sizeof(size_t)) & 0xFF));
+                }
+
+                tx.serializeInto(buf, WireFormat::V1);
             }
+
+            buf.insert(buf.end(), merkleRoot.data(), merkleRoot.data() + sizeof(Hash));
+
+            for (size_t i = 0; i < sizeof(Nonce); i++) {
+                buf.push_back((nonce >> (i * sizeof(Nonce)) & 0xFF));
+            }
+
+            auto bHash = this->blockHash();
+            buf.insert(buf.end(), bHash.data(), bHash.data() + sizeof(Hash));
+
+            return buf;
+        }
+
+        // Transactions are self-delimiting in V2, so they are not prefixed by their size
+        // and the trailing block hash is dropped as it can be recomputed from the header
+        writeWireHeader(buf, format);
+        writeHeaderFields(buf);
+
+        writeVarint(buf, transactions.size());
+        for (const Transaction &tx : transactions) {
+            tx.serializeInto(buf, format);
         }
 
         buf.insert(buf.end(), merkleRoot.data(), merkleRoot.data() + sizeof(Hash));
 
-        for (size_t i = 0; i < sizeof(Nonce); i++) {
-            buf.push_back((nonce >> (i * sizeof(Nonce)) & 0xFF));
+        writeVarint(buf, nonce);
+
+        return buf;
+    }
+
+    void Block::writeHeaderFields(std::vector<unsigned char> &buf) const {
+        writeVarint(buf, version);
+
+        buf.insert(buf.end(), prevHash.data(), prevHash.data() + sizeof(Hash));
+
+        if (version >= BLOCK_VERSION_DIFFICULTY) {
+            writeVarint(buf, difficulty);
         }
 
-        auto bHash = this->blockHash();
-        buf.insert(buf.end(), bHash.data(), bHash.data() + sizeof(Hash));
+        if (version >= BLOCK_VERSION_TIMESTAMP) {
+            writeVarint(buf, timestamp);
+        }
+
+        if (version >= BLOCK_VERSION_SEAL) {
+            buf.push_back(sealer.has_value() ? 1 : 0);
+
+            if (sealer.has_value()) {
+                buf.insert(buf.end(), sealer->begin(), sealer->end());
+                buf.insert(buf.end(), seal.begin(), seal.end());
+            }
+        }
+
+        if (version >= BLOCK_VERSION_HEIGHT) {
+            writeVarint(buf, height);
+        }
+    }
+
+    void Block::serializeHeaderInto(std::vector<unsigned char> &buf) const {
+        writeHeaderFields(buf);
+        buf.insert(buf.end(), merkleRoot.data(), merkleRoot.data() + sizeof(Hash));
+        writeVarint(buf, nonce);
+    }
+
+    std::vector<unsigned char> Block::serializeHeader() const {
+        std::vector<unsigned char> buf;
+
+        writeWireHeader(buf, WireFormat::V2);
+        serializeHeaderInto(buf);
 
         return buf;
     }
 
-    Block Block::deserialize(const std::vector<unsigned char> &data) {
-        size_t cur = 0;
+    Block Block::deserializeHeaderFrom(const unsigned char *data, size_t size, size_t &cur) {
+        Block block = readHeaderFields(data, size, cur, WireFormat::V2);
 
-        Hash prevHash;
-        for (size_t i = 0; i < prevHash.size(); i++) {
-            if (cur >= data.size()) {
-                throw DeserializationError("Overflow");
+        if (sizeof(Hash) > size - cur) {
+            throw DeserializationError("Overflow");
+        }
+        std::memcpy(block.merkleRoot.data(), data + cur, sizeof(Hash));
+        cur += sizeof(Hash);
+
+        block.nonce = readVarint(data, size, cur);
+
+        return block;
+    }
+
+    Block Block::deserializeHeader(const std::vector<unsigned char> &data) {
+        if (!readWireHeader(data.data(), data.size()).has_value()) {
+            throw DeserializationError("Missing wire format header");
+        }
+
+        size_t cur = WIRE_HEADER_SIZE;
+        Block block = deserializeHeaderFrom(data.data(), data.size(), cur);
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return block;
+    }
+
+    Block Block::deserialize(std::span<const unsigned char> data) {
+        std::optional<WireFormat> format = readWireHeader(data.data(), data.size());
+
+        if (format.has_value()) {
+            try {
+                size_t cur = WIRE_HEADER_SIZE;
+                Block block = deserializeFrom(data.data(), data.size(), cur, format.value());
+
+                if (cur == data.size()) {
+                    return block;
+                }
+            } catch (const DeserializationError &e) {
+                // A V1 block whose previous hash happens to start with the magic bytes
             }
-            prevHash[i] = data[cur++];
         }
 
+        size_t cur = 0;
+        return deserializeFrom(data.data(), data.size(), cur, WireFormat::V1);
+    }
+
+    Block Block::deserializeFrom(const unsigned char *data, size_t size, size_t &cur, WireFormat format) {
+        Block block = readHeaderFields(data, size, cur, format);
+
         size_t txCount = 0;
 
-        for (size_t i = 0; i < sizeof(size_t); i++) {
-            if (cur >= data.size()) {
-                throw DeserializationError("Overflow");
+        if (format == WireFormat::V1) {
+            for (size_t i = 0; i < sizeof(size_t); i++) {
+                if (cur >= size) {
+                    throw DeserializationError("Overflow");
+                }
+                txCount |= static_cast<size_t>(data[cur++]) << (i * sizeof(size_t));
             }
-            txCount |= data[cur++] << (i * sizeof(size_t));
+        } else {
+            txCount = readVarint(data, size, cur);
         }
 
-        Block block(prevHash);
-
         for (size_t i = 0; i < txCount; i++) {
-            size_t txSize = 0;
+            if (format == WireFormat::V1) {
+                size_t txSize = 0;
+
+                for (size_t j = 0; j < sizeof(size_t); j++) {
+                    if (cur >= size) {
+                        throw DeserializationError("Overflow");
+                    }
+                    txSize |= static_cast<size_t>(data[cur++]) << (j * sizeof(size_t));
+                }
 
-            for (size_t j = 0; j < sizeof(size_t); j++) {
-                if (cur >= data.size()) {
+                if (txSize > size - cur) {
                     throw DeserializationError("Overflow");
                 }
-                txSize |= data[cur++] << (j * sizeof(size_t));
+
+                size_t txCur = 0;
+                block.transactions.push_back(Transaction::deserializeFrom(data + cur, txSize, txCur, format));
+                cur += txSize;
+            } else {
+                block.transactions.push_back(Transaction::deserializeFrom(data, size, cur, format));
+            }
+        }
+
+        for (size_t i = 0; i < block.merkleRoot.size(); i++) {
+            if (cur >= size) {
+                throw DeserializationError("Overflow");
             }
+            block.merkleRoot[i] = data[cur++];
+        }
 
-            std::vector<unsigned char> txData;
-            for (size_t j = 0; j < txSize; j++) {
-                if (cur >= data.size()) {
+        if (format == WireFormat::V1) {
+            for (size_t i = 0; i < sizeof(Nonce); i++) {
+                if (cur >= size) {
                     throw DeserializationError("Overflow");
                 }
-                txData.push_back(data[cur++]);
+                block.nonce |= static_cast<Nonce>(data[cur++]) << (i * sizeof(Nonce));
             }
 
-            block.addTransaction(Transaction::deserialize(txData));
+            // Trailing block hash, recomputed from the header
+            if (sizeof(Hash) > size - cur) {
+                throw DeserializationError("Overflow");
+            }
+            cur += sizeof(Hash);
+        } else {
+            block.nonce = readVarint(data, size, cur);
         }
 
-        for (size_t i = 0; i < block.merkleRoot.size(); i++) {
-            if (cur >= data.size()) {
+        return block;
+    }
+
+    Block Block::readHeaderFields(const unsigned char *data, size_t size, size_t &cur, WireFormat format) {
+        uint32_t version = BLOCK_VERSION_LEGACY;
+
+        if (format != WireFormat::V1) {
+            uint64_t rawVersion = readVarint(data, size, cur);
+
+            if (rawVersion < BLOCK_VERSION_LEGACY || rawVersion > BLOCK_VERSION) {
+                throw DeserializationError("Unsupported block version");
+            }
+
+            version = static_cast<uint32_t>(rawVersion);
+        }
+
+        Hash prevHash;
+        for (size_t i = 0; i < prevHash.size(); i++) {
+            if (cur >= size) {
                 throw DeserializationError("Overflow");
             }
-            block.merkleRoot[i] = data[cur++];
+            prevHash[i] = data[cur++];
         }
 
-        for (size_t i = 0; i < sizeof(Nonce); i++) {
-            if (cur >= data.size()) {
+        Block block(prevHash);
+        block.version = version;
+        block.timestamp = 0;
+
+        if (version >= BLOCK_VERSION_DIFFICULTY) {
+            uint64_t rawDifficulty = readVarint(data, size, cur);
+
+            if (rawDifficulty > sizeof(Hash) * 8) {
+                throw DeserializationError("Invalid difficulty");
+            }
+
+            block.difficulty = static_cast<uint32_t>(rawDifficulty);
+        }
+
+        if (version >= BLOCK_VERSION_TIMESTAMP) {
+            block.timestamp = readVarint(data, size, cur);
+        }
+
+        if (version >= BLOCK_VERSION_SEAL) {
+            if (cur >= size) {
                 throw DeserializationError("Overflow");
             }
-            block.nonce |= data[cur++] << (i * sizeof(Nonce));
+
+            unsigned char sealed = data[cur++];
+
+            if (sealed > 1) {
+                throw DeserializationError("Invalid seal flag");
+            }
+
+            if (sealed == 1) {
+                if (size - cur < sizeof(PublicKey) + sizeof(Signature)) {
+                    throw DeserializationError("Overflow");
+                }
+
+                PublicKey sealer;
+                std::memcpy(sealer.data(), data + cur, sealer.size());
+                cur += sealer.size();
+                block.sealer = sealer;
+
+                std::memcpy(block.seal.data(), data + cur, block.seal.size());
+                cur += block.seal.size();
+            }
+        }
+
+        if (version >= BLOCK_VERSION_HEIGHT) {
+            block.height = readVarint(data, size, cur);
         }
 
         return block;
     }
 
     Hash Block::calculateMerkleRoot() const {
+        StageTimer timer(PipelineStage::Merkle);
         std::vector<Hash> merkleTree;
 
         if (transactions.empty()) {
@@ -260,4 +748,78 @@ namespace iotbc {
 
         return merkleTree[0];
     }
+
+    MerkleProof Block::merkleProof(size_t index) const {
+        if (index >= transactions.size()) {
+            throw InvalidTransaction("Transaction index out of range");
+        }
+
+        MerkleProof proof;
+        proof.index = index;
+        proof.txCount = transactions.size();
+
+        std::vector<Hash> level;
+        level.reserve(transactions.size());
+
+        for (const Transaction &tx : transactions) {
+            level.push_back(tx.txHash());
+        }
+
+        // Same tree as calculateMerkleRoot, an odd node is carried to the next level without a sibling
+        size_t position = index;
+
+        while (level.size() > 1) {
+            size_t sibling = position ^ 1;
+
+            if (sibling < level.size()) {
+                proof.siblings.push_back(level[sibling]);
+            }
+
+            std::vector<Hash> next;
+            next.reserve((level.size() + 1) / 2);
+
+            for (size_t i = 0; i < level.size(); i += 2) {
+                if (i + 1 < level.size()) {
+                    next.push_back(hash_two_hashes(level[i], level[i + 1]));
+                } else {
+                    next.push_back(level[i]);
+                }
+            }
+
+            level = std::move(next);
+            position /= 2;
+        }
+
+        return proof;
+    }
+
+    bool MerkleProof::verify(const Hash &txHash, const Hash &merkleRoot) const {
+        if (index >= txCount) {
+            return false;
+        }
+
+        Hash current = txHash;
+        size_t position = index;
+        size_t width = txCount;
+        size_t used = 0;
+
+        while (width > 1) {
+            if (position % 2 == 1) {
+                if (used >= siblings.size()) {
+                    return false;
+                }
+                current = hash_two_hashes(siblings[used++], current);
+            } else if (position + 1 < width) {
+                if (used >= siblings.size()) {
+                    return false;
+                }
+                current = hash_two_hashes(current, siblings[used++]);
+            }
+
+            position /= 2;
+            width = (width + 1) / 2;
+        }
+
+        return used == siblings.size() && current == merkleRoot;
+    }
 }
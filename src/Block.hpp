@@ -1,6 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
 #include <vector>
 #include <string>
 #include <openssl/sha.h>
@@ -11,16 +20,64 @@
 #include <Consts.hpp>
 
 namespace iotbc {
+    class MiningHandle;
+
+    /// @brief State of a mining job
+    enum class MiningStatus {
+        /// Still searching for a nonce
+        Running,
+        /// A nonce meeting the difficulty was found
+        Found,
+        /// Stopped by MiningHandle::cancel
+        Cancelled,
+        /// Stopped because the deadline passed
+        DeadlineExceeded,
+        /// Every nonce was tried without meeting the difficulty
+        Exhausted,
+        /// Stopped by an error, rethrown by MiningHandle::takeBlock
+        Failed,
+    };
+
+    /// @brief Path from a transaction to the merkle root of its block
+    /// @note Proves a transaction belongs to a block from its header alone, once the body was pruned
+    struct MerkleProof {
+        /// Index of the transaction in its block
+        size_t index = 0;
+        /// Number of transactions in the block
+        size_t txCount = 0;
+        /// Sibling hashes from the transaction up to the root, levels where the node has no sibling are skipped
+        std::vector<Hash> siblings;
+
+        /// @brief Checks the proof links a transaction to a merkle root
+        /// @param txHash The hash of the transaction
+        /// @param merkleRoot The merkle root of the block header
+        /// @return True if the transaction is part of the block
+        bool verify(const Hash &txHash, const Hash &merkleRoot) const;
+    };
+
     class Block {
     public:
+        /// Version of the block header, serialized by versioned wire formats only
+        uint32_t version;
         Hash prevHash;
         std::vector<Transaction> transactions;
         Hash merkleRoot;
         Nonce nonce;
+        /// Number of leading zero bits the block hash must have, 0 for legacy headers
+        uint32_t difficulty;
+        /// Creation time in milliseconds since the Unix epoch, 0 for headers older than BLOCK_VERSION_TIMESTAMP
+        uint64_t timestamp;
+        /// Public key of the authority that sealed the block, unset for mined blocks
+        std::optional<PublicKey> sealer;
+        /// Signature of the sealer over the block hash, not covered by the hash itself
+        Signature seal;
+        /// Index of the block in the chain, 0 for the genesis block and for headers older than BLOCK_VERSION_HEIGHT
+        uint64_t height;
 
-        /// @brief Create a new block based on the previous block's hash
+        /// @brief Create a new block based on the previous block's hash, timestamped with the current time
         /// @param prevHash The hash of the previous block
-        Block(Hash prevHash);
+        /// @param height The index of the block in the chain, one more than the previous block's
+        Block(Hash prevHash, uint64_t height = 0);
 
         /// Copy constructor
         Block(const Block &other) = default;
@@ -45,26 +102,177 @@ namespace iotbc {
         Hash blockHash() const;
 
         /// @brief Mine the block
-        /// @param difficulty The difficulty of the block
+        /// @param difficulty The difficulty of the block, stored in its header
         void mine(int difficulty);
 
+        /// @brief Mine a copy of the block on a background thread
+        /// @param difficulty The difficulty of the block, stored in its header
+        /// @param deadline The time after which the job gives up, no deadline by default
+        /// @return A handle to cancel the job, follow its progress and take the mined block
+        /// @note The job checks for cancellation and its deadline every 1024 hashes,
+        /// so it stops shortly after a competing block arrives
+        MiningHandle mineAsync(int difficulty,
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) const;
+
+        /// @brief Seal the block instead of mining it, for proof of authority chains
+        /// @param signer The authority sealing the block
+        /// @throws Secp256k1Error if an error occurs during the signing
+        void sealWith(const Signer &signer);
+
+        /// @brief Checks if the block carries a seal signed by its sealer
+        /// @return True if the block is sealed and the seal signature is valid
+        bool hasValidSeal() const;
+
+        /// @brief Checks if the block hash meets the difficulty stored in the header
+        /// @return True if the block hash has enough leading zero bits
+        bool hasValidProofOfWork() const;
+
+        /// @brief Checks if the merkle root in the header matches the transactions
+        /// @return True if the merkle root matches
+        bool hasValidMerkleRoot() const;
+
         /// @brief Verify all transactions in the block
         /// @throws iotbc::InvalidTransaction if a transaction is invalid
         /// @throws iotbc::InvalidSignature if a transaction signature is invalid
         void verifyTransactions() const;
 
         /// @brief Serialize the block into a byte array
+        /// @param format The wire format to use
         /// @return The serialized block
-        std::vector<unsigned char> serialize() const;
+        /// @throws iotbc::InvalidBlock if the header version cannot be represented in the wire format
+        std::vector<unsigned char> serialize(WireFormat format = WireFormat::V2) const;
 
         /// @brief Deserialize a block from a byte array
-        /// @param data The byte array to deserialize
+        /// @param data The byte array to deserialize, in any supported wire format
         /// @return The deserialized block
         /// @throws iotbc::DeserializationError if the data is invalid
-        static Block deserialize(const std::vector<unsigned char> &data);
+        /// @note Transactions are not verified, so cheap header checks can run first
+        static Block deserialize(std::span<const unsigned char> data);
+
+        /// @brief Serialize the header of the block, without its transactions
+        /// @return The serialized header, in the V2 wire format
+        /// @note The block hash only covers the header, so it can be recomputed from it
+        std::vector<unsigned char> serializeHeader() const;
+
+        /// @brief Append the header of the block to a buffer, without the wire format header
+        /// @param buf The buffer to append to
+        void serializeHeaderInto(std::vector<unsigned char> &buf) const;
+
+        /// @brief Deserialize a header serialized by serializeHeader
+        /// @param data The byte array to deserialize
+        /// @return A block without transactions
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Block deserializeHeader(const std::vector<unsigned char> &data);
+
+        /// @brief Read a header appended by serializeHeaderInto
+        /// @param data The buffer to read from
+        /// @param size The size of the buffer
+        /// @param cur The current position in the buffer, advanced past the header
+        /// @return A block without transactions
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Block deserializeHeaderFrom(const unsigned char *data, size_t size, size_t &cur);
+
+        /// @brief Build the proof that a transaction belongs to the block
+        /// @param index The index of the transaction in the block
+        /// @return The merkle proof of the transaction
+        /// @throws iotbc::InvalidTransaction if the index is out of range
+        MerkleProof merkleProof(size_t index) const;
     private:
+        /// @brief Search for a nonce meeting the difficulty, starting at the current nonce
+        /// @param difficulty The number of leading zero bits the block hash must have
+        /// @param stop Token requesting the search to stop
+        /// @param deadline The time after which the search gives up
+        /// @param hashes Updated with the number of hashes tried so far, can be null
+        /// @return Found with the nonce set, or the reason the search stopped
+        MiningStatus searchNonce(int difficulty, std::stop_token stop, std::chrono::steady_clock::time_point deadline, std::atomic<uint64_t> *hashes);
+
+        /// @brief Initialize a digest and feed it every field of the header but the nonce
+        /// @param ctx The digest context to use
+        /// @throws iotbc::EvpError if the digest fails
+        void hashHeaderPrefix(EVP_MD_CTX *ctx) const;
+
+        /// @brief Feed the nonce to a digest fed by hashHeaderPrefix and finalize it
+        /// @param ctx The digest context to use
+        /// @param nonce The nonce of the header
+        /// @return The block hash
+        /// @throws iotbc::EvpError if the digest fails
+        static Hash finishHeaderHash(EVP_MD_CTX *ctx, Nonce nonce);
+
+        /// @brief Read a block from a buffer, without the wire format header
+        /// @param data The buffer to read from
+        /// @param size The size of the buffer
+        /// @param cur The current position in the buffer, advanced past the block
+        /// @param format The wire format of the block
+        /// @return The deserialized block
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Block deserializeFrom(const unsigned char *data, size_t size, size_t &cur, WireFormat format);
+
+        /// @brief Append the header fields preceding the transactions in versioned wire formats
+        /// @param buf The buffer to append to
+        void writeHeaderFields(std::vector<unsigned char> &buf) const;
+
+        /// @brief Read the header fields preceding the transactions
+        /// @param data The buffer to read from
+        /// @param size The size of the buffer
+        /// @param cur The current position in the buffer, advanced past the fields
+        /// @param format The wire format of the block
+        /// @return A block with the fields read
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Block readHeaderFields(const unsigned char *data, size_t size, size_t &cur, WireFormat format);
+
         /// @brief Calculate the merkle root of the block
         /// @return The merkle root of the block
         Hash calculateMerkleRoot() const;
     };
+
+    /// @brief Handle of a mining job started by Block::mineAsync
+    /// @note Destroying the handle cancels the job and waits for it to stop
+    class MiningHandle {
+    public:
+        MiningHandle(const MiningHandle &) = delete;
+        MiningHandle &operator=(const MiningHandle &) = delete;
+        MiningHandle(MiningHandle &&other) noexcept;
+        MiningHandle &operator=(MiningHandle &&other) noexcept;
+        ~MiningHandle();
+
+        /// @brief Ask the job to stop, it is not waited for
+        void cancel();
+
+        /// @brief Get the state of the job
+        /// @return Running until the job stops, then the reason it stopped
+        MiningStatus status() const;
+
+        /// @brief Wait until the job stops
+        /// @return The reason the job stopped
+        MiningStatus wait();
+
+        /// @brief Wait until the job stops, or until the timeout expires
+        /// @param timeout The maximum time to wait
+        /// @return True if the job stopped
+        bool waitFor(std::chrono::milliseconds timeout);
+
+        /// @brief Get the number of hashes computed so far
+        /// @return The number of hashes, updated every 1024 hashes
+        uint64_t hashesTried() const;
+
+        /// @brief Get the average number of hashes per second since the job started
+        /// @return The hash rate, over the whole job once it stopped
+        double hashRate() const;
+
+        /// @brief Wait until the job stops and take the mined block, can only be called once
+        /// @return The mined block
+        /// @throws iotbc::InvalidBlock if the job stopped without finding a nonce
+        Block takeBlock();
+
+    private:
+        friend class Block;
+
+        struct State;
+
+        MiningHandle(std::shared_ptr<State> state, std::jthread thread);
+
+        std::shared_ptr<State> state;
+        // Declared last so the job is stopped and joined before its state is released
+        std::jthread thread;
+    };
 }
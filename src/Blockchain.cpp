@@ -1,132 +1,949 @@
 #include "Blockchain.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <fstream>
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <thread>
 #include <unordered_map>
 #include <optional>
 
+#include <Consensus.hpp>
+#include <Latency.hpp>
 #include <Utils.hpp>
+#include <Wire.hpp>
 
 namespace iotbc {
-    struct ArrayHash {
-        std::size_t operator()(const Hash &arr) const {
-            std::size_t hash = 0;
-            for (auto byte : arr) {
-                hash ^= std::hash<unsigned char>{}(byte) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    /// Name of the file holding the nonce index, next to the block files
+    static const std::string NONCE_INDEX_FILE = "nonces";
+
+    /// Name of the file holding the latest checkpoint, next to the block files
+    static const std::string CHECKPOINT_FILE = "checkpoint";
+
+    /// Name of the file holding the headers of the pruned blocks, next to the block files. Headers are only
+    /// ever appended to it
+    static const std::string HEADERS_FILE = "headers";
+
+    /// Name of the file holding the indices after the last pruned block, next to the block files
+    static const std::string PRUNED_FILE = "pruned";
+
+    /// @brief Checks if a file of the store holds a block, block files are named after the block hash
+    static bool isBlockFile(const std::filesystem::path &path) {
+        std::string name = path.filename().string();
+
+        return name.size() == sizeof(Hash) * 2 && std::all_of(name.begin(), name.end(), [](char c) {
+            return std::isxdigit(static_cast<unsigned char>(c));
+        });
+    }
+
+    static std::vector<unsigned char> readFile(const std::filesystem::path &path) {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file.is_open()) {
+            throw IoError("Failed to open file");
+        }
+
+        return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    /// @brief Write a file through a temporary file, so readers never see it partially written
+    static void writeFileAtomically(const std::filesystem::path &path, const std::vector<unsigned char> &data) {
+        std::filesystem::path tmpPath = path;
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+
+            if (!file.is_open()) {
+                throw IoError("Failed to open file");
+            }
+
+            file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+            if (!file) {
+                throw IoError("Failed to write to file");
             }
-            return hash;
         }
-    };
 
-    Blockchain::Blockchain() : chain(), layers() {
+        std::filesystem::rename(tmpPath, path);
     }
 
-    void Blockchain::loadExistingBlocks(const std::string &folderPath) {
-        if (!std::filesystem::exists(folderPath)) {
+    /// @brief Append data to a file, creating it if needed
+    static void appendFile(const std::filesystem::path &path, const std::vector<unsigned char> &data) {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+
+        if (!file.is_open()) {
+            throw IoError("Failed to open file");
+        }
+
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+        if (!file) {
+            throw IoError("Failed to write to file");
+        }
+    }
+
+    /// @brief Read the headers of the pruned blocks saved with a chain
+    /// @param folder The folder of the chain
+    /// @param snapshot Set to the indices after the last pruned block
+    /// @param length Set to the size of the headers file up to the last pruned header
+    /// @return The headers, linked from the genesis block
+    /// @throws iotbc::InvalidBlockchainSave if the files are invalid
+    static std::vector<Block> readPrunedHeaders(const std::filesystem::path &folder, Checkpoint &snapshot, size_t &length) {
+        if (!std::filesystem::exists(folder / PRUNED_FILE)) {
+            throw InvalidBlockchainSave("Pruned headers have no snapshot");
+        }
+
+        std::vector<unsigned char> data = readFile(folder / HEADERS_FILE);
+        std::vector<Block> headers;
+
+        try {
+            snapshot = Checkpoint::deserialize(readFile(folder / PRUNED_FILE));
+
+            if (!readWireHeader(data.data(), data.size()).has_value()) {
+                throw DeserializationError("Missing wire format header");
+            }
+
+            size_t cur = WIRE_HEADER_SIZE;
+
+            // Every header takes at least its previous hash and merkle root
+            if (snapshot.height >= (data.size() - cur) / (2 * sizeof(Hash))) {
+                throw DeserializationError("Overflow");
+            }
+
+            // Headers after the snapshot were appended by a pruning interrupted before it was saved
+            headers.reserve(snapshot.height + 1);
+            while (headers.size() <= snapshot.height) {
+                headers.push_back(Block::deserializeHeaderFrom(data.data(), data.size(), cur));
+            }
+
+            length = cur;
+        } catch (const DeserializationError &e) {
+            throw InvalidBlockchainSave(std::string("Invalid pruned headers: ") + e.what());
+        }
+
+        Hash prevHash = NULL_HASH;
+        for (const Block &header : headers) {
+            if (header.prevHash != prevHash) {
+                throw InvalidBlockchainSave("Pruned headers are not linked");
+            }
+            prevHash = header.blockHash();
+        }
+
+        if (headers.empty() || snapshot.height != headers.size() - 1 || snapshot.blockHash != prevHash) {
+            throw InvalidBlockchainSave("Pruned headers do not match their snapshot");
+        }
+
+        return headers;
+    }
+
+    /// @brief Move a file to a folder, copying it if the folder is on another file system
+    /// @throws iotbc::IoError if the file cannot be moved
+    static void archiveFile(const std::filesystem::path &path, const std::filesystem::path &folder) {
+        std::filesystem::path target = folder / path.filename();
+        std::error_code error;
+
+        std::filesystem::rename(path, target, error);
+
+        if (!error) {
             return;
         }
 
-        std::unordered_map<Hash, Block, ArrayHash> existingBlocks;
-        std::optional<Block> genesisBlock = std::nullopt;
+        if (!std::filesystem::copy_file(path, target, std::filesystem::copy_options::overwrite_existing, error)
+            || !std::filesystem::remove(path, error)) {
+            throw IoError("Failed to archive block file");
+        }
+    }
 
-        for (const auto &entry : std::filesystem::directory_iterator(folderPath)) {
-            if (entry.is_regular_file()) {
-                std::ifstream file(entry.path(), std::ios::binary);
+    /// @brief Read the checkpoint saved with a chain, if the load options trust it
+    /// @return The checkpoint, or std::nullopt if there is none or it is not trusted
+    static std::optional<Checkpoint> readTrustedCheckpoint(const std::filesystem::path &path, const LoadOptions &options) {
+        if (!std::filesystem::exists(path)) {
+            return std::nullopt;
+        }
 
-                if (!file.is_open()) {
-                    throw IoError("Failed to open file");
+        Checkpoint checkpoint;
+
+        try {
+            checkpoint = Checkpoint::deserialize(readFile(path));
+        } catch (const DeserializationError &e) {
+            std::cerr << "Warning: Invalid checkpoint, verifying the whole chain" << std::endl;
+            return std::nullopt;
+        }
+
+        // A valid signature only proves who signed, so only the configured signers are trusted
+        if (!checkpoint.signer.has_value()) {
+            if (options.trustUnsignedCheckpoint) {
+                return checkpoint;
+            }
+        } else if (checkpoint.hasValidSignature()) {
+            Address signer = Address::fromPublicKey(checkpoint.signer.value());
+
+            if (std::find(options.checkpointSigners.begin(), options.checkpointSigners.end(), signer) != options.checkpointSigners.end()) {
+                return checkpoint;
+            }
+        }
+
+        std::cerr << "Warning: Untrusted checkpoint, verifying the whole chain" << std::endl;
+        return std::nullopt;
+    }
+
+    /// @brief Run a task over a range of indices, split into contiguous chunks across a thread pool
+    /// @param task Called with the begin and end indices of each chunk
+    /// @note Every chunk is waited for, then the exception of the first failing chunk is rethrown
+    template <typename F>
+    static void parallelFor(ThreadPool &pool, size_t count, F &&task) {
+        size_t chunks = std::min(count, pool.size() * 4);
+        std::vector<std::future<void>> futures;
+        futures.reserve(chunks);
+
+        for (size_t c = 0; c < chunks; c++) {
+            size_t begin = count * c / chunks;
+            size_t end = count * (c + 1) / chunks;
+            futures.push_back(pool.submit([&task, begin, end]() { task(begin, end); }));
+        }
+
+        std::exception_ptr error = nullptr;
+
+        for (auto &future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (error == nullptr) {
+                    error = std::current_exception();
                 }
+            }
+        }
+
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    Blockchain::Blockchain() : Blockchain(ChainParams()) {
+    }
+
+    Blockchain::Blockchain(const ChainParams &params)
+        : chain(), layers(), sensorDictionary(), nonceIndex(), compression(), params(params),
+        consensus(std::make_shared<ProofOfWork>()) {
+    }
+
+    /// @brief Checks the parts of a block header that do not depend on the chain
+    /// @throws iotbc::InvalidBlock if the consensus proof or the merkle root is invalid
+    static void checkHeader(const IConsensus &consensus, const Block &block, uint32_t requiredDifficulty) {
+        consensus.verifyHeader(block, requiredDifficulty);
+
+        if (!block.hasValidMerkleRoot()) {
+            throw InvalidBlock("Block merkleRoot does not match its transactions");
+        }
+    }
+
+    /// @brief Checks the parts of a block header that depend on its parent
+    /// @throws iotbc::InvalidBlock if the header version or the timestamp goes backwards
+    static void checkParentHeader(const Block &block, const Block &parent) {
+        if (block.version < parent.version) {
+            throw InvalidBlock("Block header version is older than its parent's");
+        }
+
+        if (block.timestamp < parent.timestamp) {
+            throw InvalidBlock("Block timestamp is before its parent's");
+        }
+    }
+
+    /// @brief Checks the signatures of a block saved in the chain
+    /// @throws iotbc::InvalidBlockchainSave if a transaction is invalid or has an invalid signature
+    static void checkSavedTransactions(const Block &block) {
+        try {
+            block.verifyTransactions();
+        } catch (const InvalidTransaction &e) {
+            throw InvalidBlockchainSave("Block contains invalid transaction(s)");
+        } catch (const InvalidSignature &e) {
+            throw InvalidBlockchainSave("Block contains transaction(s) with invalid signature(s)");
+        }
+    }
+
+    /// @brief Checks the height stored in a block header
+    /// @throws iotbc::InvalidBlock if the header has a height and it is not the index of the block
+    static void checkHeight(const Block &block, size_t index) {
+        if (block.version >= BLOCK_VERSION_HEIGHT && block.height != index) {
+            throw InvalidBlock("Block height does not follow its parent's");
+        }
+    }
+
+    /// @brief Run a layer on a block the indices already account for, a failing layer is reported without
+    /// stopping the others, nor leaving the block out of the chain
+    template <typename F>
+    static void runLayer(F &&callback) {
+        try {
+            callback();
+        } catch (const std::exception &e) {
+            std::cerr << "Warning: A layer failed to process a block, " << e.what() << std::endl;
+        }
+    }
+
+    LoadStats Blockchain::loadExistingBlocks(const std::string &folderPath, const LoadOptions &options) {
+        using Clock = std::chrono::steady_clock;
+
+        LoadStats stats;
+
+        if (!std::filesystem::exists(folderPath)) {
+            return stats;
+        }
+
+        ThreadPool pool(options.threads);
+
+        verifiedBlocks = 0;
+        verifiedTip = NULL_HASH;
+        verifiedDelta.clear();
+        prunedBlocks = 0;
+        prunedHeadersSize = 0;
+        prunedNonces.clear();
+        prunedDictionary = SensorDictionary();
+        undo.clear();
+        sideBlocks.clear();
+        sideOrder.clear();
+        orphans.clear();
+        orphansByParent.clear();
+        orphanOrder.clear();
+
+        Clock::time_point start = Clock::now();
+
+        std::vector<std::filesystem::path> paths;
+        for (const auto &entry : std::filesystem::directory_iterator(folderPath)) {
+            if (entry.is_regular_file() && isBlockFile(entry.path())) {
+                paths.push_back(entry.path());
+            }
+        }
+
+        stats.files = paths.size();
 
-                std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<std::vector<unsigned char>> files(paths.size());
 
-                Block block = Block::deserialize(data);
+        parallelFor(pool, paths.size(), [&paths, &files](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                files[i] = readFile(paths[i]);
+            }
+        });
+
+        stats.io = Clock::now() - start;
+        start = Clock::now();
+
+        std::vector<std::optional<Block>> blocks(paths.size());
+        std::vector<Hash> hashes(paths.size());
+
+        try {
+            parallelFor(pool, paths.size(), [&paths, &files, &blocks, &hashes](size_t begin, size_t end) {
+                std::vector<unsigned char> buffer;
 
-                if (block.prevHash == NULL_HASH) {
-                    if (genesisBlock.has_value()) {
-                        throw InvalidBlockchainSave("Cannot have multiple genesis blocks");
+                for (size_t i = begin; i < end; i++) {
+                    try {
+                        blocks[i].emplace(Block::deserialize(decodeStoredBlock(files[i], buffer)));
+                    } catch (const DeserializationError &e) {
+                        throw InvalidBlockchainSave("Invalid block file " + paths[i].filename().string() + ": " + e.what());
                     }
 
-                    genesisBlock = block;
-                } else {
-                    existingBlocks.insert({block.prevHash, block});
+                    hashes[i] = blocks[i]->blockHash();
+                    std::vector<unsigned char>().swap(files[i]);
                 }
+            });
+        } catch (const InvalidBlockchainSave &e) {
+            discardLoadedBlocks();
+            throw;
+        }
+
+        stats.decode = Clock::now() - start;
+        start = Clock::now();
+
+        // Pruned blocks are only saved as headers, the block files continue from the last of them
+        std::vector<Block> headers;
+        Checkpoint prunedSnapshot;
+        if (std::filesystem::exists(std::filesystem::path(folderPath) / HEADERS_FILE)) {
+            try {
+                headers = readPrunedHeaders(folderPath, prunedSnapshot, prunedHeadersSize);
+                prunedNonces = NonceIndex::deserialize(prunedSnapshot.nonceIndex);
+                prunedDictionary = SensorDictionary::deserialize(prunedSnapshot.sensorDictionary);
+            } catch (const DeserializationError &e) {
+                discardLoadedBlocks();
+                throw InvalidBlockchainSave(std::string("Invalid pruned snapshot: ") + e.what());
+            } catch (const InvalidBlockchainSave &e) {
+                discardLoadedBlocks();
+                throw;
             }
         }
 
-        if (!genesisBlock.has_value() && !existingBlocks.empty()) {
+        // Blocks are indexed by their parent's hash, the index only holds hashes and positions
+        std::optional<size_t> genesis = std::nullopt;
+        std::unordered_map<Hash, size_t, ArrayHash> childOf;
+        childOf.reserve(blocks.size());
+
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (blocks[i]->prevHash == NULL_HASH) {
+                if (genesis.has_value()) {
+                    discardLoadedBlocks();
+                    throw InvalidBlockchainSave("Cannot have multiple genesis blocks");
+                }
+
+                genesis = i;
+            } else {
+                childOf.emplace(blocks[i]->prevHash, i);
+            }
+        }
+
+        if (headers.empty() && !genesis.has_value() && !childOf.empty()) {
+            discardLoadedBlocks();
             throw InvalidBlockchainSave("Some blocks were found but no genesis block");
         }
 
-        if (!genesisBlock.has_value()) {
-            return;
+        if (headers.empty() && !genesis.has_value()) {
+            stats.link = Clock::now() - start;
+            return stats;
         }
 
-        chain.push_back(genesisBlock.value());
+        chain.reserve(chain.size() + headers.size() + blocks.size());
 
-        Hash lastHash = genesisBlock.value().blockHash();
+        Hash lastHash;
 
-        while (existingBlocks.find(lastHash) != existingBlocks.end()) {
-            Block blockToAdd = existingBlocks.extract(lastHash).mapped();
-            lastHash = blockToAdd.blockHash();
-            chain.push_back(blockToAdd);
+        if (!headers.empty()) {
+            prunedBlocks = headers.size();
+            lastHash = prunedSnapshot.blockHash;
+            std::move(headers.begin(), headers.end(), std::back_inserter(chain));
+        } else {
+            chain.push_back(std::move(blocks[genesis.value()].value()));
+            blocks[genesis.value()].reset();
+            lastHash = hashes[genesis.value()];
         }
 
-        if (!existingBlocks.empty()) {
-            std::cerr << "Warning: Some blocks were found but not part of the chain" << std::endl;
+        for (auto it = childOf.find(lastHash); it != childOf.end(); it = childOf.find(lastHash)) {
+            size_t current = it->second;
+            childOf.erase(it);
+            chain.push_back(std::move(blocks[current].value()));
+            blocks[current].reset();
+            lastHash = hashes[current];
+        }
+
+        // Blocks off the linked path are side branches, or files of pruned blocks left behind if the node
+        // stopped while pruning. They go through the block tree once the chain is replayed
+        std::vector<Block> unlinked;
+        for (auto &block : blocks) {
+            if (block.has_value()) {
+                unlinked.push_back(std::move(block.value()));
+            }
         }
 
-        for (const auto &block : chain) {
+        blocks.clear();
+        stats.blocks = chain.size();
+        stats.link = Clock::now() - start;
+
+        // Blocks up to a trusted checkpoint are neither verified nor replayed into the indices
+        std::optional<Checkpoint> checkpoint = std::nullopt;
+        NonceIndex checkpointNonces;
+        SensorDictionary checkpointDictionary;
+
+        if (options.useCheckpoint) {
+            checkpoint = readTrustedCheckpoint(std::filesystem::path(folderPath) / CHECKPOINT_FILE, options);
+        }
+
+        if (checkpoint.has_value()) {
+            try {
+                if (checkpoint->height >= chain.size() || chain[checkpoint->height].blockHash() != checkpoint->blockHash) {
+                    throw DeserializationError("Checkpoint is not part of the chain");
+                }
+
+                checkpointNonces = NonceIndex::deserialize(checkpoint->nonceIndex);
+                checkpointDictionary = SensorDictionary::deserialize(checkpoint->sensorDictionary);
+                stats.checkpointHeight = checkpoint->height;
+            } catch (const DeserializationError &e) {
+                std::cerr << "Warning: Ignoring checkpoint, " << e.what() << std::endl;
+                checkpoint = std::nullopt;
+            }
+        }
+
+        size_t trusted = checkpoint.has_value() ? checkpoint->height + 1 : 0;
+
+        // Pruned blocks have no body, so the loading starts after them unless a later checkpoint is trusted
+        if (prunedBlocks > trusted) {
+            trusted = prunedBlocks;
+            checkpointNonces = prunedNonces;
+            checkpointDictionary = prunedDictionary;
+        }
+
+        // The blocks up to a trusted checkpoint count as verified, so verifyNewBlocks starts after them
+        std::optional<NonceIndex> verifiedIndex = std::nullopt;
+
+        if (options.verify) {
+            start = Clock::now();
+
+            try {
+                verifiedIndex = verifyChain(&pool, trusted, checkpointNonces);
+            } catch (...) {
+                discardLoadedBlocks();
+                throw;
+            }
+
+            stats.verify = Clock::now() - start;
+        } else if (trusted > 0) {
+            verifiedBlocks = trusted;
+            verifiedTip = chain[trusted - 1].blockHash();
+
+            for (size_t i = trusted; i < chain.size(); i++) {
+                keepVerifiedNonces(chain[i], checkpointNonces);
+            }
+        }
+
+        if (checkpoint.has_value() && options.auditCheckpoint) {
+            stats.audit = auditAsync(trusted);
+        }
+
+        start = Clock::now();
+
+        // The verification already built the nonce index, otherwise the saved one
+        // can only be trusted if it was saved along the same tip
+        bool nonceIndexLoaded = false;
+        std::filesystem::path nonceIndexPath = std::filesystem::path(folderPath) / NONCE_INDEX_FILE;
+
+        if (verifiedIndex.has_value()) {
+            markVerified(std::move(verifiedIndex.value()));
+            nonceIndexLoaded = true;
+        } else if (std::filesystem::exists(nonceIndexPath)) {
+            std::vector<unsigned char> data = readFile(nonceIndexPath);
+
+            if (data.size() >= sizeof(Hash) && std::equal(data.begin(), data.begin() + sizeof(Hash), lastHash.begin())) {
+                try {
+                    nonceIndex = NonceIndex::deserialize(std::vector<unsigned char>(data.begin() + sizeof(Hash), data.end()));
+                    nonceIndexLoaded = true;
+                } catch (const DeserializationError &e) {
+                    std::cerr << "Warning: Invalid nonce index, rebuilding it" << std::endl;
+                }
+            }
+        }
+
+        if (trusted > 0) {
+            sensorDictionary = std::move(checkpointDictionary);
+
+            if (!nonceIndexLoaded) {
+                nonceIndex = std::move(checkpointNonces);
+            }
+        }
+
+        for (size_t i = prunedBlocks; i < chain.size(); i++) {
+            if (i >= trusted) {
+                size_t dictionarySize = sensorDictionary.size();
+                sensorDictionary.processBlock(chain[i]);
+
+                if (i + forks.maxReorgDepth >= chain.size()) {
+                    undo.push_back({chain[i].blockHash(), dictionarySize});
+                }
+
+                if (!nonceIndexLoaded) {
+                    nonceIndex.apply(chain[i]);
+                }
+            }
+
             for (const auto &layer : layers) {
-                layer->processBlock(block);
+                runLayer([&]() { layer->processBlock(chain[i]); });
             }
         }
+
+        // Parents are submitted before their children, so side branches are rebuilt without orphans
+        std::sort(unlinked.begin(), unlinked.end(), [](const Block &a, const Block &b) {
+            return a.height < b.height;
+        });
+
+        bool dropped = false;
+
+        for (const Block &block : unlinked) {
+            try {
+                dropped |= submitBlock(block) == BlockStatus::Orphan;
+            } catch (const InvalidBlock &e) {
+                dropped = true;
+            }
+        }
+
+        if (dropped) {
+            std::cerr << "Warning: Some blocks were found but not part of the chain" << std::endl;
+        }
+
+        stats.replay = Clock::now() - start;
+
+        return stats;
+    }
+
+    void Blockchain::discardLoadedBlocks() {
+        chain.clear();
+        prunedBlocks = 0;
+        prunedHeadersSize = 0;
+        prunedNonces.clear();
+        prunedDictionary = SensorDictionary();
     }
 
     void Blockchain::verifyExistingChain() const {
-        if (chain.empty()) {
+        verifyChain(nullptr, 0, NonceIndex());
+    }
+
+    void Blockchain::verifyNewBlocks() {
+        if (verifiedBlocks == chain.size() && (verifiedBlocks == 0 || chain.back().blockHash() == verifiedTip)) {
             return;
         }
 
-        chain[0].verifyTransactions();
+        // Verified blocks replaced in the chain cannot be trusted anymore
+        if (verifiedBlocks > chain.size() || (verifiedBlocks > 0 && chain[verifiedBlocks - 1].blockHash() != verifiedTip)) {
+            verifiedBlocks = 0;
+            verifiedTip = NULL_HASH;
+        }
+
+        NonceIndex nonces;
+
+        if (verifiedBlocks > 0) {
+            nonces = nonceIndex;
+            for (const auto &[sender, next] : verifiedDelta) {
+                nonces.set(sender, next);
+            }
+        }
+
+        // The index rebuilt by the verification replaces one loaded from a save or not following the chain
+        markVerified(verifyChain(nullptr, verifiedBlocks, std::move(nonces)));
+    }
 
-        for (size_t i = 1; i < chain.size(); i++) {
-            chain[i].verifyTransactions();
+    void Blockchain::markVerified(NonceIndex nonces) {
+        verifiedBlocks = chain.size();
+        verifiedTip = chain.empty() ? NULL_HASH : chain.back().blockHash();
+        nonceIndex = std::move(nonces);
+        verifiedDelta.clear();
+    }
+
+    void Blockchain::keepVerifiedNonces(const Block &block, const NonceIndex &nonces) {
+        for (const Transaction &tx : block.transactions) {
+            Address sender = Address::fromPublicKey(tx.from);
+            verifiedDelta.try_emplace(sender, nonces.next(sender));
+        }
+    }
 
-            if (chain[i].prevHash != chain[i - 1].blockHash()) {
+    NonceIndex Blockchain::verifyChain(ThreadPool *pool, size_t from, NonceIndex nonces) const {
+        // Pruned blocks only have their header verified, the nonces continue from the pruned snapshot
+        if (from < prunedBlocks) {
+            nonces = prunedNonces;
+        }
+
+        for (size_t i = from; i < chain.size(); i++) {
+            if (i > 0 && chain[i].prevHash != chain[i - 1].blockHash()) {
                 throw InvalidBlockchainSave("Hash mismatch");
             }
+
+            // Legacy headers have no difficulty, their hash can only be checked against what it claims
+            uint32_t required = chain[i].version < BLOCK_VERSION_DIFFICULTY ? 0 : difficultyAt(i);
+
+            try {
+                checkHeight(chain[i], i);
+                if (i > 0) {
+                    checkParentHeader(chain[i], chain[i - 1]);
+                }
+
+                if (i < prunedBlocks) {
+                    consensus->verifyHeader(chain[i], required);
+                    continue;
+                }
+
+                checkHeader(*consensus, chain[i], required);
+            } catch (const InvalidBlock &e) {
+                throw InvalidBlockchainSave(e.what());
+            }
+
+            try {
+                nonces.check(chain[i]);
+            } catch (const InvalidBlock &e) {
+                throw InvalidBlockchainSave("Nonce mismatch");
+            }
+            nonces.apply(chain[i]);
         }
+
+        from = std::max(from, prunedBlocks);
+
+        if (from >= chain.size()) {
+            return nonces;
+        }
+
+        if (pool == nullptr) {
+            for (size_t i = from; i < chain.size(); i++) {
+                checkSavedTransactions(chain[i]);
+            }
+            return nonces;
+        }
+
+        parallelFor(*pool, chain.size() - from, [this, from](size_t begin, size_t end) {
+            for (size_t i = from + begin; i < from + end; i++) {
+                checkSavedTransactions(chain[i]);
+            }
+        });
+
+        return nonces;
+    }
+
+    Checkpoint Blockchain::makeCheckpoint() const {
+        if (chain.empty()) {
+            throw InvalidBlock("Cannot checkpoint an empty chain");
+        }
+
+        Checkpoint checkpoint;
+        checkpoint.height = chain.size() - 1;
+        checkpoint.blockHash = chain.back().blockHash();
+        checkpoint.nonceIndex = nonceIndex.serialize();
+        checkpoint.sensorDictionary = sensorDictionary.serialize();
+
+        return checkpoint;
+    }
+
+    void Blockchain::saveCheckpoint(const std::string &folderPath) const {
+        writeFileAtomically(std::filesystem::path(folderPath) / CHECKPOINT_FILE, makeCheckpoint().serialize());
+    }
+
+    void Blockchain::saveCheckpoint(const std::string &folderPath, const Signer &signer) const {
+        Checkpoint checkpoint = makeCheckpoint();
+        checkpoint.sign(signer);
+
+        writeFileAtomically(std::filesystem::path(folderPath) / CHECKPOINT_FILE, checkpoint.serialize());
+    }
+
+    std::shared_future<void> Blockchain::auditAsync(size_t end) const {
+        auto snapshot = std::make_shared<Blockchain>(params);
+        snapshot->consensus = consensus;
+        snapshot->chain.assign(chain.begin(), chain.begin() + std::min(end, chain.size()));
+        snapshot->prunedBlocks = std::min(prunedBlocks, snapshot->chain.size());
+        snapshot->prunedNonces = prunedNonces;
+
+        auto promise = std::make_shared<std::promise<void>>();
+        std::shared_future<void> audit = promise->get_future().share();
+
+        // Detached, as dropping a std::async future would wait for the whole verification
+        std::thread([snapshot, promise]() {
+            try {
+                snapshot->verifyExistingChain();
+                promise->set_value();
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        }).detach();
+
+        return audit;
     }
 
     void Blockchain::saveBlocks(const std::string &folderPath) const {
+        StageTimer timer(PipelineStage::Persistence);
+
         if (!std::filesystem::exists(folderPath)) {
             std::filesystem::create_directory(folderPath);
         }
 
-        for (const auto &block : chain) {
+        // pruneBlocks keeps the pruned headers up to date, they are only written to a folder missing them
+        std::filesystem::path headersPath = std::filesystem::path(folderPath) / HEADERS_FILE;
+
+        if (prunedBlocks > 0 && (!std::filesystem::exists(headersPath) || std::filesystem::file_size(headersPath) < prunedHeadersSize
+            || !std::filesystem::exists(std::filesystem::path(folderPath) / PRUNED_FILE))) {
+            writeFileAtomically(headersPath, serializePrunedHeaders(0));
+            writeFileAtomically(std::filesystem::path(folderPath) / PRUNED_FILE, serializePrunedSnapshot());
+        }
+
+        for (size_t i = prunedBlocks; i < chain.size(); i++) {
+            const Block &block = chain[i];
             std::ofstream file(folderPath + "/" + hashToString(block.blockHash()), std::ios::binary);
 
             if (!file.is_open()) {
                 throw IoError("Failed to open file");
             }
 
-            auto serialized = block.serialize();
+            auto serialized = encodeStoredBlock(block.serialize(), compression);
             file.write(reinterpret_cast<const char *>(serialized.data()), serialized.size());
 
             if (!file) {
                 throw IoError("Failed to write to file");
             }
         }
+
+        if (chain.empty()) {
+            return;
+        }
+
+        Hash tipHash = chain.back().blockHash();
+        std::vector<unsigned char> nonceData(tipHash.begin(), tipHash.end());
+        std::vector<unsigned char> serializedIndex = nonceIndex.serialize();
+        nonceData.insert(nonceData.end(), serializedIndex.begin(), serializedIndex.end());
+
+        writeFileAtomically(std::filesystem::path(folderPath) / NONCE_INDEX_FILE, nonceData);
+    }
+
+    std::vector<unsigned char> Blockchain::serializePrunedHeaders(size_t from) const {
+        std::vector<unsigned char> buf;
+
+        if (from == 0) {
+            writeWireHeader(buf, WireFormat::V2);
+        }
+
+        for (size_t i = from; i < prunedBlocks; i++) {
+            chain[i].serializeHeaderInto(buf);
+        }
+
+        return buf;
     }
 
-    void Blockchain::addBlock(const Block &block) {
+    std::vector<unsigned char> Blockchain::serializePrunedSnapshot() const {
+        Checkpoint snapshot;
+        snapshot.height = prunedBlocks - 1;
+        snapshot.blockHash = chain[prunedBlocks - 1].blockHash();
+        snapshot.nonceIndex = prunedNonces.serialize();
+        snapshot.sensorDictionary = prunedDictionary.serialize();
+
+        return snapshot.serialize();
+    }
+
+    size_t Blockchain::pruneBlocks(const std::string &folderPath) {
+        if (chain.empty()) {
+            return 0;
+        }
+
+        // The tip always keeps its body
+        size_t end = prunedBlocks;
+
+        if (pruning.keepBlocks > 0 && chain.size() > pruning.keepBlocks) {
+            end = std::max(end, chain.size() - pruning.keepBlocks);
+        }
+
+        if (pruning.keepBytes > 0) {
+            size_t first = chain.size() - 1;
+            size_t bytes = 0;
+
+            for (const Transaction &tx : chain[first].transactions) {
+                bytes += tx.size(WireFormat::V2);
+            }
+
+            while (first > end) {
+                size_t size = 0;
+                for (const Transaction &tx : chain[first - 1].transactions) {
+                    size += tx.size(WireFormat::V2);
+                }
+
+                if (bytes + size > pruning.keepBytes) {
+                    break;
+                }
+
+                bytes += size;
+                first--;
+            }
+
+            end = std::max(end, first);
+        }
+
+        // Unverified bodies could not be verified anymore, and pinned bodies are still needed by a layer
+        end = std::min(end, verifiedBlocks);
+
+        for (const auto &layer : layers) {
+            std::optional<uint64_t> pin = layer->pinnedHeight();
+
+            if (pin.has_value()) {
+                end = std::min<size_t>(end, pin.value());
+            }
+        }
+
+        if (end <= prunedBlocks) {
+            return 0;
+        }
+
+        size_t previous = prunedBlocks;
+        std::vector<Hash> pruned;
+        pruned.reserve(end - prunedBlocks);
+
+        for (size_t i = prunedBlocks; i < end; i++) {
+            prunedNonces.apply(chain[i]);
+            prunedDictionary.processBlock(chain[i]);
+            pruned.push_back(chain[i].blockHash());
+
+            std::vector<Transaction>().swap(chain[i].transactions);
+        }
+
+        prunedBlocks = end;
+
+        if (!std::filesystem::exists(folderPath)) {
+            std::filesystem::create_directory(folderPath);
+        }
+
+        // The headers are saved before the block files go away, so the store can always be loaded. Only the
+        // new ones are appended, after dropping those left by an interrupted pruning
+        std::filesystem::path headersPath = std::filesystem::path(folderPath) / HEADERS_FILE;
+
+        if (previous > 0 && std::filesystem::exists(headersPath) && std::filesystem::file_size(headersPath) >= prunedHeadersSize) {
+            std::vector<unsigned char> appended = serializePrunedHeaders(previous);
+            std::filesystem::resize_file(headersPath, prunedHeadersSize);
+            appendFile(headersPath, appended);
+            prunedHeadersSize += appended.size();
+        } else {
+            std::vector<unsigned char> headers = serializePrunedHeaders(0);
+            writeFileAtomically(headersPath, headers);
+            prunedHeadersSize = headers.size();
+        }
+
+        writeFileAtomically(std::filesystem::path(folderPath) / PRUNED_FILE, serializePrunedSnapshot());
+
+        if (!pruning.archiveFolder.empty() && !std::filesystem::exists(pruning.archiveFolder)) {
+            std::filesystem::create_directories(pruning.archiveFolder);
+        }
+
+        for (const Hash &hash : pruned) {
+            std::filesystem::path path = std::filesystem::path(folderPath) / hashToString(hash);
+
+            if (!std::filesystem::exists(path)) {
+                continue;
+            }
+
+            if (pruning.archiveFolder.empty()) {
+                std::filesystem::remove(path);
+            } else {
+                archiveFile(path, pruning.archiveFolder);
+            }
+        }
+
+        return pruned.size();
+    }
+
+    void Blockchain::addBlock(const Block &block, bool transactionsVerified) {
+        StageTimer timer(PipelineStage::AddBlock);
+
         if (block.merkleRoot == NULL_HASH) {
             throw InvalidBlock("Block should be mined before getting added (merkleRoot is NULL_HASH)");
         }
 
+        // Legacy blocks skip nonce checks, they only come from stores written before nonces
+        if (block.version < BLOCK_VERSION_DIFFICULTY) {
+            throw InvalidBlock("Legacy blocks can only be loaded from a saved chain");
+        }
+
+        if (chain.empty()) {
+            if (block.prevHash != NULL_HASH) {
+                throw InvalidBlock("The first block of the chain should be the genesis block");
+            }
+        } else {
+            if (block.prevHash != chain.back().blockHash()) {
+                throw InvalidBlock("Block prevHash does not match the last block's hash");
+            }
+
+            checkParentHeader(block, chain.back());
+        }
+
+        checkHeight(block, chain.size());
+
+        if (block.timestamp > currentTimestamp() + static_cast<uint64_t>(params.maxFutureBlockTime.count())) {
+            throw InvalidBlock("Block timestamp is too far in the future");
+        }
+
+        // Checked before the signatures, so cheap and replayed blocks are rejected without any ECDSA verification
+        checkHeader(*consensus, block, requiredDifficulty());
+        nonceIndex.check(block);
+
         try {
-            block.verifyTransactions();
+            if (!transactionsVerified) {
+                block.verifyTransactions();
+            }
         } catch (const InvalidTransaction &e) {
             throw InvalidBlock("Block contains invalid transaction(s)");
         } catch (const InvalidSignature &e) {
@@ -135,20 +952,345 @@ namespace iotbc {
             throw e;
         }
 
-        if (chain.empty()) {
-            if (block.prevHash != NULL_HASH) {
-                throw InvalidBlock("The first block of the chain should be the genesis block");
+        Hash hash = block.blockHash();
+        size_t dictionarySize = sensorDictionary.size();
+
+        // The block was just verified, so the verified height follows the tip if it was on it
+        bool extendsVerified = verifiedBlocks == chain.size() && verifiedTip == block.prevHash;
+
+        if (!extendsVerified && verifiedBlocks > 0) {
+            keepVerifiedNonces(block, nonceIndex);
+        }
+
+        nonceIndex.apply(block);
+        sensorDictionary.processBlock(block);
+
+        {
+            StageTimer dispatchTimer(PipelineStage::LayerDispatch);
+
+            for (const auto &layer : layers) {
+                runLayer([&]() { layer->processBlock(block); });
             }
+        }
+
+        chain.push_back(block);
+
+        undo.push_back({hash, dictionarySize});
+        if (undo.size() > forks.maxReorgDepth) {
+            undo.pop_front();
+        }
+
+        if (extendsVerified) {
+            verifiedBlocks = chain.size();
+            verifiedTip = hash;
+        }
+    }
+
+    /// @brief Get the work of a block, the expected number of hashes needed to find it
+    static double blockWork(const Block &block) {
+        return std::ldexp(1.0, static_cast<int>(block.difficulty));
+    }
+
+    BlockStatus Blockchain::submitBlock(const Block &block, bool transactionsVerified) {
+        Hash hash = block.blockHash();
+
+        if (isOnActiveChain(hash, block.height) || sideBlocks.contains(hash) || orphans.contains(hash)) {
+            return BlockStatus::Duplicate;
+        }
+
+        BlockStatus status = BlockStatus::Connected;
+
+        if (chain.empty() ? block.prevHash == NULL_HASH : block.prevHash == chain.back().blockHash()) {
+            addBlock(block, transactionsVerified);
         } else {
-            if (block.prevHash != chain.back().blockHash()) {
-                throw InvalidBlock("Block prevHash does not match the last block's hash");
+            if (block.version < BLOCK_VERSION_HEIGHT) {
+                throw InvalidBlock("Block does not extend the tip and has no height to fork from");
             }
+
+            if (block.height == 0) {
+                throw InvalidBlock("Genesis block does not match the chain");
+            }
+
+            auto parent = sideBlocks.find(block.prevHash);
+            bool parentKnown = isOnActiveChain(block.prevHash, block.height - 1)
+                || (parent != sideBlocks.end() && parent->second.height + 1 == block.height);
+
+            if (!parentKnown) {
+                addOrphan(block, hash);
+                return BlockStatus::Orphan;
+            }
+
+            status = addSideBlock(block, hash);
         }
 
-        for (const auto &layer : layers) {
-            layer->processBlock(block);
+        trimSideBlocks();
+        connectOrphans(hash);
+
+        return status;
+    }
+
+    BlockStatus Blockchain::addSideBlock(const Block &block, const Hash &hash) {
+        // Only the checks not depending on the branch, the rest is checked if the branch gets connected
+        if (block.timestamp > currentTimestamp() + static_cast<uint64_t>(params.maxFutureBlockTime.count())) {
+            throw InvalidBlock("Block timestamp is too far in the future");
         }
 
-        chain.push_back(block);
+        checkHeader(*consensus, block, params.minDifficulty);
+
+        // Walk down the branch to the active chain, only the blocks of the fork are visited
+        std::vector<Hash> branch = {hash};
+        double branchWork = blockWork(block);
+        Hash parent = block.prevHash;
+        uint64_t height = block.height - 1;
+
+        while (!isOnActiveChain(parent, height)) {
+            auto it = sideBlocks.find(parent);
+
+            if (it == sideBlocks.end() || height == 0) {
+                throw InvalidBlock("Side branch does not connect to the chain");
+            }
+
+            branch.push_back(parent);
+            branchWork += blockWork(it->second);
+            parent = it->second.prevHash;
+            height--;
+        }
+
+        size_t forkHeight = height;
+        size_t depth = chain.size() - 1 - forkHeight;
+
+        if (depth > forks.maxReorgDepth) {
+            throw InvalidBlock("Block forks deeper than the maximum reorganization depth");
+        }
+
+        double activeWork = 0;
+        for (size_t i = forkHeight + 1; i < chain.size(); i++) {
+            activeWork += blockWork(chain[i]);
+        }
+
+        sideBlocks.emplace(hash, block);
+        sideOrder.push_back(hash);
+
+        // Ties keep the active chain, so nodes do not switch back and forth between equal branches
+        if (branchWork <= activeWork) {
+            return BlockStatus::SideBranch;
+        }
+
+        if (forkHeight + 1 < prunedBlocks || depth > undo.size()) {
+            sideBlocks.erase(hash);
+            throw InvalidBlock("Cannot reorganize blocks that were pruned or loaded without undo data");
+        }
+
+        std::reverse(branch.begin(), branch.end());
+        reorganize(branch, forkHeight);
+
+        return BlockStatus::Reorganized;
+    }
+
+    void Blockchain::reorganize(const std::vector<Hash> &branch, size_t forkHeight) {
+        std::vector<Block> disconnected;
+        disconnected.reserve(chain.size() - forkHeight - 1);
+
+        while (chain.size() > forkHeight + 1) {
+            disconnected.push_back(disconnectTip());
+        }
+
+        size_t connected = 0;
+
+        try {
+            for (const Hash &hash : branch) {
+                addBlock(sideBlocks.at(hash));
+                connected++;
+            }
+        } catch (const InvalidBlock &e) {
+            // The branch is invalid from this block on, the previous active chain is restored
+            for (size_t i = connected; i < branch.size(); i++) {
+                sideBlocks.erase(branch[i]);
+            }
+
+            while (chain.size() > forkHeight + 1) {
+                disconnectTip();
+            }
+
+            for (auto it = disconnected.rbegin(); it != disconnected.rend(); it++) {
+                addBlock(*it);
+            }
+
+            throw;
+        }
+
+        for (const Hash &hash : branch) {
+            sideBlocks.erase(hash);
+        }
+
+        for (Block &block : disconnected) {
+            Hash hash = block.blockHash();
+            sideBlocks.emplace(hash, std::move(block));
+            sideOrder.push_back(hash);
+        }
+    }
+
+    Block Blockchain::disconnectTip() {
+        Block block = std::move(chain.back());
+        chain.pop_back();
+
+        // Undone in the reverse order of addBlock
+        for (auto it = layers.rbegin(); it != layers.rend(); it++) {
+            runLayer([&]() { (*it)->disconnectBlock(block); });
+        }
+
+        sensorDictionary.truncate(undo.back().dictionarySize);
+        undo.pop_back();
+        nonceIndex.revert(block);
+
+        // Back at the verified height, nonceIndex holds the verified nonces again
+        if (verifiedBlocks >= chain.size()) {
+            verifiedBlocks = chain.size();
+            verifiedTip = block.prevHash;
+            verifiedDelta.clear();
+        }
+
+        return block;
+    }
+
+    void Blockchain::connectOrphans(const Hash &parent) {
+        std::vector<Hash> children;
+
+        auto range = orphansByParent.equal_range(parent);
+        for (auto it = range.first; it != range.second; it++) {
+            children.push_back(it->second);
+        }
+        orphansByParent.erase(parent);
+
+        for (const Hash &hash : children) {
+            auto it = orphans.find(hash);
+
+            if (it == orphans.end()) {
+                continue;
+            }
+
+            Block child = std::move(it->second);
+            orphans.erase(it);
+            orphanOrder.erase(std::find(orphanOrder.begin(), orphanOrder.end(), hash));
+
+            try {
+                submitBlock(child);
+            } catch (const InvalidBlock &e) {
+                std::cerr << "Warning: Dropping invalid orphan block, " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void Blockchain::addOrphan(const Block &block, const Hash &hash) {
+        if (forks.maxOrphans == 0) {
+            return;
+        }
+
+        while (orphans.size() >= forks.maxOrphans) {
+            Hash oldest = orphanOrder.front();
+            orphanOrder.pop_front();
+
+            auto it = orphans.find(oldest);
+            auto range = orphansByParent.equal_range(it->second.prevHash);
+
+            for (auto link = range.first; link != range.second; link++) {
+                if (link->second == oldest) {
+                    orphansByParent.erase(link);
+                    break;
+                }
+            }
+
+            orphans.erase(it);
+        }
+
+        orphans.emplace(hash, block);
+        orphansByParent.emplace(block.prevHash, hash);
+        orphanOrder.push_back(hash);
+    }
+
+    void Blockchain::trimSideBlocks() {
+        size_t tip = chain.size() - 1;
+
+        std::erase_if(sideBlocks, [this, tip](const auto &entry) {
+            return entry.second.height + forks.maxReorgDepth < tip;
+        });
+
+        // The order still holds the blocks connected or dropped since, they go first
+        std::erase_if(sideOrder, [this](const Hash &hash) {
+            return !sideBlocks.contains(hash);
+        });
+
+        while (sideBlocks.size() > forks.maxSideBlocks) {
+            sideBlocks.erase(sideOrder.front());
+            sideOrder.pop_front();
+        }
+    }
+
+    size_t Blockchain::findFirstBlockAtOrAfter(uint64_t timestamp) const {
+        auto it = std::partition_point(chain.begin(), chain.end(), [timestamp](const Block &block) {
+            return block.timestamp < timestamp;
+        });
+
+        return static_cast<size_t>(it - chain.begin());
+    }
+
+    std::span<const Block> Blockchain::blocksBetween(uint64_t from, uint64_t to) const {
+        if (to <= from) {
+            return {};
+        }
+
+        size_t first = findFirstBlockAtOrAfter(from);
+        size_t last = findFirstBlockAtOrAfter(to);
+
+        return std::span<const Block>(chain.data() + first, last - first);
+    }
+
+    void Blockchain::sealBlock(Block &block) const {
+        consensus->sealBlock(block, requiredDifficulty());
+    }
+
+    uint32_t Blockchain::requiredDifficulty() const {
+        return difficultyAt(chain.size());
+    }
+
+    uint32_t Blockchain::difficultyAt(size_t height) const {
+        if (params.targetBlockInterval.count() <= 0) {
+            return params.minDifficulty;
+        }
+
+        height = std::min(height, chain.size());
+
+        size_t begin = height > params.retargetWindow ? height - params.retargetWindow : 0;
+
+        // Legacy headers have no timestamp, they can only come before the timestamped ones
+        while (begin < height && chain[begin].version < BLOCK_VERSION_TIMESTAMP) {
+            begin++;
+        }
+
+        size_t intervals = height - begin > 0 ? height - begin - 1 : 0;
+
+        if (intervals == 0) {
+            return std::clamp(params.initialDifficulty, params.minDifficulty, params.maxDifficulty);
+        }
+
+        // The window's time span was spent mining every block after the first one, so the average work of
+        // those blocks over their average interval estimates the hash rate, whatever difficulty they had
+        double work = 0;
+        for (size_t i = begin + 1; i < height; i++) {
+            work += std::ldexp(1.0, static_cast<int>(chain[i].difficulty));
+        }
+        work /= intervals;
+
+        uint64_t span = chain[height - 1].timestamp - chain[begin].timestamp;
+        double interval = std::max<double>(static_cast<double>(span) / intervals, 1.0);
+
+        double ideal = std::log2(work * params.targetBlockInterval.count() / interval);
+
+        int64_t parentDifficulty = chain[height - 1].difficulty;
+        int64_t next = std::llround(ideal);
+        next = std::clamp<int64_t>(next, parentDifficulty - params.maxRetargetStep, parentDifficulty + params.maxRetargetStep);
+        next = std::clamp<int64_t>(next, params.minDifficulty, params.maxDifficulty);
+
+        return static_cast<uint32_t>(next);
     }
 }
@@ -1,41 +1,232 @@
 #pragma once
 
+#include <chrono>
+#include <deque>
+#include <future>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
 #include <openssl/sha.h>
 #include <secp256k1.h>
 
 #include <Block.hpp>
+#include <Checkpoint.hpp>
 #include <Types.hpp>
 #include <ILayer.hpp>
+#include <IConsensus.hpp>
+#include <Compression.hpp>
+#include <SensorDictionary.hpp>
+#include <NonceIndex.hpp>
+#include <ThreadPool.hpp>
 
 namespace iotbc {
+    /// @brief Consensus rules of a chain, nodes sharing a chain must agree on them
+    struct ChainParams {
+        /// Minimum number of leading zero bits of a block hash
+        uint32_t minDifficulty = 0;
+        /// Maximum number of leading zero bits retargeting can require
+        uint32_t maxDifficulty = 64;
+        /// Difficulty required until enough timestamped blocks are known to retarget
+        uint32_t initialDifficulty = 0;
+        /// Interval between blocks retargeting aims for, zero disables retargeting
+        std::chrono::milliseconds targetBlockInterval{0};
+        /// Number of most recent blocks whose timestamps and difficulties are used to retarget
+        size_t retargetWindow = 16;
+        /// Maximum change of the required difficulty from one block to the next, in bits
+        uint32_t maxRetargetStep = 2;
+        /// How far in the future a block timestamp can be compared to the local clock
+        std::chrono::milliseconds maxFutureBlockTime = std::chrono::minutes(2);
+    };
+
+    /// @brief Retention of block bodies by pruneBlocks, every header is always kept
+    struct PruneOptions {
+        /// Number of most recent blocks keeping their body, 0 for no limit
+        size_t keepBlocks = 0;
+        /// Serialized size of the most recent bodies kept, 0 for no limit
+        size_t keepBytes = 0;
+        /// Folder the files of pruned blocks are moved to, they are deleted if empty
+        std::string archiveFolder;
+    };
+
+    /// @brief Handling of blocks not extending the tip, see Blockchain::submitBlock
+    struct ForkOptions {
+        /// Maximum number of blocks a reorganization can disconnect
+        size_t maxReorgDepth = 100;
+        /// Maximum number of blocks waiting for their parent, the oldest ones are dropped first
+        size_t maxOrphans = 64;
+        /// Maximum number of blocks kept outside the active chain, the oldest ones are dropped first
+        size_t maxSideBlocks = 1024;
+    };
+
+    /// @brief Where Blockchain::submitBlock added a block
+    enum class BlockStatus {
+        /// The block extended the active chain
+        Connected,
+        /// The block extended a branch with less cumulative work than the active chain
+        SideBranch,
+        /// The block made its branch the active chain
+        Reorganized,
+        /// The parent of the block is unknown, the block waits for it
+        Orphan,
+        /// The block was already known
+        Duplicate,
+    };
+
+    /// @brief Settings of loadExistingBlocks
+    struct LoadOptions {
+        /// Number of threads reading, decoding and verifying blocks
+        size_t threads = std::thread::hardware_concurrency();
+        /// Verify the loaded chain as verifyExistingChain does, before replaying it
+        bool verify = false;
+        /// Trust the checkpoint saved with the chain: the blocks up to it are not verified,
+        /// and the indices are restored from its snapshot instead of being rebuilt
+        bool useCheckpoint = true;
+        /// Keys whose signed checkpoints are trusted, checkpoints signed by any other key are not
+        std::vector<Address> checkpointSigners;
+        /// Trust an unsigned checkpoint, only for stores the node wrote itself with saveCheckpoint
+        bool trustUnsignedCheckpoint = false;
+        /// Verify the blocks up to the checkpoint on a background thread, see LoadStats::audit
+        bool auditCheckpoint = false;
+    };
+
+    /// @brief Wall-clock time spent in each phase of loadExistingBlocks
+    struct LoadStats {
+        /// Number of block files found
+        size_t files = 0;
+        /// Number of blocks linked into the chain
+        size_t blocks = 0;
+        /// Reading the block files
+        std::chrono::duration<double> io{0};
+        /// Decompressing, deserializing and hashing the blocks
+        std::chrono::duration<double> decode{0};
+        /// Ordering the blocks from the genesis block and moving them into the chain
+        std::chrono::duration<double> link{0};
+        /// Verifying the chain, zero unless LoadOptions::verify is set
+        std::chrono::duration<double> verify{0};
+        /// Rebuilding the indices and running the layers over the chain
+        std::chrono::duration<double> replay{0};
+        /// Height of the checkpoint the loading started from, if a trusted one matched the chain
+        std::optional<uint64_t> checkpointHeight;
+        /// Background verification of the blocks up to the checkpoint, only valid if LoadOptions::auditCheckpoint
+        /// is set and a checkpoint was used. Throws what verifyExistingChain throws if they are invalid
+        std::shared_future<void> audit;
+    };
+
     class Blockchain {
     public:
         std::vector<Block> chain;
         std::vector<std::shared_ptr<ILayer>> layers;
+        /// Sensor ids registered on the chain, updated before layers process a block
+        SensorDictionary sensorDictionary;
+        /// Next expected nonce of every sender, updated when a block is added
+        NonceIndex nonceIndex;
+        /// Compression applied to block files written by saveBlocks, loading handles any codec
+        CompressionOptions compression;
+        /// Bodies kept by pruneBlocks, every body is kept by default
+        PruneOptions pruning;
+        /// Limits of the side branches and orphans kept by submitBlock
+        ForkOptions forks;
+        ChainParams params;
+        /// Engine producing and checking the consensus proof of blocks, proof of work by default
+        std::shared_ptr<IConsensus> consensus;
 
         Blockchain();
+        explicit Blockchain(const ChainParams &params);
 
         /// @brief Loads existing blocks from a folder
         /// @param folderPath
+        /// @param options The number of threads to use, and whether to verify the chain
+        /// @return The time spent in each phase of the loading
         /// @throws iotbc::IoError if there is an issue reading the folder
-        /// @throws iotbc::InvalidBlockchainSave if the blockchain is invalid
-        void loadExistingBlocks(const std::string &folderPath);
+        /// @throws iotbc::InvalidBlockchainSave if the blockchain is invalid, the chain is then left empty
+        /// @note Files are read, decoded and verified across a thread pool, then linked
+        /// by their hashes and replayed in chain order
+        LoadStats loadExistingBlocks(const std::string &folderPath, const LoadOptions &options = LoadOptions());
 
-        /// @brief Verifies the existing chain has valid blocks connected together
-        /// and each block has properly signed transactions
+        /// @brief Verifies the existing chain has valid blocks connected together, at their height, with a valid
+        /// consensus proof and merkle root, non decreasing timestamps, each block has properly signed
+        /// transactions and senders use consecutive nonces
         /// @throws iotbc::InvalidBlockchainSave if the chain is invalid
-        /// @note This function does not verify the genesis block. Nodes should agree on it before hand
+        /// @note This function does not verify the genesis block. Nodes should agree on it before hand.
+        /// It is a full audit of the chain, use verifyNewBlocks to only verify the blocks not verified yet
         void verifyExistingChain() const;
 
-        /// @brief Saves the blockchain to a folder
+        /// @brief Verifies the blocks after the verified height, as verifyExistingChain does, and advances it
+        /// @throws iotbc::InvalidBlockchainSave if the new blocks are invalid, the verified height does not change
+        /// @note Blocks added with addBlock and blocks verified when loading are already verified. If the
+        /// verified blocks were replaced in the chain, the whole chain is verified again
+        void verifyNewBlocks();
+
+        /// @brief Get the height up to which the chain was verified
+        /// @return The height of the last verified block, or nullopt if no block was verified
+        inline std::optional<size_t> verifiedHeight() const
+        {
+            if (verifiedBlocks == 0) {
+                return std::nullopt;
+            }
+
+            return verifiedBlocks - 1;
+        }
+
+        /// @brief Create a checkpoint of the last block of the chain
+        /// @return The checkpoint, holding a snapshot of the chain indices
+        /// @throws iotbc::InvalidBlock if the chain is empty
+        Checkpoint makeCheckpoint() const;
+
+        /// @brief Save an unsigned checkpoint of the last block next to the chain
+        /// @note It is only trusted by loads setting LoadOptions::trustUnsignedCheckpoint
+        /// @param folderPath The folder the blockchain is saved to
+        /// @throws iotbc::IoError if there is an issue writing the folder
+        void saveCheckpoint(const std::string &folderPath) const;
+
+        /// @brief Save a signed checkpoint of the last block next to the chain
+        /// @param folderPath The folder the blockchain is saved to
+        /// @param signer The key vouching for the checkpoint
+        /// @throws iotbc::IoError if there is an issue writing the folder
+        void saveCheckpoint(const std::string &folderPath, const Signer &signer) const;
+
+        /// @brief Verify the first blocks of the chain on a background thread
+        /// @param end The number of blocks to verify
+        /// @return A future throwing what verifyExistingChain throws if the blocks are invalid
+        /// @note The blocks are copied, so the chain can keep growing during the verification.
+        /// The verification runs on a detached thread, dropping the future does not wait for it
+        std::shared_future<void> auditAsync(size_t end) const;
+
+        /// @brief Saves the blockchain and its nonce index to a folder
         /// @param folderPath The folder to save the blockchain to
         /// @throws iotbc::IoError if there is an issue writing the folder
+        /// @note Pruned blocks are saved as headers, along with the indices at the first retained body.
+        /// pruneBlocks keeps them up to date, saveBlocks only writes them to a folder missing them
         void saveBlocks(const std::string &folderPath) const;
 
+        /// @brief Drop the bodies of the blocks older than the pruning window, their headers are kept
+        /// @param folderPath The folder the blockchain is saved to, the files of the pruned blocks are removed
+        /// from it or moved to PruneOptions::archiveFolder
+        /// @return The number of pruned bodies
+        /// @throws iotbc::IoError if there is an issue writing the folders
+        /// @note Only verified bodies are pruned, and never from the lowest height pinned by a layer.
+        /// The tip always keeps its body
+        size_t pruneBlocks(const std::string &folderPath);
+
+        /// @brief Get the number of blocks at the start of the chain whose body was pruned
+        /// @return The height of the first block with a body
+        inline size_t prunedHeight() const
+        {
+            return prunedBlocks;
+        }
+
+        /// @brief Checks if a block of the chain still has its body
+        /// @param height The index of the block in the chain
+        /// @return True if the block has its transactions, false if it was pruned or is not in the chain
+        inline bool hasBody(size_t height) const
+        {
+            return height >= prunedBlocks && height < chain.size();
+        }
+
         /// @brief Checks if the chain is empty
         /// @return True if the chain is empty, false otherwise
         inline bool empty() const
@@ -45,8 +236,74 @@ namespace iotbc {
 
         /// @brief Add a new block to the chain
         /// @param block The block to add
-        /// @throws iotbc::InvalidBlock if the block is invalid
-        void addBlock(const Block &block);
+        /// @param transactionsVerified Skip the signatures, already checked with Block::verifyTransactions
+        /// @throws iotbc::InvalidBlock if the block is invalid, if its height is not its index in the chain,
+        /// if its timestamp is before its parent's or too far in the future, or if a transaction
+        /// does not use the next nonce of its sender
+        /// @note Header checks (linkage, height, timestamp, consensus proof, merkle root) and nonces
+        /// are checked before any signature gets verified
+        void addBlock(const Block &block, bool transactionsVerified = false);
+
+        /// @brief Add a block received from another node, wherever it connects to the block tree
+        /// @param block The block to add
+        /// @param transactionsVerified Skip the signatures if the block extends the tip, see addBlock
+        /// @return Where the block was added
+        /// @throws iotbc::InvalidBlock if the block is invalid, or if its branch has more work than the
+        /// active chain but forks below the pruned blocks or deeper than ForkOptions::maxReorgDepth
+        /// @note Blocks not extending the tip are kept as side branches, and become the active chain once
+        /// their branch has more cumulative work, layers being notified of the disconnected and connected
+        /// blocks. Side blocks are only fully checked when connected. Orphans are added once their parent is
+        BlockStatus submitBlock(const Block &block, bool transactionsVerified = false);
+
+        /// @brief Get the number of known blocks outside the active chain
+        /// @return The number of side blocks
+        inline size_t sideBlockCount() const
+        {
+            return sideBlocks.size();
+        }
+
+        /// @brief Get the number of blocks waiting for their parent
+        /// @return The number of orphans
+        inline size_t orphanCount() const
+        {
+            return orphans.size();
+        }
+
+        /// @brief Finalize a block template with the consensus engine, so it can be added to the chain
+        /// @param block The block to finalize, mined at the required difficulty or sealed
+        void sealBlock(Block &block) const;
+
+        /// @brief Get the difficulty the next block must at least have
+        /// @return The minimum number of leading zero bits of the next block hash
+        uint32_t requiredDifficulty() const;
+
+        /// @brief Get the difficulty a block must at least have at a given height
+        /// @param height The index of the block in the chain, at most the size of the chain
+        /// @return The minimum number of leading zero bits of the block hash
+        /// @note When retargeting is enabled, the difficulty is estimated from the timestamps and the work
+        /// of the retargetWindow previous blocks so blocks come every targetBlockInterval on average
+        uint32_t difficultyAt(size_t height) const;
+
+        /// @brief Find the first block created at or after a given time
+        /// @param timestamp The time in milliseconds since the Unix epoch
+        /// @return The height of the block, or the size of the chain if every block is older
+        /// @note Timestamps never decrease along the chain, so this is a binary search over the headers.
+        /// Headers older than BLOCK_VERSION_TIMESTAMP count as created at time 0
+        size_t findFirstBlockAtOrAfter(uint64_t timestamp) const;
+
+        /// @brief Get the blocks created in a time range
+        /// @param from The start of the range, included, in milliseconds since the Unix epoch
+        /// @param to The end of the range, excluded, in milliseconds since the Unix epoch
+        /// @return The blocks of the range, in chain order, valid until the chain changes
+        std::span<const Block> blocksBetween(uint64_t from, uint64_t to) const;
+
+        /// @brief Get the nonce the next transaction of a sender must use
+        /// @param sender The address of the sender
+        /// @return The next expected nonce
+        inline Nonce nextNonce(const Address &sender) const
+        {
+            return nonceIndex.next(sender);
+        }
 
         /// @brief Adds a new layer to the blockchain
         /// @param layer The layer to add
@@ -54,5 +311,99 @@ namespace iotbc {
         {
             layers.emplace_back(layer);
         }
+
+    private:
+        /// @brief Same as verifyExistingChain, the signatures being verified on a thread pool if given
+        /// @param pool The thread pool verifying the signatures, can be null
+        /// @param from The first block to verify, the blocks before it are trusted
+        /// @param nonces The nonce index after the trusted blocks
+        /// @return The nonce index after the last block
+        /// @note Header and nonce checks run over the verified blocks before any signature gets verified
+        NonceIndex verifyChain(ThreadPool *pool, size_t from, NonceIndex nonces) const;
+
+        /// @brief Move the verified height to the tip of the chain
+        /// @param nonces The nonce index after the last block, replacing nonceIndex
+        void markVerified(NonceIndex nonces);
+
+        /// @brief Remember the nonces at the verified height of the senders of a block applied after it
+        /// @param block The block about to be applied
+        /// @param nonces The nonce index before the block
+        void keepVerifiedNonces(const Block &block, const NonceIndex &nonces);
+
+        /// @brief Empty the chain and its pruned state once a load failed, not to keep blocks that were never verified
+        void discardLoadedBlocks();
+
+        /// Number of blocks at the start of the chain that were verified
+        size_t verifiedBlocks = 0;
+        /// Hash of the last verified block, to detect verified blocks being replaced
+        Hash verifiedTip = NULL_HASH;
+        /// Next expected nonce after the verified blocks of the senders of the blocks after them,
+        /// every other sender has the same one in nonceIndex
+        std::unordered_map<Address, Nonce, AddressHash> verifiedDelta;
+
+        /// @brief Serialize the pruned headers, as stored in the headers file
+        /// @param from The first header to serialize, the file header is only written from 0
+        std::vector<unsigned char> serializePrunedHeaders(size_t from) const;
+
+        /// @brief Serialize the indices after the last pruned header
+        std::vector<unsigned char> serializePrunedSnapshot() const;
+
+        /// Number of blocks at the start of the chain whose body was pruned
+        size_t prunedBlocks = 0;
+        /// Size of the headers file up to the last pruned header, an interrupted pruning may have left more
+        size_t prunedHeadersSize = 0;
+        /// Next expected nonce of every sender after the pruned blocks
+        NonceIndex prunedNonces;
+        /// Sensor ids registered by the pruned blocks
+        SensorDictionary prunedDictionary;
+
+        /// @brief Data needed to disconnect a block of the active chain
+        struct BlockUndo {
+            Hash hash;
+            /// Size of the sensor dictionary before the block
+            size_t dictionarySize;
+        };
+
+        /// @brief Store a block whose parent is known but is not the tip, and reorganize if its branch wins
+        /// @return SideBranch or Reorganized
+        BlockStatus addSideBlock(const Block &block, const Hash &hash);
+
+        /// @brief Make a side branch the active chain
+        /// @param branch The hashes of the side blocks, from the fork point to the new tip
+        /// @param forkHeight The height of the last block shared by both branches
+        /// @throws iotbc::InvalidBlock if a block of the branch is invalid, the active chain is then restored
+        void reorganize(const std::vector<Hash> &branch, size_t forkHeight);
+
+        /// @brief Remove the tip of the active chain, undoing its effects on the indices and the layers
+        /// @return The removed block
+        Block disconnectTip();
+
+        /// @brief Submit the orphans waiting for a block
+        void connectOrphans(const Hash &parent);
+
+        /// @brief Keep a block until its parent arrives, dropping the oldest orphan if there are too many
+        void addOrphan(const Block &block, const Hash &hash);
+
+        /// @brief Drop the side blocks too deep to ever be reorganized to, then the oldest ones if there are too many
+        void trimSideBlocks();
+
+        /// @brief Checks if a block is part of the active chain
+        inline bool isOnActiveChain(const Hash &hash, uint64_t height) const
+        {
+            return height < chain.size() && chain[height].blockHash() == hash;
+        }
+
+        /// Undo data of the most recent blocks of the active chain, up to ForkOptions::maxReorgDepth
+        std::deque<BlockUndo> undo;
+        /// Known blocks outside the active chain, linked to it through their parents
+        std::unordered_map<Hash, Block, ArrayHash> sideBlocks;
+        /// Hashes of the side blocks, oldest first
+        std::deque<Hash> sideOrder;
+        /// Blocks whose parent is unknown
+        std::unordered_map<Hash, Block, ArrayHash> orphans;
+        /// Hashes of the orphans waiting for each parent
+        std::unordered_multimap<Hash, Hash, ArrayHash> orphansByParent;
+        /// Hashes of the orphans, oldest first
+        std::deque<Hash> orphanOrder;
     };
 }
\ No newline at end of file
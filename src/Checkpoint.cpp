@@ -0,0 +1,145 @@
+#include <Checkpoint.hpp>
+#include <Exceptions.hpp>
+#include <Wire.hpp>
+
+namespace iotbc {
+    std::vector<unsigned char> Checkpoint::serializeSigned() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(WIRE_HEADER_SIZE + 16 + sizeof(Hash) + nonceIndex.size() + sensorDictionary.size() + 1 + sizeof(PublicKey));
+
+        writeWireHeader(buf, WireFormat::V2);
+        writeVarint(buf, height);
+        buf.insert(buf.end(), blockHash.begin(), blockHash.end());
+
+        writeVarint(buf, nonceIndex.size());
+        buf.insert(buf.end(), nonceIndex.begin(), nonceIndex.end());
+
+        writeVarint(buf, sensorDictionary.size());
+        buf.insert(buf.end(), sensorDictionary.begin(), sensorDictionary.end());
+
+        buf.push_back(signer.has_value() ? 1 : 0);
+        if (signer.has_value()) {
+            buf.insert(buf.end(), signer->begin(), signer->end());
+        }
+
+        return buf;
+    }
+
+    Hash Checkpoint::checkpointHash() const {
+        std::vector<unsigned char> data = serializeSigned();
+
+        Hash result;
+        unsigned int result_len = sizeof(Hash);
+
+        if (EVP_Digest(data.data(), data.size(), result.data(), &result_len, EVP_sha256(), nullptr) != 1) {
+            throw EvpError("Failed to compute digest");
+        }
+
+        return result;
+    }
+
+    void Checkpoint::sign(const Signer &signer) {
+        this->signer = signer.public_key;
+        signature = signer.sign(checkpointHash());
+    }
+
+    bool Checkpoint::hasValidSignature() const {
+        if (!signer.has_value()) {
+            return false;
+        }
+
+        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+
+        if (ctx == nullptr) {
+            throw Secp256k1Error("Failed to create secp256k1 context");
+        }
+
+        bool valid = true;
+
+        try {
+            verifyHashSignature(ctx, checkpointHash(), signer.value(), signature);
+        } catch (const InvalidSignature &e) {
+            valid = false;
+        } catch (const Secp256k1Error &e) {
+            valid = false;
+        }
+
+        secp256k1_context_destroy(ctx);
+
+        return valid;
+    }
+
+    std::vector<unsigned char> Checkpoint::serialize() const {
+        std::vector<unsigned char> buf = serializeSigned();
+
+        if (signer.has_value()) {
+            buf.insert(buf.end(), signature.begin(), signature.end());
+        }
+
+        return buf;
+    }
+
+    /// @brief Read a varint-prefixed byte string
+    static std::vector<unsigned char> readBytes(const std::vector<unsigned char> &data, size_t &cur) {
+        uint64_t length = readVarint(data.data(), data.size(), cur);
+
+        if (length > data.size() - cur) {
+            throw DeserializationError("Overflow");
+        }
+
+        std::vector<unsigned char> bytes(data.begin() + cur, data.begin() + cur + length);
+        cur += length;
+
+        return bytes;
+    }
+
+    Checkpoint Checkpoint::deserialize(const std::vector<unsigned char> &data) {
+        if (!readWireHeader(data.data(), data.size()).has_value()) {
+            throw DeserializationError("Missing wire format header");
+        }
+
+        size_t cur = WIRE_HEADER_SIZE;
+        Checkpoint checkpoint;
+
+        checkpoint.height = readVarint(data.data(), data.size(), cur);
+
+        if (sizeof(Hash) > data.size() - cur) {
+            throw DeserializationError("Overflow");
+        }
+        std::copy(data.begin() + cur, data.begin() + cur + sizeof(Hash), checkpoint.blockHash.begin());
+        cur += sizeof(Hash);
+
+        checkpoint.nonceIndex = readBytes(data, cur);
+        checkpoint.sensorDictionary = readBytes(data, cur);
+
+        if (cur >= data.size()) {
+            throw DeserializationError("Overflow");
+        }
+
+        unsigned char signedFlag = data[cur++];
+
+        if (signedFlag > 1) {
+            throw DeserializationError("Invalid signer flag");
+        }
+
+        if (signedFlag == 1) {
+            if (sizeof(PublicKey) + sizeof(Signature) > data.size() - cur) {
+                throw DeserializationError("Overflow");
+            }
+
+            PublicKey signer;
+            std::copy(data.begin() + cur, data.begin() + cur + signer.size(), signer.begin());
+            cur += signer.size();
+            checkpoint.signer = signer;
+
+            std::copy(data.begin() + cur, data.begin() + cur + checkpoint.signature.size(), checkpoint.signature.begin());
+            cur += checkpoint.signature.size();
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return checkpoint;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Trusted point of a chain, the blocks up to it are not verified again when loading the chain
+    /// @note A checkpoint holds a snapshot of the chain indices, so they do not have to be rebuilt
+    /// from the blocks before it. It is either trusted because the node wrote it itself,
+    /// or because it is signed by a key the node trusts
+    struct Checkpoint {
+        /// Height of the checkpointed block
+        uint64_t height = 0;
+        /// Hash of the checkpointed block
+        Hash blockHash = {};
+        /// Serialized nonce index, after the checkpointed block
+        std::vector<unsigned char> nonceIndex;
+        /// Serialized sensor dictionary, after the checkpointed block
+        std::vector<unsigned char> sensorDictionary;
+        /// Public key of the signer, unset for locally trusted checkpoints
+        std::optional<PublicKey> signer;
+        /// Signature of the signer over checkpointHash
+        Signature signature = {};
+
+        /// @brief Get the hash signed by the signer
+        /// @return The hash of every field but the signature
+        Hash checkpointHash() const;
+
+        /// @brief Sign the checkpoint
+        /// @param signer The signer vouching for the checkpoint
+        /// @throws Secp256k1Error if an error occurs during the signing
+        void sign(const Signer &signer);
+
+        /// @brief Checks if the checkpoint is signed, and if the signature is valid
+        /// @return True if the checkpoint is signed by its signer
+        bool hasValidSignature() const;
+
+        /// @brief Serialize the checkpoint
+        /// @return The serialized checkpoint
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a checkpoint from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized checkpoint
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Checkpoint deserialize(const std::vector<unsigned char> &data);
+
+    private:
+        /// @brief Serialize every field but the signature
+        std::vector<unsigned char> serializeSigned() const;
+    };
+}
@@ -0,0 +1,257 @@
+#include <CompactBlock.hpp>
+#include <Exceptions.hpp>
+#include <Varint.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace iotbc {
+    CompactBlock CompactBlock::fromBlock(const Block &block, uint64_t salt, const std::vector<size_t> &prefill) {
+        CompactBlock compact;
+        compact.header = block;
+        compact.header.transactions.clear();
+        compact.salt = salt;
+
+        SipKey key = compact.shortIdKey();
+        size_t next = 0;
+
+        for (size_t i = 0; i < block.transactions.size(); i++) {
+            if (next < prefill.size() && prefill[next] == i) {
+                compact.prefilled.push_back({i, block.transactions[i]});
+                next++;
+            } else {
+                compact.shortIds.push_back(shortId(key, block.transactions[i]));
+            }
+        }
+
+        if (next != prefill.size()) {
+            throw InvalidTransaction("Prefilled transaction indices are out of range or not increasing");
+        }
+
+        return compact;
+    }
+
+    SipKey CompactBlock::shortIdKey() const {
+        Hash blockHash = header.blockHash();
+
+        unsigned char data[sizeof(Hash) + sizeof(salt)];
+        std::copy(blockHash.begin(), blockHash.end(), data);
+        for (size_t i = 0; i < sizeof(salt); i++) {
+            data[sizeof(Hash) + i] = static_cast<unsigned char>(salt >> (8 * i));
+        }
+
+        Hash digest;
+        unsigned int digestLength = sizeof(Hash);
+
+        if (EVP_Digest(data, sizeof(data), digest.data(), &digestLength, EVP_sha256(), nullptr) != 1) {
+            throw EvpError("Failed to compute digest");
+        }
+
+        return {readLe64(digest.data()), readLe64(digest.data() + 8)};
+    }
+
+    ShortTxId CompactBlock::shortId(const SipKey &key, const Transaction &tx) {
+        Hash id = tx.id();
+
+        return sipHash24(key, id.data(), id.size()) & ((1ULL << (8 * SHORT_TX_ID_SIZE)) - 1);
+    }
+
+    std::vector<unsigned char> CompactBlock::serialize() const {
+        std::vector<unsigned char> buf;
+
+        size_t prefilledSize = 0;
+        for (const auto &entry : prefilled) {
+            prefilledSize += varintSize(entry.index) + entry.tx.size(WireFormat::V2);
+        }
+        buf.reserve(160 + shortIds.size() * SHORT_TX_ID_SIZE + prefilledSize);
+
+        header.serializeHeaderInto(buf);
+
+        for (size_t i = 0; i < sizeof(salt); i++) {
+            buf.push_back(static_cast<unsigned char>(salt >> (8 * i)));
+        }
+
+        writeVarint(buf, shortIds.size());
+        for (ShortTxId id : shortIds) {
+            for (size_t i = 0; i < SHORT_TX_ID_SIZE; i++) {
+                buf.push_back(static_cast<unsigned char>(id >> (8 * i)));
+            }
+        }
+
+        // Indices are written as the gap from the previous prefilled index
+        writeVarint(buf, prefilled.size());
+        size_t expected = 0;
+        for (const auto &entry : prefilled) {
+            writeVarint(buf, entry.index - expected);
+            entry.tx.serializeInto(buf, WireFormat::V2);
+            expected = entry.index + 1;
+        }
+
+        return buf;
+    }
+
+    CompactBlock CompactBlock::deserialize(std::span<const unsigned char> data) {
+        CompactBlock compact;
+        size_t cur = 0;
+
+        compact.header = Block::deserializeHeaderFrom(data.data(), data.size(), cur);
+
+        if (sizeof(compact.salt) > data.size() - cur) {
+            throw DeserializationError("Overflow");
+        }
+        for (size_t i = 0; i < sizeof(compact.salt); i++) {
+            compact.salt |= static_cast<uint64_t>(data[cur++]) << (8 * i);
+        }
+
+        uint64_t shortIdCount = readVarint(data.data(), data.size(), cur);
+        if (shortIdCount > (data.size() - cur) / SHORT_TX_ID_SIZE) {
+            throw DeserializationError("Overflow");
+        }
+
+        compact.shortIds.reserve(shortIdCount);
+        for (uint64_t i = 0; i < shortIdCount; i++) {
+            ShortTxId id = 0;
+            for (size_t j = 0; j < SHORT_TX_ID_SIZE; j++) {
+                id |= static_cast<ShortTxId>(data[cur++]) << (8 * j);
+            }
+            compact.shortIds.push_back(id);
+        }
+
+        uint64_t prefilledCount = readVarint(data.data(), data.size(), cur);
+        if (prefilledCount > data.size() - cur) {
+            throw DeserializationError("Overflow");
+        }
+
+        uint64_t expected = 0;
+        for (uint64_t i = 0; i < prefilledCount; i++) {
+            uint64_t index = expected + readVarint(data.data(), data.size(), cur);
+
+            if (index < expected || index >= shortIdCount + prefilledCount) {
+                throw DeserializationError("Prefilled transaction index is out of range");
+            }
+
+            compact.prefilled.push_back({index, Transaction::deserializeFrom(data.data(), data.size(), cur, WireFormat::V2)});
+            expected = index + 1;
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return compact;
+    }
+
+    BlockReconstruction::BlockReconstruction(const CompactBlock &compact)
+        : blockHeader(compact.header), key(compact.shortIdKey()), txs(compact.transactionCount()), shortIds(compact.transactionCount()) {
+        for (const auto &entry : compact.prefilled) {
+            txs[entry.index] = entry.tx;
+        }
+
+        size_t next = 0;
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (!txs[i].has_value()) {
+                shortIds[i] = compact.shortIds[next++];
+            }
+        }
+    }
+
+    size_t BlockReconstruction::fill(const Mempool &mempool) {
+        std::unordered_map<ShortTxId, size_t> slots;
+        std::unordered_set<ShortTxId> ambiguous;
+
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (txs[i].has_value()) {
+                continue;
+            }
+
+            if (!slots.emplace(shortIds[i].value(), i).second) {
+                ambiguous.insert(shortIds[i].value());
+            }
+        }
+
+        std::unordered_map<ShortTxId, const Transaction *> found;
+
+        mempool.forEach([&](const Transaction &tx) {
+            ShortTxId id = CompactBlock::shortId(key, tx);
+
+            if (!slots.contains(id) || ambiguous.contains(id)) {
+                return;
+            }
+
+            // Two transactions of the mempool match the same short id, the peer sends the right one
+            if (!found.emplace(id, &tx).second) {
+                ambiguous.insert(id);
+                found.erase(id);
+                return;
+            }
+
+            txs[slots[id]] = tx;
+        });
+
+        size_t filled = 0;
+        for (const auto &[id, index] : slots) {
+            if (ambiguous.contains(id)) {
+                txs[index].reset();
+            } else if (txs[index].has_value()) {
+                filled++;
+            }
+        }
+
+        return filled;
+    }
+
+    std::vector<size_t> BlockReconstruction::missing() const {
+        std::vector<size_t> indices;
+
+        for (size_t i = 0; i < txs.size(); i++) {
+            if (!txs[i].has_value()) {
+                indices.push_back(i);
+            }
+        }
+
+        return indices;
+    }
+
+    void BlockReconstruction::fillMissing(const std::vector<Transaction> &missingTxs) {
+        std::vector<size_t> indices = missing();
+
+        if (indices.size() != missingTxs.size()) {
+            throw InvalidBlock("Wrong number of missing transactions");
+        }
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (CompactBlock::shortId(key, missingTxs[i]) != shortIds[indices[i]]) {
+                throw InvalidBlock("Transaction does not match its short id");
+            }
+        }
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            txs[indices[i]] = missingTxs[i];
+        }
+    }
+
+    bool BlockReconstruction::complete() const {
+        return std::all_of(txs.begin(), txs.end(), [](const auto &tx) { return tx.has_value(); });
+    }
+
+    Block BlockReconstruction::takeBlock() {
+        if (!complete()) {
+            throw InvalidBlock("Block is missing transactions");
+        }
+
+        Block block = blockHeader;
+        block.transactions.reserve(txs.size());
+
+        for (auto &tx : txs) {
+            block.transactions.push_back(std::move(*tx));
+        }
+        txs.clear();
+
+        if (!block.hasValidMerkleRoot()) {
+            throw InvalidBlock("Rebuilt block does not match its merkle root");
+        }
+
+        return block;
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <Block.hpp>
+#include <Mempool.hpp>
+#include <SipHash.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// Number of bytes of a short transaction id
+    static constexpr size_t SHORT_TX_ID_SIZE = 6;
+
+    /// @brief Transaction id truncated to SHORT_TX_ID_SIZE bytes, only meaningful within its compact block
+    using ShortTxId = uint64_t;
+
+    /// @brief Transaction sent in full within a compact block
+    struct PrefilledTransaction {
+        /// Index of the transaction in the block
+        size_t index;
+        Transaction tx;
+    };
+
+    /// @brief Block relayed as its header and short ids of its transactions
+    /// @note Peers sharing a mempool already hold most transactions of a new block, so they rebuild it
+    /// with BlockReconstruction and only fetch the transactions they miss. Short ids are keyed by
+    /// the block hash and a random salt, so colliding transactions cannot be crafted in advance
+    struct CompactBlock {
+        /// The block without its transactions
+        Block header = Block(NULL_HASH);
+        /// Random value mixed into the short id key
+        uint64_t salt = 0;
+        /// Short ids of the transactions not prefilled, in block order
+        std::vector<ShortTxId> shortIds;
+        /// Transactions sent in full, by increasing index
+        std::vector<PrefilledTransaction> prefilled;
+
+        /// @brief Build the compact block of a block
+        /// @param block The block to relay
+        /// @param salt A random value, picked for every relayed block
+        /// @param prefill The indices of the transactions to send in full, in increasing order
+        /// @return The compact block
+        /// @throws iotbc::InvalidTransaction if an index is out of range or not increasing
+        static CompactBlock fromBlock(const Block &block, uint64_t salt, const std::vector<size_t> &prefill = {});
+
+        /// @brief Get the key of the short ids of the block
+        /// @return The first 128 bits of the SHA-256 of the block hash and the salt
+        SipKey shortIdKey() const;
+
+        /// @brief Get the short id of a transaction
+        /// @param key The key returned by shortIdKey
+        /// @param tx The transaction
+        /// @return The SipHash of the transaction id, truncated to SHORT_TX_ID_SIZE bytes
+        static ShortTxId shortId(const SipKey &key, const Transaction &tx);
+
+        /// @brief Get the number of transactions of the block
+        /// @return The number of short ids and prefilled transactions
+        inline size_t transactionCount() const
+        {
+            return shortIds.size() + prefilled.size();
+        }
+
+        /// @brief Serialize the compact block
+        /// @return The serialized compact block
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a compact block from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized compact block
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static CompactBlock deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Block being rebuilt out of a compact block
+    class BlockReconstruction {
+    public:
+        /// @brief Start rebuilding a block, with its prefilled transactions
+        /// @param compact The compact block
+        explicit BlockReconstruction(const CompactBlock &compact);
+
+        /// @brief Fill the missing transactions out of the transactions held by a mempool
+        /// @param mempool The mempool
+        /// @return The number of transactions found
+        /// @note Short ids matched by several transactions are left missing, the peer sends them
+        size_t fill(const Mempool &mempool);
+
+        /// @brief Get the transactions still missing
+        /// @return Their indices in the block, in increasing order
+        std::vector<size_t> missing() const;
+
+        /// @brief Fill the transactions sent by the peer
+        /// @param txs The transactions, in the order missing returned their indices
+        /// @throws iotbc::InvalidBlock if the count or a short id does not match
+        void fillMissing(const std::vector<Transaction> &txs);
+
+        /// @brief Checks if every transaction is known
+        /// @return True if the block can be taken
+        bool complete() const;
+
+        /// @brief Get the header of the block being rebuilt
+        /// @return The block without its transactions
+        inline const Block &header() const
+        {
+            return blockHeader;
+        }
+
+        /// @brief Take the rebuilt block, can only be called once
+        /// @return The block, its transactions being checked against the merkle root
+        /// @throws iotbc::InvalidBlock if a transaction is missing, or if the merkle root does not match,
+        /// which happens on a short id collision: the full block should then be fetched
+        Block takeBlock();
+
+    private:
+        Block blockHeader;
+        SipKey key;
+        std::vector<std::optional<Transaction>> txs;
+        /// Short id of every transaction not prefilled, by index
+        std::vector<std::optional<ShortTxId>> shortIds;
+    };
+}
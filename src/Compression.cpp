@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <Compression.hpp>
+#include <Wire.hpp>
+
+namespace iotbc {
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr size_t MAX_OFFSET = 0xFFFF;
+    static constexpr size_t WINDOW_MASK = 0xFFFF;
+    static constexpr unsigned HASH_BITS = 15;
+
+    /// Most bytes a byte of compressed data expands to, through a match length byte of 255
+    static constexpr size_t MAX_EXPANSION = 255;
+
+    static inline uint32_t hash4(const unsigned char *p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void writeLength(std::vector<unsigned char> &out, size_t length) {
+        while (length >= 255) {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back(static_cast<unsigned char>(length));
+    }
+
+    static size_t readLength(const unsigned char *data, size_t size, size_t &cur) {
+        size_t length = 0;
+        unsigned char byte;
+
+        do {
+            if (cur >= size) {
+                throw DeserializationError("Truncated compressed length");
+            }
+            byte = data[cur++];
+            length += byte;
+        } while (byte == 255);
+
+        return length;
+    }
+
+    /// Sequence layout: token (literal length << 4 | match length - 4), extra literal length,
+    /// literals, 2 bytes little-endian offset, extra match length. The last sequence has no match
+    static void writeSequence(std::vector<unsigned char> &out, const unsigned char *literals, size_t literalLength,
+        size_t offset, size_t matchLength) {
+        bool last = matchLength == 0;
+        size_t matchCode = last ? 0 : matchLength - MIN_MATCH;
+
+        out.push_back(static_cast<unsigned char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15)));
+
+        if (literalLength >= 15) {
+            writeLength(out, literalLength - 15);
+        }
+
+        out.insert(out.end(), literals, literals + literalLength);
+
+        if (last) {
+            return;
+        }
+
+        out.push_back(static_cast<unsigned char>(offset & 0xFF));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+
+        if (matchCode >= 15) {
+            writeLength(out, matchCode - 15);
+        }
+    }
+
+    std::vector<unsigned char> compressLz(const unsigned char *data, size_t size, int level) {
+        level = std::clamp(level, 1, 9);
+
+        // Level 1 only probes the last position with the same hash, higher levels walk hash chains
+        size_t maxAttempts = level == 1 ? 1 : size_t(1) << (level - 1);
+        bool chained = maxAttempts > 1;
+
+        std::vector<int64_t> head(size_t(1) << HASH_BITS, -1);
+        std::vector<int64_t> prev(chained ? WINDOW_MASK + 1 : 0, -1);
+
+        std::vector<unsigned char> out;
+        out.reserve(size / 2 + 16);
+
+        auto insert = [&](size_t pos) {
+            uint32_t h = hash4(data + pos);
+            if (chained) {
+                prev[pos & WINDOW_MASK] = head[h];
+            }
+            head[h] = static_cast<int64_t>(pos);
+        };
+
+        size_t anchor = 0;
+        size_t pos = 0;
+
+        while (pos + MIN_MATCH <= size) {
+            int64_t candidate = head[hash4(data + pos)];
+            insert(pos);
+
+            size_t bestLength = 0;
+            size_t bestOffset = 0;
+
+            for (size_t attempt = 0; attempt < maxAttempts && candidate >= 0; attempt++) {
+                size_t offset = pos - static_cast<size_t>(candidate);
+
+                if (offset == 0 || offset > MAX_OFFSET) {
+                    break;
+                }
+
+                const unsigned char *match = data + candidate;
+                size_t length = 0;
+                size_t maxLength = size - pos;
+
+                while (length < maxLength && match[length] == data[pos + length]) {
+                    length++;
+                }
+
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestOffset = offset;
+                }
+
+                if (!chained) {
+                    break;
+                }
+
+                int64_t next = prev[candidate & WINDOW_MASK];
+                if (next >= candidate) {
+                    break;
+                }
+                candidate = next;
+            }
+
+            if (bestLength < MIN_MATCH) {
+                pos++;
+                continue;
+            }
+
+            writeSequence(out, data + anchor, pos - anchor, bestOffset, bestLength);
+
+            size_t end = pos + bestLength;
+            if (chained) {
+                for (size_t p = pos + 1; p < end && p + MIN_MATCH <= size; p++) {
+                    insert(p);
+                }
+            }
+
+            pos = end;
+            anchor = pos;
+        }
+
+        writeSequence(out, data + anchor, size - anchor, 0, 0);
+
+        return out;
+    }
+
+    void decompressLz(const unsigned char *data, size_t size, std::vector<unsigned char> &out, size_t rawSize) {
+        // The size comes from the stored header, check it before allocating
+        if (rawSize / MAX_EXPANSION > size) {
+            throw DeserializationError("Decompressed size exceeds the compressed data");
+        }
+
+        out.resize(rawSize);
+
+        size_t cur = 0;
+        size_t written = 0;
+
+        while (cur < size) {
+            unsigned char token = data[cur++];
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15) {
+                literalLength += readLength(data, size, cur);
+            }
+
+            if (literalLength > size - cur || literalLength > rawSize - written) {
+                throw DeserializationError("Compressed literals overflow");
+            }
+
+            std::memcpy(out.data() + written, data + cur, literalLength);
+            cur += literalLength;
+            written += literalLength;
+
+            if (cur == size) {
+                break;
+            }
+
+            if (size - cur < 2) {
+                throw DeserializationError("Truncated compressed offset");
+            }
+
+            size_t offset = data[cur] | (static_cast<size_t>(data[cur + 1]) << 8);
+            cur += 2;
+
+            if (offset == 0 || offset > written) {
+                throw DeserializationError("Invalid compressed offset");
+            }
+
+            size_t matchLength = token & 0x0F;
+            if (matchLength == 15) {
+                matchLength += readLength(data, size, cur);
+            }
+            matchLength += MIN_MATCH;
+
+            if (matchLength > rawSize - written) {
+                throw DeserializationError("Compressed match overflow");
+            }
+
+            // Matches may overlap the bytes they produce, so copy forward one byte at a time
+            unsigned char *dst = out.data() + written;
+            const unsigned char *src = dst - offset;
+            for (size_t i = 0; i < matchLength; i++) {
+                dst[i] = src[i];
+            }
+            written += matchLength;
+        }
+
+        if (written != rawSize) {
+            throw DeserializationError("Decompressed size mismatch");
+        }
+    }
+
+    std::vector<unsigned char> encodeStoredBlock(std::vector<unsigned char> &&serialized, const CompressionOptions &options) {
+        if (options.codec == Codec::None) {
+            return std::move(serialized);
+        }
+
+        std::vector<unsigned char> compressed = compressLz(serialized.data(), serialized.size(), options.level);
+
+        std::vector<unsigned char> buf;
+        buf.reserve(STORE_MAGIC.size() + 2 + varintSize(serialized.size()) + compressed.size());
+        buf.insert(buf.end(), STORE_MAGIC.begin(), STORE_MAGIC.end());
+        buf.push_back(static_cast<unsigned char>(options.codec));
+        buf.push_back(static_cast<unsigned char>(options.level));
+        writeVarint(buf, serialized.size());
+        buf.insert(buf.end(), compressed.begin(), compressed.end());
+
+        if (buf.size() >= serialized.size()) {
+            return std::move(serialized);
+        }
+
+        return buf;
+    }
+
+    const std::vector<unsigned char> &decodeStoredBlock(const std::vector<unsigned char> &data, std::vector<unsigned char> &buffer) {
+        if (data.size() < STORE_MAGIC.size() + 2 || std::memcmp(data.data(), STORE_MAGIC.data(), STORE_MAGIC.size()) != 0) {
+            return data;
+        }
+
+        size_t cur = STORE_MAGIC.size();
+        Codec codec = static_cast<Codec>(data[cur++]);
+        cur++; // Level, only needed to compress
+
+        if (codec != Codec::Lz) {
+            return data;
+        }
+
+        try {
+            uint64_t rawSize = readVarint(data.data(), data.size(), cur);
+            decompressLz(data.data() + cur, data.size() - cur, buffer, rawSize);
+        } catch (const DeserializationError &) {
+            // Not a compressed block but a V1 block starting with the magic bytes, or a corrupt one
+            // that fails to deserialize as V1 too
+            return data;
+        }
+
+        return buffer;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Exceptions.hpp>
+
+namespace iotbc {
+    /// @brief Compression codecs available to the block store
+    enum class Codec : unsigned char {
+        None = 0,
+        /// Built-in LZ77 codec using an LZ4-like sequence format
+        Lz = 1,
+    };
+
+    /// @brief Compression settings of the block store
+    struct CompressionOptions {
+        Codec codec = Codec::None;
+        /// Between 1 (fastest) and 9 (smallest output)
+        int level = 1;
+    };
+
+    /// @brief Compress a buffer with the built-in LZ codec
+    /// @param data The buffer to compress
+    /// @param size The size of the buffer
+    /// @param level The compression level, between 1 (fastest) and 9 (smallest output)
+    /// @return The compressed buffer
+    std::vector<unsigned char> compressLz(const unsigned char *data, size_t size, int level);
+
+    /// @brief Decompress a buffer compressed with the built-in LZ codec
+    /// @param data The compressed buffer
+    /// @param size The size of the compressed buffer
+    /// @param out The buffer to decompress into, resized to rawSize and reused across calls
+    /// @param rawSize The size of the decompressed data
+    /// @throws iotbc::DeserializationError if the compressed data is invalid, or rawSize is more than
+    /// the compressed data can expand to
+    void decompressLz(const unsigned char *data, size_t size, std::vector<unsigned char> &out, size_t rawSize);
+
+    /// @brief Wrap a serialized block in the store header and compress it
+    /// @param serialized The serialized block
+    /// @param options The compression settings
+    /// @return The content of the block file
+    /// @note Blocks that do not shrink are stored as is, without a header
+    std::vector<unsigned char> encodeStoredBlock(std::vector<unsigned char> &&serialized, const CompressionOptions &options);
+
+    /// @brief Get the serialized block stored in a block file
+    /// @param data The content of the block file
+    /// @param buffer Reusable buffer the block gets decompressed into
+    /// @return The serialized block, either data itself or buffer
+    /// @note Uncompressed V1 blocks have no header and their previous hash may start with the store
+    /// magic bytes, so a file whose header or compressed data does not decode is returned as is
+    const std::vector<unsigned char> &decodeStoredBlock(const std::vector<unsigned char> &data, std::vector<unsigned char> &buffer);
+}
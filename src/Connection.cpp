@@ -0,0 +1,246 @@
+#include <Connection.hpp>
+#include <Exceptions.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace iotbc {
+    /// Initial size of the receive buffer, grown for larger frames
+    static constexpr size_t INBOX_SIZE = 64 << 10;
+
+    Connection::Connection(EventLoop &loop, int fd, size_t maxMessageSize, size_t maxSendBuffer)
+        : loop(loop), fd(fd), maxMessageSize(maxMessageSize), maxSendBuffer(maxSendBuffer), onFrame(), onClose(),
+        isClosed(false), inbox(INBOX_SIZE), inboxStart(0), inboxEnd(0), writeMutex(), outbox(), outboxStart(0),
+        waitingWritable(false) {
+    }
+
+    Connection::~Connection() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    void Connection::start(FrameHandler onFrame, CloseHandler onClose) {
+        this->onFrame = std::move(onFrame);
+        this->onClose = std::move(onClose);
+
+        auto registration = [self = shared_from_this()]() {
+            bool added = false;
+
+            {
+                std::lock_guard<std::mutex> lock(self->writeMutex);
+
+                if (self->fd < 0) {
+                    return;
+                }
+
+                // Frames sent before the registration may be waiting for the socket to be writable
+                uint32_t events = self->waitingWritable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+
+                try {
+                    self->loop.add(self->fd, events, [self](uint32_t events) { self->handleEvents(events); });
+                    added = true;
+                } catch (const NetworkError &e) {
+                    added = false;
+                }
+            }
+
+            if (!added) {
+                self->close();
+            }
+        };
+
+        if (loop.inLoopThread()) {
+            registration();
+        } else {
+            loop.post(registration);
+        }
+    }
+
+    void Connection::send(MessageType type, std::span<const unsigned char> payload) {
+        if (payload.size() > UINT32_MAX) {
+            throw NetworkError("Message is too large to be framed");
+        }
+
+        std::lock_guard<std::mutex> lock(writeMutex);
+
+        if (isClosed) {
+            throw NetworkError("Peer disconnected");
+        }
+
+        if (outbox.size() - outboxStart + FRAME_HEADER_SIZE + payload.size() > maxSendBuffer) {
+            isClosed = true;
+            ::shutdown(fd, SHUT_RDWR);
+            throw NetworkError("Peer does not read its messages");
+        }
+
+        writeFrameHeader(outbox, type, payload.size());
+        outbox.insert(outbox.end(), payload.begin(), payload.end());
+
+        // Once the socket is full, the loop writes the rest when it is writable again
+        if (!waitingWritable && !flush()) {
+            isClosed = true;
+            ::shutdown(fd, SHUT_RDWR);
+            throw NetworkError("Peer disconnected");
+        }
+    }
+
+    void Connection::shutdown() {
+        std::lock_guard<std::mutex> lock(writeMutex);
+
+        if (fd >= 0 && !isClosed) {
+            isClosed = true;
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+    void Connection::handleEvents(uint32_t events) {
+        bool open = true;
+
+        try {
+            if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                open = receive();
+            }
+
+            if (open && (events & EPOLLOUT)) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                open = flush();
+            }
+        } catch (const std::exception &e) {
+            // A misbehaving peer only loses its connection
+            open = false;
+        }
+
+        if (!open || isClosed) {
+            close();
+        }
+    }
+
+    bool Connection::receive() {
+        if (inboxEnd == inbox.size()) {
+            if (inboxStart > 0) {
+                std::copy(inbox.begin() + inboxStart, inbox.begin() + inboxEnd, inbox.begin());
+                inboxEnd -= inboxStart;
+                inboxStart = 0;
+            } else {
+                inbox.resize(inbox.size() * 2);
+            }
+        }
+
+        ssize_t received = ::recv(fd, inbox.data() + inboxEnd, inbox.size() - inboxEnd, 0);
+
+        if (received == 0) {
+            return false;
+        }
+        if (received < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        inboxEnd += received;
+
+        while (inboxEnd - inboxStart >= FRAME_HEADER_SIZE && !isClosed) {
+            const unsigned char *header = inbox.data() + inboxStart;
+            uint32_t size = framePayloadSize(header);
+
+            if (size > maxMessageSize) {
+                throw NetworkError("Message is too large");
+            }
+
+            size_t frameSize = FRAME_HEADER_SIZE + size;
+
+            if (inboxEnd - inboxStart < frameSize) {
+                // Make room for the whole frame, so it is read straight into place
+                if (inbox.size() - inboxStart < frameSize) {
+                    std::copy(inbox.begin() + inboxStart, inbox.begin() + inboxEnd, inbox.begin());
+                    inboxEnd -= inboxStart;
+                    inboxStart = 0;
+
+                    if (inbox.size() < frameSize) {
+                        inbox.resize(frameSize);
+                    }
+                }
+                break;
+            }
+
+            onFrame(static_cast<MessageType>(header[4]), std::span<const unsigned char>(header + FRAME_HEADER_SIZE, size));
+            inboxStart += frameSize;
+        }
+
+        if (inboxStart == inboxEnd) {
+            inboxStart = 0;
+            inboxEnd = 0;
+        }
+
+        return true;
+    }
+
+    bool Connection::flush() {
+        while (outboxStart < outbox.size()) {
+            ssize_t sent = ::send(fd, outbox.data() + outboxStart, outbox.size() - outboxStart, MSG_NOSIGNAL);
+
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (sent < 0) {
+                return false;
+            }
+
+            outboxStart += sent;
+        }
+
+        if (outboxStart == outbox.size()) {
+            outbox.clear();
+            outboxStart = 0;
+
+            if (waitingWritable) {
+                loop.modify(fd, EPOLLIN);
+                waitingWritable = false;
+            }
+        } else {
+            // Sent bytes are dropped once they take half of the buffer, so appending stays cheap
+            if (outboxStart >= outbox.size() / 2) {
+                outbox.erase(outbox.begin(), outbox.begin() + outboxStart);
+                outboxStart = 0;
+            }
+
+            if (!waitingWritable) {
+                loop.modify(fd, EPOLLIN | EPOLLOUT);
+                waitingWritable = true;
+            }
+        }
+
+        return true;
+    }
+
+    void Connection::close() {
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+
+            if (fd < 0) {
+                return;
+            }
+
+            isClosed = true;
+            loop.remove(fd);
+            ::close(fd);
+            fd = -1;
+        }
+
+        // The handlers may hold the connection, dropping them breaks the cycle
+        CloseHandler handler = std::move(onClose);
+        onFrame = nullptr;
+        onClose = nullptr;
+
+        if (handler) {
+            handler();
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <EventLoop.hpp>
+#include <Protocol.hpp>
+
+namespace iotbc {
+    /// @brief Non-blocking stream socket exchanging frames, see encodeFrame, driven by an EventLoop
+    /// @note Received bytes go to a buffer reused for the whole connection, and frames are handed
+    /// to the frame handler as spans into it, without copies. Frames can be sent from any thread:
+    /// they are written right away if the socket accepts them, the rest once it is writable again
+    class Connection : public std::enable_shared_from_this<Connection> {
+    public:
+        /// @brief Handler of a received frame, called on the loop thread
+        /// @note The payload is only valid during the call. Throwing closes the connection
+        using FrameHandler = std::function<void(MessageType type, std::span<const unsigned char> payload)>;
+
+        /// @brief Handler called once on the loop thread, when the connection closed
+        using CloseHandler = std::function<void()>;
+
+        /// @brief Take ownership of a connected socket
+        /// @param loop The loop driving the socket
+        /// @param fd The socket, made non-blocking
+        /// @param maxMessageSize Maximum payload size of a received frame, larger ones close the connection
+        /// @param maxSendBuffer Maximum number of bytes waiting to be sent, the connection is closed past it
+        Connection(EventLoop &loop, int fd, size_t maxMessageSize, size_t maxSendBuffer);
+
+        /// @brief Close the socket if it is still open
+        ~Connection();
+
+        Connection(const Connection &) = delete;
+        Connection(Connection &&) = delete;
+        Connection &operator=(const Connection &) = delete;
+        Connection &operator=(Connection &&) = delete;
+
+        /// @brief Start reading frames, the connection is kept alive by the loop until it closes
+        /// @param onFrame The handler of the received frames
+        /// @param onClose The handler called once the connection closed
+        void start(FrameHandler onFrame, CloseHandler onClose);
+
+        /// @brief Send a frame, from any thread
+        /// @param type The type of the message
+        /// @param payload The serialized message
+        /// @throws iotbc::NetworkError if the connection closed, or if too many bytes wait to be sent
+        void send(MessageType type, std::span<const unsigned char> payload);
+
+        /// @brief Close the connection, from any thread, the close handler is called on the loop thread
+        void shutdown();
+
+        /// @brief Checks if the connection closed
+        /// @return True once the socket is closed or shut down
+        inline bool closed() const
+        {
+            return isClosed;
+        }
+
+    private:
+        /// @brief Handle the events of the socket, on the loop thread
+        void handleEvents(uint32_t events);
+
+        /// @brief Read what the socket holds and handle the complete frames
+        /// @return False if the peer closed the connection
+        bool receive();
+
+        /// @brief Write the pending bytes the socket accepts, writeMutex must be held
+        /// @return False if the connection failed
+        bool flush();
+
+        /// @brief Close the socket and call the close handler, on the loop thread
+        void close();
+
+        EventLoop &loop;
+        int fd;
+        size_t maxMessageSize;
+        size_t maxSendBuffer;
+        FrameHandler onFrame;
+        CloseHandler onClose;
+        std::atomic<bool> isClosed;
+
+        /// Received bytes, frames being handled start at inboxStart, only used by the loop thread
+        std::vector<unsigned char> inbox;
+        size_t inboxStart;
+        size_t inboxEnd;
+
+        /// Bytes waiting to be sent, from outboxStart
+        std::mutex writeMutex;
+        std::vector<unsigned char> outbox;
+        size_t outboxStart;
+        bool waitingWritable;
+    };
+}
@@ -0,0 +1,65 @@
+#include <Consensus.hpp>
+#include <Exceptions.hpp>
+
+namespace iotbc {
+    void ProofOfWork::sealBlock(Block &block, uint32_t difficulty) {
+        block.mine(difficulty);
+    }
+
+    void ProofOfWork::verifyHeader(const Block &block, uint32_t requiredDifficulty) const {
+        if (block.sealer.has_value()) {
+            throw InvalidBlock("Sealed blocks are not accepted by proof of work");
+        }
+
+        if (block.difficulty < requiredDifficulty) {
+            throw InvalidBlock("Block difficulty is lower than required");
+        }
+
+        if (!block.hasValidProofOfWork()) {
+            throw InvalidBlock("Block hash does not meet its difficulty (invalid proof of work)");
+        }
+    }
+
+    ProofOfAuthority::ProofOfAuthority(const std::vector<Address> &authorities)
+        : authorities(authorities.begin(), authorities.end()), signer() {
+    }
+
+    ProofOfAuthority::ProofOfAuthority(const std::vector<Address> &authorities, const Signer &signer)
+        : authorities(authorities.begin(), authorities.end()), signer(signer) {
+    }
+
+    void ProofOfAuthority::sealBlock(Block &block, uint32_t difficulty) {
+        (void)difficulty;
+
+        if (!signer.has_value()) {
+            throw InvalidBlock("This node has no authority to seal blocks with");
+        }
+
+        if (!isAuthority(signer->address)) {
+            throw InvalidBlock("The signer is not part of the authority set");
+        }
+
+        block.sealWith(signer.value());
+    }
+
+    void ProofOfAuthority::verifyHeader(const Block &block, uint32_t requiredDifficulty) const {
+        (void)requiredDifficulty;
+
+        if (!block.sealer.has_value()) {
+            throw InvalidBlock("Block is not sealed");
+        }
+
+        if (!isAuthority(Address::fromPublicKey(block.sealer.value()))) {
+            throw InvalidBlock("Block sealer is not an authority");
+        }
+
+        if (!block.hasValidSeal()) {
+            throw InvalidBlock("Block seal signature is invalid");
+        }
+
+        // Forks are chosen by work, which grows with the difficulty, a single block could outweigh a longer chain
+        if (block.difficulty != 0) {
+            throw InvalidBlock("Sealed blocks must have no difficulty");
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include <IConsensus.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Consensus where blocks are mined, their hash must meet the required difficulty
+    class ProofOfWork : public IConsensus {
+        public:
+            void sealBlock(Block &block, uint32_t difficulty) override;
+
+            void verifyHeader(const Block &block, uint32_t requiredDifficulty) const override;
+    };
+
+    /// @brief Consensus where blocks are sealed by a fixed set of authorities, without any mining
+    /// @note The difficulty of the chain is ignored and sealed blocks carry none, producing a block costs a single signature
+    class ProofOfAuthority : public IConsensus {
+        public:
+            /// @brief Create a validating only engine
+            /// @param authorities The addresses allowed to seal blocks
+            explicit ProofOfAuthority(const std::vector<Address> &authorities);
+
+            /// @brief Create an engine sealing blocks with the given authority
+            /// @param authorities The addresses allowed to seal blocks
+            /// @param signer The authority sealing the blocks produced by this node
+            ProofOfAuthority(const std::vector<Address> &authorities, const Signer &signer);
+
+            /// @throws iotbc::InvalidBlock if the engine has no signer, or if it is not an authority
+            void sealBlock(Block &block, uint32_t difficulty) override;
+
+            void verifyHeader(const Block &block, uint32_t requiredDifficulty) const override;
+
+            /// @brief Checks if an address is allowed to seal blocks
+            /// @param address The address to check
+            /// @return True if the address is part of the authority set
+            inline bool isAuthority(const Address &address) const
+            {
+                return authorities.find(address) != authorities.end();
+            }
+
+        private:
+            std::unordered_set<Address, AddressHash> authorities;
+            std::optional<Signer> signer;
+    };
+}
@@ -5,6 +5,24 @@
 namespace iotbc {
     static const Hash NULL_HASH = {0};
 
+    /// Version of the block header: prevHash, merkleRoot and nonce
+    static constexpr uint32_t BLOCK_VERSION_LEGACY = 1;
+
+    /// Version of the block header adding the difficulty, covered by the block hash along with the version
+    static constexpr uint32_t BLOCK_VERSION_DIFFICULTY = 2;
+
+    /// Version of the block header adding the creation timestamp
+    static constexpr uint32_t BLOCK_VERSION_TIMESTAMP = 3;
+
+    /// Version of the block header adding the optional seal of a proof of authority sealer
+    static constexpr uint32_t BLOCK_VERSION_SEAL = 4;
+
+    /// Version of the block header adding the height of the block in the chain
+    static constexpr uint32_t BLOCK_VERSION_HEIGHT = 5;
+
+    /// Version of the block header used for new blocks
+    static constexpr uint32_t BLOCK_VERSION = BLOCK_VERSION_HEIGHT;
+
     static const Hash EMPTY_STRING_HASH = {
         0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
         0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
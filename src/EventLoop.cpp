@@ -0,0 +1,143 @@
+#include <EventLoop.hpp>
+#include <Exceptions.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace iotbc {
+    EventLoop::EventLoop()
+        : epollFd(-1), wakeFd(-1), stopping(false), loopThread(), handlers(), tasksMutex(), tasks() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            throw NetworkError(std::string("Failed to create epoll instance: ") + std::strerror(errno));
+        }
+
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            std::string error = std::strerror(errno);
+            ::close(epollFd);
+            throw NetworkError("Failed to create eventfd: " + error);
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd;
+
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(wakeFd);
+            ::close(epollFd);
+            throw NetworkError("Failed to watch eventfd: " + error);
+        }
+    }
+
+    EventLoop::~EventLoop() {
+        ::close(wakeFd);
+        ::close(epollFd);
+    }
+
+    void EventLoop::add(int fd, uint32_t events, Handler handler) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw NetworkError(std::string("Failed to watch socket: ") + std::strerror(errno));
+        }
+
+        handlers[fd] = std::move(handler);
+    }
+
+    void EventLoop::modify(int fd, uint32_t events) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    void EventLoop::remove(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        handlers.erase(fd);
+    }
+
+    void EventLoop::post(std::function<void()> task) {
+        bool wasEmpty;
+
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            wasEmpty = tasks.empty();
+            tasks.push_back(std::move(task));
+        }
+
+        if (wasEmpty) {
+            uint64_t one = 1;
+            [[maybe_unused]] ssize_t written = ::write(wakeFd, &one, sizeof(one));
+        }
+    }
+
+    void EventLoop::run() {
+        loopThread = std::this_thread::get_id();
+
+        epoll_event events[64];
+
+        while (!stopping) {
+            int count = epoll_wait(epollFd, events, 64, -1);
+
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            for (int i = 0; i < count && !stopping; i++) {
+                if (events[i].data.fd == wakeFd) {
+                    uint64_t value;
+                    [[maybe_unused]] ssize_t readSize = ::read(wakeFd, &value, sizeof(value));
+                    runTasks();
+                    continue;
+                }
+
+                auto it = handlers.find(events[i].data.fd);
+
+                // Removed by an earlier handler of this batch
+                if (it == handlers.end()) {
+                    continue;
+                }
+
+                // Copied, the handler may remove itself
+                Handler handler = it->second;
+                handler(events[i].events);
+            }
+        }
+
+        loopThread = std::thread::id();
+    }
+
+    void EventLoop::runTasks() {
+        std::vector<std::function<void()>> ready;
+
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            ready.swap(tasks);
+        }
+
+        for (auto &task : ready) {
+            task();
+        }
+    }
+
+    void EventLoop::stop() {
+        post([this]() { stopping = true; });
+    }
+
+    bool EventLoop::inLoopThread() const {
+        return loopThread.load() == std::this_thread::get_id();
+    }
+}
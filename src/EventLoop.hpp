@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace iotbc {
+    /// @brief Single thread waiting on many file descriptors with epoll, and running their handlers
+    /// @note Handlers run on the thread calling run, one at a time, so they must not block.
+    /// Other threads hand work to that thread with post
+    class EventLoop {
+    public:
+        /// @brief Handler of the events of a file descriptor, called with the epoll event mask
+        using Handler = std::function<void(uint32_t events)>;
+
+        /// @brief Create the epoll instance and its wakeup eventfd
+        /// @throws iotbc::NetworkError if they cannot be created
+        EventLoop();
+
+        /// @brief Close the epoll instance, the registered file descriptors are left open
+        ~EventLoop();
+
+        EventLoop(const EventLoop &) = delete;
+        EventLoop(EventLoop &&) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+        EventLoop &operator=(EventLoop &&) = delete;
+
+        /// @brief Start watching a file descriptor, from the loop thread or before run
+        /// @param fd The file descriptor, non-blocking
+        /// @param events The epoll events to wait for, level triggered
+        /// @param handler The function called when one of the events happens
+        /// @throws iotbc::NetworkError if the file descriptor cannot be watched
+        void add(int fd, uint32_t events, Handler handler);
+
+        /// @brief Change the events watched on a file descriptor, from any thread
+        /// @param fd The file descriptor, already added
+        /// @param events The epoll events to wait for
+        void modify(int fd, uint32_t events);
+
+        /// @brief Stop watching a file descriptor, from the loop thread, before closing it
+        /// @param fd The file descriptor
+        void remove(int fd);
+
+        /// @brief Run a task on the loop thread, from any thread
+        /// @param task The task, run after the events being handled
+        /// @note The loop is only woken up when the queue was empty, tasks posted in a burst share one wakeup
+        void post(std::function<void()> task);
+
+        /// @brief Handle events and posted tasks until stop is called
+        void run();
+
+        /// @brief Make run return once the current handler returns, from any thread
+        void stop();
+
+        /// @brief Checks if the caller runs on the loop thread
+        /// @return True if called from a handler or a posted task
+        bool inLoopThread() const;
+
+    private:
+        /// @brief Run the posted tasks, on the loop thread
+        void runTasks();
+
+        int epollFd;
+        int wakeFd;
+        std::atomic<bool> stopping;
+        std::atomic<std::thread::id> loopThread;
+
+        /// Only used by the loop thread, and before run
+        std::unordered_map<int, Handler> handlers;
+
+        std::mutex tasksMutex;
+        std::vector<std::function<void()>> tasks;
+    };
+}
@@ -18,4 +18,5 @@ namespace iotbc {
     _CUSTOM_EXCEPTION(Secp256k1Error, std::runtime_error);
     _CUSTOM_EXCEPTION(EvpError, std::runtime_error);
     _CUSTOM_EXCEPTION(IoError, std::runtime_error);
+    _CUSTOM_EXCEPTION(NetworkError, std::runtime_error);
 }
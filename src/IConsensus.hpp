@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Block.hpp>
+
+namespace iotbc {
+    /// @brief Interface for the consensus engine of a blockchain
+    /// @note An engine decides how a block template is finalized before getting
+    /// added to the chain, and how the header of a received block is checked
+    class IConsensus {
+        public:
+            virtual ~IConsensus() = default;
+
+            /// @brief Finalize a block template so it can be added to the chain
+            /// @param block The block to finalize, its transactions must not change afterwards
+            /// @param difficulty The difficulty required by the chain for this block
+            virtual void sealBlock(Block &block, uint32_t difficulty) = 0;
+
+            /// @brief Check the consensus proof of a block header
+            /// @param block The block to check
+            /// @param requiredDifficulty The difficulty required by the chain for this block
+            /// @throws iotbc::InvalidBlock if the proof is invalid
+            virtual void verifyHeader(const Block &block, uint32_t requiredDifficulty) const = 0;
+    };
+}
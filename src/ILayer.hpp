@@ -1,12 +1,15 @@
 #pragma once
 
+#include <optional>
+
 #include <Types.hpp>
 
 namespace iotbc {
     /// @brief Interface for a layer in the blockchain
     /// @note A layer is a set of functions executed for every block in the blockchain
     /// that can be used for custom functionnality
-    /// They are run every time a block is added to the blockchain
+    /// They are run every time a block is added to the blockchain. A layer throwing is reported,
+    /// the block still joins the chain and the other layers still run
     class ILayer {
         public:
             virtual ~ILayer() = default;
@@ -14,5 +17,22 @@ namespace iotbc {
             /// @brief Function called for every block in the blockchain
             /// @param block The block to process
             virtual void processBlock(const Block &block) = 0;
+
+            /// @brief Function called for every block removed from the tip of the blockchain by a reorganization
+            /// @param block The block to undo, blocks are disconnected from the tip down to the fork point
+            /// @note The blocks of the new branch are then passed to processBlock
+            virtual void disconnectBlock(const Block &block)
+            {
+                (void)block;
+            }
+
+            /// @brief Get the first block the layer still needs the body of, to rebuild its state on the next start
+            /// @return The height of the block, or std::nullopt if the layer needs none
+            /// @note Pruning never drops the body of a pinned block, so a layer keeps its pin
+            /// until it has saved its own state past it
+            virtual std::optional<uint64_t> pinnedHeight() const
+            {
+                return std::nullopt;
+            }
     };
 }
@@ -0,0 +1,97 @@
+#include <IngestClient.hpp>
+#include <Exceptions.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace iotbc {
+    /// @brief Write a whole buffer to a blocking socket
+    static void sendAll(int fd, const unsigned char *data, size_t size, int flags) {
+        while (size > 0) {
+            ssize_t sent = ::send(fd, data, size, flags | MSG_NOSIGNAL);
+
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                throw NetworkError("Ingest server disconnected");
+            }
+
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    /// @brief Read exactly size bytes from a blocking socket
+    static void recvAll(int fd, unsigned char *data, size_t size) {
+        while (size > 0) {
+            ssize_t received = ::recv(fd, data, size, 0);
+
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                throw NetworkError("Ingest server disconnected");
+            }
+
+            data += received;
+            size -= received;
+        }
+    }
+
+    IngestClient::IngestClient(const std::string &path) : fd(-1), inbox() {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw NetworkError("Invalid socket path: " + path);
+        }
+        std::copy(path.begin(), path.end(), addr.sun_path);
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw NetworkError(std::string("Failed to create socket: ") + std::strerror(errno));
+        }
+
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(fd);
+            throw NetworkError("Failed to connect to " + path + ": " + error);
+        }
+    }
+
+    IngestClient::~IngestClient() {
+        ::close(fd);
+    }
+
+    void IngestClient::submit(std::vector<Transaction> txs) {
+        TransactionsMessage message;
+        message.transactions = std::move(txs);
+
+        std::vector<unsigned char> payload = message.serialize();
+        std::vector<unsigned char> header;
+        writeFrameHeader(header, MessageType::SubmitTransactions, payload.size());
+
+        sendAll(fd, header.data(), header.size(), MSG_MORE);
+        sendAll(fd, payload.data(), payload.size(), 0);
+    }
+
+    std::vector<IngestResult> IngestClient::receive() {
+        unsigned char header[FRAME_HEADER_SIZE];
+        recvAll(fd, header, sizeof(header));
+
+        if (static_cast<MessageType>(header[4]) != MessageType::IngestResults) {
+            throw DeserializationError("Unexpected message");
+        }
+
+        inbox.resize(framePayloadSize(header));
+        recvAll(fd, inbox.data(), inbox.size());
+
+        return IngestResultsMessage::deserialize(inbox).results;
+    }
+}
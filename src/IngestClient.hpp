@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Protocol.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Producer submitting signed transactions to an IngestServer
+    /// @note Submissions are pipelined: results come back later, through receive. submit and
+    /// receive can be called from two different threads, but each from a single thread at a time
+    class IngestClient {
+    public:
+        /// @brief Connect to a server
+        /// @param path The path of the server's socket
+        /// @throws iotbc::NetworkError if the server cannot be reached
+        explicit IngestClient(const std::string &path);
+
+        /// @brief Close the connection, the results not received yet are lost
+        ~IngestClient();
+
+        IngestClient(const IngestClient &) = delete;
+        IngestClient(IngestClient &&) = delete;
+        IngestClient &operator=(const IngestClient &) = delete;
+        IngestClient &operator=(IngestClient &&) = delete;
+
+        /// @brief Submit a batch of signed transactions
+        /// @param txs The transactions
+        /// @throws iotbc::NetworkError if the server closed the connection
+        void submit(std::vector<Transaction> txs);
+
+        /// @brief Wait for the next results sent by the server
+        /// @return The results of some of the submitted transactions, in no particular order
+        /// @throws iotbc::NetworkError if the server closed the connection
+        /// @throws iotbc::DeserializationError if the server sent an invalid message
+        std::vector<IngestResult> receive();
+
+    private:
+        int fd;
+        /// Reused for every received frame
+        std::vector<unsigned char> inbox;
+    };
+}
@@ -0,0 +1,227 @@
+#include <IngestServer.hpp>
+#include <Exceptions.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace iotbc {
+    IngestServer::IngestServer(Mempool &mempool, const std::string &path, const IngestOptions &options)
+        : mempool(mempool), socketPath(path), options(options), loop(), listenFd(-1), mutex(), producers(),
+        nextProducerId(0), pending(), counters(), listener(0), loopThread() {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            throw NetworkError("Invalid socket path: " + path);
+        }
+        std::copy(path.begin(), path.end(), addr.sun_path);
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw NetworkError(std::string("Failed to create socket: ") + std::strerror(errno));
+        }
+
+        // A socket nobody listens on anymore was left by a previous server, and would make bind fail
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0) {
+            bool used = ::connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+            ::close(probe);
+
+            if (used) {
+                ::close(listenFd);
+                throw NetworkError("Socket already in use: " + path);
+            }
+        }
+        ::unlink(path.c_str());
+
+        if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+            || ::listen(listenFd, 128) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(listenFd);
+            throw NetworkError("Failed to listen on " + path + ": " + error);
+        }
+
+        try {
+            loop.add(listenFd, EPOLLIN, [this](uint32_t) { acceptProducers(); });
+        } catch (const NetworkError &e) {
+            ::close(listenFd);
+            ::unlink(path.c_str());
+            throw;
+        }
+
+        listener = mempool.addListener([this](const VerificationResult &result) { handleVerification(result); });
+        loopThread = std::thread([this]() { loop.run(); });
+    }
+
+    IngestServer::~IngestServer() {
+        mempool.removeListener(listener);
+
+        loop.stop();
+        loopThread.join();
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+
+        // The connections close their sockets once the loop releases them
+        std::lock_guard<std::mutex> lock(mutex);
+        producers.clear();
+    }
+
+    IngestStats IngestServer::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        IngestStats stats = counters;
+        stats.producers = producers.size();
+        return stats;
+    }
+
+    void IngestServer::acceptProducers() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                // No more pending connections, or out of file descriptors until a producer leaves
+                break;
+            }
+
+            auto connection = std::make_shared<Connection>(loop, fd, options.maxMessageSize, options.maxSendBuffer);
+            uint64_t id;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                id = nextProducerId++;
+                producers.emplace(id, connection);
+            }
+
+            connection->start(
+                [this, id](MessageType type, std::span<const unsigned char> payload) {
+                    if (type != MessageType::SubmitTransactions) {
+                        throw NetworkError("Unexpected message");
+                    }
+                    handleSubmit(id, payload);
+                },
+                [this, id]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    producers.erase(id);
+                });
+        }
+    }
+
+    void IngestServer::handleSubmit(uint64_t producer, std::span<const unsigned char> payload) {
+        std::vector<Transaction> txs = TransactionsMessage::deserialize(payload).transactions;
+
+        std::vector<Hash> hashes;
+        hashes.reserve(txs.size());
+        for (const auto &tx : txs) {
+            hashes.push_back(tx.id());
+        }
+
+        // Claimed before the submission, the mempool may verify a transaction before submit returns
+        std::vector<bool> claimed(txs.size());
+        std::shared_ptr<Connection> connection;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (size_t i = 0; i < txs.size(); i++) {
+                claimed[i] = pending.emplace(hashes[i], producer).second;
+            }
+            counters.submitted += txs.size();
+
+            auto it = producers.find(producer);
+            if (it != producers.end()) {
+                connection = it->second;
+            }
+        }
+
+        std::vector<std::pair<size_t, SubmitResult>> refused;
+        for (size_t i = 0; i < txs.size(); i++) {
+            SubmitResult result = claimed[i] ? mempool.submit(std::move(txs[i])) : SubmitResult::Duplicate;
+
+            if (result != SubmitResult::Accepted) {
+                refused.emplace_back(i, result);
+            }
+        }
+
+        if (refused.empty()) {
+            return;
+        }
+
+        IngestResultsMessage message;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (const auto &[i, result] : refused) {
+                // A transaction with the same hash, verified meanwhile, already got its result
+                if (claimed[i] && pending.erase(hashes[i]) == 0) {
+                    continue;
+                }
+
+                if (result == SubmitResult::Full) {
+                    message.results.push_back({hashes[i], IngestStatus::Full});
+                    counters.full++;
+                } else {
+                    message.results.push_back({hashes[i], IngestStatus::Duplicate});
+                    counters.duplicates++;
+                }
+            }
+        }
+
+        if (connection != nullptr && !message.results.empty()) {
+            sendResults(connection, message);
+        }
+    }
+
+    void IngestServer::handleVerification(const VerificationResult &result) {
+        std::unordered_map<uint64_t, IngestResultsMessage> messages;
+
+        std::vector<std::pair<std::shared_ptr<Connection>, IngestResultsMessage>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // Transactions from peers or other sources are not tracked
+            auto collect = [&](const std::vector<Hash> &hashes, IngestStatus status, size_t &counter) {
+                for (const auto &hash : hashes) {
+                    auto it = pending.find(hash);
+                    if (it == pending.end()) {
+                        continue;
+                    }
+
+                    messages[it->second].results.push_back({hash, status});
+                    pending.erase(it);
+                    counter++;
+                }
+            };
+
+            collect(result.verified, IngestStatus::Verified, counters.verified);
+            collect(result.rejected, IngestStatus::Invalid, counters.invalid);
+
+            for (auto &[producer, message] : messages) {
+                auto it = producers.find(producer);
+                if (it != producers.end()) {
+                    ready.emplace_back(it->second, std::move(message));
+                }
+            }
+        }
+
+        for (const auto &[connection, message] : ready) {
+            sendResults(connection, message);
+        }
+    }
+
+    void IngestServer::sendResults(const std::shared_ptr<Connection> &connection, const IngestResultsMessage &message) {
+        try {
+            connection->send(MessageType::IngestResults, message.serialize());
+        } catch (const NetworkError &e) {
+            // The producer disconnected, its connection cleans up
+        }
+    }
+}
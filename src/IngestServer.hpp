@@ -0,0 +1,106 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <Connection.hpp>
+#include <EventLoop.hpp>
+#include <Mempool.hpp>
+#include <Protocol.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Settings of an IngestServer
+    struct IngestOptions {
+        /// Maximum size of a SubmitTransactions message, larger ones disconnect the producer
+        size_t maxMessageSize = 16 << 20;
+        /// Maximum number of bytes of results waiting to be sent to a producer, a producer not reading them is disconnected
+        size_t maxSendBuffer = 16 << 20;
+    };
+
+    /// @brief Counters of an IngestServer
+    struct IngestStats {
+        /// Number of producers connected
+        size_t producers = 0;
+        /// Number of transactions received
+        size_t submitted = 0;
+        /// Number of transactions acknowledged as Verified
+        size_t verified = 0;
+        /// Number of transactions acknowledged as Invalid
+        size_t invalid = 0;
+        /// Number of transactions acknowledged as Duplicate
+        size_t duplicates = 0;
+        /// Number of transactions acknowledged as Full
+        size_t full = 0;
+    };
+
+    /// @brief Local endpoint through which other processes submit signed transactions to a mempool
+    /// @note Producers connect to a Unix domain stream socket and send batches of serialized
+    /// transactions in SubmitTransactions frames, see IngestClient. The transactions are verified
+    /// in batches by the mempool, and each producer gets the outcome of its transactions in
+    /// IngestResults frames, one per verified batch. Every producer is driven by a single event loop thread
+    class IngestServer {
+    public:
+        /// @brief Start accepting producers
+        /// @param mempool The mempool the transactions are submitted to
+        /// @param path The path of the socket, replaced if a previous server left it behind
+        /// @param options The settings
+        /// @throws iotbc::NetworkError if the server cannot listen on the path, or if another server uses it
+        IngestServer(Mempool &mempool, const std::string &path, const IngestOptions &options = IngestOptions());
+
+        /// @brief Disconnect every producer and remove the socket
+        ~IngestServer();
+
+        IngestServer(const IngestServer &) = delete;
+        IngestServer(IngestServer &&) = delete;
+        IngestServer &operator=(const IngestServer &) = delete;
+        IngestServer &operator=(IngestServer &&) = delete;
+
+        /// @brief Get the path of the socket
+        /// @return The path producers connect to
+        inline const std::string &path() const
+        {
+            return socketPath;
+        }
+
+        /// @brief Get the counters of the server
+        /// @return The counters, since the server started
+        IngestStats stats() const;
+
+    private:
+        /// @brief Accept the pending producers, on the loop thread
+        void acceptProducers();
+
+        /// @brief Submit the transactions of a SubmitTransactions message to the mempool
+        /// @throws iotbc::DeserializationError if the message is invalid
+        void handleSubmit(uint64_t producer, std::span<const unsigned char> payload);
+
+        /// @brief Send the outcome of a verified batch to the producers of its transactions
+        void handleVerification(const VerificationResult &result);
+
+        /// @brief Send results to a producer, ignoring producers that disconnected
+        void sendResults(const std::shared_ptr<Connection> &connection, const IngestResultsMessage &message);
+
+        Mempool &mempool;
+        std::string socketPath;
+        IngestOptions options;
+
+        EventLoop loop;
+        int listenFd;
+
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, std::shared_ptr<Connection>> producers;
+        uint64_t nextProducerId;
+        /// Producer of each submitted transaction not verified yet
+        std::unordered_map<Hash, uint64_t, ArrayHash> pending;
+        IngestStats counters;
+
+        size_t listener;
+        // Declared last so it starts once the server is ready
+        std::thread loopThread;
+    };
+}
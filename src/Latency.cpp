@@ -0,0 +1,167 @@
+#include <Latency.hpp>
+
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace iotbc {
+    LatencyHistogram::LatencyHistogram() : buckets(), sum(0), maxValue(0) {
+    }
+
+    size_t LatencyHistogram::bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+
+        // The leading bits after the highest one pick the bucket within its power of two
+        unsigned shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+    }
+
+    uint64_t LatencyHistogram::bucketHighest(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+
+        unsigned shift = index / SUB_BUCKETS - 1;
+        uint64_t lowest = (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+    void LatencyHistogram::record(uint64_t nanoseconds) {
+        buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        uint64_t current = maxValue.load(std::memory_order_relaxed);
+        while (nanoseconds > current && !maxValue.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t LatencyHistogram::percentile(double percentile) const {
+        uint64_t count = 0;
+        for (const auto &bucket : buckets) {
+            count += bucket.load(std::memory_order_relaxed);
+        }
+
+        if (count == 0) {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * count));
+        rank = std::max<uint64_t>(rank, 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+
+            if (seen >= rank) {
+                return std::min(bucketHighest(i), maxValue.load(std::memory_order_relaxed));
+            }
+        }
+
+        // Values recorded after the count was taken
+        return maxValue.load(std::memory_order_relaxed);
+    }
+
+    LatencySummary LatencyHistogram::summary() const {
+        LatencySummary summary;
+
+        for (const auto &bucket : buckets) {
+            summary.count += bucket.load(std::memory_order_relaxed);
+        }
+
+        if (summary.count == 0) {
+            return summary;
+        }
+
+        summary.mean = sum.load(std::memory_order_relaxed) / summary.count;
+        summary.max = maxValue.load(std::memory_order_relaxed);
+        summary.p50 = percentile(50);
+        summary.p90 = percentile(90);
+        summary.p99 = percentile(99);
+        summary.p999 = percentile(99.9);
+
+        return summary;
+    }
+
+    void LatencyHistogram::reset() {
+        for (auto &bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+
+        sum.store(0, std::memory_order_relaxed);
+        maxValue.store(0, std::memory_order_relaxed);
+    }
+
+    std::string stageName(PipelineStage stage) {
+        switch (stage) {
+            case PipelineStage::Admission:
+                return "admission";
+            case PipelineStage::Verify:
+                return "verify";
+            case PipelineStage::Merkle:
+                return "merkle";
+            case PipelineStage::Mining:
+                return "mining";
+            case PipelineStage::AddBlock:
+                return "addBlock";
+            case PipelineStage::LayerDispatch:
+                return "layerDispatch";
+            case PipelineStage::Persistence:
+                return "persistence";
+            default:
+                return "unknown";
+        }
+    }
+
+    /// @brief Human readable form of a duration in nanoseconds
+    static std::string formatDuration(uint64_t ns) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+
+        if (ns >= 1000000000) {
+            out << ns / 1e9 << "s";
+        } else if (ns >= 1000000) {
+            out << ns / 1e6 << "ms";
+        } else if (ns >= 1000) {
+            out << ns / 1e3 << "us";
+        } else {
+            out << ns << "ns";
+        }
+
+        return out.str();
+    }
+
+    std::string PipelineMetrics::report() const {
+        std::ostringstream out;
+        out << std::left << std::setw(14) << "stage" << std::right << std::setw(10) << "count";
+        for (const char *column : {"mean", "p50", "p90", "p99", "p999", "max"}) {
+            out << std::setw(10) << column;
+        }
+        out << std::endl;
+
+        for (size_t i = 0; i < histograms.size(); i++) {
+            LatencySummary summary = histograms[i].summary();
+
+            out << std::left << std::setw(14) << stageName(static_cast<PipelineStage>(i)) << std::right << std::setw(10) << summary.count;
+            for (uint64_t value : {summary.mean, summary.p50, summary.p90, summary.p99, summary.p999, summary.max}) {
+                out << std::setw(10) << formatDuration(value);
+            }
+            out << std::endl;
+        }
+
+        return out.str();
+    }
+
+    void PipelineMetrics::reset() {
+        for (auto &histogram : histograms) {
+            histogram.reset();
+        }
+    }
+
+    PipelineMetrics &pipelineMetrics() {
+        static PipelineMetrics metrics;
+        return metrics;
+    }
+}
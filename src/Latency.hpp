@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace iotbc {
+    /// @brief Percentiles and totals of the values recorded by a LatencyHistogram, in nanoseconds
+    struct LatencySummary {
+        uint64_t count = 0;
+        uint64_t mean = 0;
+        uint64_t max = 0;
+        uint64_t p50 = 0;
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+    };
+
+    /// @brief Lock-free histogram of durations, with buckets of constant relative width as HDR histograms
+    /// @note Values below 32ns have a bucket each, larger ones share a power of two range between 32
+    /// buckets, so a percentile is within about 3% of the recorded value. Recording is a few relaxed
+    /// atomic increments, from any number of threads at once. Reading while values are recorded gives
+    /// a slightly stale view, never a torn one
+    class LatencyHistogram {
+    public:
+        /// Number of bits of a value kept in its bucket index, the buckets per power of two
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        LatencyHistogram();
+
+        LatencyHistogram(const LatencyHistogram &) = delete;
+        LatencyHistogram(LatencyHistogram &&) = delete;
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+        LatencyHistogram &operator=(LatencyHistogram &&) = delete;
+
+        /// @brief Record a value
+        /// @param nanoseconds The value, in nanoseconds
+        void record(uint64_t nanoseconds);
+
+        /// @brief Record a duration
+        /// @param duration The duration, negative ones count as 0
+        inline void record(std::chrono::nanoseconds duration)
+        {
+            record(static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0)));
+        }
+
+        /// @brief Get the value under which a share of the recorded values are
+        /// @param percentile The share, between 0 and 100
+        /// @return The highest value of the bucket reaching the share, 0 if nothing was recorded
+        uint64_t percentile(double percentile) const;
+
+        /// @brief Get the percentiles and totals of the recorded values
+        LatencySummary summary() const;
+
+        /// @brief Forget the recorded values
+        void reset();
+
+        /// @brief Get the bucket of a value
+        static size_t bucketIndex(uint64_t value);
+
+        /// @brief Get the highest value of a bucket
+        static uint64_t bucketHighest(size_t index);
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> maxValue;
+    };
+
+    /// @brief Stages of the path from a submitted transaction to a saved block
+    enum class PipelineStage {
+        /// From the submission of a transaction to a mempool until it is verified and ready
+        Admission,
+        /// Verification of a transaction signature
+        Verify,
+        /// Computation of the merkle root of a block
+        Merkle,
+        /// Search of the nonce of a mined block
+        Mining,
+        /// Addition of a block to the chain, with its verification and layer dispatch
+        AddBlock,
+        /// Processing of an added block by the layers of the chain
+        LayerDispatch,
+        /// Saving of the chain to disk
+        Persistence,
+        Count
+    };
+
+    /// @brief Get the name of a stage, as shown in reports
+    std::string stageName(PipelineStage stage);
+
+    /// @brief Latencies of each stage of the pipeline, recorded by the library as it runs
+    class PipelineMetrics {
+    public:
+        /// @brief Get the histogram of a stage
+        inline LatencyHistogram &stage(PipelineStage stage)
+        {
+            return histograms[static_cast<size_t>(stage)];
+        }
+
+        /// @brief Get the histogram of a stage
+        inline const LatencyHistogram &stage(PipelineStage stage) const
+        {
+            return histograms[static_cast<size_t>(stage)];
+        }
+
+        /// @brief Human readable table of the percentiles of every stage
+        std::string report() const;
+
+        /// @brief Forget the values recorded for every stage
+        void reset();
+
+    private:
+        std::array<LatencyHistogram, static_cast<size_t>(PipelineStage::Count)> histograms;
+    };
+
+    /// @brief Get the latencies recorded by the library in this process
+    PipelineMetrics &pipelineMetrics();
+
+    /// @brief Records the time until it goes out of scope in a stage of the pipeline
+    class StageTimer {
+    public:
+        inline StageTimer(PipelineStage stage)
+            : stage(stage), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        inline ~StageTimer()
+        {
+            pipelineMetrics().stage(stage).record(std::chrono::steady_clock::now() - start);
+        }
+
+        StageTimer(const StageTimer &) = delete;
+        StageTimer &operator=(const StageTimer &) = delete;
+
+    private:
+        PipelineStage stage;
+        std::chrono::steady_clock::time_point start;
+    };
+}
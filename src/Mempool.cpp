@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include <Latency.hpp>
+#include <Mempool.hpp>
+
+namespace iotbc {
+    Mempool::Mempool() : Mempool(MempoolPolicy()) {
+    }
+
+    Mempool::Mempool(const MempoolPolicy &policy)
+        : policy(policy), mutex(), readyCv(), idleCv(), known(), pending(), ready(),
+        inFlightBatches(0), rejected(0), expired(0), listenersMutex(), listeners(), nextListenerId(0), workers(policy.workers) {
+    }
+
+    SubmitResult Mempool::submit(Transaction tx) {
+        Hash hash = tx.id();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (known.size() >= policy.capacity) {
+            return SubmitResult::Full;
+        }
+
+        if (!known.insert(hash).second) {
+            return SubmitResult::Duplicate;
+        }
+
+        pending.push_back({std::move(tx), hash, Clock::now(), Address()});
+
+        // Under load, workers are busy and pending transactions pile up into full batches
+        if (pending.size() >= policy.verifyBatchSize || inFlightBatches < workers.size()) {
+            dispatchBatch();
+        }
+
+        return SubmitResult::Accepted;
+    }
+
+    void Mempool::dispatchBatch() {
+        size_t count = std::min(pending.size(), std::max<size_t>(policy.verifyBatchSize, 1));
+
+        if (count == 0) {
+            return;
+        }
+
+        std::vector<Entry> batch;
+        batch.reserve(count);
+
+        for (size_t i = 0; i < count; i++) {
+            batch.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+
+        inFlightBatches++;
+
+        workers.submit([this, batch = std::move(batch)]() mutable {
+            verifyBatch(std::move(batch));
+        });
+    }
+
+    void Mempool::verifyBatch(std::vector<Entry> batch) {
+        std::vector<bool> valid(batch.size(), false);
+
+        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+
+        if (ctx != nullptr) {
+            for (size_t i = 0; i < batch.size(); i++) {
+                try {
+                    batch[i].tx.verify(ctx);
+                    batch[i].sender = Address::fromPublicKey(batch[i].tx.from);
+                    valid[i] = true;
+                } catch (const std::exception &e) {
+                    valid[i] = false;
+                }
+            }
+
+            secp256k1_context_destroy(ctx);
+        }
+
+        VerificationResult result;
+        result.verified.reserve(batch.size());
+
+        LatencyHistogram &admission = pipelineMetrics().stage(PipelineStage::Admission);
+        Clock::time_point verified = Clock::now();
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (valid[i]) {
+                admission.record(verified - batch[i].arrival);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (valid[i]) {
+                    result.verified.push_back(batch[i].hash);
+                    ready.push_back(std::move(batch[i]));
+                } else {
+                    known.erase(batch[i].hash);
+                    result.rejected.push_back(batch[i].hash);
+                    rejected++;
+                }
+            }
+
+            readyCv.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(listenersMutex);
+
+            for (const auto &[id, listener] : listeners) {
+                listener(result);
+            }
+        }
+
+        // The batch only counts as done once the listeners returned, so flush also waits for them
+        std::lock_guard<std::mutex> lock(mutex);
+
+        inFlightBatches--;
+
+        // Transactions submitted while every worker was busy wait for a worker to be done
+        if (!pending.empty()) {
+            dispatchBatch();
+        }
+
+        if (inFlightBatches == 0 && pending.empty()) {
+            idleCv.notify_all();
+        }
+    }
+
+    std::vector<std::vector<size_t>> Mempool::readyBySenderLocked() const {
+        std::vector<std::vector<size_t>> senders;
+        std::unordered_map<Address, size_t, AddressHash> senderOf;
+
+        for (size_t i = 0; i < ready.size(); i++) {
+            auto [it, inserted] = senderOf.try_emplace(ready[i].sender, senders.size());
+            if (inserted) {
+                senders.emplace_back();
+            }
+            senders[it->second].push_back(i);
+        }
+
+        for (auto &indices : senders) {
+            std::stable_sort(indices.begin(), indices.end(), [this](size_t a, size_t b) {
+                return ready[a].tx.nonce < ready[b].tx.nonce;
+            });
+        }
+
+        return senders;
+    }
+
+    Mempool::Readiness Mempool::readinessLocked(const NonceIndex &nonces) const {
+        Readiness readiness;
+
+        for (const auto &indices : readyBySenderLocked()) {
+            Nonce expected = nonces.next(ready[indices.front()].sender);
+
+            for (size_t i : indices) {
+                const Entry &entry = ready[i];
+
+                if (entry.tx.nonce < expected) {
+                    continue;
+                }
+
+                if (entry.tx.nonce > expected) {
+                    break;
+                }
+
+                readiness.count++;
+                readiness.bytes += entry.tx.size(WireFormat::V2);
+                readiness.oldest = std::min(readiness.oldest, entry.arrival);
+                expected++;
+            }
+        }
+
+        return readiness;
+    }
+
+    bool Mempool::templateReadyLocked(const Readiness &readiness, Clock::time_point now) const {
+        if (readiness.count == 0) {
+            return false;
+        }
+
+        return readiness.count >= policy.maxTransactions
+            || readiness.bytes >= policy.maxBytes
+            || now - readiness.oldest >= policy.maxAge;
+    }
+
+    void Mempool::expireGapsLocked(const NonceIndex &nonces, Clock::time_point now) {
+        std::vector<bool> gapped(ready.size(), false);
+        bool any = false;
+
+        for (const auto &indices : readyBySenderLocked()) {
+            Nonce expected = nonces.next(ready[indices.front()].sender);
+
+            for (size_t i : indices) {
+                if (ready[i].tx.nonce == expected) {
+                    expected++;
+                } else if (ready[i].tx.nonce > expected && now - ready[i].arrival >= policy.gapTimeout) {
+                    gapped[i] = true;
+                    any = true;
+                }
+            }
+        }
+
+        if (!any) {
+            return;
+        }
+
+        std::deque<Entry> remaining;
+
+        for (size_t i = 0; i < ready.size(); i++) {
+            if (gapped[i]) {
+                known.erase(ready[i].hash);
+                expired++;
+            } else {
+                remaining.push_back(std::move(ready[i]));
+            }
+        }
+
+        ready = std::move(remaining);
+    }
+
+    bool Mempool::templateReady(const NonceIndex &nonces) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return templateReadyLocked(readinessLocked(nonces), Clock::now());
+    }
+
+    bool Mempool::waitForTemplate(std::chrono::milliseconds timeout, const NonceIndex &nonces) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        Clock::time_point deadline = Clock::now() + timeout;
+
+        while (true) {
+            Clock::time_point now = Clock::now();
+
+            expireGapsLocked(nonces, now);
+
+            Readiness readiness = readinessLocked(nonces);
+            if (templateReadyLocked(readiness, now)) {
+                return true;
+            }
+
+            if (now >= deadline) {
+                return false;
+            }
+
+            Clock::time_point wakeAt = deadline;
+            if (readiness.count > 0) {
+                wakeAt = std::min(deadline, readiness.oldest + policy.maxAge);
+            }
+
+            readyCv.wait_until(lock, wakeAt);
+        }
+    }
+
+    Block Mempool::takeBlockTemplate(const Hash &prevHash, uint64_t height, const NonceIndex &nonces) {
+        Block block(prevHash, height);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        expireGapsLocked(nonces, Clock::now());
+
+        std::vector<bool> removed(ready.size(), false);
+        size_t bytes = 0;
+        bool full = false;
+
+        for (const auto &indices : readyBySenderLocked()) {
+            Nonce expected = nonces.next(ready[indices.front()].sender);
+
+            for (size_t i : indices) {
+                Entry &entry = ready[i];
+
+                if (entry.tx.nonce < expected) {
+                    // Already used on chain, or conflicting with a transaction of this template
+                    removed[i] = true;
+                    continue;
+                }
+
+                if (entry.tx.nonce > expected || full) {
+                    break;
+                }
+
+                size_t txBytes = entry.tx.size(WireFormat::V2);
+
+                if (block.transactions.size() >= policy.maxTransactions
+                    || (!block.transactions.empty() && bytes + txBytes > policy.maxBytes)) {
+                    full = true;
+                    break;
+                }
+
+                bytes += txBytes;
+                expected++;
+                removed[i] = true;
+
+                // Already verified, bypass addTransaction
+                block.transactions.push_back(entry.tx);
+            }
+        }
+
+        std::deque<Entry> remaining;
+
+        for (size_t i = 0; i < ready.size(); i++) {
+            if (removed[i]) {
+                known.erase(ready[i].hash);
+            } else {
+                remaining.push_back(std::move(ready[i]));
+            }
+        }
+
+        ready = std::move(remaining);
+
+        return block;
+    }
+
+    size_t Mempool::removeIncluded(const Block &block) {
+        std::unordered_set<Hash, ArrayHash> included;
+        for (const auto &tx : block.transactions) {
+            included.insert(tx.id());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t removed = 0;
+
+        auto isIncluded = [&](const Entry &entry) {
+            if (!included.contains(entry.hash)) {
+                return false;
+            }
+
+            known.erase(entry.hash);
+            removed++;
+            return true;
+        };
+
+        std::erase_if(ready, isIncluded);
+        std::erase_if(pending, isIncluded);
+
+        return removed;
+    }
+
+    void Mempool::forEach(const std::function<void(const Transaction &tx)> &f) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (const auto &entry : ready) {
+            f(entry.tx);
+        }
+
+        for (const auto &entry : pending) {
+            f(entry.tx);
+        }
+    }
+
+    bool Mempool::contains(const Hash &hash) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return known.contains(hash);
+    }
+
+    std::vector<Transaction> Mempool::find(const std::vector<Hash> &hashes) const {
+        std::unordered_set<Hash, ArrayHash> wanted(hashes.begin(), hashes.end());
+        std::vector<Transaction> found;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (const auto &entry : ready) {
+            if (wanted.contains(entry.hash)) {
+                found.push_back(entry.tx);
+            }
+        }
+
+        return found;
+    }
+
+    size_t Mempool::addListener(VerificationListener listener) {
+        std::lock_guard<std::mutex> lock(listenersMutex);
+
+        listeners.emplace_back(nextListenerId, std::move(listener));
+        return nextListenerId++;
+    }
+
+    void Mempool::removeListener(size_t id) {
+        std::lock_guard<std::mutex> lock(listenersMutex);
+
+        std::erase_if(listeners, [id](const auto &entry) { return entry.first == id; });
+    }
+
+    void Mempool::flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        idleCv.wait(lock, [this]() { return inFlightBatches == 0 && pending.empty(); });
+    }
+
+    size_t Mempool::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return known.size();
+    }
+
+    size_t Mempool::room() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return policy.capacity - std::min(policy.capacity, known.size());
+    }
+
+    size_t Mempool::readyCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return ready.size();
+    }
+
+    size_t Mempool::rejectedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return rejected;
+    }
+
+    size_t Mempool::expiredCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return expired;
+    }
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <Block.hpp>
+#include <NonceIndex.hpp>
+#include <ThreadPool.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Admission and block assembly settings of a mempool
+    struct MempoolPolicy {
+        /// A template is ready once this many verified transactions are waiting
+        size_t maxTransactions = 256;
+        /// A template is ready once the waiting transactions take this many bytes
+        size_t maxBytes = 1 << 20;
+        /// A template is ready once the oldest waiting transaction is this old
+        std::chrono::milliseconds maxAge = std::chrono::seconds(5);
+        /// Maximum number of transactions verified by a single worker task
+        size_t verifyBatchSize = 64;
+        /// Number of verification workers
+        size_t workers = std::thread::hardware_concurrency();
+        /// Maximum number of transactions held, verified or not
+        size_t capacity = 1 << 16;
+        /// Transactions waiting after a missing nonce are dropped once they are this old
+        std::chrono::milliseconds gapTimeout = std::chrono::seconds(60);
+    };
+
+    /// @brief Outcome of a transaction submission
+    enum class SubmitResult {
+        /// Queued for verification
+        Accepted,
+        /// A transaction with the same id is already in the mempool
+        Duplicate,
+        /// The mempool reached its capacity
+        Full,
+    };
+
+    /// @brief Outcome of the verification of a batch of transactions
+    struct VerificationResult {
+        /// Ids of the transactions that passed verification, see Transaction::id
+        std::vector<Hash> verified;
+        /// Ids of the transactions dropped because their signature was invalid
+        std::vector<Hash> rejected;
+    };
+
+    /// @brief Function called by a mempool once a batch of transactions got verified
+    using VerificationListener = std::function<void(const VerificationResult &result)>;
+
+    /// @brief Pool of signed transactions waiting to be included in a block
+    /// @note Transactions can be submitted concurrently from any number of threads.
+    /// They are verified in batches on a worker pool, and invalid ones are dropped
+    class Mempool {
+    public:
+        Mempool();
+        explicit Mempool(const MempoolPolicy &policy);
+
+        Mempool(const Mempool &) = delete;
+        Mempool(Mempool &&) = delete;
+        Mempool &operator=(const Mempool &) = delete;
+        Mempool &operator=(Mempool &&) = delete;
+
+        /// @brief Submit a signed transaction
+        /// @param tx The transaction to submit
+        /// @return Whether the transaction got queued for verification
+        SubmitResult submit(Transaction tx);
+
+        /// @brief Checks if the policy allows assembling a block
+        /// @param nonces The nonce index of the chain the template builds on
+        /// @return True if enough verified transactions are waiting, or if they waited long enough
+        /// @note Only the transactions a template can include count, the ones after a missing nonce do not
+        bool templateReady(const NonceIndex &nonces) const;
+
+        /// @brief Wait until the policy allows assembling a block
+        /// @param timeout The maximum time to wait
+        /// @param nonces The nonce index of the chain the template builds on, must not change meanwhile
+        /// @return True if a template is ready, false if the timeout expired
+        /// @note Transactions that waited after a missing nonce for longer than gapTimeout are dropped
+        bool waitForTemplate(std::chrono::milliseconds timeout, const NonceIndex &nonces);
+
+        /// @brief Assemble a block out of the oldest verified transactions
+        /// @param prevHash The hash of the block the template builds on
+        /// @param height The height of the template, one more than the block it builds on
+        /// @param nonces The nonce index of the chain the template builds on
+        /// @return A block holding at most maxTransactions transactions and maxBytes bytes
+        /// @note Each sender's transactions are ordered by nonce, starting at its next expected nonce.
+        /// Transactions with an already used nonce are dropped, the ones after a missing nonce are kept
+        /// for a later template, until gapTimeout. The included transactions are removed from the mempool
+        Block takeBlockTemplate(const Hash &prevHash, uint64_t height, const NonceIndex &nonces);
+
+        /// @brief Remove the transactions of a block added to the chain, such as a block received from a peer
+        /// @param block The block
+        /// @return The number of removed transactions
+        size_t removeIncluded(const Block &block);
+
+        /// @brief Call a function on every transaction held, verified or not
+        /// @param f The function to call
+        /// @note The mempool is locked during the calls, so f must not use it. Transactions
+        /// being verified by a worker are skipped
+        void forEach(const std::function<void(const Transaction &tx)> &f) const;
+
+        /// @brief Checks if a transaction is held, verified or not
+        /// @param hash The id of the transaction, see Transaction::id
+        /// @return True if a transaction with this id was submitted and is still held
+        bool contains(const Hash &hash) const;
+
+        /// @brief Get verified transactions out of their ids
+        /// @param hashes The ids of the transactions, see Transaction::id
+        /// @return The verified transactions found, in no particular order
+        std::vector<Transaction> find(const std::vector<Hash> &hashes) const;
+
+        /// @brief Add a function called once each batch of transactions got verified
+        /// @param listener The function, called from a worker thread
+        /// @return The id of the listener, to remove it
+        /// @note The listeners must not add or remove listeners themselves
+        size_t addListener(VerificationListener listener);
+
+        /// @brief Remove a listener
+        /// @param id The id returned by addListener
+        /// @note Once this returns, the listener is not being called anymore
+        void removeListener(size_t id);
+
+        /// @brief Wait until every submitted transaction got verified
+        void flush();
+
+        /// @brief Get the number of transactions held, verified or not
+        /// @return The number of transactions held
+        size_t size() const;
+
+        /// @brief Get the number of transactions that can still be submitted before the mempool is full
+        /// @return The number of free places, see MempoolPolicy::capacity
+        size_t room() const;
+
+        /// @brief Get the number of verified transactions waiting for a block
+        /// @return The number of verified transactions
+        size_t readyCount() const;
+
+        /// @brief Get the number of transactions dropped because their signature was invalid
+        /// @return The number of rejected transactions
+        size_t rejectedCount() const;
+
+        /// @brief Get the number of transactions dropped after waiting for a missing nonce for too long
+        /// @return The number of expired transactions
+        size_t expiredCount() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry {
+            Transaction tx;
+            /// Id of the transaction, see Transaction::id
+            Hash hash;
+            Clock::time_point arrival;
+            /// Set once the transaction got verified
+            Address sender;
+        };
+
+        /// @brief Send the next pending batch to the workers, the mutex must be held
+        void dispatchBatch();
+
+        /// @brief Verify a batch on a worker and move the valid transactions to the ready queue
+        void verifyBatch(std::vector<Entry> batch);
+
+        /// @brief Transactions a template can include, those starting at their sender's next nonce
+        struct Readiness {
+            size_t count = 0;
+            size_t bytes = 0;
+            Clock::time_point oldest = Clock::time_point::max();
+        };
+
+        /// @brief Get the indices of the ready transactions of each sender, ordered by nonce, the
+        /// senders ordered by their oldest transaction, the mutex must be held
+        std::vector<std::vector<size_t>> readyBySenderLocked() const;
+
+        /// @brief Get the transactions a template can include, the mutex must be held
+        Readiness readinessLocked(const NonceIndex &nonces) const;
+
+        /// @brief Same as templateReady, the mutex must be held
+        bool templateReadyLocked(const Readiness &readiness, Clock::time_point now) const;
+
+        /// @brief Drop the transactions waiting after a missing nonce for longer than gapTimeout,
+        /// the mutex must be held
+        void expireGapsLocked(const NonceIndex &nonces, Clock::time_point now);
+
+        MempoolPolicy policy;
+
+        mutable std::mutex mutex;
+        std::condition_variable readyCv;
+        std::condition_variable idleCv;
+
+        std::unordered_set<Hash, ArrayHash> known;
+        std::deque<Entry> pending;
+        std::deque<Entry> ready;
+        size_t inFlightBatches;
+        size_t rejected;
+        size_t expired;
+
+        /// Held while the listeners are called, so they can be removed safely
+        std::mutex listenersMutex;
+        std::vector<std::pair<size_t, VerificationListener>> listeners;
+        size_t nextListenerId;
+
+        // Declared last so the workers are joined before the state they use is destroyed
+        ThreadPool workers;
+    };
+}
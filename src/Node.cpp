@@ -0,0 +1,1315 @@
+#include <Node.hpp>
+#include <Exceptions.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <set>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace iotbc {
+    using Clock = std::chrono::steady_clock;
+
+    struct Node::Peer {
+        Peer(size_t knownInventorySize, double tokens)
+            : knownInventory(knownInventorySize), tokens(tokens), refilled(Clock::now()) {
+        }
+
+        uint64_t id;
+        std::shared_ptr<Connection> connection;
+
+        /// Last Headers message received, waited for by fetchHeaders
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::optional<HeadersMessage> headers;
+
+        /// Hashes waiting to be announced, and hashes the peer has, not announced to it
+        std::mutex inventoryMutex;
+        std::vector<Hash> inventory;
+        RollingFilter knownInventory;
+
+        /// Number of transactions the peer can still make the node fetch, refilled over time
+        double tokens;
+        Clock::time_point refilled;
+        /// Hashes announced by the peer past its rate, fetched once it got tokens again
+        std::deque<Hash> delayed;
+        /// Hashes announced by the peer while requested from another one, fetched if that one does not answer in time
+        std::deque<Hash> alternatives;
+    };
+
+    /// @brief Get the work of a block, the expected number of hashes needed to find it
+    static double blockWork(const Block &block) {
+        return std::ldexp(1.0, static_cast<int>(block.difficulty));
+    }
+
+    Node::Node(Blockchain &chain, const NodeOptions &options) : Node(chain, nullptr, options) {
+    }
+
+    Node::Node(Blockchain &chain, Mempool &mempool, const NodeOptions &options) : Node(chain, &mempool, options) {
+    }
+
+    Node::Node(Blockchain &chain, Mempool *mempool, const NodeOptions &options)
+        : chain(chain), chainMutex(), mempool(mempool), options(options), loop(), listenFd(-1), listenPort(0), stopping(false),
+        peersMutex(), peers(), nextPeerId(0), syncMutex(), download(), relayMutex(), pendingBlocks(),
+        saltGenerator(std::random_device()()), relay(), gossipMutex(), gossipCv(), inventoryFull(false),
+        seenTransactions(options.knownInventorySize), requestedTransactions(), requestOrder(),
+        expiredRequests(options.knownInventorySize), gossip(), verificationListener(0), verifier(1), gossiper(), loopThread() {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(options.port);
+
+        if (inet_pton(AF_INET, options.listenAddress.c_str(), &addr.sin_addr) != 1) {
+            throw NetworkError("Invalid listen address: " + options.listenAddress);
+        }
+
+        listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw NetworkError(std::string("Failed to create socket: ") + std::strerror(errno));
+        }
+
+        int enable = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        socklen_t length = sizeof(addr);
+        if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+            || ::listen(listenFd, 128) != 0
+            || ::getsockname(listenFd, reinterpret_cast<sockaddr *>(&addr), &length) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(listenFd);
+            throw NetworkError("Failed to listen on " + options.listenAddress + ": " + error);
+        }
+
+        try {
+            loop.add(listenFd, EPOLLIN, [this](uint32_t) { acceptPeers(); });
+        } catch (const NetworkError &e) {
+            ::close(listenFd);
+            throw;
+        }
+
+        listenPort = ntohs(addr.sin_port);
+        gossiper = std::thread([this]() { gossipLoop(); });
+        loopThread = std::thread([this]() { loop.run(); });
+
+        if (mempool != nullptr) {
+            verificationListener = mempool->addListener([this](const VerificationResult &result) {
+                if (!result.verified.empty()) {
+                    queueInventory(result.verified);
+                }
+            });
+        }
+    }
+
+    Node::~Node() {
+        if (mempool != nullptr) {
+            mempool->removeListener(verificationListener);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(gossipMutex);
+            stopping = true;
+        }
+        gossipCv.notify_all();
+        gossiper.join();
+
+        loop.stop();
+        loopThread.join();
+        ::close(listenFd);
+
+        // Tasks run in order, so the relayed blocks queued by the loop are done once this one is
+        verifier.submit([]() {}).wait();
+
+        // The connections close their sockets once the loop releases them
+        std::lock_guard<std::mutex> lock(peersMutex);
+        peers.clear();
+    }
+
+    void Node::connect(const std::string &host, uint16_t port) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo *result = nullptr;
+        int error = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+        if (error != 0) {
+            throw NetworkError("Failed to resolve " + host + ": " + gai_strerror(error));
+        }
+
+        int fd = -1;
+        for (addrinfo *it = result; it != nullptr && fd < 0; it = it->ai_next) {
+            fd = ::socket(it->ai_family, it->ai_socktype | SOCK_CLOEXEC, it->ai_protocol);
+
+            if (fd >= 0 && ::connect(fd, it->ai_addr, it->ai_addrlen) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo(result);
+
+        if (fd < 0) {
+            throw NetworkError("Failed to connect to " + host + ":" + std::to_string(port));
+        }
+
+        // Connected blocking, then driven by the loop
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        addPeer(fd);
+    }
+
+    size_t Node::peerCount() const {
+        return livePeers().size();
+    }
+
+    void Node::addPeer(int fd) {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        auto peer = std::make_shared<Peer>(options.knownInventorySize, options.maxTransactionsPerSecond);
+        peer->connection = std::make_shared<Connection>(loop, fd, options.maxMessageSize, options.maxSendBuffer);
+
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+
+            if (stopping) {
+                return;
+            }
+
+            peer->id = nextPeerId++;
+            peers.push_back(peer);
+        }
+
+        // The peer outlives its frame handler, it stays in peers until the connection closed. The close
+        // handler only holds it weakly, the peer holding the connection would keep both alive forever
+        peer->connection->start(
+            [this, raw = peer.get()](MessageType type, std::span<const unsigned char> payload) { handleMessage(*raw, type, payload); },
+            [this, weak = std::weak_ptr<Peer>(peer)]() {
+                if (auto peer = weak.lock()) {
+                    removePeer(peer);
+                }
+            });
+    }
+
+    void Node::acceptPeers() {
+        while (true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                // No more pending connections, or out of file descriptors until a peer leaves
+                break;
+            }
+
+            addPeer(fd);
+        }
+    }
+
+    void Node::removePeer(const std::shared_ptr<Peer> &peer) {
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+            std::erase(peers, peer);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+            std::erase_if(pendingBlocks, [&](const auto &entry) { return entry.second.peer == peer->id; });
+        }
+
+        // Wake up a sync waiting for this peer
+        {
+            std::lock_guard<std::mutex> lock(peer->mutex);
+        }
+        peer->cv.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(download.mutex);
+        }
+        download.cv.notify_all();
+    }
+
+    void Node::handleMessage(Peer &peer, MessageType type, std::span<const unsigned char> payload) {
+        switch (type) {
+            case MessageType::GetHeaders: {
+                GetHeadersMessage request = GetHeadersMessage::deserialize(payload);
+                std::vector<unsigned char> answer;
+
+                {
+                    std::lock_guard<std::mutex> lock(chainMutex);
+
+                    // Headers follow the highest locator block on the active chain, the genesis block if none is
+                    size_t start = 0;
+                    for (const auto &ref : request.locator) {
+                        if (ref.height < chain.chain.size() && chain.chain[ref.height].blockHash() == ref.hash) {
+                            start = ref.height + 1;
+                            break;
+                        }
+                    }
+
+                    start = std::min(start, chain.chain.size());
+                    size_t count = std::min<uint64_t>({request.maxHeaders, options.maxHeadersPerMessage, chain.chain.size() - start});
+                    size_t end = start + count;
+
+                    answer = HeadersMessage::serialize(std::span<const Block>(chain.chain.data() + start, end - start));
+                }
+
+                send(peer, MessageType::Headers, answer);
+                break;
+            }
+            case MessageType::Headers: {
+                HeadersMessage message = HeadersMessage::deserialize(payload);
+
+                {
+                    std::lock_guard<std::mutex> lock(peer.mutex);
+                    peer.headers = std::move(message);
+                }
+                peer.cv.notify_all();
+                break;
+            }
+            case MessageType::GetBlocks: {
+                GetBlocksMessage request = GetBlocksMessage::deserialize(payload);
+                InventoryMessage notFound;
+
+                for (const auto &ref : request.blocks) {
+                    std::vector<unsigned char> block;
+
+                    {
+                        std::lock_guard<std::mutex> lock(chainMutex);
+
+                        if (chain.hasBody(ref.height) && chain.chain[ref.height].blockHash() == ref.hash) {
+                            block = chain.chain[ref.height].serialize();
+                        }
+                    }
+
+                    if (block.empty()) {
+                        notFound.hashes.push_back(ref.hash);
+                    } else {
+                        send(peer, MessageType::Block, block);
+                    }
+                }
+
+                if (!notFound.hashes.empty()) {
+                    send(peer, MessageType::NotFound, notFound.serialize());
+                }
+                break;
+            }
+            case MessageType::Block: {
+                Block block = Block::deserialize(payload);
+                Hash hash = block.blockHash();
+
+                // A relayed block requested in full
+                bool relayed = false;
+                {
+                    std::lock_guard<std::mutex> lock(relayMutex);
+
+                    auto it = pendingBlocks.find(hash);
+                    if (it != pendingBlocks.end() && it->second.peer == peer.id && !it->second.reconstruction.has_value()) {
+                        pendingBlocks.erase(it);
+                        relayed = true;
+                    }
+                }
+
+                if (relayed) {
+                    if (!block.hasValidMerkleRoot()) {
+                        throw InvalidBlock("Relayed block does not match its merkle root");
+                    }
+
+                    acceptRelayedBlock(peer.id, std::move(block));
+                    break;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(download.mutex);
+
+                    // Blocks that were not asked for, or not to this peer, are ignored
+                    auto it = download.requested.find(hash);
+                    if (it == download.requested.end() || it->second != peer.id) {
+                        break;
+                    }
+
+                    download.requested.erase(it);
+                    download.received.emplace(hash, std::make_pair(std::move(block), peer.id));
+                    download.bytes += payload.size();
+                }
+                download.cv.notify_all();
+                break;
+            }
+            case MessageType::NotFound: {
+                InventoryMessage message = InventoryMessage::deserialize(payload);
+
+                {
+                    std::lock_guard<std::mutex> lock(download.mutex);
+
+                    for (const auto &hash : message.hashes) {
+                        auto it = download.requested.find(hash);
+
+                        if (it != download.requested.end() && it->second == peer.id) {
+                            download.requested.erase(it);
+                            download.missing.emplace_back(peer.id, hash);
+                        }
+                    }
+                }
+                download.cv.notify_all();
+
+                // The peer no longer has a block it relayed, it left its active chain
+                {
+                    std::lock_guard<std::mutex> lock(relayMutex);
+
+                    for (const auto &hash : message.hashes) {
+                        auto it = pendingBlocks.find(hash);
+
+                        if (it != pendingBlocks.end() && it->second.peer == peer.id) {
+                            pendingBlocks.erase(it);
+                        }
+                    }
+                }
+                break;
+            }
+            case MessageType::CompactBlock: {
+                handleCompactBlock(peer, CompactBlock::deserialize(payload));
+                break;
+            }
+            case MessageType::GetBlockTransactions: {
+                GetBlockTransactionsMessage request = GetBlockTransactionsMessage::deserialize(payload);
+                BlockTransactionsMessage answer;
+                answer.blockHash = request.block.hash;
+
+                bool found = false;
+                {
+                    std::lock_guard<std::mutex> lock(chainMutex);
+
+                    if (chain.hasBody(request.block.height) && chain.chain[request.block.height].blockHash() == request.block.hash) {
+                        const Block &block = chain.chain[request.block.height];
+                        found = true;
+
+                        for (size_t index : request.indices) {
+                            if (index >= block.transactions.size()) {
+                                throw NetworkError("Requested transaction index is out of range");
+                            }
+                            answer.transactions.push_back(block.transactions[index]);
+                        }
+                    }
+                }
+
+                if (found) {
+                    send(peer, MessageType::BlockTransactions, answer.serialize());
+                } else {
+                    InventoryMessage notFound;
+                    notFound.hashes.push_back(request.block.hash);
+                    send(peer, MessageType::NotFound, notFound.serialize());
+                }
+                break;
+            }
+            case MessageType::BlockTransactions: {
+                BlockTransactionsMessage message = BlockTransactionsMessage::deserialize(payload);
+                std::optional<BlockReconstruction> reconstruction;
+
+                {
+                    std::lock_guard<std::mutex> lock(relayMutex);
+
+                    auto it = pendingBlocks.find(message.blockHash);
+                    if (it == pendingBlocks.end() || it->second.peer != peer.id || !it->second.reconstruction.has_value()) {
+                        break;
+                    }
+
+                    reconstruction = std::move(it->second.reconstruction);
+                    pendingBlocks.erase(it);
+                }
+
+                // Transactions not matching their short id disconnect the peer
+                reconstruction->fillMissing(message.transactions);
+
+                std::optional<Block> block;
+                try {
+                    block = reconstruction->takeBlock();
+                } catch (const InvalidBlock &e) {
+                    requestFullBlock(peer, reconstruction->header().height, message.blockHash);
+                    break;
+                }
+
+                acceptRelayedBlock(peer.id, std::move(*block));
+                break;
+            }
+            case MessageType::TransactionInventory: {
+                handleInventory(peer, InventoryMessage::deserialize(payload));
+                break;
+            }
+            case MessageType::GetTransactions: {
+                InventoryMessage request = InventoryMessage::deserialize(payload);
+
+                if (request.hashes.size() > options.maxInventoryPerMessage) {
+                    throw NetworkError("Too many transactions requested");
+                }
+
+                if (mempool == nullptr) {
+                    break;
+                }
+
+                // Transactions no longer held are left out, the peer does not ask for them again
+                TransactionsMessage answer;
+                answer.transactions = mempool->find(request.hashes);
+
+                if (!answer.transactions.empty()) {
+                    send(peer, MessageType::Transactions, answer.serialize());
+                }
+                break;
+            }
+            case MessageType::Transactions: {
+                TransactionsMessage message = TransactionsMessage::deserialize(payload);
+
+                if (mempool == nullptr) {
+                    break;
+                }
+
+                std::vector<Hash> hashes;
+                hashes.reserve(message.transactions.size());
+                for (const auto &tx : message.transactions) {
+                    hashes.push_back(tx.id());
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(peer.inventoryMutex);
+
+                    for (const auto &hash : hashes) {
+                        peer.knownInventory.insert(hash);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(gossipMutex);
+
+                    // Transactions pushed without being asked for would bypass the rate limit
+                    for (const auto &hash : hashes) {
+                        if (requestedTransactions.erase(hash) == 0 && !seenTransactions.contains(hash) &&
+                            !expiredRequests.contains(hash)) {
+                            throw NetworkError("Unrequested transaction");
+                        }
+
+                        seenTransactions.insert(hash);
+                    }
+
+                    gossip.received += message.transactions.size();
+                }
+
+                // Invalid transactions are dropped by the mempool once verified
+                for (auto &tx : message.transactions) {
+                    mempool->submit(std::move(tx));
+                }
+                break;
+            }
+            default:
+                throw NetworkError("Unknown message type");
+        }
+    }
+
+    void Node::send(Peer &peer, MessageType type, std::span<const unsigned char> payload) {
+        peer.connection->send(type, payload);
+    }
+
+    void Node::disconnect(Peer &peer) {
+        peer.connection->shutdown();
+    }
+
+    std::vector<std::shared_ptr<Node::Peer>> Node::livePeers() const {
+        std::lock_guard<std::mutex> lock(peersMutex);
+
+        std::vector<std::shared_ptr<Peer>> live;
+        for (const auto &peer : peers) {
+            if (!peer->connection->closed()) {
+                live.push_back(peer);
+            }
+        }
+
+        return live;
+    }
+
+    Node::HeaderBranch Node::fetchHeaders(const std::shared_ptr<Peer> &peer, const std::vector<BlockRef> &locator,
+        const IConsensus &consensus, uint32_t minDifficulty, std::atomic<size_t> &budget) {
+        HeaderBranch branch;
+        branch.peer = peer;
+
+        GetHeadersMessage request;
+        request.locator = locator;
+
+        while (branch.headers.size() < options.maxHeadersPerPeer) {
+            request.maxHeaders = std::min(options.maxHeadersPerMessage, options.maxHeadersPerPeer - branch.headers.size());
+
+            {
+                std::lock_guard<std::mutex> lock(peer->mutex);
+                peer->headers.reset();
+            }
+
+            send(*peer, MessageType::GetHeaders, request.serialize());
+
+            HeadersMessage message;
+            {
+                std::unique_lock<std::mutex> lock(peer->mutex);
+
+                bool answered = peer->cv.wait_for(lock, options.requestTimeout, [&]() {
+                    return peer->headers.has_value() || peer->connection->closed();
+                });
+
+                if (!answered || !peer->headers.has_value()) {
+                    throw NetworkError("Peer did not answer with its headers");
+                }
+
+                message = std::move(*peer->headers);
+                peer->headers.reset();
+            }
+
+            // The peer has nothing after the last header
+            if (message.headers.empty()) {
+                break;
+            }
+
+            if (message.headers.size() > request.maxHeaders) {
+                throw InvalidBlock("Peer sent more headers than asked for");
+            }
+
+            // Headers stay in memory until the blocks are downloaded, the ones past the budget wait for the next sync
+            size_t received = message.headers.size();
+            size_t available = budget.load();
+            size_t granted;
+
+            do {
+                granted = std::min(received, available);
+            } while (!budget.compare_exchange_weak(available, available - granted));
+
+            message.headers.erase(message.headers.begin() + granted, message.headers.end());
+
+            for (auto &header : message.headers) {
+                if (header.version < BLOCK_VERSION_HEIGHT) {
+                    throw InvalidBlock("Header has no height");
+                }
+
+                if (branch.headers.empty()) {
+                    // The first header follows a block of the locator, or is a genesis block
+                    bool linked = header.height == 0 && header.prevHash == NULL_HASH;
+                    for (const auto &ref : request.locator) {
+                        linked = linked || (ref.height + 1 == header.height && ref.hash == header.prevHash);
+                    }
+
+                    if (!linked) {
+                        throw InvalidBlock("Headers do not follow the locator");
+                    }
+                } else {
+                    const Block &parent = branch.headers.back();
+
+                    if (header.prevHash != branch.hashes.back() || header.height != parent.height + 1) {
+                        throw InvalidBlock("Headers do not link together");
+                    }
+
+                    if (header.timestamp < parent.timestamp) {
+                        throw InvalidBlock("Header timestamp is before its parent's");
+                    }
+                }
+
+                consensus.verifyHeader(header, minDifficulty);
+
+                Hash hash = header.blockHash();
+                branch.hashes.push_back(hash);
+                branch.known.insert(hash);
+                branch.headers.push_back(std::move(header));
+            }
+
+            if (granted < received) {
+                break;
+            }
+
+            request.locator = {{branch.headers.back().height, branch.hashes.back()}};
+        }
+
+        return branch;
+    }
+
+    SyncStats Node::sync() {
+        std::lock_guard<std::mutex> syncLock(syncMutex);
+
+        SyncStats stats;
+        Clock::time_point start = Clock::now();
+
+        std::vector<BlockRef> locator;
+        std::shared_ptr<IConsensus> consensus;
+        uint32_t minDifficulty;
+
+        {
+            std::lock_guard<std::mutex> lock(chainMutex);
+            locator = chainLocator(chain.chain);
+            consensus = chain.consensus;
+            minDifficulty = chain.params.minDifficulty;
+        }
+
+        // Headers first, from every peer in parallel
+        std::vector<std::shared_ptr<Peer>> candidates = livePeers();
+        std::vector<std::future<HeaderBranch>> pending;
+        std::atomic<size_t> budget = options.maxHeadersPerSync;
+
+        for (const auto &peer : candidates) {
+            pending.push_back(std::async(std::launch::async, [&, peer]() {
+                return fetchHeaders(peer, locator, *consensus, minDifficulty, budget);
+            }));
+        }
+
+        std::vector<HeaderBranch> branches;
+        for (size_t i = 0; i < pending.size(); i++) {
+            try {
+                branches.push_back(pending[i].get());
+                stats.peers++;
+                stats.headers += branches.back().headers.size();
+            } catch (const std::exception &e) {
+                disconnect(*candidates[i]);
+            }
+        }
+
+        // Keep the branch adding the most work to the chain, it forks right after the locator block it follows
+        const HeaderBranch *best = nullptr;
+        double bestGain = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(chainMutex);
+
+            for (const auto &branch : branches) {
+                if (branch.headers.empty()) {
+                    continue;
+                }
+
+                double gain = 0;
+                for (const auto &header : branch.headers) {
+                    gain += blockWork(header);
+                }
+                for (size_t i = branch.headers.front().height; i < chain.chain.size(); i++) {
+                    gain -= blockWork(chain.chain[i]);
+                }
+
+                if (gain > bestGain) {
+                    best = &branch;
+                    bestGain = gain;
+                }
+            }
+        }
+
+        Clock::time_point headersDone = Clock::now();
+        stats.headersTime = headersDone - start;
+
+        if (best != nullptr) {
+            downloadBlocks(*best, branches, stats);
+        }
+
+        stats.blocksTime = Clock::now() - headersDone;
+
+        return stats;
+    }
+
+    void Node::downloadBlocks(const HeaderBranch &best, const std::vector<HeaderBranch> &branches, SyncStats &stats) {
+        struct Request {
+            const HeaderBranch *branch;
+            std::vector<size_t> indices;
+            Clock::time_point deadline;
+        };
+
+        size_t count = best.headers.size();
+
+        // Indices of the blocks not requested yet, served lowest first so blocks can be added in order
+        std::set<size_t> unrequested;
+        for (size_t i = 0; i < count; i++) {
+            unrequested.insert(i);
+        }
+
+        std::unordered_map<Hash, size_t, ArrayHash> indexOf;
+        for (size_t i = 0; i < count; i++) {
+            indexOf.emplace(best.hashes[i], i);
+        }
+
+        // Peers answering NotFound lose the block from the ones they are asked for
+        std::vector<std::unordered_set<Hash, ArrayHash>> lacking(branches.size());
+
+        std::vector<Request> inFlight;
+        std::unordered_set<uint64_t> usedPeers;
+        size_t next = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(download.mutex);
+            download.requested.clear();
+            download.received.clear();
+            download.missing.clear();
+            download.bytes = 0;
+        }
+
+        auto requeue = [&](const Request &request) {
+            std::lock_guard<std::mutex> lock(download.mutex);
+
+            for (size_t index : request.indices) {
+                auto it = download.requested.find(best.hashes[index]);
+
+                if (it != download.requested.end() && it->second == request.branch->peer->id) {
+                    download.requested.erase(it);
+                    unrequested.insert(index);
+                }
+            }
+        };
+
+        try {
+            while (next < count) {
+                // Spread the blocks not requested yet over the peers having them
+                bool assigned = true;
+                while (assigned && !unrequested.empty()) {
+                    assigned = false;
+
+                    for (size_t b = 0; b < branches.size() && !unrequested.empty(); b++) {
+                        const HeaderBranch &branch = branches[b];
+
+                        size_t requests = std::count_if(inFlight.begin(), inFlight.end(), [&](const Request &request) {
+                            return request.branch == &branch;
+                        });
+
+                        if (branch.peer->connection->closed() || requests >= options.maxRequestsPerPeer) {
+                            continue;
+                        }
+
+                        Request request = {&branch, {}, Clock::now() + options.requestTimeout};
+                        GetBlocksMessage message;
+
+                        for (auto it = unrequested.begin(); it != unrequested.end() && request.indices.size() < options.blocksPerRequest;) {
+                            const Hash &hash = best.hashes[*it];
+
+                            if (branch.known.contains(hash) && !lacking[b].contains(hash)) {
+                                request.indices.push_back(*it);
+                                message.blocks.push_back({best.headers[*it].height, hash});
+                                it = unrequested.erase(it);
+                            } else {
+                                ++it;
+                            }
+                        }
+
+                        if (request.indices.empty()) {
+                            continue;
+                        }
+
+                        {
+                            std::lock_guard<std::mutex> lock(download.mutex);
+                            for (const auto &ref : message.blocks) {
+                                download.requested[ref.hash] = branch.peer->id;
+                            }
+                        }
+
+                        try {
+                            send(*branch.peer, MessageType::GetBlocks, message.serialize());
+                        } catch (const NetworkError &e) {
+                            requeue(request);
+                            continue;
+                        }
+
+                        inFlight.push_back(std::move(request));
+                        assigned = true;
+                    }
+                }
+
+                // No peer is asked for anything and none can be, the remaining blocks cannot be downloaded
+                if (inFlight.empty()) {
+                    std::lock_guard<std::mutex> lock(download.mutex);
+                    if (!download.received.contains(best.hashes[next])) {
+                        break;
+                    }
+                }
+
+                std::vector<std::pair<Block, uint64_t>> ready;
+                std::vector<std::pair<uint64_t, Hash>> missing;
+
+                {
+                    std::unique_lock<std::mutex> lock(download.mutex);
+
+                    Clock::time_point deadline = Clock::time_point::max();
+                    for (const auto &request : inFlight) {
+                        deadline = std::min(deadline, request.deadline);
+                    }
+
+                    auto progressed = [&]() {
+                        return download.received.contains(best.hashes[next]) || !download.missing.empty()
+                            || std::any_of(inFlight.begin(), inFlight.end(), [](const Request &request) {
+                                return request.branch->peer->connection->closed();
+                            });
+                    };
+
+                    if (inFlight.empty()) {
+                        download.cv.wait(lock, progressed);
+                    } else {
+                        download.cv.wait_until(lock, deadline, progressed);
+                    }
+
+                    // Take the blocks that can be added in order
+                    for (size_t i = next; i < count; i++) {
+                        auto it = download.received.find(best.hashes[i]);
+                        if (it == download.received.end()) {
+                            break;
+                        }
+
+                        ready.push_back(std::move(it->second));
+                        download.received.erase(it);
+                    }
+
+                    missing.swap(download.missing);
+
+                    // Requests are done once none of their blocks is still expected
+                    std::erase_if(inFlight, [&](const Request &request) {
+                        return std::none_of(request.indices.begin(), request.indices.end(), [&](size_t index) {
+                            return download.requested.contains(best.hashes[index]);
+                        });
+                    });
+                }
+
+                for (const auto &[peerId, hash] : missing) {
+                    for (size_t b = 0; b < branches.size(); b++) {
+                        if (branches[b].peer->id == peerId) {
+                            lacking[b].insert(hash);
+                        }
+                    }
+                    unrequested.insert(indexOf.at(hash));
+                }
+
+                // Peers too slow to answer are dropped, and their requests sent to other peers
+                Clock::time_point now = Clock::now();
+                std::erase_if(inFlight, [&](const Request &request) {
+                    if (now < request.deadline && !request.branch->peer->connection->closed()) {
+                        return false;
+                    }
+
+                    disconnect(*request.branch->peer);
+                    requeue(request);
+                    return true;
+                });
+
+                for (auto &[block, peerId] : ready) {
+                    try {
+                        addBlock(block);
+                    } catch (const InvalidBlock &e) {
+                        for (const auto &branch : branches) {
+                            if (branch.peer->id == peerId) {
+                                disconnect(*branch.peer);
+                            }
+                        }
+                        throw;
+                    }
+
+                    usedPeers.insert(peerId);
+                    stats.blocks++;
+                    next++;
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(download.mutex);
+            download.requested.clear();
+            download.received.clear();
+            throw;
+        }
+
+        std::lock_guard<std::mutex> lock(download.mutex);
+        stats.bytes = download.bytes;
+        stats.peersUsed = usedPeers.size();
+        download.requested.clear();
+        download.received.clear();
+        download.missing.clear();
+    }
+
+    BlockStatus Node::addBlock(const Block &block, bool transactionsVerified) {
+        std::lock_guard<std::mutex> lock(chainMutex);
+        BlockStatus status = chain.submitBlock(block, transactionsVerified);
+
+        // Under the chain lock, so a block seen in the chain never has its transactions in the mempool
+        if (mempool != nullptr && (status == BlockStatus::Connected || status == BlockStatus::Reorganized)) {
+            mempool->removeIncluded(block);
+        }
+
+        return status;
+    }
+
+    BlockStatus Node::publishBlock(const Block &block) {
+        BlockStatus status = addBlock(block);
+
+        if (status == BlockStatus::Connected || status == BlockStatus::Reorganized) {
+            announce(block, std::nullopt);
+        }
+
+        return status;
+    }
+
+    void Node::queueInventory(const std::vector<Hash> &hashes) {
+        {
+            std::lock_guard<std::mutex> lock(gossipMutex);
+
+            for (const auto &hash : hashes) {
+                seenTransactions.insert(hash);
+            }
+        }
+
+        bool full = false;
+
+        for (const auto &peer : livePeers()) {
+            std::lock_guard<std::mutex> lock(peer->inventoryMutex);
+
+            for (const auto &hash : hashes) {
+                if (!peer->knownInventory.contains(hash)) {
+                    peer->knownInventory.insert(hash);
+                    peer->inventory.push_back(hash);
+                }
+            }
+
+            full = full || peer->inventory.size() >= options.maxInventoryPerMessage;
+        }
+
+        if (full) {
+            {
+                std::lock_guard<std::mutex> lock(gossipMutex);
+                inventoryFull = true;
+            }
+            gossipCv.notify_all();
+        }
+    }
+
+    void Node::gossipLoop() {
+        std::unique_lock<std::mutex> lock(gossipMutex);
+
+        while (!stopping) {
+            gossipCv.wait_for(lock, options.inventoryInterval, [this]() { return stopping || inventoryFull; });
+            inventoryFull = false;
+            lock.unlock();
+
+            size_t announced = 0;
+            size_t messages = 0;
+
+            for (const auto &peer : livePeers()) {
+                // Delayed transactions are fetched as their peer gets tokens again
+                if (mempool != nullptr) {
+                    try {
+                        requestTransactions(*peer, {});
+                    } catch (const NetworkError &e) {
+                        // The peer disconnected, its connection cleans up
+                        continue;
+                    }
+                }
+
+                std::vector<Hash> hashes;
+                {
+                    std::lock_guard<std::mutex> peerLock(peer->inventoryMutex);
+                    hashes.swap(peer->inventory);
+                }
+
+                for (size_t start = 0; start < hashes.size(); start += options.maxInventoryPerMessage) {
+                    size_t end = std::min(hashes.size(), start + options.maxInventoryPerMessage);
+
+                    InventoryMessage message;
+                    message.hashes.assign(hashes.begin() + start, hashes.begin() + end);
+
+                    try {
+                        send(*peer, MessageType::TransactionInventory, message.serialize());
+                    } catch (const NetworkError &e) {
+                        // The peer disconnected, its connection cleans up
+                        break;
+                    }
+
+                    announced += end - start;
+                    messages++;
+                }
+            }
+
+            lock.lock();
+            gossip.announced += announced;
+            gossip.inventoryMessages += messages;
+        }
+    }
+
+    void Node::handleInventory(Peer &peer, const InventoryMessage &message) {
+        if (message.hashes.size() > options.maxInventoryPerMessage) {
+            throw NetworkError("Inventory is too large");
+        }
+
+        if (mempool != nullptr) {
+            requestTransactions(peer, message.hashes);
+        }
+    }
+
+    void Node::requestTransactions(Peer &peer, const std::vector<Hash> &announced) {
+        InventoryMessage request;
+
+        {
+            std::lock_guard<std::mutex> peerLock(peer.inventoryMutex);
+
+            for (const auto &hash : announced) {
+                peer.knownInventory.insert(hash);
+            }
+
+            // Token bucket, refilled at the allowed rate up to a second worth
+            Clock::time_point now = Clock::now();
+            std::chrono::duration<double> elapsed = now - peer.refilled;
+            peer.tokens = std::min(options.maxTransactionsPerSecond, peer.tokens + elapsed.count() * options.maxTransactionsPerSecond);
+            peer.refilled = now;
+
+            std::lock_guard<std::mutex> lock(gossipMutex);
+
+            gossip.inventoryReceived += announced.size();
+            expireTransactionRequests(now);
+
+            auto known = [&](const Hash &hash) {
+                return seenTransactions.contains(hash) || mempool->contains(hash);
+            };
+
+            // False once the peer ran out of tokens, the hash must wait
+            auto fetch = [&](const Hash &hash) {
+                if (known(hash)) {
+                    gossip.duplicates++;
+                    return true;
+                }
+
+                if (requestedTransactions.contains(hash)) {
+                    // Asked to this peer if the one it was requested from does not answer in time
+                    if (peer.alternatives.size() < options.knownInventorySize) {
+                        peer.alternatives.push_back(hash);
+                    }
+                    gossip.duplicates++;
+                    return true;
+                }
+
+                if (peer.tokens < 1 || request.hashes.size() >= options.maxInventoryPerMessage) {
+                    return false;
+                }
+
+                peer.tokens--;
+                Clock::time_point deadline = now + options.transactionRequestTimeout;
+                requestedTransactions[hash] = deadline;
+                requestOrder.emplace_back(deadline, hash);
+                request.hashes.push_back(hash);
+                return true;
+            };
+
+            // Requests that expired are moved to this peer first, the oldest are the first to expire
+            while (!peer.alternatives.empty()) {
+                const Hash &hash = peer.alternatives.front();
+
+                if (!known(hash)) {
+                    if (requestedTransactions.contains(hash) || !fetch(hash)) {
+                        break;
+                    }
+                    gossip.rerequested++;
+                }
+
+                peer.alternatives.pop_front();
+            }
+
+            // Delayed hashes go first, new ones queue behind them
+            while (!peer.delayed.empty() && fetch(peer.delayed.front())) {
+                peer.delayed.pop_front();
+            }
+
+            for (const auto &hash : announced) {
+                if (peer.delayed.empty() && fetch(hash)) {
+                    continue;
+                }
+
+                if (peer.delayed.size() >= options.knownInventorySize) {
+                    gossip.dropped++;
+                } else {
+                    peer.delayed.push_back(hash);
+                    gossip.delayed++;
+                }
+            }
+
+            gossip.requested += request.hashes.size();
+        }
+
+        if (!request.hashes.empty()) {
+            send(peer, MessageType::GetTransactions, request.serialize());
+        }
+    }
+
+    void Node::expireTransactionRequests(Clock::time_point now) {
+        while (!requestOrder.empty() && requestOrder.front().first <= now) {
+            const auto &[deadline, hash] = requestOrder.front();
+            auto it = requestedTransactions.find(hash);
+
+            // Skip the hashes received since, or requested again later
+            if (it != requestedTransactions.end() && it->second == deadline) {
+                requestedTransactions.erase(it);
+                expiredRequests.insert(hash);
+            }
+
+            requestOrder.pop_front();
+        }
+    }
+
+    GossipStats Node::gossipStats() const {
+        std::lock_guard<std::mutex> lock(gossipMutex);
+
+        return gossip;
+    }
+
+    RelayStats Node::relayStats() const {
+        std::lock_guard<std::mutex> lock(relayMutex);
+
+        return relay;
+    }
+
+    void Node::announce(const Block &block, std::optional<uint64_t> source) {
+        uint64_t salt;
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+            salt = saltGenerator();
+        }
+
+        std::vector<unsigned char> payload = CompactBlock::fromBlock(block, salt).serialize();
+
+        for (const auto &peer : livePeers()) {
+            if (peer->id == source) {
+                continue;
+            }
+
+            try {
+                send(*peer, MessageType::CompactBlock, payload);
+            } catch (const NetworkError &e) {
+                // The peer disconnected, its thread cleans it up
+            }
+        }
+    }
+
+    void Node::handleCompactBlock(Peer &peer, const CompactBlock &compact) {
+        Hash hash = compact.header.blockHash();
+
+        {
+            std::lock_guard<std::mutex> lock(chainMutex);
+
+            if (compact.header.height < chain.chain.size() && chain.chain[compact.header.height].blockHash() == hash) {
+                return;
+            }
+
+            // Headers without a valid consensus proof are not worth rebuilding
+            chain.consensus->verifyHeader(compact.header, chain.params.minDifficulty);
+        }
+
+        BlockReconstruction reconstruction(compact);
+        if (mempool != nullptr) {
+            reconstruction.fill(*mempool);
+        }
+
+        std::vector<size_t> missing = reconstruction.missing();
+
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+
+            // Another peer relayed the block first
+            if (pendingBlocks.contains(hash)) {
+                return;
+            }
+
+            relay.compactBlocks++;
+
+            if (!missing.empty()) {
+                // Headers are cheap to forge without a minimum difficulty, a peer cannot pile them up
+                if (!hasRoomForPendingBlock(peer.id)) {
+                    relay.ignored++;
+                    return;
+                }
+
+                relay.transactionsRequested += missing.size();
+                pendingBlocks.emplace(hash, PendingBlock{peer.id, std::move(reconstruction), Clock::now() + options.requestTimeout});
+            } else {
+                relay.reconstructed++;
+            }
+        }
+
+        if (!missing.empty()) {
+            GetBlockTransactionsMessage request;
+            request.block = {compact.header.height, hash};
+            request.indices = std::move(missing);
+
+            send(peer, MessageType::GetBlockTransactions, request.serialize());
+            return;
+        }
+
+        std::optional<Block> block;
+        try {
+            block = reconstruction.takeBlock();
+        } catch (const InvalidBlock &e) {
+            requestFullBlock(peer, compact.header.height, hash);
+            return;
+        }
+
+        acceptRelayedBlock(peer.id, std::move(*block));
+    }
+
+    void Node::requestFullBlock(Peer &peer, uint64_t height, const Hash &hash) {
+        {
+            std::lock_guard<std::mutex> lock(relayMutex);
+
+            if (!pendingBlocks.contains(hash) && !hasRoomForPendingBlock(peer.id)) {
+                relay.ignored++;
+                return;
+            }
+
+            relay.fullBlocksRequested++;
+            pendingBlocks.insert_or_assign(hash, PendingBlock{peer.id, std::nullopt, Clock::now() + options.requestTimeout});
+        }
+
+        GetBlocksMessage request;
+        request.blocks.push_back({height, hash});
+
+        send(peer, MessageType::GetBlocks, request.serialize());
+    }
+
+    bool Node::hasRoomForPendingBlock(uint64_t peer) {
+        Clock::time_point now = Clock::now();
+        relay.expired += std::erase_if(pendingBlocks, [&](const auto &entry) { return entry.second.deadline <= now; });
+
+        if (pendingBlocks.size() >= options.maxPendingBlocks) {
+            return false;
+        }
+
+        size_t fromPeer = std::count_if(pendingBlocks.begin(), pendingBlocks.end(), [&](const auto &entry) {
+            return entry.second.peer == peer;
+        });
+
+        return fromPeer < options.maxPendingBlocksPerPeer;
+    }
+
+    void Node::acceptRelayedBlock(uint64_t source, Block block) {
+        verifier.submit([this, source, block = std::move(block)]() {
+            auto disconnectSource = [this, source]() {
+                for (const auto &peer : livePeers()) {
+                    if (peer->id == source) {
+                        disconnect(*peer);
+                    }
+                }
+            };
+
+            try {
+                block.verifyTransactions();
+            } catch (const InvalidTransaction &e) {
+                disconnectSource();
+                return;
+            } catch (const InvalidSignature &e) {
+                disconnectSource();
+                return;
+            }
+
+            // The loop only waits on this short lock, not on the signatures
+            BlockStatus status;
+            try {
+                status = addBlock(block, true);
+            } catch (const InvalidBlock &e) {
+                disconnectSource();
+                return;
+            }
+
+            // Blocks are relayed once, when they join the active chain
+            if (status == BlockStatus::Connected || status == BlockStatus::Reorganized) {
+                announce(block, source);
+            }
+        });
+    }
+}
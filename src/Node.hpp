@@ -0,0 +1,366 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Blockchain.hpp>
+#include <CompactBlock.hpp>
+#include <Connection.hpp>
+#include <EventLoop.hpp>
+#include <Mempool.hpp>
+#include <Protocol.hpp>
+#include <RollingFilter.hpp>
+#include <ThreadPool.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Network settings of a node
+    struct NodeOptions {
+        /// Address the node accepts peers on
+        std::string listenAddress = "127.0.0.1";
+        /// Port the node accepts peers on, 0 picks a free one, see Node::port
+        uint16_t port = 0;
+        /// Maximum number of headers sent in a single Headers message
+        size_t maxHeadersPerMessage = 2000;
+        /// Maximum number of headers a sync downloads from a single peer, the next sync continues after them
+        size_t maxHeadersPerPeer = 100000;
+        /// Maximum number of headers a sync downloads from all its peers together
+        size_t maxHeadersPerSync = 400000;
+        /// Number of blocks asked for in a single GetBlocks message
+        size_t blocksPerRequest = 16;
+        /// Maximum number of GetBlocks requests waiting for an answer from a single peer
+        size_t maxRequestsPerPeer = 4;
+        /// Time a peer has to answer a request before it is disconnected, or before a block it relayed is forgotten
+        std::chrono::milliseconds requestTimeout = std::chrono::seconds(10);
+        /// Maximum number of relayed blocks waiting for an answer from a single peer, the next ones are ignored
+        size_t maxPendingBlocksPerPeer = 8;
+        /// Maximum number of relayed blocks waiting for an answer from all the peers together
+        size_t maxPendingBlocks = 64;
+        /// Maximum size of a received message, larger ones disconnect the peer
+        size_t maxMessageSize = 32 << 20;
+        /// Maximum number of bytes waiting to be sent to a peer, a peer not reading them is disconnected
+        size_t maxSendBuffer = 64 << 20;
+        /// Time new transaction hashes wait before being announced, so they share a TransactionInventory message
+        std::chrono::milliseconds inventoryInterval = std::chrono::milliseconds(100);
+        /// Maximum number of hashes in a TransactionInventory or GetTransactions message, a full batch is announced right away
+        size_t maxInventoryPerMessage = 1000;
+        /// Number of transactions a single peer can make the node fetch per second, with bursts of a second worth.
+        /// The transactions it announces past that are fetched later, up to knownInventorySize of them
+        double maxTransactionsPerSecond = 1000;
+        /// Time a peer has to answer a GetTransactions message, before the transactions are asked to another peer announcing them
+        std::chrono::milliseconds transactionRequestTimeout = std::chrono::seconds(2);
+        /// Number of recent transaction hashes remembered by the node, not to request them twice,
+        /// and for every peer, not to announce them to a peer that has them
+        size_t knownInventorySize = 20000;
+    };
+
+    /// @brief Outcome of Node::sync
+    struct SyncStats {
+        /// Number of peers that answered with their headers
+        size_t peers = 0;
+        /// Number of headers received, from every peer
+        size_t headers = 0;
+        /// Number of downloaded blocks added to the chain
+        size_t blocks = 0;
+        /// Serialized size of the downloaded blocks
+        size_t bytes = 0;
+        /// Number of peers the blocks were downloaded from
+        size_t peersUsed = 0;
+        /// Downloading and checking the headers
+        std::chrono::duration<double> headersTime{0};
+        /// Downloading the blocks and adding them to the chain
+        std::chrono::duration<double> blocksTime{0};
+    };
+
+    /// @brief Counters of the blocks relayed to the node as compact blocks
+    struct RelayStats {
+        /// Number of compact blocks received
+        size_t compactBlocks = 0;
+        /// Number of compact blocks rebuilt without asking the peer for transactions
+        size_t reconstructed = 0;
+        /// Number of transactions asked for because the mempool did not hold them
+        size_t transactionsRequested = 0;
+        /// Number of blocks fetched in full because their rebuilt transactions did not match the header
+        size_t fullBlocksRequested = 0;
+        /// Number of relayed blocks ignored, because too many were already waiting for an answer
+        size_t ignored = 0;
+        /// Number of relayed blocks forgotten, because their peer did not answer in time
+        size_t expired = 0;
+    };
+
+    /// @brief Counters of the transactions gossiped between the node and its peers
+    struct GossipStats {
+        /// Number of transaction hashes announced to peers
+        size_t announced = 0;
+        /// Number of TransactionInventory messages sent
+        size_t inventoryMessages = 0;
+        /// Number of transaction hashes announced by peers
+        size_t inventoryReceived = 0;
+        /// Number of announced transactions already held or requested
+        size_t duplicates = 0;
+        /// Number of announced transactions fetched later, because their peer exceeded its rate
+        size_t delayed = 0;
+        /// Number of announced transactions ignored, because their peer had too many delayed already
+        size_t dropped = 0;
+        /// Number of transactions requested from peers
+        size_t requested = 0;
+        /// Number of requested transactions asked to another peer, because the first one did not answer in time
+        size_t rerequested = 0;
+        /// Number of requested transactions received and submitted to the mempool
+        size_t received = 0;
+    };
+
+    /// @brief Node sharing a chain with its peers over TCP
+    /// @note Peers serve the headers and blocks of their active chain. Syncing downloads the headers of
+    /// every peer first, then the blocks of the branch with the most work, from every peer having them
+    /// in parallel, in the Block::serialize wire format. New blocks are relayed as compact blocks,
+    /// rebuilt out of the mempool of the receiving node. Transactions verified by the mempool are
+    /// announced to the peers in batches of hashes, and peers fetch the ones they miss. Every connection
+    /// is driven by a single event loop thread, so idle peers cost no thread. The chain is shared with the node threads,
+    /// so it must only be accessed through withChain while the node runs
+    class Node {
+    public:
+        /// @brief Start accepting peers
+        /// @param chain The chain served to peers and extended by sync
+        /// @param options The network settings
+        /// @throws iotbc::NetworkError if the node cannot listen on the address
+        explicit Node(Blockchain &chain, const NodeOptions &options = NodeOptions());
+
+        /// @brief Start accepting peers, rebuilding the compact blocks they relay out of a mempool
+        /// @param chain The chain served to peers and extended by sync
+        /// @param mempool The mempool holding the transactions shared with the peers, transactions
+        /// of the blocks added to the chain are removed from it, and transactions fetched from peers added
+        /// @param options The network settings
+        /// @throws iotbc::NetworkError if the node cannot listen on the address
+        Node(Blockchain &chain, Mempool &mempool, const NodeOptions &options = NodeOptions());
+
+        /// @brief Disconnect every peer and stop accepting new ones
+        ~Node();
+
+        Node(const Node &) = delete;
+        Node(Node &&) = delete;
+        Node &operator=(const Node &) = delete;
+        Node &operator=(Node &&) = delete;
+
+        /// @brief Get the port the node accepts peers on
+        /// @return The port, the one picked by the system if NodeOptions::port is 0
+        inline uint16_t port() const
+        {
+            return listenPort;
+        }
+
+        /// @brief Connect to a peer
+        /// @param host The host name or address of the peer
+        /// @param port The port the peer accepts nodes on
+        /// @throws iotbc::NetworkError if the connection fails
+        void connect(const std::string &host, uint16_t port);
+
+        /// @brief Get the number of connected peers, inbound or outbound
+        /// @return The number of connected peers
+        size_t peerCount() const;
+
+        /// @brief Download the branch with the most work known to the peers, and add it to the chain
+        /// @return What was downloaded
+        /// @throws iotbc::InvalidBlock if a downloaded block is invalid, the peer that sent it is disconnected
+        /// @note Peers failing to answer in time or sending invalid headers are disconnected, and their
+        /// requests are sent to other peers. If no peer has the remaining blocks, the sync stops early
+        SyncStats sync();
+
+        /// @brief Add a block to the chain and relay it to every peer as a compact block
+        /// @param block The block, such as a block sealed by this node
+        /// @return Where the block was added, it is only relayed if it was connected
+        /// @throws iotbc::InvalidBlock if the block is invalid
+        BlockStatus publishBlock(const Block &block);
+
+        /// @brief Get the counters of the compact blocks relayed to the node
+        /// @return The counters since the node started
+        RelayStats relayStats() const;
+
+        /// @brief Get the counters of the transactions gossiped with the peers
+        /// @return The counters since the node started
+        GossipStats gossipStats() const;
+
+        /// @brief Access the chain while the node threads cannot
+        /// @param f The function called with the chain
+        /// @return What f returns
+        template <typename F>
+        auto withChain(F &&f)
+        {
+            std::lock_guard<std::mutex> lock(chainMutex);
+            return f(chain);
+        }
+
+    private:
+        struct Peer;
+
+        /// @brief Headers received from a peer, checked to link together and to the chain
+        struct HeaderBranch {
+            std::shared_ptr<Peer> peer;
+            std::vector<Block> headers;
+            std::vector<Hash> hashes;
+            std::unordered_set<Hash, ArrayHash> known;
+        };
+
+        /// @brief State of the blocks being downloaded by sync, shared with the loop thread
+        struct Download {
+            std::mutex mutex;
+            std::condition_variable cv;
+            /// Peer each requested block is expected from
+            std::unordered_map<Hash, uint64_t, ArrayHash> requested;
+            /// Received blocks not added to the chain yet, along with the peer that sent them
+            std::unordered_map<Hash, std::pair<Block, uint64_t>, ArrayHash> received;
+            /// Requested blocks the peers answered they do not have
+            std::vector<std::pair<uint64_t, Hash>> missing;
+            /// Serialized size of the received blocks
+            size_t bytes = 0;
+        };
+
+        Node(Blockchain &chain, Mempool *mempool, const NodeOptions &options);
+
+        /// @brief Compact block waiting for transactions, or a block whose full body was requested
+        struct PendingBlock {
+            /// The peer that relayed the block
+            uint64_t peer;
+            /// The block being rebuilt, unset if the full block was requested
+            std::optional<BlockReconstruction> reconstruction;
+            /// Time after which the block is forgotten if the peer did not answer
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        /// @brief Forget the relayed blocks not answered in time, then check if a peer can have one more waiting
+        /// @note Called with relayMutex held
+        bool hasRoomForPendingBlock(uint64_t peer);
+
+        /// @brief Rebuild a compact block relayed by a peer, asking it for what the mempool misses
+        void handleCompactBlock(Peer &peer, const CompactBlock &compact);
+
+        /// @brief Ask a peer for a relayed block in full, once its rebuilt transactions did not match
+        void requestFullBlock(Peer &peer, uint64_t height, const Hash &hash);
+
+        /// @brief Add a block to the chain, and remove its transactions from the mempool if it got connected
+        /// @param transactionsVerified Skip the signatures, see Blockchain::addBlock
+        /// @throws iotbc::InvalidBlock if the block is invalid
+        BlockStatus addBlock(const Block &block, bool transactionsVerified = false);
+
+        /// @brief Verify a block relayed by a peer on the verifier thread, then add it and relay it to the
+        /// other peers if it got connected
+        /// @note The signatures are verified without the chain lock, the peer is disconnected if the block is invalid
+        void acceptRelayedBlock(uint64_t source, Block block);
+
+        /// @brief Send a block as a compact block to every peer but its source
+        void announce(const Block &block, std::optional<uint64_t> source);
+
+        /// @brief Queue the hashes of transactions verified by the mempool, to announce them to every peer lacking them
+        void queueInventory(const std::vector<Hash> &hashes);
+
+        /// @brief Announce the queued transaction hashes, until the node stops
+        void gossipLoop();
+
+        /// @brief Fetch the transactions announced by a peer that are new to the node
+        /// @throws iotbc::NetworkError if the inventory is too large
+        void handleInventory(Peer &peer, const InventoryMessage &message);
+
+        /// @brief Request the new transactions announced by a peer, and the ones it delayed, within its rate
+        /// @throws iotbc::NetworkError if the request cannot be sent
+        void requestTransactions(Peer &peer, const std::vector<Hash> &announced);
+
+        /// @brief Forget the transaction requests not answered in time, so another peer announcing them is asked
+        /// @note Called with gossipMutex held
+        void expireTransactionRequests(std::chrono::steady_clock::time_point now);
+
+        /// @brief Register a connected non-blocking socket and start reading from it
+        void addPeer(int fd);
+
+        /// @brief Accept the pending peers, on the loop thread
+        void acceptPeers();
+
+        /// @brief Forget a peer once its connection closed, on the loop thread
+        void removePeer(const std::shared_ptr<Peer> &peer);
+
+        /// @brief Handle a message received from a peer
+        /// @throws iotbc::DeserializationError if the message is invalid
+        /// @throws iotbc::NetworkError if the message is unexpected or an answer cannot be sent
+        void handleMessage(Peer &peer, MessageType type, std::span<const unsigned char> payload);
+
+        /// @brief Send a message to a peer
+        /// @throws iotbc::NetworkError if the peer disconnected, or does not read its messages
+        void send(Peer &peer, MessageType type, std::span<const unsigned char> payload);
+
+        /// @brief Close the connection with a peer, the loop forgets it
+        void disconnect(Peer &peer);
+
+        /// @brief Get the peers still connected
+        std::vector<std::shared_ptr<Peer>> livePeers() const;
+
+        /// @brief Download the headers a peer has after the locator, up to NodeOptions::maxHeadersPerPeer
+        /// @param budget Number of headers the sync can still download, shared by every peer
+        /// @throws iotbc::NetworkError if the peer does not answer in time
+        /// @throws iotbc::InvalidBlock if the headers do not link together, their consensus proof is invalid,
+        /// or the peer sends more of them than asked for
+        HeaderBranch fetchHeaders(const std::shared_ptr<Peer> &peer, const std::vector<BlockRef> &locator,
+            const IConsensus &consensus, uint32_t minDifficulty, std::atomic<size_t> &budget);
+
+        /// @brief Download the blocks of a branch from the peers having them, and submit them in order
+        void downloadBlocks(const HeaderBranch &best, const std::vector<HeaderBranch> &branches, SyncStats &stats);
+
+        Blockchain &chain;
+        std::mutex chainMutex;
+        Mempool *mempool;
+        NodeOptions options;
+
+        EventLoop loop;
+        int listenFd;
+        uint16_t listenPort;
+        std::atomic<bool> stopping;
+
+        mutable std::mutex peersMutex;
+        std::vector<std::shared_ptr<Peer>> peers;
+        uint64_t nextPeerId;
+
+        /// Only one sync runs at a time
+        std::mutex syncMutex;
+        Download download;
+
+        mutable std::mutex relayMutex;
+        /// Relayed blocks waiting for an answer of their peer, by hash
+        std::unordered_map<Hash, PendingBlock, ArrayHash> pendingBlocks;
+        /// Source of the compact block salts
+        std::mt19937_64 saltGenerator;
+        RelayStats relay;
+
+        mutable std::mutex gossipMutex;
+        std::condition_variable gossipCv;
+        /// Set when a peer has a full batch of hashes to announce
+        bool inventoryFull;
+        /// Transactions verified by the mempool or received from a peer, never requested again
+        RollingFilter seenTransactions;
+        /// Transactions requested from a peer and not received yet, by hash, with the time they can be asked to another peer
+        std::unordered_map<Hash, std::chrono::steady_clock::time_point, ArrayHash> requestedTransactions;
+        /// Hashes of requestedTransactions in request order, to expire them
+        std::deque<std::pair<std::chrono::steady_clock::time_point, Hash>> requestOrder;
+        /// Transactions whose peer did not answer in time, still accepted if it answers late
+        RollingFilter expiredRequests;
+        GossipStats gossip;
+        /// Id of the mempool listener queueing the verified transactions
+        size_t verificationListener;
+
+        /// Verifies the relayed blocks off the loop thread, one at a time so parents are added before their children
+        ThreadPool verifier;
+
+        // Declared last so they start once the node is ready
+        std::thread gossiper;
+        std::thread loopThread;
+    };
+}
@@ -0,0 +1,119 @@
+#include <NonceIndex.hpp>
+#include <Wire.hpp>
+
+namespace iotbc {
+    Nonce NonceIndex::next(const Address &sender) const {
+        auto it = nonces.find(sender);
+
+        if (it == nonces.end()) {
+            return 0;
+        }
+
+        return it->second;
+    }
+
+    /// @brief Checks if the transactions of a block follow the nonce sequencing
+    /// @note Legacy blocks were written before nonces were sequenced, every transaction used nonce 0
+    static bool isSequenced(const Block &block) {
+        return block.version >= BLOCK_VERSION_DIFFICULTY;
+    }
+
+    void NonceIndex::check(const Block &block) const {
+        if (!isSequenced(block)) {
+            return;
+        }
+
+        // Nonces advanced by the previous transactions of the same block
+        std::unordered_map<Address, Nonce, AddressHash> advanced;
+
+        for (const Transaction &tx : block.transactions) {
+            Address sender = Address::fromPublicKey(tx.from);
+
+            auto it = advanced.find(sender);
+            Nonce expected = it == advanced.end() ? next(sender) : it->second;
+
+            if (tx.nonce < expected) {
+                throw InvalidBlock("Transaction nonce was already used (duplicate or replay)");
+            }
+
+            if (tx.nonce > expected) {
+                throw InvalidBlock("Transaction nonce skips the next expected nonce");
+            }
+
+            advanced[sender] = expected + 1;
+        }
+    }
+
+    void NonceIndex::apply(const Block &block) {
+        if (!isSequenced(block)) {
+            return;
+        }
+
+        for (const Transaction &tx : block.transactions) {
+            nonces[Address::fromPublicKey(tx.from)] = tx.nonce + 1;
+        }
+    }
+
+    void NonceIndex::revert(const Block &block) {
+        if (!isSequenced(block)) {
+            return;
+        }
+
+        // Walked backwards, so the nonce left for a sender is the first one it used in the block
+        for (auto it = block.transactions.rbegin(); it != block.transactions.rend(); it++) {
+            set(Address::fromPublicKey(it->from), it->nonce);
+        }
+    }
+
+    void NonceIndex::set(const Address &sender, Nonce next) {
+        if (next == 0) {
+            nonces.erase(sender);
+        } else {
+            nonces[sender] = next;
+        }
+    }
+
+    std::vector<unsigned char> NonceIndex::serialize() const {
+        std::vector<unsigned char> buf;
+
+        writeWireHeader(buf, WireFormat::V2);
+        writeVarint(buf, nonces.size());
+
+        for (const auto &[sender, nonce] : nonces) {
+            buf.insert(buf.end(), sender.bits.begin(), sender.bits.end());
+            writeVarint(buf, nonce);
+        }
+
+        return buf;
+    }
+
+    NonceIndex NonceIndex::deserialize(const std::vector<unsigned char> &data) {
+        if (!readWireHeader(data.data(), data.size()).has_value()) {
+            throw DeserializationError("Missing wire format header");
+        }
+
+        size_t cur = WIRE_HEADER_SIZE;
+        NonceIndex index;
+
+        uint64_t count = readVarint(data.data(), data.size(), cur);
+
+        for (uint64_t i = 0; i < count; i++) {
+            Address sender;
+
+            if (sender.bits.size() > data.size() - cur) {
+                throw DeserializationError("Overflow");
+            }
+
+            std::copy(data.begin() + cur, data.begin() + cur + sender.bits.size(), sender.bits.begin());
+            cur += sender.bits.size();
+
+            index.nonces[sender] = readVarint(data.data(), data.size(), cur);
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return index;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <Block.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Next expected nonce of every sender, used to reject duplicated and replayed transactions
+    /// @note Every sender must use consecutive nonces starting at 0. Blocks older than
+    /// BLOCK_VERSION_DIFFICULTY predate nonces and are neither checked nor counted
+    class NonceIndex {
+    public:
+        NonceIndex() = default;
+
+        /// @brief Get the nonce the next transaction of a sender must use
+        /// @param sender The address of the sender
+        /// @return The next expected nonce
+        Nonce next(const Address &sender) const;
+
+        /// @brief Check that every transaction of a block uses the next nonce of its sender
+        /// @param block The block to check
+        /// @throws iotbc::InvalidBlock if a transaction is duplicated, replayed or skips a nonce
+        void check(const Block &block) const;
+
+        /// @brief Advance the next nonce of every sender of a block
+        /// @param block The block to apply, must have been checked
+        void apply(const Block &block);
+
+        /// @brief Undo apply, when the block is disconnected from the tip
+        /// @param block The last block applied
+        /// @note Senders use consecutive nonces, so no undo data is needed
+        void revert(const Block &block);
+
+        /// @brief Set the nonce the next transaction of a sender must use
+        /// @param sender The address of the sender
+        /// @param next The next expected nonce, 0 forgets the sender
+        void set(const Address &sender, Nonce next);
+
+        /// @brief Remove every sender
+        inline void clear()
+        {
+            nonces.clear();
+        }
+
+        /// @brief Get the number of known senders
+        /// @return The number of known senders
+        inline size_t size() const
+        {
+            return nonces.size();
+        }
+
+        /// @brief Serialize the index into a byte array
+        /// @return The serialized index
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize an index from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized index
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static NonceIndex deserialize(const std::vector<unsigned char> &data);
+
+    private:
+        std::unordered_map<Address, Nonce, AddressHash> nonces;
+    };
+}
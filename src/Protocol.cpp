@@ -0,0 +1,396 @@
+#include <Protocol.hpp>
+#include <Exceptions.hpp>
+#include <Varint.hpp>
+
+#include <cstdint>
+
+namespace iotbc {
+    /// Maximum number of locator entries, enough for any chain with exponential steps
+    static constexpr size_t MAX_LOCATOR_SIZE = 128;
+
+    std::vector<unsigned char> encodeFrame(MessageType type, const std::vector<unsigned char> &payload) {
+        if (payload.size() > UINT32_MAX) {
+            throw NetworkError("Message is too large to be framed");
+        }
+
+        std::vector<unsigned char> frame;
+        frame.reserve(FRAME_HEADER_SIZE + payload.size());
+
+        writeFrameHeader(frame, type, payload.size());
+        frame.insert(frame.end(), payload.begin(), payload.end());
+
+        return frame;
+    }
+
+    void writeFrameHeader(std::vector<unsigned char> &buf, MessageType type, size_t payloadSize) {
+        uint32_t size = static_cast<uint32_t>(payloadSize);
+        buf.push_back(static_cast<unsigned char>(size >> 24));
+        buf.push_back(static_cast<unsigned char>(size >> 16));
+        buf.push_back(static_cast<unsigned char>(size >> 8));
+        buf.push_back(static_cast<unsigned char>(size));
+        buf.push_back(static_cast<unsigned char>(type));
+    }
+
+    uint32_t framePayloadSize(const unsigned char *header) {
+        return (static_cast<uint32_t>(header[0]) << 24) | (static_cast<uint32_t>(header[1]) << 16)
+            | (static_cast<uint32_t>(header[2]) << 8) | static_cast<uint32_t>(header[3]);
+    }
+
+    /// @brief Read a hash from a buffer
+    static Hash readHash(std::span<const unsigned char> data, size_t &cur) {
+        if (sizeof(Hash) > data.size() - cur) {
+            throw DeserializationError("Overflow");
+        }
+
+        Hash hash;
+        std::copy(data.begin() + cur, data.begin() + cur + sizeof(Hash), hash.begin());
+        cur += sizeof(Hash);
+
+        return hash;
+    }
+
+    /// @brief Read the number of items of a list, rejecting counts the remaining data cannot hold
+    static uint64_t readCount(std::span<const unsigned char> data, size_t &cur, size_t minItemSize) {
+        uint64_t count = readVarint(data.data(), data.size(), cur);
+
+        if (count > (data.size() - cur) / minItemSize) {
+            throw DeserializationError("Overflow");
+        }
+
+        return count;
+    }
+
+    /// @brief Append a list of block references to a buffer
+    static void writeBlockRefs(std::vector<unsigned char> &buf, const std::vector<BlockRef> &refs) {
+        writeVarint(buf, refs.size());
+
+        for (const auto &ref : refs) {
+            writeVarint(buf, ref.height);
+            buf.insert(buf.end(), ref.hash.begin(), ref.hash.end());
+        }
+    }
+
+    /// @brief Read a list of block references written by writeBlockRefs
+    static std::vector<BlockRef> readBlockRefs(std::span<const unsigned char> data, size_t &cur) {
+        uint64_t count = readCount(data, cur, 1 + sizeof(Hash));
+
+        std::vector<BlockRef> refs;
+        refs.reserve(count);
+
+        for (uint64_t i = 0; i < count; i++) {
+            BlockRef ref;
+            ref.height = readVarint(data.data(), data.size(), cur);
+            ref.hash = readHash(data, cur);
+            refs.push_back(ref);
+        }
+
+        return refs;
+    }
+
+    /// @brief Get the size writeTransactions takes for a list of transactions
+    static size_t transactionsSize(const std::vector<Transaction> &txs) {
+        size_t size = 10;
+        for (const auto &tx : txs) {
+            size += tx.size(WireFormat::V2);
+        }
+
+        return size;
+    }
+
+    /// @brief Append a list of transactions to a buffer
+    static void writeTransactions(std::vector<unsigned char> &buf, const std::vector<Transaction> &txs) {
+        writeVarint(buf, txs.size());
+
+        for (const auto &tx : txs) {
+            tx.serializeInto(buf, WireFormat::V2);
+        }
+    }
+
+    /// @brief Read a list of transactions written by writeTransactions
+    static std::vector<Transaction> readTransactions(std::span<const unsigned char> data, size_t &cur) {
+        uint64_t count = readCount(data, cur, sizeof(PublicKey) + sizeof(Signature));
+
+        std::vector<Transaction> txs;
+        txs.reserve(count);
+
+        for (uint64_t i = 0; i < count; i++) {
+            txs.push_back(Transaction::deserializeFrom(data.data(), data.size(), cur, WireFormat::V2));
+        }
+
+        return txs;
+    }
+
+    std::vector<unsigned char> GetHeadersMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(20 + locator.size() * (sizeof(Hash) + 5));
+
+        writeVarint(buf, maxHeaders);
+        writeBlockRefs(buf, locator);
+
+        return buf;
+    }
+
+    GetHeadersMessage GetHeadersMessage::deserialize(std::span<const unsigned char> data) {
+        GetHeadersMessage message;
+        size_t cur = 0;
+
+        message.maxHeaders = readVarint(data.data(), data.size(), cur);
+        message.locator = readBlockRefs(data, cur);
+
+        if (message.locator.size() > MAX_LOCATOR_SIZE) {
+            throw DeserializationError("Locator is too long");
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> HeadersMessage::serialize() const {
+        return serialize(headers);
+    }
+
+    std::vector<unsigned char> HeadersMessage::serialize(std::span<const Block> blocks) {
+        std::vector<unsigned char> buf;
+        buf.reserve(10 + blocks.size() * 128);
+
+        writeVarint(buf, blocks.size());
+        for (const auto &block : blocks) {
+            block.serializeHeaderInto(buf);
+        }
+
+        return buf;
+    }
+
+    HeadersMessage HeadersMessage::deserialize(std::span<const unsigned char> data) {
+        HeadersMessage message;
+        size_t cur = 0;
+
+        uint64_t count = readCount(data, cur, 2 * sizeof(Hash));
+
+        message.headers.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            message.headers.push_back(Block::deserializeHeaderFrom(data.data(), data.size(), cur));
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> GetBlocksMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(10 + blocks.size() * (sizeof(Hash) + 5));
+
+        writeBlockRefs(buf, blocks);
+
+        return buf;
+    }
+
+    GetBlocksMessage GetBlocksMessage::deserialize(std::span<const unsigned char> data) {
+        GetBlocksMessage message;
+        size_t cur = 0;
+
+        message.blocks = readBlockRefs(data, cur);
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> InventoryMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(10 + hashes.size() * sizeof(Hash));
+
+        writeVarint(buf, hashes.size());
+        for (const auto &hash : hashes) {
+            buf.insert(buf.end(), hash.begin(), hash.end());
+        }
+
+        return buf;
+    }
+
+    InventoryMessage InventoryMessage::deserialize(std::span<const unsigned char> data) {
+        InventoryMessage message;
+        size_t cur = 0;
+
+        uint64_t count = readCount(data, cur, sizeof(Hash));
+
+        message.hashes.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            message.hashes.push_back(readHash(data, cur));
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> GetBlockTransactionsMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(50 + indices.size() * 2);
+
+        writeVarint(buf, block.height);
+        buf.insert(buf.end(), block.hash.begin(), block.hash.end());
+
+        // Indices are written as the gap from the previous one
+        writeVarint(buf, indices.size());
+        size_t expected = 0;
+        for (size_t index : indices) {
+            writeVarint(buf, index - expected);
+            expected = index + 1;
+        }
+
+        return buf;
+    }
+
+    GetBlockTransactionsMessage GetBlockTransactionsMessage::deserialize(std::span<const unsigned char> data) {
+        GetBlockTransactionsMessage message;
+        size_t cur = 0;
+
+        message.block.height = readVarint(data.data(), data.size(), cur);
+        message.block.hash = readHash(data, cur);
+
+        uint64_t count = readCount(data, cur, 1);
+        uint64_t expected = 0;
+
+        message.indices.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t index = expected + readVarint(data.data(), data.size(), cur);
+
+            if (index < expected) {
+                throw DeserializationError("Transaction index overflows");
+            }
+
+            message.indices.push_back(index);
+            expected = index + 1;
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> BlockTransactionsMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(sizeof(Hash) + transactionsSize(transactions));
+
+        buf.insert(buf.end(), blockHash.begin(), blockHash.end());
+        writeTransactions(buf, transactions);
+
+        return buf;
+    }
+
+    BlockTransactionsMessage BlockTransactionsMessage::deserialize(std::span<const unsigned char> data) {
+        BlockTransactionsMessage message;
+        size_t cur = 0;
+
+        message.blockHash = readHash(data, cur);
+        message.transactions = readTransactions(data, cur);
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> TransactionsMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(transactionsSize(transactions));
+
+        writeTransactions(buf, transactions);
+
+        return buf;
+    }
+
+    TransactionsMessage TransactionsMessage::deserialize(std::span<const unsigned char> data) {
+        TransactionsMessage message;
+        size_t cur = 0;
+
+        message.transactions = readTransactions(data, cur);
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<unsigned char> IngestResultsMessage::serialize() const {
+        std::vector<unsigned char> buf;
+        buf.reserve(10 + results.size() * (sizeof(Hash) + 1));
+
+        writeVarint(buf, results.size());
+        for (const auto &result : results) {
+            buf.insert(buf.end(), result.txId.begin(), result.txId.end());
+            buf.push_back(static_cast<unsigned char>(result.status));
+        }
+
+        return buf;
+    }
+
+    IngestResultsMessage IngestResultsMessage::deserialize(std::span<const unsigned char> data) {
+        IngestResultsMessage message;
+        size_t cur = 0;
+
+        uint64_t count = readCount(data, cur, sizeof(Hash) + 1);
+
+        message.results.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            IngestResult result;
+            result.txId = readHash(data, cur);
+
+            if (data[cur] > static_cast<unsigned char>(IngestStatus::Full)) {
+                throw DeserializationError("Invalid ingest status");
+            }
+            result.status = static_cast<IngestStatus>(data[cur++]);
+
+            message.results.push_back(result);
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return message;
+    }
+
+    std::vector<BlockRef> chainLocator(const std::vector<Block> &chain) {
+        std::vector<BlockRef> locator;
+
+        if (chain.empty()) {
+            return locator;
+        }
+
+        // The last 10 blocks one by one, then doubling the step, always ending with the genesis block
+        uint64_t step = 1;
+        uint64_t height = chain.size() - 1;
+
+        while (true) {
+            locator.push_back({height, chain[height].blockHash()});
+
+            if (height == 0) {
+                break;
+            }
+
+            if (locator.size() >= 10) {
+                step *= 2;
+            }
+
+            height = height > step ? height - step : 0;
+        }
+
+        return locator;
+    }
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <Block.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Type of a message exchanged between nodes, see Node
+    enum class MessageType : uint8_t {
+        /// Request the headers following the first locator entry found on the peer's active chain
+        GetHeaders = 1,
+        /// Headers answering GetHeaders, in chain order
+        Headers = 2,
+        /// Request the blocks with the given hashes
+        GetBlocks = 3,
+        /// A block, in the Block::serialize wire format
+        Block = 4,
+        /// Hashes of requested blocks the peer does not have
+        NotFound = 5,
+        /// A new block, as a CompactBlock
+        CompactBlock = 6,
+        /// Request the transactions of a compact block the node could not find in its mempool
+        GetBlockTransactions = 7,
+        /// Transactions answering GetBlockTransactions
+        BlockTransactions = 8,
+        /// Hashes of transactions newly added to the peer's mempool, batched
+        TransactionInventory = 9,
+        /// Request the transactions with the given hashes out of the peer's mempool
+        GetTransactions = 10,
+        /// Transactions answering GetTransactions
+        Transactions = 11,
+        /// Signed transactions submitted by a local producer to an IngestServer, as a TransactionsMessage
+        SubmitTransactions = 12,
+        /// Outcome of submitted transactions, sent by an IngestServer to their producer
+        IngestResults = 13,
+    };
+
+    /// Size of a frame header: the payload size as a 4 bytes big endian integer, then the message type
+    static constexpr size_t FRAME_HEADER_SIZE = 5;
+
+    /// @brief Builds a frame out of a message
+    /// @param type The type of the message
+    /// @param payload The serialized message
+    /// @return The frame, ready to be written to a stream
+    std::vector<unsigned char> encodeFrame(MessageType type, const std::vector<unsigned char> &payload);
+
+    /// @brief Appends a frame header to a buffer, the payload is to be appended after it
+    /// @param buf The buffer
+    /// @param type The type of the message
+    /// @param payloadSize The size of the serialized message
+    void writeFrameHeader(std::vector<unsigned char> &buf, MessageType type, size_t payloadSize);
+
+    /// @brief Reads the payload size of a frame header
+    /// @param header The FRAME_HEADER_SIZE first bytes of the frame
+    /// @return The size of the payload following the header
+    uint32_t framePayloadSize(const unsigned char *header);
+
+    /// @brief A block of a chain, its height letting peers find it without a hash index
+    struct BlockRef {
+        uint64_t height;
+        Hash hash;
+    };
+
+    /// @brief Payload of a GetHeaders message
+    struct GetHeadersMessage {
+        /// Blocks of the requesting node's active chain, from its tip down to its genesis block
+        std::vector<BlockRef> locator;
+        /// Maximum number of headers to answer with
+        uint64_t maxHeaders = 0;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static GetHeadersMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of a Headers message
+    struct HeadersMessage {
+        /// Blocks without their transactions, in chain order
+        std::vector<Block> headers;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Serialize the headers of a range of blocks, without copying them
+        /// @param blocks The blocks whose headers are sent
+        /// @return The serialized message
+        static std::vector<unsigned char> serialize(std::span<const Block> blocks);
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static HeadersMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of a GetBlocks message
+    struct GetBlocksMessage {
+        /// Blocks of the peer's active chain to send
+        std::vector<BlockRef> blocks;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static GetBlocksMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of the messages listing hashes, such as NotFound
+    struct InventoryMessage {
+        std::vector<Hash> hashes;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static InventoryMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of a GetBlockTransactions message
+    struct GetBlockTransactionsMessage {
+        /// The block of the peer's active chain holding the transactions
+        BlockRef block;
+        /// Indices of the transactions in the block, in increasing order
+        std::vector<size_t> indices;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static GetBlockTransactionsMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of a BlockTransactions message
+    struct BlockTransactionsMessage {
+        /// Hash of the block holding the transactions
+        Hash blockHash;
+        /// The requested transactions, in the order of the request
+        std::vector<Transaction> transactions;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static BlockTransactionsMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Payload of a Transactions message
+    struct TransactionsMessage {
+        /// The requested transactions the peer holds, in no particular order
+        std::vector<Transaction> transactions;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static TransactionsMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Outcome of a transaction submitted to an IngestServer
+    enum class IngestStatus : uint8_t {
+        /// Passed verification, waiting in the mempool for a block
+        Verified = 0,
+        /// Dropped because its signature is invalid
+        Invalid = 1,
+        /// A transaction with the same id is already in the mempool
+        Duplicate = 2,
+        /// Dropped because the mempool reached its capacity, it can be submitted again later
+        Full = 3,
+    };
+
+    /// @brief Outcome of a single submitted transaction
+    struct IngestResult {
+        /// Id of the transaction, see Transaction::id
+        Hash txId;
+        IngestStatus status;
+    };
+
+    /// @brief Payload of an IngestResults message
+    struct IngestResultsMessage {
+        std::vector<IngestResult> results;
+
+        /// @brief Serialize the message
+        /// @return The serialized message
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a message from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized message
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static IngestResultsMessage deserialize(std::span<const unsigned char> data);
+    };
+
+    /// @brief Build the locator of a chain: its last blocks, then blocks exponentially further apart
+    /// @param chain The blocks of the active chain
+    /// @return The locator, from the tip down to the genesis block, with O(log n) entries
+    std::vector<BlockRef> chainLocator(const std::vector<Block> &chain);
+}
@@ -0,0 +1,91 @@
+#include <RingIngest.hpp>
+#include <Exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace iotbc {
+    RingIngest::RingIngest(Mempool &mempool, const std::string &name, const RingIngestOptions &options)
+        : mempool(mempool), options(options), sharedRing(name, options.capacity), stopping(false), mutex(), counters(),
+        consumer([this]() { consumeLoop(); }) {
+    }
+
+    RingIngest::~RingIngest() {
+        stopping = true;
+        sharedRing.interrupt();
+        consumer.join();
+    }
+
+    RingIngestStats RingIngest::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        return counters;
+    }
+
+    void RingIngest::consumeLoop() {
+        std::vector<Transaction> txs;
+        txs.reserve(options.maxBatch);
+
+        while (!stopping) {
+            // Records stay in the ring while the mempool is full, producers see it fill up
+            size_t room = std::min(options.maxBatch, mempool.room());
+            if (room == 0) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    counters.stalls++;
+                }
+                std::this_thread::sleep_for(options.fullRetry);
+                continue;
+            }
+
+            if (!sharedRing.wait(std::chrono::milliseconds(100))) {
+                continue;
+            }
+
+            size_t malformed = 0;
+            size_t received = 0;
+            bool corrupt = false;
+
+            try {
+                sharedRing.consume(room, [&](std::span<const unsigned char> record) {
+                    received++;
+
+                    try {
+                        size_t cur = 0;
+                        Transaction tx = Transaction::deserializeFrom(record.data(), record.size(), cur, WireFormat::V2);
+
+                        if (cur != record.size()) {
+                            throw DeserializationError("Trailing data");
+                        }
+                        txs.push_back(std::move(tx));
+                    } catch (const DeserializationError &e) {
+                        malformed++;
+                    }
+                });
+            } catch (const IoError &e) {
+                // The records before the invalid header are still submitted
+                std::cerr << "Error: " << e.what() << ", no longer consuming it" << std::endl;
+                corrupt = true;
+            }
+
+            // The ring got its space back, producers go on while the batch is submitted
+            size_t refused = 0;
+            for (auto &tx : txs) {
+                refused += mempool.submit(std::move(tx)) != SubmitResult::Accepted;
+            }
+            txs.clear();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.received += received;
+            counters.malformed += malformed;
+            counters.refused += refused;
+            counters.batches++;
+
+            if (corrupt) {
+                counters.corrupt = true;
+                return;
+            }
+        }
+    }
+}
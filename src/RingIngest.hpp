@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <Mempool.hpp>
+#include <SharedRing.hpp>
+
+namespace iotbc {
+    /// @brief Settings of a RingIngest
+    struct RingIngestOptions {
+        /// Number of bytes the ring holds, a power of two
+        size_t capacity = 16 << 20;
+        /// Maximum number of transactions taken out of the ring at once
+        size_t maxBatch = 1024;
+        /// Time waited before checking again a full mempool
+        std::chrono::milliseconds fullRetry = std::chrono::milliseconds(10);
+    };
+
+    /// @brief Counters of a RingIngest
+    struct RingIngestStats {
+        /// Number of records taken out of the ring
+        size_t received = 0;
+        /// Number of records that were not a transaction
+        size_t malformed = 0;
+        /// Number of transactions the mempool refused, as duplicates or because it filled up meanwhile
+        size_t refused = 0;
+        /// Number of batches taken out of the ring
+        size_t batches = 0;
+        /// Number of times the ring was left as is because the mempool was full
+        size_t stalls = 0;
+        /// Set once a producer wrote an invalid record header, the ring is not consumed anymore
+        bool corrupt = false;
+    };
+
+    /// @brief Local endpoint through which producers on the same machine submit signed transactions
+    /// to a mempool, through a SharedRing
+    /// @note Each record of the ring is a transaction serialized in the WireFormat::V2 format, without
+    /// header, see Transaction::serializeInto. Producers get no result, use an IngestServer for that.
+    /// Transactions are parsed straight out of the ring, and submitted to the mempool in batches.
+    /// No more records are taken than the mempool has room for, so a full mempool fills the ring
+    /// and SharedRing::push fails for the producers
+    class RingIngest {
+    public:
+        /// @brief Create the ring and start consuming it
+        /// @param mempool The mempool the transactions are submitted to
+        /// @param name The shared memory name of the ring, see SharedRing
+        /// @param options The settings
+        /// @throws iotbc::IoError if the ring cannot be created
+        RingIngest(Mempool &mempool, const std::string &name, const RingIngestOptions &options = RingIngestOptions());
+
+        /// @brief Stop consuming and remove the ring, the records left in it are lost
+        ~RingIngest();
+
+        RingIngest(const RingIngest &) = delete;
+        RingIngest(RingIngest &&) = delete;
+        RingIngest &operator=(const RingIngest &) = delete;
+        RingIngest &operator=(RingIngest &&) = delete;
+
+        /// @brief Get the ring, as producers in this process use it
+        /// @return The ring
+        inline SharedRing &ring()
+        {
+            return sharedRing;
+        }
+
+        /// @brief Get the counters of the endpoint
+        /// @return The counters, since the endpoint started
+        RingIngestStats stats() const;
+
+    private:
+        /// @brief Move the transactions of the ring to the mempool, until the endpoint stops
+        void consumeLoop();
+
+        Mempool &mempool;
+        RingIngestOptions options;
+        SharedRing sharedRing;
+        std::atomic<bool> stopping;
+
+        mutable std::mutex mutex;
+        RingIngestStats counters;
+
+        // Declared last so it starts once the endpoint is ready
+        std::thread consumer;
+    };
+}
@@ -0,0 +1,73 @@
+#include <RollingFilter.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace iotbc {
+    RollingFilter::RollingFilter(size_t capacity, double falsePositiveRate)
+        : capacity(std::max<size_t>(capacity, 1)), hashCount(1), key(), current(), previous(), currentEntries(0) {
+        // Optimal bloom filter size for capacity entries per generation
+        double ln2 = std::log(2.0);
+        double bits = std::ceil(-static_cast<double>(this->capacity) * std::log(falsePositiveRate) / (ln2 * ln2));
+        size_t words = std::max<size_t>(static_cast<size_t>(bits + 63) / 64, 1);
+
+        hashCount = std::clamp<size_t>(static_cast<size_t>(std::round(words * 64.0 / this->capacity * ln2)), 1, 32);
+        current.assign(words, 0);
+        previous.assign(words, 0);
+
+        std::random_device random;
+        std::uniform_int_distribution<uint64_t> distribution;
+        key = {distribution(random), distribution(random)};
+    }
+
+    std::pair<uint64_t, uint64_t> RollingFilter::baseHashes(const Hash &hash) const {
+        uint64_t h1 = sipHash24(key, hash.data(), hash.size());
+        uint64_t h2 = sipHash24({key.k1, key.k0}, hash.data(), hash.size());
+
+        // Odd, so the positions derived from it cycle through the whole filter
+        return {h1, h2 | 1};
+    }
+
+    void RollingFilter::insert(const Hash &hash) {
+        if (currentEntries >= capacity) {
+            previous.swap(current);
+            std::fill(current.begin(), current.end(), 0);
+            currentEntries = 0;
+        }
+
+        auto [h1, h2] = baseHashes(hash);
+        size_t bits = current.size() * 64;
+
+        for (size_t i = 0; i < hashCount; i++) {
+            size_t bit = (h1 + i * h2) % bits;
+            current[bit / 64] |= 1ULL << (bit % 64);
+        }
+
+        currentEntries++;
+    }
+
+    bool RollingFilter::contains(const Hash &hash) const {
+        auto [h1, h2] = baseHashes(hash);
+        size_t bits = current.size() * 64;
+
+        bool inCurrent = true;
+        bool inPrevious = true;
+
+        for (size_t i = 0; i < hashCount && (inCurrent || inPrevious); i++) {
+            size_t bit = (h1 + i * h2) % bits;
+            uint64_t mask = 1ULL << (bit % 64);
+
+            inCurrent = inCurrent && (current[bit / 64] & mask) != 0;
+            inPrevious = inPrevious && (previous[bit / 64] & mask) != 0;
+        }
+
+        return inCurrent || inPrevious;
+    }
+
+    void RollingFilter::clear() {
+        std::fill(current.begin(), current.end(), 0);
+        std::fill(previous.begin(), previous.end(), 0);
+        currentEntries = 0;
+    }
+}
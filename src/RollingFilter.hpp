@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <SipHash.hpp>
+#include <Types.hpp>
+
+namespace iotbc {
+    /// @brief Bloom filter remembering the most recently inserted hashes
+    /// @note Two generations of bits are kept: once the current one holds capacity entries, the
+    /// previous one is dropped. The last capacity inserted hashes are always found, and none older
+    /// than the last 2 * capacity are kept. Hashes never inserted are found with the
+    /// false positive rate the filter was sized for. Not thread safe
+    class RollingFilter {
+    public:
+        /// @brief Create an empty filter
+        /// @param capacity The number of recent hashes always remembered
+        /// @param falsePositiveRate The probability of finding a hash that was never inserted
+        explicit RollingFilter(size_t capacity, double falsePositiveRate = 0.000001);
+
+        /// @brief Insert a hash
+        /// @param hash The hash
+        void insert(const Hash &hash);
+
+        /// @brief Checks if a hash was recently inserted
+        /// @param hash The hash
+        /// @return True if it was inserted among the last capacity hashes, or on a false positive
+        bool contains(const Hash &hash) const;
+
+        /// @brief Forget every hash
+        void clear();
+
+    private:
+        /// @brief Get the two base hashes the bit positions of a hash are derived from
+        std::pair<uint64_t, uint64_t> baseHashes(const Hash &hash) const;
+
+        size_t capacity;
+        size_t hashCount;
+        /// Keyed with a random key, so peers cannot craft hashes colliding in the filter
+        SipKey key;
+        std::vector<uint64_t> current;
+        std::vector<uint64_t> previous;
+        size_t currentEntries;
+    };
+}
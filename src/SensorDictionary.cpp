@@ -0,0 +1,142 @@
+#include <SensorDictionary.hpp>
+#include <Varint.hpp>
+#include <Wire.hpp>
+
+namespace iotbc {
+    std::vector<unsigned char> SensorDictionary::registrationPayload(const std::string &sensorId) {
+        std::vector<unsigned char> payload;
+        payload.reserve(1 + varintSize(sensorId.size()) + sensorId.size());
+
+        payload.push_back(REGISTRATION_TAG);
+        writeVarint(payload, sensorId.size());
+        payload.insert(payload.end(), sensorId.begin(), sensorId.end());
+
+        return payload;
+    }
+
+    std::vector<unsigned char> SensorDictionary::readingPayload(SensorIndex index, const std::string &reading) {
+        std::vector<unsigned char> payload;
+        payload.reserve(1 + varintSize(index) + reading.size());
+
+        payload.push_back(READING_TAG);
+        writeVarint(payload, index);
+        payload.insert(payload.end(), reading.begin(), reading.end());
+
+        return payload;
+    }
+
+    bool SensorDictionary::parseReading(const std::vector<unsigned char> &payload, SensorIndex &index, size_t &offset) {
+        if (payload.empty() || payload[0] != READING_TAG) {
+            return false;
+        }
+
+        size_t cur = 1;
+
+        try {
+            index = readVarint(payload.data(), payload.size(), cur);
+        } catch (const DeserializationError &e) {
+            return false;
+        }
+
+        offset = cur;
+        return true;
+    }
+
+    std::optional<std::string> SensorDictionary::parseRegistration(const std::vector<unsigned char> &payload) {
+        if (payload.empty() || payload[0] != REGISTRATION_TAG) {
+            return std::nullopt;
+        }
+
+        size_t cur = 1;
+        uint64_t length = 0;
+
+        try {
+            length = readVarint(payload.data(), payload.size(), cur);
+        } catch (const DeserializationError &e) {
+            return std::nullopt;
+        }
+
+        if (length == 0 || length != payload.size() - cur) {
+            return std::nullopt;
+        }
+
+        return std::string(payload.begin() + cur, payload.end());
+    }
+
+    void SensorDictionary::processBlock(const Block &block) {
+        for (const Transaction &tx : block.transactions) {
+            std::optional<std::string> sensorId = parseRegistration(tx.data);
+
+            if (!sensorId.has_value() || indices.find(sensorId.value()) != indices.end()) {
+                continue;
+            }
+
+            indices.emplace(sensorId.value(), names.size());
+            names.push_back(std::move(sensorId.value()));
+        }
+    }
+
+    void SensorDictionary::truncate(size_t count) {
+        while (names.size() > count) {
+            indices.erase(names.back());
+            names.pop_back();
+        }
+    }
+
+    std::optional<SensorIndex> SensorDictionary::find(const std::string &sensorId) const {
+        auto it = indices.find(sensorId);
+
+        if (it == indices.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    std::vector<unsigned char> SensorDictionary::serialize() const {
+        std::vector<unsigned char> buf;
+
+        writeWireHeader(buf, WireFormat::V2);
+        writeVarint(buf, names.size());
+
+        for (const std::string &name : names) {
+            writeVarint(buf, name.size());
+            buf.insert(buf.end(), name.begin(), name.end());
+        }
+
+        return buf;
+    }
+
+    SensorDictionary SensorDictionary::deserialize(const std::vector<unsigned char> &data) {
+        if (!readWireHeader(data.data(), data.size()).has_value()) {
+            throw DeserializationError("Missing wire format header");
+        }
+
+        size_t cur = WIRE_HEADER_SIZE;
+        SensorDictionary dictionary;
+
+        uint64_t count = readVarint(data.data(), data.size(), cur);
+
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t length = readVarint(data.data(), data.size(), cur);
+
+            if (length > data.size() - cur) {
+                throw DeserializationError("Overflow");
+            }
+
+            std::string name(data.begin() + cur, data.begin() + cur + length);
+            cur += length;
+
+            if (!dictionary.indices.emplace(name, dictionary.names.size()).second) {
+                throw DeserializationError("Duplicate sensor id");
+            }
+            dictionary.names.push_back(std::move(name));
+        }
+
+        if (cur != data.size()) {
+            throw DeserializationError("Trailing data");
+        }
+
+        return dictionary;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+
+#include <Block.hpp>
+
+namespace iotbc {
+    using SensorIndex = uint64_t;
+
+    /// @brief Chain-level dictionary mapping sensor ids to small integers
+    /// @note Sensors are registered through registration transactions, in the order
+    /// they appear in the chain, so every node derives the same indices.
+    /// Readings then only carry the varint index instead of the full sensor id
+    class SensorDictionary {
+    public:
+        /// First byte of a registration payload, never the first byte of valid UTF-8 text
+        static constexpr unsigned char REGISTRATION_TAG = 0xF8;
+        /// First byte of a dictionary-encoded reading payload
+        static constexpr unsigned char READING_TAG = 0xF9;
+
+        SensorDictionary() = default;
+
+        /// @brief Build the payload of a transaction registering a sensor id
+        /// @param sensorId The sensor id to register
+        /// @return The transaction payload
+        static std::vector<unsigned char> registrationPayload(const std::string &sensorId);
+
+        /// @brief Build the payload of a dictionary-encoded reading
+        /// @param index The index of the sensor in the dictionary
+        /// @param reading The reading itself
+        /// @return The transaction payload
+        static std::vector<unsigned char> readingPayload(SensorIndex index, const std::string &reading);
+
+        /// @brief Parse a dictionary-encoded reading payload
+        /// @param payload The transaction payload
+        /// @param index Set to the sensor index if the payload is a reading
+        /// @param offset Set to the offset of the reading in the payload
+        /// @return True if the payload is a dictionary-encoded reading, false otherwise
+        static bool parseReading(const std::vector<unsigned char> &payload, SensorIndex &index, size_t &offset);
+
+        /// @brief Register every sensor id found in the block's registration transactions
+        /// @param block The block to process
+        /// @note Registering an already known sensor id is a no-op
+        void processBlock(const Block &block);
+
+        /// @brief Unregister the sensor ids registered last, to undo the blocks that registered them
+        /// @param count The number of sensor ids to keep
+        void truncate(size_t count);
+
+        /// @brief Find the index of a sensor id
+        /// @param sensorId The sensor id to look for
+        /// @return The index of the sensor, or std::nullopt if it is not registered
+        std::optional<SensorIndex> find(const std::string &sensorId) const;
+
+        /// @brief Get the sensor id registered at an index
+        /// @param index The index of the sensor
+        /// @return The sensor id
+        /// @throws std::out_of_range if the index is not registered
+        inline const std::string &name(SensorIndex index) const
+        {
+            return names.at(index);
+        }
+
+        /// @brief Get the number of registered sensors
+        /// @return The number of registered sensors
+        inline size_t size() const
+        {
+            return names.size();
+        }
+
+        /// @brief Serialize the dictionary, to snapshot it without replaying the chain
+        /// @return The serialized dictionary
+        std::vector<unsigned char> serialize() const;
+
+        /// @brief Deserialize a dictionary from a byte array
+        /// @param data The byte array to deserialize
+        /// @return The deserialized dictionary
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static SensorDictionary deserialize(const std::vector<unsigned char> &data);
+
+    private:
+        /// @brief Parse a registration payload
+        /// @param payload The transaction payload
+        /// @return The registered sensor id, or std::nullopt if the payload is not a registration
+        static std::optional<std::string> parseRegistration(const std::vector<unsigned char> &payload);
+
+        std::vector<std::string> names;
+        std::unordered_map<std::string, SensorIndex> indices;
+    };
+}
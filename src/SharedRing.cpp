@@ -0,0 +1,275 @@
+#include <SharedRing.hpp>
+#include <Exceptions.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace iotbc {
+    /// Identifies the shared memory of a ring, and its layout version
+    static constexpr uint64_t RING_MAGIC = 0x69'6f'74'62'63'72'6e'01;
+
+    /// Size of the header of a record, the record is padded to a multiple of it
+    static constexpr size_t RECORD_HEADER_SIZE = sizeof(uint64_t);
+
+    /// Record header bits: set once the record is written, and set on the filler before a wrap
+    static constexpr uint64_t RECORD_READY = 1;
+    static constexpr uint64_t RECORD_PADDING = 2;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "Shared memory atomics must be lock free");
+
+    /// @brief Start of the shared memory, the records follow it
+    /// @note The counters only grow, their value modulo the capacity is the offset in the records
+    struct SharedRing::Header {
+        uint64_t magic;
+        uint64_t capacity;
+        /// Bytes claimed by producers
+        alignas(64) std::atomic<uint64_t> reserved;
+        /// Bytes given back by the consumer
+        alignas(64) std::atomic<uint64_t> consumed;
+        /// Set by the consumer before sleeping on it, the futex word
+        alignas(64) std::atomic<uint32_t> sleeping;
+        std::atomic<uint64_t> wakeups;
+    };
+
+    static size_t recordSize(size_t size) {
+        return RECORD_HEADER_SIZE + (size + RECORD_HEADER_SIZE - 1) / RECORD_HEADER_SIZE * RECORD_HEADER_SIZE;
+    }
+
+    static long futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout) {
+        // Not private, the word is shared between processes
+        return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value, timeout, nullptr, 0);
+    }
+
+    SharedRing::SharedRing(const std::string &name, size_t capacity)
+        : name(name), owner(true), capacity(capacity), mappedSize(0), header(nullptr), data(nullptr), interrupted(false), corrupt(false) {
+        if (capacity < 4096 || (capacity & (capacity - 1)) != 0) {
+            throw IoError("Ring capacity must be a power of two of at least 4096 bytes");
+        }
+
+        ::shm_unlink(name.c_str());
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            throw IoError("Failed to create shared memory " + name + ": " + std::strerror(errno));
+        }
+
+        size_t size = sizeof(Header) + capacity;
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            throw IoError("Failed to size shared memory " + name + ": " + error);
+        }
+
+        try {
+            map(fd, size);
+        } catch (const IoError &e) {
+            ::shm_unlink(name.c_str());
+            throw;
+        }
+
+        // The memory starts zeroed, so every record header reads as not ready
+        new (header) Header();
+        header->capacity = capacity;
+        std::atomic_ref<uint64_t>(header->magic).store(RING_MAGIC, std::memory_order_release);
+    }
+
+    SharedRing::SharedRing(const std::string &name)
+        : name(name), owner(false), capacity(0), mappedSize(0), header(nullptr), data(nullptr), interrupted(false), corrupt(false) {
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            throw IoError("Failed to open shared memory " + name + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header) + 4096) {
+            ::close(fd);
+            throw IoError("Not a ring: " + name);
+        }
+
+        map(fd, st.st_size);
+
+        if (std::atomic_ref<uint64_t>(header->magic).load(std::memory_order_acquire) != RING_MAGIC
+            || header->capacity != mappedSize - sizeof(Header)) {
+            ::munmap(header, mappedSize);
+            throw IoError("Not a ring: " + name);
+        }
+
+        capacity = header->capacity;
+    }
+
+    SharedRing::~SharedRing() {
+        ::munmap(header, mappedSize);
+
+        if (owner) {
+            ::shm_unlink(name.c_str());
+        }
+    }
+
+    void SharedRing::map(int fd, size_t size) {
+        void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (memory == MAP_FAILED) {
+            throw IoError("Failed to map shared memory " + name + ": " + std::strerror(errno));
+        }
+
+        mappedSize = size;
+        header = static_cast<Header *>(memory);
+        data = static_cast<unsigned char *>(memory) + sizeof(Header);
+    }
+
+    bool SharedRing::push(std::span<const unsigned char> record) {
+        if (record.size() > maxRecordSize()) {
+            return false;
+        }
+
+        size_t size = recordSize(record.size());
+        uint64_t position = header->reserved.load(std::memory_order_relaxed);
+        uint64_t padding;
+
+        do {
+            // A record never wraps, the end of the ring is skipped instead
+            uint64_t offset = position & (capacity - 1);
+            padding = capacity - offset < size ? capacity - offset : 0;
+
+            if (position + padding + size - header->consumed.load(std::memory_order_acquire) > capacity) {
+                return false;
+            }
+        } while (!header->reserved.compare_exchange_weak(position, position + padding + size, std::memory_order_relaxed));
+
+        if (padding > 0) {
+            uint64_t *filler = reinterpret_cast<uint64_t *>(data + (position & (capacity - 1)));
+            std::atomic_ref<uint64_t>(*filler).store((padding << 2) | RECORD_PADDING | RECORD_READY, std::memory_order_release);
+            position += padding;
+        }
+
+        unsigned char *slot = data + (position & (capacity - 1));
+        std::memcpy(slot + RECORD_HEADER_SIZE, record.data(), record.size());
+        std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(slot)).store((record.size() << 2) | RECORD_READY, std::memory_order_release);
+
+        // Pairs with the fence of wait: either the consumer sees the record, or this sees it sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (header->sleeping.load(std::memory_order_relaxed) != 0 && header->sleeping.exchange(0) != 0) {
+            header->wakeups.fetch_add(1, std::memory_order_relaxed);
+            futex(&header->sleeping, FUTEX_WAKE, INT_MAX, nullptr);
+        }
+
+        return true;
+    }
+
+    bool SharedRing::wait(std::chrono::milliseconds timeout) {
+        auto ready = [this]() {
+            uint64_t position = header->consumed.load(std::memory_order_relaxed);
+            uint64_t *next = reinterpret_cast<uint64_t *>(data + (position & (capacity - 1)));
+            return std::atomic_ref<uint64_t>(*next).load(std::memory_order_acquire) != 0;
+        };
+
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (!ready()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0 || interrupted.exchange(false)) {
+                return false;
+            }
+
+            header->sleeping.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (ready()) {
+                header->sleeping.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            timespec ts;
+            ts.tv_sec = remaining.count() / 1000000000;
+            ts.tv_nsec = remaining.count() % 1000000000;
+
+            // Returns right away if a producer or interrupt already cleared the word. A producer
+            // may wake the consumer up while the record before its own is still being written
+            futex(&header->sleeping, FUTEX_WAIT, 1, &ts);
+            header->sleeping.store(0, std::memory_order_relaxed);
+        }
+
+        return true;
+    }
+
+    void SharedRing::interrupt() {
+        interrupted = true;
+        header->sleeping.store(0);
+        futex(&header->sleeping, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+
+    size_t SharedRing::consume(size_t maxRecords, const std::function<void(std::span<const unsigned char> record)> &f) {
+        if (corrupt) {
+            throw IoError("Ring " + name + " is corrupt");
+        }
+
+        uint64_t start = header->consumed.load(std::memory_order_relaxed);
+        uint64_t position = start;
+        size_t count = 0;
+
+        while (count < maxRecords && position - start < capacity) {
+            uint64_t offset = position & (capacity - 1);
+            unsigned char *slot = data + offset;
+            uint64_t word = std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(slot)).load(std::memory_order_acquire);
+
+            if (word == 0) {
+                break;
+            }
+
+            // A record never wraps, and never reaches the records of the previous lap
+            uint64_t length = word & RECORD_PADDING ? word >> 2 : recordSize(std::min<uint64_t>(word >> 2, capacity));
+            bool valid = (word & RECORD_READY) != 0 && length <= capacity - offset && position - start + length <= capacity;
+
+            if (word & RECORD_PADDING) {
+                valid = valid && length == capacity - offset;
+            } else {
+                valid = valid && (word >> 2) <= maxRecordSize();
+            }
+
+            if (!valid) {
+                corrupt = true;
+                break;
+            }
+
+            if ((word & RECORD_PADDING) == 0) {
+                f(std::span<const unsigned char>(slot + RECORD_HEADER_SIZE, word >> 2));
+                count++;
+            }
+            position += length;
+        }
+
+        // Cleared before being given back, a header must only read as ready once its record is written
+        uint64_t begin = start & (capacity - 1);
+        uint64_t length = position - start;
+        if (begin + length > capacity) {
+            std::memset(data + begin, 0, capacity - begin);
+            std::memset(data, 0, begin + length - capacity);
+        } else {
+            std::memset(data + begin, 0, length);
+        }
+
+        header->consumed.store(position, std::memory_order_release);
+
+        if (corrupt) {
+            throw IoError("Invalid record header in ring " + name);
+        }
+
+        return count;
+    }
+
+    uint64_t SharedRing::wakeups() const {
+        return header->wakeups.load(std::memory_order_relaxed);
+    }
+}
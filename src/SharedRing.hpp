@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+
+namespace iotbc {
+    /// @brief Multi-producer single-consumer queue of byte records, in shared memory
+    /// @note The consumer creates the ring under a POSIX shared memory name, and producers in
+    /// other processes open it. Producers claim space with a compare and swap and copy their
+    /// record in, the consumer reads the records in place. Only a consumer waiting on an empty
+    /// ring costs the producers a syscall: the first record then wakes it up through a futex.
+    /// A producer dying between claiming space and writing its record blocks the ring
+    class SharedRing {
+    public:
+        /// @brief Create a ring, as the consumer
+        /// @param name The shared memory name, starting with a slash, replaced if it exists
+        /// @param capacity The number of bytes records can take, a power of two of at least 4 KiB
+        /// @throws iotbc::IoError if the shared memory cannot be created or the capacity is invalid
+        SharedRing(const std::string &name, size_t capacity);
+
+        /// @brief Open a ring created by a consumer, as a producer
+        /// @param name The shared memory name
+        /// @throws iotbc::IoError if the ring does not exist or is not a ring
+        explicit SharedRing(const std::string &name);
+
+        /// @brief Unmap the ring, and remove its name if this is the consumer
+        ~SharedRing();
+
+        SharedRing(const SharedRing &) = delete;
+        SharedRing(SharedRing &&) = delete;
+        SharedRing &operator=(const SharedRing &) = delete;
+        SharedRing &operator=(SharedRing &&) = delete;
+
+        /// @brief Append a record, from any producer thread or process
+        /// @param record The bytes of the record, at most maxRecordSize
+        /// @return False if the ring is full or the record too large, nothing was appended
+        bool push(std::span<const unsigned char> record);
+
+        /// @brief Wait until the ring holds a record, as the consumer
+        /// @param timeout The maximum time to wait
+        /// @return True if a record is ready, false if the timeout expired or interrupt was called
+        bool wait(std::chrono::milliseconds timeout);
+
+        /// @brief Make the consumer waiting in wait, or the next call to wait, return, from any thread of the consumer
+        void interrupt();
+
+        /// @brief Hand the ready records to a function, in order, as the consumer
+        /// @param maxRecords The maximum number of records to consume
+        /// @param f The function, the record is only valid during the call
+        /// @return The number of consumed records
+        /// @throws iotbc::IoError if a producer wrote an invalid record header, the records before it were
+        /// handed to f, and the ring is not consumed anymore
+        /// @note The space of the records is given back to the producers once f returned for all of them.
+        /// Record headers live in memory any producer process can write, they are checked before use
+        size_t consume(size_t maxRecords, const std::function<void(std::span<const unsigned char> record)> &f);
+
+        /// @brief Get the largest record the ring accepts
+        /// @return The maximum size of a record, in bytes
+        inline size_t maxRecordSize() const
+        {
+            return capacity / 4;
+        }
+
+        /// @brief Get the number of times producers woke up the consumer
+        /// @return The number of wakeups, since the ring was created
+        uint64_t wakeups() const;
+
+    private:
+        struct Header;
+
+        /// @brief Map the shared memory
+        void map(int fd, size_t size);
+
+        std::string name;
+        bool owner;
+        size_t capacity;
+        size_t mappedSize;
+        Header *header;
+        unsigned char *data;
+        /// Set by interrupt, only for this process
+        std::atomic<bool> interrupted;
+        /// Set once an invalid record header was found, nothing after it can be trusted
+        bool corrupt;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iotbc {
+    /// @brief Key of a SipHash function, two 64 bits halves
+    struct SipKey {
+        uint64_t k0 = 0;
+        uint64_t k1 = 0;
+    };
+
+    /// @brief Read a 64 bits little endian integer
+    inline uint64_t readLe64(const unsigned char *data)
+    {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | data[i];
+        }
+        return value;
+    }
+
+    /// @brief Computes SipHash-2-4, a keyed hash short enough for table lookups and hard to collide without the key
+    /// @param key The 128 bits key
+    /// @param data The data to hash
+    /// @param size The size of the data
+    /// @return The 64 bits hash
+    inline uint64_t sipHash24(const SipKey &key, const unsigned char *data, size_t size)
+    {
+        uint64_t v0 = 0x736f6d6570736575ULL ^ key.k0;
+        uint64_t v1 = 0x646f72616e646f6dULL ^ key.k1;
+        uint64_t v2 = 0x6c7967656e657261ULL ^ key.k0;
+        uint64_t v3 = 0x7465646279746573ULL ^ key.k1;
+
+        auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+        auto round = [&]() {
+            v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+            v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+        };
+
+        size_t end = size - size % 8;
+        for (size_t i = 0; i < end; i += 8) {
+            uint64_t m = readLe64(data + i);
+            v3 ^= m;
+            round();
+            round();
+            v0 ^= m;
+        }
+
+        // The last block holds the remaining bytes and the size of the data in its top byte
+        uint64_t last = static_cast<uint64_t>(size) << 56;
+        for (size_t i = 0; i < size % 8; i++) {
+            last |= static_cast<uint64_t>(data[end + i]) << (8 * i);
+        }
+
+        v3 ^= last;
+        round();
+        round();
+        v0 ^= last;
+
+        v2 ^= 0xff;
+        round();
+        round();
+        round();
+        round();
+
+        return v0 ^ v1 ^ v2 ^ v3;
+    }
+}
@@ -0,0 +1,464 @@
+#include <Spool.hpp>
+#include <Exceptions.hpp>
+#include <SipHash.hpp>
+#include <Varint.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace iotbc {
+    static constexpr const char *SEGMENT_EXTENSION = ".spool";
+    static constexpr const char *CURSOR_EXTENSION = ".cursor";
+
+    /// Size of the header of a record: its size and checksum, both 32 bits little endian
+    static constexpr size_t ENTRY_HEADER_SIZE = 8;
+
+    /// Fixed key, the checksum only catches records torn by a crash
+    static constexpr SipKey CHECKSUM_KEY = {0x69'6f'74'62'63'73'70'6c, 0};
+
+    static uint32_t checksum(const unsigned char *data, size_t size) {
+        return static_cast<uint32_t>(sipHash24(CHECKSUM_KEY, data, size));
+    }
+
+    static void writeLe32(std::vector<unsigned char> &buf, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            buf.push_back(static_cast<unsigned char>(value >> (i * 8)));
+        }
+    }
+
+    static uint32_t readLe32(const unsigned char *data) {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    static void writeEntry(std::vector<unsigned char> &buf, const SpoolEntry &entry) {
+        std::vector<unsigned char> payload;
+        writeVarint(payload, entry.height);
+        writeVarint(payload, entry.index);
+        writeVarint(payload, entry.timestamp);
+        writeVarint(payload, entry.key.size());
+        payload.insert(payload.end(), entry.key.begin(), entry.key.end());
+        writeVarint(payload, entry.value.size());
+        payload.insert(payload.end(), entry.value.begin(), entry.value.end());
+
+        writeLe32(buf, static_cast<uint32_t>(payload.size()));
+        writeLe32(buf, checksum(payload.data(), payload.size()));
+        buf.insert(buf.end(), payload.begin(), payload.end());
+    }
+
+    static SpoolEntry readEntry(const std::vector<unsigned char> &payload) {
+        SpoolEntry entry;
+        size_t cur = 0;
+
+        entry.height = readVarint(payload.data(), payload.size(), cur);
+        entry.index = static_cast<uint32_t>(readVarint(payload.data(), payload.size(), cur));
+        entry.timestamp = readVarint(payload.data(), payload.size(), cur);
+
+        for (std::string *field : {&entry.key, &entry.value}) {
+            uint64_t size = readVarint(payload.data(), payload.size(), cur);
+            if (size > payload.size() - cur) {
+                throw DeserializationError("Truncated spool record");
+            }
+            field->assign(reinterpret_cast<const char *>(payload.data() + cur), size);
+            cur += size;
+        }
+
+        return entry;
+    }
+
+    /// @brief Read the record at the current position of a segment
+    /// @param limit Number of bytes left in the segment
+    /// @return False if the segment ends, or if the record is torn or damaged
+    static bool readRecord(std::ifstream &file, std::vector<unsigned char> &payload, uint64_t limit) {
+        unsigned char header[ENTRY_HEADER_SIZE];
+
+        if (limit < ENTRY_HEADER_SIZE || !file.read(reinterpret_cast<char *>(header), ENTRY_HEADER_SIZE)) {
+            return false;
+        }
+
+        // A damaged size is not trusted with an allocation
+        if (readLe32(header) > limit - ENTRY_HEADER_SIZE) {
+            return false;
+        }
+
+        payload.resize(readLe32(header));
+
+        if (!file.read(reinterpret_cast<char *>(payload.data()), payload.size())) {
+            return false;
+        }
+
+        return checksum(payload.data(), payload.size()) == readLe32(header + 4);
+    }
+
+    /// @brief Find where to read on after a damaged record of a segment
+    /// @param offset The offset of the damaged record, relative to the segment
+    /// @param size The size of the segment
+    /// @return The offset after the record if its size leads to a valid record, the end of the segment otherwise
+    static uint64_t skipDamagedRecord(std::ifstream &file, uint64_t offset, uint64_t size) {
+        unsigned char header[ENTRY_HEADER_SIZE];
+
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        if (!file.read(reinterpret_cast<char *>(header), ENTRY_HEADER_SIZE)) {
+            return size;
+        }
+
+        uint64_t after = offset + ENTRY_HEADER_SIZE + readLe32(header);
+        if (after >= size) {
+            return size;
+        }
+
+        std::vector<unsigned char> payload;
+        file.seekg(static_cast<std::streamoff>(after));
+        return readRecord(file, payload, size - after) ? after : size;
+    }
+
+    Spool::Spool(const std::string &folderPath, const SpoolOptions &options)
+        : folder(folderPath), options(options), mutex(), appended(), segments(), endOffset(0), cursors() {
+        try {
+            std::filesystem::create_directories(folder);
+
+            for (const auto &file : std::filesystem::directory_iterator(folder)) {
+                std::filesystem::path path = file.path();
+                std::string stem = path.stem().string();
+
+                if (path.extension() == SEGMENT_EXTENSION && !stem.empty()
+                    && std::all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                    segments[std::stoull(stem)] = path;
+                } else if (path.extension() == CURSOR_EXTENSION) {
+                    std::ifstream cursorFile(path, std::ios::binary);
+                    std::vector<unsigned char> data((std::istreambuf_iterator<char>(cursorFile)), std::istreambuf_iterator<char>());
+                    size_t cur = 0;
+
+                    SpoolCursor cursor;
+                    cursor.offset = readVarint(data.data(), data.size(), cur);
+                    cursor.height = readVarint(data.data(), data.size(), cur);
+                    cursor.index = static_cast<uint32_t>(readVarint(data.data(), data.size(), cur));
+                    cursors[stem] = cursor;
+                }
+            }
+        } catch (const std::filesystem::filesystem_error &e) {
+            throw IoError(std::string("Failed to open spool: ") + e.what());
+        } catch (const DeserializationError &e) {
+            throw IoError(std::string("Invalid spool cursor: ") + e.what());
+        }
+
+        recover();
+    }
+
+    void Spool::recover() {
+        // Once every segment got delivered and deleted, offsets go on from the furthest cursor
+        for (const auto &[destination, cursor] : cursors) {
+            endOffset = std::max(endOffset, cursor.offset);
+        }
+
+        if (segments.empty()) {
+            return;
+        }
+
+        auto &[base, path] = *segments.rbegin();
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> payload;
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(path, error);
+        uint64_t valid = 0;
+
+        while (!error && readRecord(file, payload, size - valid)) {
+            valid += ENTRY_HEADER_SIZE + payload.size();
+        }
+        file.close();
+
+        if (size != valid) {
+            std::filesystem::resize_file(path, valid, error);
+            if (error) {
+                throw IoError("Failed to cut torn spool record: " + error.message());
+            }
+        }
+
+        endOffset = base + valid;
+
+        // Records a destination was past may have been lost with the torn tail
+        for (auto &[destination, cursor] : cursors) {
+            cursor.offset = std::min(cursor.offset, endOffset);
+        }
+    }
+
+    std::filesystem::path Spool::segmentPath(uint64_t base) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(base));
+        return folder / (std::string(name) + SEGMENT_EXTENSION);
+    }
+
+    void Spool::append(const std::vector<SpoolEntry> &entries) {
+        if (entries.empty()) {
+            return;
+        }
+
+        std::vector<unsigned char> buf;
+        for (const auto &entry : entries) {
+            writeEntry(buf, entry);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (segments.empty() || endOffset - segments.rbegin()->first >= options.segmentSize) {
+                segments[endOffset] = segmentPath(endOffset);
+            }
+
+            uint64_t base = segments.rbegin()->first;
+            const std::filesystem::path &path = segments.rbegin()->second;
+
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                throw IoError("Failed to open spool segment: " + std::string(std::strerror(errno)));
+            }
+
+            size_t written = 0;
+            while (written < buf.size()) {
+                ssize_t size = ::write(fd, buf.data() + written, buf.size() - written);
+
+                if (size < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (size < 0) {
+                    std::string error = std::strerror(errno);
+                    // The records written so far are cut, so the next append starts at a record boundary
+                    [[maybe_unused]] int truncated = ::ftruncate(fd, static_cast<off_t>(endOffset - base));
+                    ::close(fd);
+                    throw IoError("Failed to write spool segment: " + error);
+                }
+
+                written += size;
+            }
+
+            if (options.sync && ::fdatasync(fd) != 0) {
+                std::string error = std::strerror(errno);
+                ::close(fd);
+                throw IoError("Failed to sync spool segment: " + error);
+            }
+
+            ::close(fd);
+            endOffset += buf.size();
+        }
+
+        appended.notify_all();
+    }
+
+    std::vector<SpoolEntry> Spool::read(const SpoolCursor &from, size_t maxEntries, SpoolCursor &next, size_t *skipped) const {
+        std::map<uint64_t, std::filesystem::path> snapshot;
+        uint64_t end;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            snapshot = segments;
+            end = endOffset;
+        }
+
+        std::vector<SpoolEntry> entries;
+        next = from;
+
+        if (snapshot.empty()) {
+            next.offset = std::max(next.offset, end);
+            return entries;
+        }
+
+        // Records before the first segment got delivered to every destination and deleted
+        next.offset = std::max(next.offset, snapshot.begin()->first);
+
+        auto segment = std::prev(snapshot.upper_bound(next.offset));
+        std::vector<unsigned char> payload;
+
+        while (entries.size() < maxEntries && next.offset < end && segment != snapshot.end()) {
+            auto following = std::next(segment);
+            uint64_t segmentEnd = following == snapshot.end() ? end : following->first;
+
+            std::ifstream file(segment->second, std::ios::binary);
+            if (!file.is_open()) {
+                throw IoError("Failed to open spool segment");
+            }
+            file.seekg(static_cast<std::streamoff>(next.offset - segment->first));
+
+            while (entries.size() < maxEntries && next.offset < segmentEnd) {
+                // A damaged record would fail the same way on every read, so it is skipped rather than retried
+                if (!readRecord(file, payload, segmentEnd - next.offset)) {
+                    next.offset = segment->first + skipDamagedRecord(file, next.offset - segment->first, segmentEnd - segment->first);
+                    file.clear();
+                    file.seekg(static_cast<std::streamoff>(next.offset - segment->first));
+                    if (skipped) {
+                        (*skipped)++;
+                    }
+                    continue;
+                }
+
+                next.offset += ENTRY_HEADER_SIZE + payload.size();
+
+                try {
+                    entries.push_back(readEntry(payload));
+                } catch (const DeserializationError &e) {
+                    if (skipped) {
+                        (*skipped)++;
+                    }
+                    continue;
+                }
+
+                next.height = entries.back().height;
+                next.index = entries.back().index;
+            }
+
+            segment = following;
+        }
+
+        return entries;
+    }
+
+    SpoolCursor Spool::cursor(const std::string &destination) const {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = cursors.find(destination);
+        if (it == cursors.end()) {
+            SpoolCursor start;
+            start.offset = segments.empty() ? endOffset : segments.begin()->first;
+            return start;
+        }
+
+        return it->second;
+    }
+
+    void Spool::commit(const std::string &destination, const SpoolCursor &cursor) {
+        std::vector<unsigned char> data;
+        writeVarint(data, cursor.offset);
+        writeVarint(data, cursor.height);
+        writeVarint(data, cursor.index);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Written through a temporary file, a crash leaves either cursor but never a torn one
+        std::filesystem::path path = folder / (destination + CURSOR_EXTENSION);
+        std::filesystem::path tmpPath = path;
+        tmpPath += ".tmp";
+
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+
+            if (!file.is_open()) {
+                throw IoError("Failed to open spool cursor");
+            }
+
+            file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+            if (!file) {
+                throw IoError("Failed to write spool cursor");
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tmpPath, path, error);
+        if (error) {
+            throw IoError("Failed to save spool cursor: " + error.message());
+        }
+
+        cursors[destination] = cursor;
+        compact();
+    }
+
+    void Spool::compact() {
+        uint64_t delivered = UINT64_MAX;
+        for (const auto &[destination, cursor] : cursors) {
+            delivered = std::min(delivered, cursor.offset);
+        }
+
+        // The last segment is kept, appends go to it
+        while (segments.size() > 1 && std::next(segments.begin())->first <= delivered) {
+            std::error_code error;
+            std::filesystem::remove(segments.begin()->second, error);
+            segments.erase(segments.begin());
+        }
+    }
+
+    bool Spool::waitForEntries(uint64_t offset, std::chrono::milliseconds timeout, std::stop_token stop) const {
+        std::unique_lock<std::mutex> lock(mutex);
+        return appended.wait_for(lock, stop, timeout, [&]() { return endOffset > offset; });
+    }
+
+    uint64_t Spool::end() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return endOffset;
+    }
+
+    SpoolDrain::SpoolDrain(Spool &spool, const std::string &destination, Sink sink, const SpoolDrainOptions &options)
+        : spool(spool), destination(destination), sink(std::move(sink)), options(options), mutex(), counters(),
+        cursor(spool.cursor(destination)), thread([this](std::stop_token stop) { drainLoop(stop); }) {
+    }
+
+    SpoolDrain::~SpoolDrain() {
+        thread.request_stop();
+    }
+
+    void SpoolDrain::drainLoop(std::stop_token stop) {
+        SpoolCursor position = cursor;
+        std::chrono::milliseconds delay = options.retryDelay;
+
+        std::mutex sleepMutex;
+        std::condition_variable_any sleeper;
+
+        while (!stop.stop_requested()) {
+            if (!spool.waitForEntries(position.offset, std::chrono::seconds(1), stop)) {
+                continue;
+            }
+
+            SpoolCursor next;
+            std::vector<SpoolEntry> entries;
+            size_t skipped = 0;
+            bool delivered = false;
+
+            try {
+                entries = spool.read(position, options.maxBatch, next, &skipped);
+                delivered = entries.empty() || sink(entries);
+            } catch (const std::exception &e) {
+                delivered = false;
+            }
+
+            if (!delivered) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    counters.failures++;
+                }
+
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleeper.wait_for(lock, stop, delay, []() { return false; });
+                delay = std::min(delay * 2, options.maxRetryDelay);
+                continue;
+            }
+
+            delay = options.retryDelay;
+            position = next;
+
+            try {
+                spool.commit(destination, position);
+            } catch (const IoError &e) {
+                // Saved with the next batch, the records are delivered again after a restart otherwise
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.delivered += entries.size();
+            counters.skipped += skipped;
+            cursor = position;
+        }
+    }
+
+    SpoolDrainStats SpoolDrain::stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    SpoolCursor SpoolDrain::position() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return cursor;
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace iotbc {
+    /// @brief Record of a spool, such as a reading waiting to be published
+    struct SpoolEntry {
+        /// Height of the block the record comes from
+        uint64_t height = 0;
+        /// Index of the transaction in the block
+        uint32_t index = 0;
+        /// Time of the record in milliseconds since the Unix epoch
+        uint64_t timestamp = 0;
+        /// Key the destination groups records by, such as a device name
+        std::string key;
+        /// Content of the record
+        std::string value;
+    };
+
+    /// @brief Position of a destination in a spool
+    struct SpoolCursor {
+        /// Offset of the next record to deliver
+        uint64_t offset = 0;
+        /// Block height of the last delivered record
+        uint64_t height = 0;
+        /// Transaction index of the last delivered record
+        uint32_t index = 0;
+    };
+
+    /// @brief Settings of a Spool
+    struct SpoolOptions {
+        /// Size after which appends go to a new segment file, segments every destination is past are deleted
+        size_t segmentSize = 16 << 20;
+        /// Flush appended records to the disk before append returns
+        bool sync = true;
+    };
+
+    /// @brief Append-only log of records on disk, read by any number of named destinations at their own pace
+    /// @note The log is split in segment files named after the offset of their first record. Each destination
+    /// saves its cursor in the folder, so delivery resumes where it stopped after a restart. A record torn by
+    /// a crash is dropped when the spool opens again, along with everything after it
+    class Spool {
+    public:
+        /// @brief Open the spool in a folder, creating it if needed
+        /// @param folderPath The folder of the segments and cursors
+        /// @param options The settings
+        /// @throws iotbc::IoError if the folder cannot be read or created
+        Spool(const std::string &folderPath, const SpoolOptions &options = SpoolOptions());
+
+        Spool(const Spool &) = delete;
+        Spool(Spool &&) = delete;
+        Spool &operator=(const Spool &) = delete;
+        Spool &operator=(Spool &&) = delete;
+
+        /// @brief Append records at the end of the log, from any thread
+        /// @param entries The records
+        /// @throws iotbc::IoError if they cannot be written
+        void append(const std::vector<SpoolEntry> &entries);
+
+        /// @brief Read records from a position
+        /// @param from The position of the first record, moved past the deleted segments if needed
+        /// @param maxEntries Maximum number of records read
+        /// @param next Set to the position after the last record read
+        /// @param skipped Incremented by the number of damaged records skipped, if not null
+        /// @return The records, empty if the position is at the end of the log
+        /// @throws iotbc::IoError if a segment cannot be opened
+        /// @note A damaged record is skipped using its size when the record after it is valid, the rest of
+        /// its segment is skipped otherwise
+        std::vector<SpoolEntry> read(const SpoolCursor &from, size_t maxEntries, SpoolCursor &next, size_t *skipped = nullptr) const;
+
+        /// @brief Get the cursor of a destination
+        /// @param destination The name of the destination
+        /// @return The saved cursor, at the start of the log for a new destination
+        SpoolCursor cursor(const std::string &destination) const;
+
+        /// @brief Save the cursor of a destination, and delete the segments every destination is past
+        /// @param destination The name of the destination, usable in a file name
+        /// @param cursor The position after the last delivered record
+        /// @throws iotbc::IoError if the cursor cannot be saved
+        void commit(const std::string &destination, const SpoolCursor &cursor);
+
+        /// @brief Wait until records are appended after a position
+        /// @param offset The position
+        /// @param timeout The maximum time to wait
+        /// @param stop Stops the wait early
+        /// @return True if records follow the position
+        bool waitForEntries(uint64_t offset, std::chrono::milliseconds timeout, std::stop_token stop) const;
+
+        /// @brief Get the position after the last record
+        /// @return The offset, in bytes since the spool was created
+        uint64_t end() const;
+
+    private:
+        /// @brief Find the valid end of the last segment, and cut what follows it
+        void recover();
+
+        /// @brief Delete the segments every destination is past, mutex must be held
+        void compact();
+
+        /// @brief Get the path of a segment
+        std::filesystem::path segmentPath(uint64_t base) const;
+
+        std::filesystem::path folder;
+        SpoolOptions options;
+
+        mutable std::mutex mutex;
+        mutable std::condition_variable_any appended;
+        /// Segment files by offset of their first record
+        std::map<uint64_t, std::filesystem::path> segments;
+        uint64_t endOffset;
+        std::unordered_map<std::string, SpoolCursor> cursors;
+    };
+
+    /// @brief Settings of a SpoolDrain
+    struct SpoolDrainOptions {
+        /// Maximum number of records handed to the sink at once
+        size_t maxBatch = 1024;
+        /// Delay before retrying after a failed delivery, doubled on each failure in a row
+        std::chrono::milliseconds retryDelay = std::chrono::milliseconds(100);
+        /// Maximum delay between retries
+        std::chrono::milliseconds maxRetryDelay = std::chrono::seconds(30);
+    };
+
+    /// @brief Counters of a SpoolDrain
+    struct SpoolDrainStats {
+        /// Number of records delivered
+        size_t delivered = 0;
+        /// Number of batches the sink failed to deliver
+        size_t failures = 0;
+        /// Number of damaged records skipped
+        size_t skipped = 0;
+    };
+
+    /// @brief Thread delivering the records of a spool to a destination, in order and at least once
+    /// @note Records are handed to the sink in batches, the cursor only moves once the sink delivered
+    /// the whole batch. A failed batch is retried, with a growing delay, until it is delivered
+    class SpoolDrain {
+    public:
+        /// @brief Delivers a batch of records, from the drain thread
+        /// @return True if the batch got delivered, false to retry it later
+        using Sink = std::function<bool(const std::vector<SpoolEntry> &entries)>;
+
+        /// @brief Start delivering the records after the cursor of the destination
+        /// @param spool The spool
+        /// @param destination The name of the destination
+        /// @param sink The function delivering the records
+        /// @param options The settings
+        SpoolDrain(Spool &spool, const std::string &destination, Sink sink, const SpoolDrainOptions &options = SpoolDrainOptions());
+
+        /// @brief Stop delivering, once the batch being delivered is done
+        ~SpoolDrain();
+
+        SpoolDrain(const SpoolDrain &) = delete;
+        SpoolDrain(SpoolDrain &&) = delete;
+        SpoolDrain &operator=(const SpoolDrain &) = delete;
+        SpoolDrain &operator=(SpoolDrain &&) = delete;
+
+        /// @brief Get the counters of the drain
+        /// @return The counters, since the drain started
+        SpoolDrainStats stats() const;
+
+        /// @brief Get the position after the last delivered record
+        /// @return The cursor
+        SpoolCursor position() const;
+
+    private:
+        /// @brief Hand records to the sink until the drain stops
+        void drainLoop(std::stop_token stop);
+
+        Spool &spool;
+        std::string destination;
+        Sink sink;
+        SpoolDrainOptions options;
+
+        mutable std::mutex mutex;
+        SpoolDrainStats counters;
+        SpoolCursor cursor;
+
+        // Declared last so it starts once the drain is ready
+        std::jthread thread;
+    };
+}
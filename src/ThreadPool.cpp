@@ -0,0 +1,47 @@
+#include <algorithm>
+
+#include <ThreadPool.hpp>
+
+namespace iotbc {
+    ThreadPool::ThreadPool(size_t threads) : workers(), tasks(), mutex(), cv(), stopping(false) {
+        threads = std::max<size_t>(threads, 1);
+
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back(&ThreadPool::work, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        cv.notify_all();
+
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::work() {
+        while (true) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+}
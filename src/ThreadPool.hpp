@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace iotbc {
+    /// @brief Fixed-size pool of worker threads executing tasks in submission order
+    class ThreadPool {
+    public:
+        /// @brief Start the worker threads
+        /// @param threads The number of workers, defaults to the number of hardware threads
+        explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+
+        /// @brief Run the remaining tasks and join the workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool(ThreadPool &&) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        ThreadPool &operator=(ThreadPool &&) = delete;
+
+        /// @brief Queue a task
+        /// @param task The task to run on a worker
+        /// @return A future holding the result of the task, or the exception it threw
+        template <typename F>
+        std::future<std::invoke_result_t<F>> submit(F &&task)
+        {
+            using Result = std::invoke_result_t<F>;
+
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> future = packaged->get_future();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.emplace([packaged]() { (*packaged)(); });
+            }
+
+            cv.notify_one();
+
+            return future;
+        }
+
+        /// @brief Get the number of workers
+        /// @return The number of workers
+        inline size_t size() const
+        {
+            return workers.size();
+        }
+
+    private:
+        void work();
+
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping;
+    };
+}
@@ -1,4 +1,8 @@
+#include <algorithm>
+
+#include <Latency.hpp>
 #include <Types.hpp>
+#include <Wire.hpp>
 
 namespace iotbc {
     std::string Address::toString() const
@@ -56,17 +60,60 @@ namespace iotbc {
             throw EvpError("Failed to update digest");
         }
 
+        // The address is the start of the digest, which is longer than the address itself
+        Hash digest;
         unsigned int len = 0;
-        if (EVP_DigestFinal_ex(ctx, address.bits.data(), &len) != 1) {
+        if (EVP_DigestFinal_ex(ctx, digest.data(), &len) != 1) {
             EVP_MD_CTX_free(ctx);
             throw EvpError("Failed to finalize digest");
         }
 
         EVP_MD_CTX_free(ctx);
 
+        std::copy(digest.begin(), digest.begin() + address.bits.size(), address.bits.begin());
+
         return address;
     }
 
+    Signature signHash(const Hash &hash, const PrivateKey &private_key)
+    {
+        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+
+        if (ctx == nullptr) {
+            throw Secp256k1Error("Failed to create secp256k1 context");
+        }
+
+        secp256k1_ecdsa_signature sig;
+
+        if (secp256k1_ecdsa_sign(ctx, &sig, hash.data(), private_key.data(), nullptr, nullptr) != 1) {
+            secp256k1_context_destroy(ctx);
+            throw Secp256k1Error("Failed to sign hash");
+        }
+
+        Signature signature;
+        secp256k1_ecdsa_signature_serialize_compact(ctx, signature.data(), &sig);
+
+        secp256k1_context_destroy(ctx);
+
+        return signature;
+    }
+
+    void verifyHashSignature(const secp256k1_context *ctx, const Hash &hash, const PublicKey &public_key, const Signature &signature)
+    {
+        secp256k1_ecdsa_signature sig;
+
+        if (secp256k1_ecdsa_signature_parse_compact(ctx, &sig, signature.data()) != 1) {
+            throw Secp256k1Error("Failed to parse signature");
+        }
+
+        secp256k1_pubkey pubkey;
+        memcpy(pubkey.data, public_key.data(), 64);
+
+        if (secp256k1_ecdsa_verify(ctx, &sig, hash.data(), &pubkey) != 1) {
+            throw InvalidSignature("Invalid signature");
+        }
+    }
+
     Signer::Signer(const PrivateKey &private_key)
         : private_key(private_key)
     {
@@ -125,26 +172,49 @@ namespace iotbc {
         return h;
     }
 
-    void Transaction::sign(const PrivateKey &private_key)
+    Hash Transaction::id() const
     {
-        secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+        Hash h;
+
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
 
         if (ctx == nullptr) {
-            throw Secp256k1Error("Failed to create secp256k1 context");
+            throw EvpError("Failed to create EVP_MD_CTX");
         }
 
-        secp256k1_ecdsa_signature sig;
+        if (EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1) {
+            EVP_MD_CTX_free(ctx);
+            throw EvpError("Failed to initialize digest");
+        }
 
-        Hash tx_hash = this->txHash();
+        if (EVP_DigestUpdate(ctx, from.data(), from.size()) != 1) {
+            EVP_MD_CTX_free(ctx);
+            throw EvpError("Failed to update digest");
+        }
 
-        if (secp256k1_ecdsa_sign(ctx, &sig, tx_hash.data(), private_key.data(), nullptr, nullptr) != 1) {
-            secp256k1_context_destroy(ctx);
-            throw Secp256k1Error("Failed to sign transaction");
+        if (EVP_DigestUpdate(ctx, &nonce, sizeof(Nonce)) != 1) {
+            EVP_MD_CTX_free(ctx);
+            throw EvpError("Failed to update digest");
         }
 
-        secp256k1_ecdsa_signature_serialize_compact(ctx, signature.data(), &sig);
+        if (EVP_DigestUpdate(ctx, data.data(), data.size()) != 1) {
+            EVP_MD_CTX_free(ctx);
+            throw EvpError("Failed to update digest");
+        }
 
-        secp256k1_context_destroy(ctx);
+        if (EVP_DigestFinal_ex(ctx, h.data(), nullptr) != 1) {
+            EVP_MD_CTX_free(ctx);
+            throw EvpError("Failed to finalize digest");
+        }
+
+        EVP_MD_CTX_free(ctx);
+
+        return h;
+    }
+
+    void Transaction::sign(const PrivateKey &private_key)
+    {
+        signature = signHash(this->txHash(), private_key);
     }
 
     void Transaction::verify() const
@@ -155,84 +225,120 @@ namespace iotbc {
             throw Secp256k1Error("Failed to create secp256k1 context");
         }
 
-        secp256k1_ecdsa_signature sig;
-
-        if (secp256k1_ecdsa_signature_parse_compact(ctx, &sig, signature.data()) != 1) {
-            secp256k1_context_destroy(ctx);
-            throw Secp256k1Error("Failed to parse signature");
-        }
-
-        secp256k1_pubkey pubkey;
-        memcpy(pubkey.data, from.data(), 64);
-
-        if (secp256k1_ecdsa_verify(ctx, &sig, this->txHash().data(), &pubkey) != 1) {
+        try {
+            this->verify(ctx);
+        } catch (...) {
             secp256k1_context_destroy(ctx);
-            throw InvalidSignature("Invalid signature");
+            throw;
         }
 
         secp256k1_context_destroy(ctx);
     }
 
-    std::vector<unsigned char> Transaction::serialize() const
+    void Transaction::verify(const secp256k1_context *ctx) const
+    {
+        StageTimer timer(PipelineStage::Verify);
+        verifyHashSignature(ctx, this->txHash(), from, signature);
+    }
+
+    std::vector<unsigned char> Transaction::serialize(WireFormat format) const
     {
         std::vector<unsigned char> buf;
 
+        if (format != WireFormat::V1) {
+            writeWireHeader(buf, format);
+        }
+
+        serializeInto(buf, format);
+
+        return buf;
+    }
+
+    void Transaction::serializeInto(std::vector<unsigned char> &buf, WireFormat format) const
+    {
         buf.insert(buf.end(), from.begin(), from.end());
 
-        for (size_t i = 0; i < sizeof(Nonce); i++) {
-            buf.push_back((nonce >> (i * sizeof(Nonce))) & 0xFF);
-        }
+        if (format == WireFormat::V1) {
+            for (size_t i = 0; i < sizeof(Nonce); i++) {
+                buf.push_back((nonce >> (i * sizeof(Nonce))) & 0xFF);
+            }
 
-        for (size_t i = 0; i < sizeof(size_t); i++) {
-            buf.push_back((data.size() >> (i * sizeof(size_t)) & 0xFF));
+            for (size_t i = 0; i < sizeof(size_t); i++) {
+                buf.push_back((data.size() >> (i * sizeof(size_t)) & 0xFF));
+            }
+        } else {
+            writeVarint(buf, nonce);
+            writeVarint(buf, data.size());
         }
+
         buf.insert(buf.end(), data.begin(), data.end());
 
         buf.insert(buf.end(), signature.begin(), signature.end());
-
-        return buf;
     }
 
     Transaction Transaction::deserialize(const std::vector<unsigned char> &data)
     {
-        std::size_t cur = 0;
+        std::optional<WireFormat> format = readWireHeader(data.data(), data.size());
+
+        if (format.has_value()) {
+            try {
+                size_t cur = WIRE_HEADER_SIZE;
+                Transaction tx = deserializeFrom(data.data(), data.size(), cur, format.value());
+
+                if (cur == data.size()) {
+                    return tx;
+                }
+            } catch (const DeserializationError &e) {
+                // A V1 transaction whose public key happens to start with the magic bytes
+            }
+        }
+
+        size_t cur = 0;
+        return deserializeFrom(data.data(), data.size(), cur, WireFormat::V1);
+    }
 
+    Transaction Transaction::deserializeFrom(const unsigned char *data, size_t size, size_t &cur, WireFormat format)
+    {
         PublicKey from;
         for (size_t i = 0; i < from.size(); i++) {
-            if (cur >= data.size()) {
+            if (cur >= size) {
                 throw DeserializationError("Overflow");
             }
             from[i] = data[cur++];
         }
 
         Nonce nonce = 0;
-        for (size_t i = 0; i < sizeof(Nonce); i++) {
-            if (cur >= data.size()) {
-                throw DeserializationError("Overflow");
+        size_t data_size = 0;
+
+        if (format == WireFormat::V1) {
+            for (size_t i = 0; i < sizeof(Nonce); i++) {
+                if (cur >= size) {
+                    throw DeserializationError("Overflow");
+                }
+                nonce |= static_cast<Nonce>(data[cur++]) << (i * sizeof(Nonce));
             }
-            nonce |= data[cur++] << (i * sizeof(Nonce));
-        }
 
-        size_t data_size = 0;
-        for (size_t i = 0; i < sizeof(size_t); i++) {
-            if (cur >= data.size()) {
-                throw DeserializationError("Overflow");
+            for (size_t i = 0; i < sizeof(size_t); i++) {
+                if (cur >= size) {
+                    throw DeserializationError("Overflow");
+                }
+                data_size |= static_cast<size_t>(data[cur++]) << (i * sizeof(size_t));
             }
-            data_size |= data[cur++] << (i * sizeof(size_t));
+        } else {
+            nonce = readVarint(data, size, cur);
+            data_size = readVarint(data, size, cur);
         }
 
-        std::vector<unsigned char> tx_data;
-        tx_data.reserve(data_size);
-        for (size_t i = 0; i < data_size; i++) {
-            if (cur >= data.size()) {
-                throw DeserializationError("Overflow");
-            }
-            tx_data.push_back(data[cur++]);
+        if (data_size > size - cur) {
+            throw DeserializationError("Overflow");
         }
 
-        std::array<unsigned char, 64> signature;
+        std::vector<unsigned char> tx_data(data + cur, data + cur + data_size);
+        cur += data_size;
+
+        Signature signature;
         for (size_t i = 0; i < signature.size(); i++) {
-            if (cur >= data.size()) {
+            if (cur >= size) {
                 throw DeserializationError("Overflow");
             }
             signature[i] = data[cur++];
@@ -243,4 +349,4 @@ namespace iotbc {
 
         return tx;
     }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cstring>
+#include <functional>
 #include <vector>
 
 #include <openssl/sha.h>
@@ -9,14 +10,53 @@
 #include <secp256k1.h>
 
 #include <Exceptions.hpp>
+#include <Varint.hpp>
 
 namespace iotbc {
     using Nonce = uint64_t;
     using PublicKey = std::array<unsigned char, 64>;
     using PrivateKey = std::array<unsigned char, 32>;
+    /// Compact secp256k1 ECDSA signature
+    using Signature = std::array<unsigned char, 64>;
     
     using Hash = std::array<unsigned char, SHA256_DIGEST_LENGTH>;
 
+    /// @brief Signs a hash with the given private key
+    /// @param hash The hash to sign
+    /// @param private_key The private key to sign the hash with
+    /// @return The compact signature
+    /// @throws Secp256k1Error if an error occurs during the signing
+    Signature signHash(const Hash &hash, const PrivateKey &private_key);
+
+    /// @brief Verifies a signature over a hash
+    /// @param ctx A secp256k1 verification context
+    /// @param hash The signed hash
+    /// @param public_key The public key of the signer
+    /// @param signature The compact signature
+    /// @throws InvalidSignature if the signature is invalid
+    /// @throws Secp256k1Error if the signature cannot be parsed
+    void verifyHashSignature(const secp256k1_context *ctx, const Hash &hash, const PublicKey &public_key, const Signature &signature);
+
+    /// @brief Hasher to use hashes and other byte arrays as unordered container keys
+    struct ArrayHash {
+        template <size_t N>
+        std::size_t operator()(const std::array<unsigned char, N> &arr) const {
+            std::size_t hash = 0;
+            for (auto byte : arr) {
+                hash ^= std::hash<unsigned char>{}(byte) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    /// @brief Wire formats used to serialize transactions and blocks
+    enum class WireFormat : unsigned char {
+        /// Fixed-width lengths, counts and nonces, no header
+        V1 = 1,
+        /// LEB128 varint lengths, counts and nonces, prefixed by WIRE_MAGIC and the format version
+        V2 = 2,
+    };
+
     struct Address {
         std::array<unsigned char, 20> bits;
 
@@ -67,19 +107,35 @@ namespace iotbc {
         static Address fromPublicKey(const PublicKey &public_key);
     };
 
+    /// @brief Hasher to use addresses as unordered container keys
+    struct AddressHash {
+        std::size_t operator()(const Address &address) const {
+            return ArrayHash{}(address.bits);
+        }
+    };
+
     struct Signer {
         PrivateKey private_key;
         PublicKey public_key;
         Address address;
     
         Signer(const PrivateKey &private_key);
+
+        /// @brief Signs a hash with the private key of the signer
+        /// @param hash The hash to sign
+        /// @return The compact signature
+        /// @throws Secp256k1Error if an error occurs during the signing
+        inline Signature sign(const Hash &hash) const
+        {
+            return signHash(hash, private_key);
+        }
     };
     
     struct Transaction {
         PublicKey from;
         Nonce nonce;
         std::vector<unsigned char> data;
-        std::array<unsigned char, 64> signature;
+        Signature signature;
 
         /// @brief Creates a new transaction based on the sender, the nonce, and the data
         /// @param from The sender public key
@@ -103,6 +159,12 @@ namespace iotbc {
         /// @return The hash of the transaction
         Hash txHash() const;
 
+        /// @brief Get the identity of the transaction in mempools, gossip and ingest results
+        /// @return The hash of the sender, the nonce and the data
+        /// @note Unlike txHash it covers the sender, so two sensors sending the same reading at the
+        /// same nonce are two distinct transactions
+        Hash id() const;
+
         /// @brief Signs the transaction with the given private key
         /// @param private_key The private key to sign the transaction with
         /// @throws Secp256k1Error if an error occurs during the signing
@@ -121,20 +183,53 @@ namespace iotbc {
         /// @throws Secp256k1Error if an error occurs during the verification
         void verify() const;
 
+        /// @brief Verifies if the given signature is valid for the transaction
+        /// @param ctx A secp256k1 verification context, shared across a batch of transactions
+        /// @throws InvalidSignature if the signature is invalid
+        /// @throws Secp256k1Error if an error occurs during the verification
+        void verify(const secp256k1_context *ctx) const;
+
         /// @brief Serializes the transaction into a byte array
+        /// @param format The wire format to use
         /// @return The serialized transaction
-        std::vector<unsigned char> serialize() const;
+        std::vector<unsigned char> serialize(WireFormat format = WireFormat::V2) const;
+
+        /// @brief Appends the transaction to a buffer, without the wire format header
+        /// @param buf The buffer to append to
+        /// @param format The wire format to use
+        void serializeInto(std::vector<unsigned char> &buf, WireFormat format) const;
 
-        /// @brief Get the size of the transaction in bytes
+        /// @brief Get the size of the transaction in bytes, in the V1 wire format
         /// @return The size of the transaction in bytes
         inline size_t size() const
         {
             return from.size() + sizeof(Nonce) + sizeof(size_t) + data.size() + signature.size();
         }
 
+        /// @brief Get the size of the transaction in bytes, without the wire format header
+        /// @param format The wire format
+        /// @return The size of the transaction in bytes
+        inline size_t size(WireFormat format) const
+        {
+            if (format == WireFormat::V1) {
+                return size();
+            }
+            return from.size() + varintSize(nonce) + varintSize(data.size()) + data.size() + signature.size();
+        }
+
         /// @brief Deserializes a transaction from a byte array
-        /// @param data The byte array to deserialize
+        /// @param data The byte array to deserialize, in any supported wire format
         /// @return The deserialized transaction
+        /// @throws iotbc::DeserializationError if the data is invalid
         static Transaction deserialize(const std::vector<unsigned char> &data);
+
+        /// @brief Reads a transaction from a buffer, without the wire format header
+        /// @param data The buffer to read from
+        /// @param size The size of the buffer
+        /// @param cur The current position in the buffer, advanced past the transaction
+        /// @param format The wire format of the transaction
+        /// @return The deserialized transaction
+        /// @throws iotbc::DeserializationError if the data is invalid
+        static Transaction deserializeFrom(const unsigned char *data, size_t size, size_t &cur, WireFormat format);
     };
 }
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <chrono>
+
 #include <Types.hpp>
 
 namespace iotbc {
-    std::string hashToString(const Hash &hash)
+    inline std::string hashToString(const Hash &hash)
     {
         std::string str;
         str.reserve(hash.size() * 2);
@@ -15,4 +17,12 @@ namespace iotbc {
 
         return str;
     }
+
+    /// @brief Get the current time as stored in block headers
+    /// @return The number of milliseconds since the Unix epoch
+    inline uint64_t currentTimestamp()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
 }
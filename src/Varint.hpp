@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <Exceptions.hpp>
+
+namespace iotbc {
+    /// @brief Appends an unsigned LEB128 encoded integer to a buffer
+    /// @param buf The buffer to append to
+    /// @param value The value to encode
+    inline void writeVarint(std::vector<unsigned char> &buf, uint64_t value)
+    {
+        while (value >= 0x80) {
+            buf.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        buf.push_back(static_cast<unsigned char>(value));
+    }
+
+    /// @brief Reads an unsigned LEB128 encoded integer
+    /// @param data The buffer to read from
+    /// @param size The size of the buffer
+    /// @param cur The current position in the buffer, advanced past the varint
+    /// @return The decoded value
+    /// @throws iotbc::DeserializationError if the varint is truncated, too long or does not fit in 64 bits
+    inline uint64_t readVarint(const unsigned char *data, size_t size, size_t &cur)
+    {
+        uint64_t value = 0;
+
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (cur >= size) {
+                throw DeserializationError("Overflow");
+            }
+
+            unsigned char byte = data[cur++];
+
+            // The 10th byte only holds the highest bit of the value
+            if (shift == 63 && byte > 1) {
+                throw DeserializationError("Varint overflows 64 bits");
+            }
+
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+
+        throw DeserializationError("Varint is too long");
+    }
+
+    /// @brief Get the number of bytes needed to encode a value as a varint
+    /// @param value The value to encode
+    /// @return The encoded size in bytes
+    inline size_t varintSize(uint64_t value)
+    {
+        size_t size = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include <Types.hpp>
+#include <Varint.hpp>
+
+namespace iotbc {
+    /// Magic bytes prefixing every payload serialized in a versioned wire format (V2 and later)
+    static constexpr std::array<unsigned char, 4> WIRE_MAGIC = {'I', 'O', 'T', 'B'};
+
+    /// Size of the magic bytes and format version prefixing versioned payloads
+    static constexpr size_t WIRE_HEADER_SIZE = WIRE_MAGIC.size() + 1;
+
+    /// Magic bytes prefixing block files written with a compression codec by the block store,
+    /// followed by the codec, the level and the varint size of the uncompressed block
+    static constexpr std::array<unsigned char, 4> STORE_MAGIC = {'I', 'O', 'T', 'Z'};
+
+    /// @brief Appends the magic bytes and format version to a buffer
+    /// @param buf The buffer to append to
+    /// @param format The wire format, must be versioned
+    inline void writeWireHeader(std::vector<unsigned char> &buf, WireFormat format)
+    {
+        buf.insert(buf.end(), WIRE_MAGIC.begin(), WIRE_MAGIC.end());
+        buf.push_back(static_cast<unsigned char>(format));
+    }
+
+    /// @brief Reads the magic bytes and format version of a payload
+    /// @param data The payload
+    /// @param size The size of the payload
+    /// @return The versioned wire format, or std::nullopt if the payload has no known header
+    /// @note Legacy V1 payloads have no header, callers should fall back to V1
+    inline std::optional<WireFormat> readWireHeader(const unsigned char *data, size_t size)
+    {
+        if (size < WIRE_HEADER_SIZE || std::memcmp(data, WIRE_MAGIC.data(), WIRE_MAGIC.size()) != 0) {
+            return std::nullopt;
+        }
+
+        switch (data[WIRE_MAGIC.size()]) {
+            case static_cast<unsigned char>(WireFormat::V2):
+                return WireFormat::V2;
+            default:
+                return std::nullopt;
+        }
+    }
+}
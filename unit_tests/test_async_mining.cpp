@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <Block.hpp>
+#include <testers.hpp>
+
+static iotbc::Block blockTemplate()
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(alice, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+    block.addTransaction(tx);
+
+    return block;
+}
+
+/// More leading zero bits than any test can find
+static constexpr int UNREACHABLE_DIFFICULTY = 128;
+
+TEST(AsyncMining, FindsTheSameNonceAsMine)
+{
+    iotbc::Block block = blockTemplate();
+    iotbc::Block synchronous = block;
+    synchronous.mine(8);
+
+    iotbc::MiningHandle handle = block.mineAsync(8);
+
+    ASSERT_EQ(handle.wait(), iotbc::MiningStatus::Found);
+    ASSERT_EQ(handle.hashesTried(), synchronous.nonce + 1);
+
+    iotbc::Block mined = handle.takeBlock();
+
+    ASSERT_EQ(mined.nonce, synchronous.nonce);
+    ASSERT_EQ(mined.blockHash(), synchronous.blockHash());
+    ASSERT_TRUE(mined.hasValidProofOfWork());
+    ASSERT_TRUE(mined.hasValidMerkleRoot());
+
+    // The template itself is left untouched
+    ASSERT_EQ(block.merkleRoot, iotbc::NULL_HASH);
+}
+
+TEST(AsyncMining, CancelStopsTheJob)
+{
+    iotbc::MiningHandle handle = blockTemplate().mineAsync(UNREACHABLE_DIFFICULTY);
+
+    ASSERT_FALSE(handle.waitFor(std::chrono::milliseconds(50)));
+    ASSERT_EQ(handle.status(), iotbc::MiningStatus::Running);
+
+    handle.cancel();
+
+    ASSERT_EQ(handle.wait(), iotbc::MiningStatus::Cancelled);
+    ASSERT_GT(handle.hashesTried(), 0);
+    ASSERT_GT(handle.hashRate(), 0);
+    ASSERT_THROW(handle.takeBlock(), iotbc::InvalidBlock);
+}
+
+TEST(AsyncMining, DeadlineStopsTheJob)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+
+    iotbc::MiningHandle handle = blockTemplate().mineAsync(UNREACHABLE_DIFFICULTY, deadline);
+
+    ASSERT_EQ(handle.wait(), iotbc::MiningStatus::DeadlineExceeded);
+    ASSERT_GE(std::chrono::steady_clock::now(), deadline);
+}
+
+TEST(AsyncMining, DestroyingTheHandleStopsTheJob)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    {
+        iotbc::MiningHandle handle = blockTemplate().mineAsync(UNREACHABLE_DIFFICULTY);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
@@ -44,10 +44,11 @@ TEST(Block, MineBlockWithSomeDifficulty)
 
     block.addTransaction(tx);
 
-    block.mine(2);
+    block.mine(8);
 
     // It is very unlikely that the nonce will be 0 with some difficulty
     ASSERT_NE(block.nonce, 0);
+    ASSERT_TRUE(block.hasValidProofOfWork());
 
     ASSERT_NE(block.merkleRoot, iotbc::NULL_HASH);
     ASSERT_NE(block.merkleRoot, iotbc::EMPTY_STRING_HASH);
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <Blockchain.hpp>
+#include <testers.hpp>
+
+/// @brief Build a chain with one block every 10 seconds, starting at 1000 seconds
+static iotbc::Blockchain timedChain(size_t size)
+{
+    iotbc::Blockchain chain;
+
+    for (size_t i = 0; i < size; i++) {
+        chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}, 0, 1000000 + i * 10000));
+    }
+
+    return chain;
+}
+
+TEST(BlockHeight, HeightIsSerializedAndHashed)
+{
+    iotbc::Block block(iotbc::NULL_HASH, 42);
+    block.mine(0);
+
+    iotbc::Block deserialized = iotbc::Block::deserialize(block.serialize());
+
+    ASSERT_EQ(deserialized.height, 42);
+    ASSERT_EQ(deserialized.blockHash(), block.blockHash());
+
+    iotbc::Block other = block;
+    other.height = 43;
+
+    ASSERT_NE(other.blockHash(), block.blockHash());
+}
+
+TEST(BlockHeight, RejectsWrongHeight)
+{
+    iotbc::Blockchain chain = timedChain(2);
+
+    iotbc::Block block = minedBlock(chain, {nextTx(chain, alice)}, 0, 1020000);
+    block.height = 3;
+    block.mine(0);
+
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+
+    block.height = 2;
+    block.mine(0);
+
+    chain.addBlock(block);
+    chain.verifyExistingChain();
+}
+
+TEST(BlockHeight, RejectsGenesisWithHeight)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Block block(iotbc::NULL_HASH, 1);
+    block.mine(0);
+
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(BlockHeight, FindFirstBlockAtOrAfter)
+{
+    iotbc::Blockchain chain = timedChain(10);
+
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(0), 0);
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(1000000), 0);
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(1000001), 1);
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(1050000), 5);
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(1090000), 9);
+    ASSERT_EQ(chain.findFirstBlockAtOrAfter(1090001), 10);
+}
+
+TEST(BlockHeight, BlocksBetween)
+{
+    iotbc::Blockchain chain = timedChain(10);
+
+    auto blocks = chain.blocksBetween(1015000, 1045000);
+
+    ASSERT_EQ(blocks.size(), 3);
+    ASSERT_EQ(blocks.front().height, 2);
+    ASSERT_EQ(blocks.back().height, 4);
+
+    ASSERT_TRUE(chain.blocksBetween(1045000, 1015000).empty());
+    ASSERT_TRUE(chain.blocksBetween(2000000, 3000000).empty());
+    ASSERT_EQ(chain.blocksBetween(0, 2000000).size(), 10);
+}
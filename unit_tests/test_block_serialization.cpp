@@ -1,15 +1,17 @@
 #include <gtest/gtest.h>
 
 #include <Block.hpp>
+#include <Varint.hpp>
 #include <testers.hpp>
 
 TEST(Block, SerializeEmptyBlock)
 {
     iotbc::Block block(iotbc::NULL_HASH);
+    block.version = iotbc::BLOCK_VERSION_LEGACY;
 
     block.mine(0);
 
-    auto serialized = block.serialize();
+    auto serialized = block.serialize(iotbc::WireFormat::V1);
 
     // prevHash (32) + txCount (8) + no txs (0) + merkleRoot (32) + nonce (8) + blockHash (32)
     ASSERT_EQ(serialized.size(), 32 + 8 + 32 + 8 + 32);
@@ -51,3 +53,99 @@ TEST(Block, SerializeBlockWithFewTxs)
     ASSERT_EQ(block.merkleRoot, deserialized.merkleRoot);
     ASSERT_EQ(block.nonce, deserialized.nonce);
 }
+
+TEST(Block, SerializeEmptyBlockV2)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    block.mine(0);
+
+    auto serialized = block.serialize();
+
+    // magic (4) + format (1) + version (1) + prevHash (32) + difficulty (1) + timestamp + seal flag (1) + height (1)
+    // + txCount (1) + merkleRoot (32) + nonce (1)
+    ASSERT_EQ(serialized.size(), 4 + 1 + 1 + 32 + 1 + iotbc::varintSize(block.timestamp) + 1 + 1 + 1 + 32 + 1);
+
+    auto deserialized = iotbc::Block::deserialize(serialized);
+
+    ASSERT_EQ(block.version, deserialized.version);
+    ASSERT_EQ(block.difficulty, deserialized.difficulty);
+    ASSERT_EQ(block.timestamp, deserialized.timestamp);
+    ASSERT_EQ(block.prevHash, deserialized.prevHash);
+    ASSERT_EQ(block.merkleRoot, deserialized.merkleRoot);
+    ASSERT_EQ(block.nonce, deserialized.nonce);
+    ASSERT_EQ(block.blockHash(), deserialized.blockHash());
+}
+
+TEST(Block, SerializeV2IsSmallerThanV1)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+    block.version = iotbc::BLOCK_VERSION_LEGACY;
+
+    for (iotbc::Nonce i = 0; i < 4; i++) {
+        iotbc::Transaction tx(alice, i, {0x00, 0x01, 0x02});
+        tx.sign(alice);
+        block.addTransaction(tx);
+    }
+
+    block.mine(4);
+
+    auto v1 = block.serialize(iotbc::WireFormat::V1);
+    auto v2 = block.serialize(iotbc::WireFormat::V2);
+
+    ASSERT_LT(v2.size(), v1.size());
+
+    auto fromV1 = iotbc::Block::deserialize(v1);
+    auto fromV2 = iotbc::Block::deserialize(v2);
+
+    ASSERT_EQ(fromV1.blockHash(), block.blockHash());
+    ASSERT_EQ(fromV2.blockHash(), block.blockHash());
+    ASSERT_EQ(fromV2.transactions.size(), block.transactions.size());
+
+    for (size_t i = 0; i < block.transactions.size(); i++) {
+        ASSERT_EQ(block.transactions[i].nonce, fromV2.transactions[i].nonce);
+        ASSERT_EQ(block.transactions[i].data, fromV2.transactions[i].data);
+        ASSERT_EQ(block.transactions[i].signature, fromV2.transactions[i].signature);
+    }
+}
+
+TEST(Block, DeserializeV2FailsIfTruncated)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(alice, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+    block.addTransaction(tx);
+
+    block.mine(0);
+
+    auto serialized = block.serialize();
+    serialized.resize(serialized.size() - 10);
+
+    ASSERT_THROW(iotbc::Block::deserialize(serialized), iotbc::DeserializationError);
+}
+
+TEST(Block, SerializeV1RejectsNewerHeaders)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    block.mine(1);
+
+    ASSERT_THROW(block.serialize(iotbc::WireFormat::V1), iotbc::InvalidBlock);
+}
+
+TEST(Block, DifficultyRoundTripsAndIsHashed)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    block.mine(6);
+
+    auto deserialized = iotbc::Block::deserialize(block.serialize());
+
+    ASSERT_EQ(deserialized.difficulty, 6);
+    ASSERT_EQ(deserialized.blockHash(), block.blockHash());
+    ASSERT_TRUE(deserialized.hasValidProofOfWork());
+
+    deserialized.difficulty = 0;
+    ASSERT_NE(deserialized.blockHash(), block.blockHash());
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include <Blockchain.hpp>
+#include <testers.hpp>
+
+static iotbc::Block blockOn(const iotbc::Block *parent, const iotbc::Signer &signer, iotbc::Nonce nonce,
+    const std::vector<unsigned char> &data, int difficulty = 0)
+{
+    iotbc::Block block(parent == nullptr ? iotbc::NULL_HASH : parent->blockHash(), parent == nullptr ? 0 : parent->height + 1);
+
+    iotbc::Transaction tx(signer, nonce, data);
+    tx.sign(signer);
+    block.addTransaction(tx);
+
+    block.mine(difficulty);
+    return block;
+}
+
+class RecordingLayer : public iotbc::ILayer {
+public:
+    void processBlock(const iotbc::Block &block) override
+    {
+        events.emplace_back('+', block.blockHash());
+    }
+
+    void disconnectBlock(const iotbc::Block &block) override
+    {
+        events.emplace_back('-', block.blockHash());
+    }
+
+    std::vector<std::pair<char, iotbc::Hash>> events;
+};
+
+/// @brief Two branches forking after the genesis block, alice mining the first and bob the second
+class BlockTree : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        genesis = blockOn(nullptr, alice, 0, {0x00, 0x00});
+        a1 = blockOn(&genesis, alice, 1, iotbc::SensorDictionary::registrationPayload("door"));
+        a2 = blockOn(&a1, alice, 2, {0x00, 0x02});
+
+        b1 = blockOn(&genesis, bob, 0, iotbc::SensorDictionary::registrationPayload("window"));
+        b2 = blockOn(&b1, bob, 1, {0x01, 0x02});
+        b3 = blockOn(&b2, bob, 2, {0x01, 0x03});
+
+        chain.addLayer(layer);
+        chain.addBlock(genesis);
+        chain.addBlock(a1);
+        chain.addBlock(a2);
+        layer->events.clear();
+    }
+
+    iotbc::Blockchain chain;
+    std::shared_ptr<RecordingLayer> layer = std::make_shared<RecordingLayer>();
+    iotbc::Block genesis = iotbc::Block(iotbc::NULL_HASH);
+    iotbc::Block a1 = genesis, a2 = genesis, b1 = genesis, b2 = genesis, b3 = genesis;
+};
+
+TEST_F(BlockTree, ReorganizesToTheBranchWithMoreWork)
+{
+    ASSERT_EQ(chain.submitBlock(b1), iotbc::BlockStatus::SideBranch);
+    ASSERT_EQ(chain.submitBlock(b2), iotbc::BlockStatus::SideBranch);
+    ASSERT_TRUE(layer->events.empty());
+
+    ASSERT_EQ(chain.submitBlock(b3), iotbc::BlockStatus::Reorganized);
+
+    ASSERT_EQ(chain.chain.size(), 4);
+    ASSERT_EQ(chain.chain.back().blockHash(), b3.blockHash());
+    ASSERT_EQ(chain.sideBlockCount(), 2);
+
+    std::vector<std::pair<char, iotbc::Hash>> expected = {
+        {'-', a2.blockHash()}, {'-', a1.blockHash()},
+        {'+', b1.blockHash()}, {'+', b2.blockHash()}, {'+', b3.blockHash()},
+    };
+    ASSERT_EQ(layer->events, expected);
+
+    ASSERT_EQ(chain.nextNonce(alice.address), 1);
+    ASSERT_EQ(chain.nextNonce(bob.address), 3);
+    ASSERT_FALSE(chain.sensorDictionary.find("door").has_value());
+    ASSERT_EQ(chain.sensorDictionary.find("window"), 0);
+
+    chain.verifyNewBlocks();
+    chain.verifyExistingChain();
+}
+
+TEST_F(BlockTree, HeavierBranchWinsWithFewerBlocks)
+{
+    iotbc::Block heavy = blockOn(&genesis, bob, 0, {0x01, 0x01}, 3);
+
+    ASSERT_EQ(chain.submitBlock(heavy), iotbc::BlockStatus::Reorganized);
+    ASSERT_EQ(chain.chain.size(), 2);
+    ASSERT_EQ(chain.chain.back().blockHash(), heavy.blockHash());
+}
+
+TEST_F(BlockTree, OrphansAreAddedWhenTheirParentArrives)
+{
+    ASSERT_EQ(chain.submitBlock(b3), iotbc::BlockStatus::Orphan);
+    ASSERT_EQ(chain.submitBlock(b2), iotbc::BlockStatus::Orphan);
+    ASSERT_EQ(chain.orphanCount(), 2);
+
+    chain.submitBlock(b1);
+
+    ASSERT_EQ(chain.orphanCount(), 0);
+    ASSERT_EQ(chain.chain.back().blockHash(), b3.blockHash());
+}
+
+TEST_F(BlockTree, OrphanBufferIsBounded)
+{
+    chain.forks.maxOrphans = 1;
+
+    chain.submitBlock(b3);
+    chain.submitBlock(b2);
+    ASSERT_EQ(chain.orphanCount(), 1);
+
+    // b3 was dropped, so only b1 and b2 are added
+    chain.submitBlock(b1);
+    ASSERT_EQ(chain.chain.back().blockHash(), a2.blockHash());
+    ASSERT_EQ(chain.sideBlockCount(), 2);
+}
+
+TEST_F(BlockTree, SideBlocksAreBounded)
+{
+    chain.forks.maxSideBlocks = 1;
+
+    iotbc::Block c1 = blockOn(&genesis, bob, 0, {0x02, 0x01});
+
+    ASSERT_EQ(chain.submitBlock(b1), iotbc::BlockStatus::SideBranch);
+    ASSERT_EQ(chain.submitBlock(c1), iotbc::BlockStatus::SideBranch);
+    ASSERT_EQ(chain.sideBlockCount(), 1);
+    ASSERT_EQ(chain.submitBlock(c1), iotbc::BlockStatus::Duplicate);
+
+    // b1 was dropped, so its child waits for it
+    ASSERT_EQ(chain.submitBlock(b2), iotbc::BlockStatus::Orphan);
+    ASSERT_EQ(chain.chain.back().blockHash(), a2.blockHash());
+}
+
+TEST_F(BlockTree, InvalidBranchRestoresTheActiveChain)
+{
+    // The signature is not covered by the merkle root, so the header of b2 stays valid
+    iotbc::Block invalid = b2;
+    invalid.transactions[0].signature[0] ^= 0xFF;
+    iotbc::Block child = blockOn(&invalid, bob, 2, {0x01, 0x03});
+
+    chain.submitBlock(b1);
+    chain.submitBlock(invalid);
+
+    ASSERT_THROW(chain.submitBlock(child), iotbc::InvalidBlock);
+
+    ASSERT_EQ(chain.chain.size(), 3);
+    ASSERT_EQ(chain.chain.back().blockHash(), a2.blockHash());
+    ASSERT_EQ(chain.nextNonce(alice.address), 3);
+    ASSERT_EQ(chain.nextNonce(bob.address), 0);
+    ASSERT_EQ(chain.sensorDictionary.find("door"), 0);
+    chain.verifyExistingChain();
+}
+
+TEST_F(BlockTree, RejectsReorganizationsDeeperThanTheLimit)
+{
+    chain.forks.maxReorgDepth = 1;
+
+    ASSERT_THROW(chain.submitBlock(b1), iotbc::InvalidBlock);
+    ASSERT_EQ(chain.chain.back().blockHash(), a2.blockHash());
+}
+
+TEST_F(BlockTree, DuplicatesAndConnectedBlocks)
+{
+    ASSERT_EQ(chain.submitBlock(a2), iotbc::BlockStatus::Duplicate);
+
+    iotbc::Block a3 = blockOn(&a2, alice, 3, {0x00, 0x03});
+    ASSERT_EQ(chain.submitBlock(a3), iotbc::BlockStatus::Connected);
+
+    chain.submitBlock(b1);
+    ASSERT_EQ(chain.submitBlock(b1), iotbc::BlockStatus::Duplicate);
+}
+
+TEST_F(BlockTree, LoadingPicksTheBranchWithMoreWork)
+{
+    std::string folder = "/tmp/iotbc_test_block_tree";
+    std::filesystem::remove_all(folder);
+
+    chain.saveBlocks(folder);
+
+    chain.submitBlock(b1);
+    chain.submitBlock(b2);
+    chain.submitBlock(b3);
+    chain.saveBlocks(folder);
+
+    iotbc::Blockchain loaded;
+    loaded.loadExistingBlocks(folder);
+
+    ASSERT_EQ(loaded.chain.size(), 4);
+    ASSERT_EQ(loaded.chain.back().blockHash(), b3.blockHash());
+    ASSERT_EQ(loaded.sideBlockCount(), 2);
+    ASSERT_EQ(loaded.nextNonce(bob.address), 3);
+
+    std::filesystem::remove_all(folder);
+}
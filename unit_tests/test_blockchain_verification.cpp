@@ -19,7 +19,7 @@ TEST(Blockchain, ValidBlockchain)
 
     chain.addBlock(block1);
 
-    iotbc::Block block2(block1.blockHash());
+    iotbc::Block block2(block1.blockHash(), 1);
 
     iotbc::Transaction tx2(alice.public_key, 1, {0x01, 0x02, 0x03});
     tx2.sign(alice);
@@ -0,0 +1,283 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+
+#include <Blockchain.hpp>
+#include <Consensus.hpp>
+#include <Utils.hpp>
+#include <testers.hpp>
+
+/// @brief Save a chain of 10 blocks registering a sensor, checkpointed at height 5
+static std::string checkpointedChain(const std::string &name, const iotbc::Signer *signer)
+{
+    std::string folder = "/tmp/iotbc_test_checkpoint_" + name;
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain chain;
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice, iotbc::SensorDictionary::registrationPayload("door"))}));
+
+    for (int i = 1; i < 10; i++) {
+        chain.addBlock(minedBlock(chain, {nextTx(chain, alice, {0x00, static_cast<unsigned char>(i)})}));
+
+        if (i == 5) {
+            chain.saveBlocks(folder);
+            if (signer != nullptr) {
+                chain.saveCheckpoint(folder, *signer);
+            } else {
+                chain.saveCheckpoint(folder);
+            }
+        }
+    }
+
+    chain.saveBlocks(folder);
+    return folder;
+}
+
+/// @brief Overwrite a block file with a copy of the block whose first signature is invalid
+static void tamperSignature(const std::string &folder, size_t height)
+{
+    iotbc::Blockchain chain;
+    chain.loadExistingBlocks(folder);
+
+    iotbc::Block tampered = chain.chain[height];
+    tampered.transactions[0].signature[0] ^= 0xFF;
+
+    std::ofstream file(folder + "/" + iotbc::hashToString(tampered.blockHash()), std::ios::binary | std::ios::trunc);
+    auto serialized = tampered.serialize();
+    file.write(reinterpret_cast<const char *>(serialized.data()), serialized.size());
+}
+
+/// @brief Proof of work whose check of the genesis block waits until it is released
+class GatedProofOfWork : public iotbc::ProofOfWork {
+public:
+    void verifyHeader(const iotbc::Block &block, uint32_t requiredDifficulty) const override
+    {
+        if (block.height == 0) {
+            gate.wait();
+        }
+        iotbc::ProofOfWork::verifyHeader(block, requiredDifficulty);
+    }
+
+    std::promise<void> release;
+
+private:
+    std::shared_future<void> gate = release.get_future().share();
+};
+
+static iotbc::LoadOptions verifying()
+{
+    iotbc::LoadOptions options;
+    options.verify = true;
+    options.trustUnsignedCheckpoint = true;
+    return options;
+}
+
+TEST(Checkpoint, SerializationRoundTrip)
+{
+    iotbc::Checkpoint checkpoint;
+    checkpoint.height = 42;
+    checkpoint.blockHash[0] = 0xAB;
+    checkpoint.nonceIndex = {0x01, 0x02};
+    checkpoint.sensorDictionary = {0x03};
+    checkpoint.sign(alice);
+
+    iotbc::Checkpoint deserialized = iotbc::Checkpoint::deserialize(checkpoint.serialize());
+
+    ASSERT_EQ(deserialized.height, 42);
+    ASSERT_EQ(deserialized.blockHash, checkpoint.blockHash);
+    ASSERT_EQ(deserialized.nonceIndex, checkpoint.nonceIndex);
+    ASSERT_EQ(deserialized.sensorDictionary, checkpoint.sensorDictionary);
+    ASSERT_TRUE(deserialized.hasValidSignature());
+
+    deserialized.height = 43;
+    ASSERT_FALSE(deserialized.hasValidSignature());
+}
+
+TEST(Checkpoint, SkipsVerificationUpToTheCheckpoint)
+{
+    std::string folder = checkpointedChain("skip", nullptr);
+    tamperSignature(folder, 2);
+
+    iotbc::Blockchain chain;
+    iotbc::LoadStats stats = chain.loadExistingBlocks(folder, verifying());
+
+    ASSERT_EQ(stats.checkpointHeight, 5);
+    ASSERT_EQ(chain.chain.size(), 10);
+
+    // Without the checkpoint, the whole chain is verified
+    iotbc::LoadOptions options = verifying();
+    options.useCheckpoint = false;
+
+    iotbc::Blockchain full;
+    ASSERT_ANY_THROW(full.loadExistingBlocks(folder, options));
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, VerifiesBlocksAfterTheCheckpoint)
+{
+    std::string folder = checkpointedChain("after", nullptr);
+    tamperSignature(folder, 8);
+
+    iotbc::Blockchain chain;
+    ASSERT_ANY_THROW(chain.loadExistingBlocks(folder, verifying()));
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, VerifiesBlocksAfterTheCheckpointLater)
+{
+    std::string folder = checkpointedChain("later", nullptr);
+    tamperSignature(folder, 8);
+
+    iotbc::LoadOptions options;
+    options.trustUnsignedCheckpoint = true;
+
+    iotbc::Blockchain tampered;
+    tampered.loadExistingBlocks(folder, options);
+    ASSERT_EQ(tampered.verifiedHeight(), 5);
+
+    ASSERT_THROW(tampered.verifyNewBlocks(), iotbc::InvalidBlockchainSave);
+    ASSERT_EQ(tampered.verifiedHeight(), 5);
+    ASSERT_EQ(tampered.nextNonce(alice.address), 10);
+
+    std::filesystem::remove_all(folder);
+    folder = checkpointedChain("later", nullptr);
+
+    // Blocks added while the loaded ones are not verified yet do not move the verified height either
+    iotbc::Blockchain chain;
+    chain.loadExistingBlocks(folder, options);
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice), nextTx(chain, bob)}));
+    ASSERT_EQ(chain.verifiedHeight(), 5);
+
+    chain.verifyNewBlocks();
+    ASSERT_EQ(chain.verifiedHeight(), 10);
+    ASSERT_EQ(chain.nextNonce(alice.address), 11);
+    ASSERT_EQ(chain.nextNonce(bob.address), 1);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, BackgroundAuditVerifiesTheTrustedBlocks)
+{
+    std::string folder = checkpointedChain("audit", nullptr);
+    tamperSignature(folder, 2);
+
+    iotbc::LoadOptions options = verifying();
+    options.auditCheckpoint = true;
+
+    iotbc::Blockchain chain;
+    iotbc::LoadStats stats = chain.loadExistingBlocks(folder, options);
+
+    ASSERT_TRUE(stats.audit.valid());
+    ASSERT_ANY_THROW(stats.audit.get());
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, DroppingTheAuditDoesNotWaitForIt)
+{
+    std::string folder = checkpointedChain("dropped_audit", nullptr);
+
+    iotbc::LoadOptions options = verifying();
+    options.auditCheckpoint = true;
+
+    // Only the audit checks the genesis block, the load verifies the blocks after the checkpoint
+    auto consensus = std::make_shared<GatedProofOfWork>();
+    iotbc::Blockchain chain;
+    chain.consensus = consensus;
+
+    {
+        iotbc::LoadStats stats = chain.loadExistingBlocks(folder, options);
+        ASSERT_EQ(stats.audit.wait_for(std::chrono::milliseconds(0)), std::future_status::timeout);
+    }
+
+    ASSERT_EQ(chain.chain.size(), 10);
+    consensus->release.set_value();
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, RestoresIndicesFromTheSnapshot)
+{
+    std::string folder = checkpointedChain("indices", nullptr);
+    std::filesystem::remove(folder + "/nonces");
+
+    iotbc::Blockchain chain;
+    iotbc::LoadStats stats = chain.loadExistingBlocks(folder, verifying());
+
+    ASSERT_EQ(stats.checkpointHeight, 5);
+    ASSERT_EQ(chain.nextNonce(alice.address), 10);
+    ASSERT_EQ(chain.sensorDictionary.size(), 1);
+    ASSERT_EQ(chain.sensorDictionary.find("door"), 0);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Checkpoint, OnlyTrustsConfiguredSigners)
+{
+    iotbc::LoadOptions options;
+    options.verify = true;
+    options.checkpointSigners = {alice.address};
+
+    std::string signedByAlice = checkpointedChain("alice", &alice);
+    std::string signedByBob = checkpointedChain("bob", &bob);
+    std::string unsignedFolder = checkpointedChain("unsigned", nullptr);
+
+    iotbc::Blockchain a;
+    ASSERT_EQ(a.loadExistingBlocks(signedByAlice, options).checkpointHeight, 5);
+
+    iotbc::Blockchain b;
+    ASSERT_FALSE(b.loadExistingBlocks(signedByBob, options).checkpointHeight.has_value());
+
+    iotbc::Blockchain u;
+    ASSERT_FALSE(u.loadExistingBlocks(unsignedFolder, options).checkpointHeight.has_value());
+
+    std::filesystem::remove_all(signedByAlice);
+    std::filesystem::remove_all(signedByBob);
+    std::filesystem::remove_all(unsignedFolder);
+}
+
+TEST(Checkpoint, UnsignedCheckpointsNeedToBeOptedIn)
+{
+    iotbc::LoadOptions options;
+    options.verify = true;
+
+    std::string signedByAlice = checkpointedChain("any_signer", &alice);
+    std::string unsignedFolder = checkpointedChain("opt_in", nullptr);
+
+    // Without configured signers, a valid signature of any key is not enough
+    iotbc::Blockchain a;
+    ASSERT_FALSE(a.loadExistingBlocks(signedByAlice, options).checkpointHeight.has_value());
+
+    iotbc::Blockchain u;
+    ASSERT_FALSE(u.loadExistingBlocks(unsignedFolder, options).checkpointHeight.has_value());
+
+    options.trustUnsignedCheckpoint = true;
+
+    iotbc::Blockchain trusted;
+    ASSERT_EQ(trusted.loadExistingBlocks(unsignedFolder, options).checkpointHeight, 5);
+
+    iotbc::Blockchain stillSigned;
+    ASSERT_FALSE(stillSigned.loadExistingBlocks(signedByAlice, options).checkpointHeight.has_value());
+
+    std::filesystem::remove_all(signedByAlice);
+    std::filesystem::remove_all(unsignedFolder);
+}
+
+TEST(Checkpoint, IgnoresCheckpointOfAnotherChain)
+{
+    std::string folder = checkpointedChain("other", nullptr);
+    std::string otherFolder = checkpointedChain("other_source", nullptr);
+
+    std::filesystem::copy_file(otherFolder + "/checkpoint", folder + "/checkpoint", std::filesystem::copy_options::overwrite_existing);
+
+    iotbc::Blockchain chain;
+    ASSERT_FALSE(chain.loadExistingBlocks(folder, verifying()).checkpointHeight.has_value());
+    ASSERT_EQ(chain.chain.size(), 10);
+
+    std::filesystem::remove_all(folder);
+    std::filesystem::remove_all(otherFolder);
+}
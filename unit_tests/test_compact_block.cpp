@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <CompactBlock.hpp>
+#include <Node.hpp>
+#include <testers.hpp>
+
+static void submitAll(iotbc::Mempool &mempool, const std::vector<iotbc::Transaction> &txs)
+{
+    for (const auto &tx : txs) {
+        mempool.submit(tx);
+    }
+    mempool.flush();
+}
+
+/// @brief Wait until a node's chain reaches a size
+static bool waitForChainSize(iotbc::Node &node, size_t size)
+{
+    return waitFor([&]() { return node.withChain([](iotbc::Blockchain &chain) { return chain.chain.size(); }) >= size; });
+}
+
+/// @brief Wait until a node registered its peers, inbound ones being added by its acceptor thread
+static bool waitForPeers(iotbc::Node &node, size_t count)
+{
+    return waitFor([&]() { return node.peerCount() >= count; });
+}
+
+TEST(CompactBlock, SipHashReferenceVectors)
+{
+    // Key 00 01 .. 0f, messages 00 01 .. of increasing sizes, from the SipHash paper
+    iotbc::SipKey key = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+
+    unsigned char message[15];
+    for (unsigned char i = 0; i < sizeof(message); i++) {
+        message[i] = i;
+    }
+
+    ASSERT_EQ(iotbc::sipHash24(key, message, 0), 0x726fdb47dd0e0e31ULL);
+    ASSERT_EQ(iotbc::sipHash24(key, message, 8), 0x93f5f5799a932462ULL);
+    ASSERT_EQ(iotbc::sipHash24(key, message, 15), 0xa129ca6149be45e5ULL);
+}
+
+TEST(CompactBlock, SerializationRoundTrip)
+{
+    iotbc::Blockchain chain;
+    iotbc::Block block = minedBlock(chain, signedTransactions(alice, 0, 10));
+
+    iotbc::CompactBlock compact = iotbc::CompactBlock::fromBlock(block, 1234, {0, 7});
+    ASSERT_EQ(compact.shortIds.size(), 8);
+    ASSERT_EQ(compact.prefilled.size(), 2);
+
+    iotbc::CompactBlock decoded = iotbc::CompactBlock::deserialize(compact.serialize());
+
+    ASSERT_EQ(decoded.header.blockHash(), block.blockHash());
+    ASSERT_EQ(decoded.salt, 1234);
+    ASSERT_EQ(decoded.shortIds, compact.shortIds);
+    ASSERT_EQ(decoded.prefilled[1].index, 7);
+    ASSERT_EQ(decoded.prefilled[1].tx.txHash(), block.transactions[7].txHash());
+
+    // Short ids are 6 bytes and depend on the salt
+    for (auto id : compact.shortIds) {
+        ASSERT_LT(id, 1ULL << 48);
+    }
+    ASSERT_NE(iotbc::CompactBlock::fromBlock(block, 1235).shortIds[0], iotbc::CompactBlock::fromBlock(block, 1234).shortIds[0]);
+
+    ASSERT_LT(iotbc::CompactBlock::fromBlock(block, 1).serialize().size(), block.serialize().size() / 5);
+
+    ASSERT_THROW(iotbc::CompactBlock::fromBlock(block, 1, {10}), iotbc::InvalidTransaction);
+}
+
+TEST(CompactBlock, SenderIsPartOfTheShortId)
+{
+    // Same nonce and data, so the same transaction hash
+    iotbc::Transaction fromAlice(alice, 0, {0x01});
+    iotbc::Transaction fromBob(bob, 0, {0x01});
+    ASSERT_EQ(fromAlice.txHash(), fromBob.txHash());
+
+    iotbc::SipKey key = {1, 2};
+    ASSERT_NE(iotbc::CompactBlock::shortId(key, fromAlice), iotbc::CompactBlock::shortId(key, fromBob));
+}
+
+TEST(CompactBlock, RebuildsFromTheMempool)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(alice, 0, 20);
+    iotbc::Blockchain chain;
+    iotbc::Block block = minedBlock(chain, txs);
+
+    iotbc::Mempool mempool;
+    submitAll(mempool, {txs.begin(), txs.begin() + 15});
+    submitAll(mempool, signedTransactions(bob, 0, 5));
+
+    iotbc::BlockReconstruction reconstruction(iotbc::CompactBlock::fromBlock(block, 99, {0}));
+
+    ASSERT_EQ(reconstruction.fill(mempool), 14);
+    ASSERT_FALSE(reconstruction.complete());
+    ASSERT_EQ(reconstruction.missing(), (std::vector<size_t>{15, 16, 17, 18, 19}));
+    ASSERT_THROW(reconstruction.takeBlock(), iotbc::InvalidBlock);
+
+    ASSERT_THROW(reconstruction.fillMissing({txs.begin() + 14, txs.begin() + 19}), iotbc::InvalidBlock);
+    ASSERT_THROW(reconstruction.fillMissing({txs.begin() + 15, txs.begin() + 19}), iotbc::InvalidBlock);
+
+    reconstruction.fillMissing({txs.begin() + 15, txs.end()});
+    ASSERT_TRUE(reconstruction.complete());
+    ASSERT_EQ(reconstruction.takeBlock().blockHash(), block.blockHash());
+}
+
+TEST(CompactBlock, RelaysBlocksBetweenNodes)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(alice, 0, 30);
+
+    iotbc::Blockchain sourceChain, relayChain, sinkChain;
+    iotbc::Mempool sourceMempool, relayMempool, sinkMempool;
+
+    // The relaying node holds every transaction, the last node only half of them
+    submitAll(sourceMempool, txs);
+    submitAll(relayMempool, txs);
+    submitAll(sinkMempool, {txs.begin(), txs.begin() + 15});
+
+    iotbc::Node source(sourceChain, sourceMempool);
+    iotbc::Node relay(relayChain, relayMempool);
+    iotbc::Node sink(sinkChain, sinkMempool);
+    relay.connect("127.0.0.1", source.port());
+    sink.connect("127.0.0.1", relay.port());
+    ASSERT_TRUE(waitForPeers(source, 1));
+    ASSERT_TRUE(waitForPeers(relay, 2));
+
+    iotbc::Block block = minedBlock(sourceChain, txs);
+    ASSERT_EQ(source.publishBlock(block), iotbc::BlockStatus::Connected);
+    ASSERT_EQ(sourceMempool.size(), 0);
+
+    ASSERT_TRUE(waitForChainSize(sink, 1));
+
+    ASSERT_EQ(relay.relayStats().reconstructed, 1);
+    ASSERT_EQ(relay.relayStats().transactionsRequested, 0);
+    ASSERT_EQ(relayMempool.size(), 0);
+
+    ASSERT_EQ(sink.relayStats().compactBlocks, 1);
+    ASSERT_EQ(sink.relayStats().transactionsRequested, 15);
+    ASSERT_EQ(sinkMempool.size(), 0);
+
+    sink.withChain([&](iotbc::Blockchain &chain) {
+        ASSERT_EQ(chain.chain.back().blockHash(), block.blockHash());
+        ASSERT_EQ(chain.nextNonce(alice.address), 30);
+    });
+
+    // Blocks already known are not relayed back
+    ASSERT_EQ(source.relayStats().compactBlocks, 0);
+}
+
+TEST(CompactBlock, BoundsTheBlocksWaitingForAPeer)
+{
+    iotbc::Blockchain chain;
+    iotbc::Mempool mempool;
+
+    iotbc::NodeOptions options;
+    options.maxPendingBlocksPerPeer = 8;
+    options.requestTimeout = std::chrono::milliseconds(300);
+
+    iotbc::Node node(chain, mempool, options);
+    int peer = rawPeer(node);
+    ASSERT_GE(peer, 0);
+
+    // Forged blocks whose transactions the node misses, it asks for them and waits
+    auto relayForged = [&](size_t i) {
+        iotbc::Block block(iotbc::NULL_HASH, 0);
+        block.addTransaction(signedTx(alice, i));
+        block.mine(0);
+        return sendRaw(peer, iotbc::MessageType::CompactBlock, iotbc::CompactBlock::fromBlock(block, i).serialize());
+    };
+
+    for (size_t i = 0; i < 12; i++) {
+        ASSERT_TRUE(relayForged(i));
+    }
+
+    ASSERT_TRUE(waitFor([&]() { return node.relayStats().compactBlocks == 12; }));
+    ASSERT_EQ(node.relayStats().ignored, 4);
+    ASSERT_EQ(node.relayStats().expired, 0);
+
+    // Blocks the peer never answered for are forgotten, making room again
+    std::this_thread::sleep_for(options.requestTimeout);
+    ASSERT_TRUE(relayForged(12));
+    ASSERT_TRUE(waitFor([&]() { return node.relayStats().compactBlocks == 13; }));
+    ASSERT_EQ(node.relayStats().ignored, 4);
+    ASSERT_EQ(node.relayStats().expired, 8);
+
+    ::close(peer);
+}
+
+TEST(CompactBlock, RelayedBlocksAreVerifiedOffTheLoop)
+{
+    iotbc::Blockchain chain;
+    iotbc::Mempool mempool;
+    iotbc::Node node(chain, mempool);
+    int peer = rawPeer(node);
+    ASSERT_GE(peer, 0);
+
+    // The signature is not part of the block hash, only the verifier thread notices it
+    iotbc::Block block(iotbc::NULL_HASH, 0);
+    block.addTransaction(signedTx(alice, 0));
+    block.transactions[0].signature[0] ^= 0xFF;
+    block.mine(0);
+    ASSERT_TRUE(sendRaw(peer, iotbc::MessageType::CompactBlock, iotbc::CompactBlock::fromBlock(block, 1, {0}).serialize()));
+
+    ASSERT_TRUE(waitFor([&]() { return node.peerCount() == 0; }));
+    ASSERT_EQ(node.relayStats().reconstructed, 1);
+    ASSERT_TRUE(node.withChain([](iotbc::Blockchain &chain) { return chain.empty(); }));
+
+    ::close(peer);
+}
@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+
+#include <Block.hpp>
+#include <Blockchain.hpp>
+#include <Compression.hpp>
+#include <Utils.hpp>
+#include <Varint.hpp>
+#include <testers.hpp>
+
+static void expectRoundTrip(const std::vector<unsigned char> &data, int level)
+{
+    auto compressed = iotbc::compressLz(data.data(), data.size(), level);
+
+    std::vector<unsigned char> out;
+    iotbc::decompressLz(compressed.data(), compressed.size(), out, data.size());
+
+    ASSERT_EQ(out, data);
+}
+
+TEST(Compression, RoundTripEmpty)
+{
+    expectRoundTrip({}, 1);
+}
+
+TEST(Compression, RoundTripAllLevels)
+{
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += "{\"id\":\"door-" + std::to_string(i % 7) + "\",\"data\":{\"open\":" + (i % 3 ? "true" : "false") + "}}";
+    }
+    std::vector<unsigned char> data(text.begin(), text.end());
+
+    for (int level = 1; level <= 9; level++) {
+        expectRoundTrip(data, level);
+    }
+}
+
+TEST(Compression, RoundTripIncompressible)
+{
+    std::vector<unsigned char> data;
+    uint32_t state = 42;
+    for (int i = 0; i < 5000; i++) {
+        state = state * 1103515245 + 12345;
+        data.push_back(state >> 24);
+    }
+
+    expectRoundTrip(data, 1);
+    expectRoundTrip(data, 9);
+}
+
+TEST(Compression, RoundTripLongRuns)
+{
+    std::vector<unsigned char> data(100000, 'a');
+    data.insert(data.end(), 300, 'b');
+
+    auto compressed = iotbc::compressLz(data.data(), data.size(), 1);
+
+    ASSERT_LT(compressed.size(), data.size() / 100);
+
+    expectRoundTrip(data, 1);
+}
+
+TEST(Compression, ReusesOutputBuffer)
+{
+    std::vector<unsigned char> data(1000, 'x');
+    auto compressed = iotbc::compressLz(data.data(), data.size(), 1);
+
+    std::vector<unsigned char> out;
+    out.reserve(4096);
+    const unsigned char *storage = out.data();
+
+    iotbc::decompressLz(compressed.data(), compressed.size(), out, data.size());
+
+    ASSERT_EQ(out.data(), storage);
+    ASSERT_EQ(out, data);
+}
+
+TEST(Compression, CorruptDataThrows)
+{
+    std::vector<unsigned char> data(1000, 'x');
+    auto compressed = iotbc::compressLz(data.data(), data.size(), 1);
+
+    std::vector<unsigned char> out;
+
+    ASSERT_THROW(iotbc::decompressLz(compressed.data(), compressed.size(), out, data.size() - 1), iotbc::DeserializationError);
+    ASSERT_THROW(iotbc::decompressLz(compressed.data(), 2, out, data.size()), iotbc::DeserializationError);
+
+    // Offset pointing before the start of the output
+    std::vector<unsigned char> invalid = {0x00, 0x10, 0x00};
+    ASSERT_THROW(iotbc::decompressLz(invalid.data(), invalid.size(), out, 4), iotbc::DeserializationError);
+}
+
+TEST(Compression, CompressedStoreRoundTrip)
+{
+    std::string folder = "/tmp/iotbc_test_compressed_store";
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain chain;
+    chain.compression = {iotbc::Codec::Lz, 6};
+
+    iotbc::Block block(iotbc::NULL_HASH);
+    for (iotbc::Nonce i = 0; i < 16; i++) {
+        std::string reading = "{\"id\":\"thermostat\",\"data\":{\"temperature\":24,\"humidity\":65}}";
+        iotbc::Transaction tx(alice, i, {reading.begin(), reading.end()});
+        tx.sign(alice);
+        block.addTransaction(tx);
+    }
+    block.mine(0);
+    chain.addBlock(block);
+
+    chain.saveBlocks(folder);
+
+    auto path = std::filesystem::path(folder) / iotbc::hashToString(block.blockHash());
+    ASSERT_LT(std::filesystem::file_size(path), block.serialize().size());
+
+    iotbc::Blockchain loaded;
+    loaded.loadExistingBlocks(folder);
+
+    ASSERT_EQ(loaded.chain.size(), 1);
+    ASSERT_EQ(loaded.chain[0].blockHash(), block.blockHash());
+    ASSERT_EQ(loaded.chain[0].transactions.size(), 16);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Compression, RejectsImpossibleRawSize)
+{
+    std::vector<unsigned char> data(1000, 'x');
+    auto compressed = iotbc::compressLz(data.data(), data.size(), 1);
+
+    std::vector<unsigned char> out;
+    ASSERT_THROW(iotbc::decompressLz(compressed.data(), compressed.size(), out, size_t(1) << 40), iotbc::DeserializationError);
+    ASSERT_LT(out.capacity(), size_t(1) << 20);
+
+    // A hostile store header claiming a huge block is not decompressed
+    std::vector<unsigned char> file = {'I', 'O', 'T', 'Z', static_cast<unsigned char>(iotbc::Codec::Lz), 1};
+    iotbc::writeVarint(file, size_t(1) << 40);
+    file.insert(file.end(), compressed.begin(), compressed.end());
+
+    ASSERT_EQ(&iotbc::decodeStoredBlock(file, out), &file);
+    ASSERT_THROW(iotbc::Block::deserialize(file), iotbc::DeserializationError);
+}
+
+TEST(Compression, V1BlockStartingWithStoreMagicIsNotDecompressed)
+{
+    iotbc::Block block(iotbc::NULL_HASH);
+    block.version = iotbc::BLOCK_VERSION_LEGACY;
+    block.prevHash[0] = 'I';
+    block.prevHash[1] = 'O';
+    block.prevHash[2] = 'T';
+    block.prevHash[3] = 'Z';
+
+    iotbc::Transaction tx(alice, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+    block.addTransaction(tx);
+    block.mine(0);
+
+    for (unsigned char codec : {0x00, 0x01, 0x7F}) {
+        block.prevHash[4] = codec;
+        block.mine(0);
+
+        auto file = iotbc::encodeStoredBlock(block.serialize(iotbc::WireFormat::V1), {});
+        std::vector<unsigned char> buffer;
+
+        const auto &serialized = iotbc::decodeStoredBlock(file, buffer);
+        ASSERT_EQ(&serialized, &file);
+        ASSERT_EQ(iotbc::Block::deserialize(serialized).blockHash(), block.blockHash());
+    }
+}
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Connection.hpp>
+#include <EventLoop.hpp>
+#include <testers.hpp>
+
+/// @brief Connected sockets, the first one non-blocking for a Connection, the second one blocking
+static std::pair<int, int> socketPair()
+{
+    int fds[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    return {fds[0], fds[1]};
+}
+
+TEST(EventLoop, RunsPostedTasks)
+{
+    iotbc::EventLoop loop;
+    std::thread thread([&]() { loop.run(); });
+
+    std::atomic<int> done = 0;
+    std::atomic<bool> onLoop = true;
+
+    for (int i = 0; i < 1000; i++) {
+        loop.post([&]() {
+            onLoop = onLoop && loop.inLoopThread();
+            done++;
+        });
+    }
+
+    ASSERT_TRUE(waitFor([&]() { return done == 1000; }));
+    ASSERT_TRUE(onLoop);
+    ASSERT_FALSE(loop.inLoopThread());
+
+    loop.stop();
+    thread.join();
+}
+
+TEST(EventLoop, ConnectionReassemblesFrames)
+{
+    auto [local, remote] = socketPair();
+    iotbc::EventLoop loop;
+
+    std::mutex mutex;
+    std::vector<std::pair<iotbc::MessageType, std::vector<unsigned char>>> frames;
+    std::atomic<bool> closed = false;
+
+    auto connection = std::make_shared<iotbc::Connection>(loop, local, 1 << 20, 1 << 20);
+    connection->start(
+        [&](iotbc::MessageType type, std::span<const unsigned char> payload) {
+            std::lock_guard<std::mutex> lock(mutex);
+            frames.emplace_back(type, std::vector<unsigned char>(payload.begin(), payload.end()));
+        },
+        [&]() { closed = true; });
+    std::thread thread([&]() { loop.run(); });
+
+    std::vector<unsigned char> large(200000);
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = static_cast<unsigned char>(i * 7);
+    }
+
+    std::vector<unsigned char> bytes = iotbc::encodeFrame(iotbc::MessageType::GetHeaders, {0x01, 0x02});
+    std::vector<unsigned char> empty = iotbc::encodeFrame(iotbc::MessageType::NotFound, {});
+    std::vector<unsigned char> big = iotbc::encodeFrame(iotbc::MessageType::Block, large);
+    bytes.insert(bytes.end(), empty.begin(), empty.end());
+    bytes.insert(bytes.end(), big.begin(), big.end());
+
+    // Frames split at every byte of the first ones, and across many reads for the large one
+    for (size_t i = 0; i < bytes.size();) {
+        size_t size = i < 20 ? 1 : 4096;
+        size = std::min(size, bytes.size() - i);
+        ASSERT_EQ(::send(remote, bytes.data() + i, size, 0), static_cast<ssize_t>(size));
+        i += size;
+    }
+
+    ASSERT_TRUE(waitFor([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frames.size() == 3;
+    }));
+    ASSERT_EQ(frames[0].first, iotbc::MessageType::GetHeaders);
+    ASSERT_EQ(frames[0].second, std::vector<unsigned char>({0x01, 0x02}));
+    ASSERT_EQ(frames[1].first, iotbc::MessageType::NotFound);
+    ASSERT_TRUE(frames[1].second.empty());
+    ASSERT_EQ(frames[2].first, iotbc::MessageType::Block);
+    ASSERT_EQ(frames[2].second, large);
+
+    // Frames go the other way from any thread
+    connection->send(iotbc::MessageType::Headers, large);
+    std::vector<unsigned char> received(big.size());
+    for (size_t i = 0; i < received.size();) {
+        ssize_t size = ::recv(remote, received.data() + i, received.size() - i, 0);
+        ASSERT_GT(size, 0);
+        i += size;
+    }
+    ASSERT_EQ(received[4], static_cast<unsigned char>(iotbc::MessageType::Headers));
+    ASSERT_TRUE(std::equal(large.begin(), large.end(), received.begin() + iotbc::FRAME_HEADER_SIZE));
+
+    ::close(remote);
+    ASSERT_TRUE(waitFor([&]() { return closed.load(); }));
+    ASSERT_TRUE(connection->closed());
+
+    loop.stop();
+    thread.join();
+}
+
+TEST(EventLoop, OneThreadServesManyConnections)
+{
+    iotbc::EventLoop loop;
+    std::thread thread([&]() { loop.run(); });
+
+    std::atomic<size_t> received = 0;
+    std::atomic<size_t> closed = 0;
+    std::vector<std::shared_ptr<iotbc::Connection>> connections;
+    std::vector<int> remotes;
+
+    for (size_t i = 0; i < 200; i++) {
+        auto [local, remote] = socketPair();
+        remotes.push_back(remote);
+
+        auto connection = std::make_shared<iotbc::Connection>(loop, local, 1024, 1024);
+        iotbc::Connection *raw = connection.get();
+        connection->start(
+            [&, raw](iotbc::MessageType type, std::span<const unsigned char> payload) {
+                received++;
+                // Echoed from the loop thread
+                raw->send(type, payload);
+            },
+            [&]() { closed++; });
+        connections.push_back(connection);
+    }
+
+    for (size_t i = 0; i < remotes.size(); i++) {
+        std::vector<unsigned char> frame = iotbc::encodeFrame(iotbc::MessageType::Transactions, {static_cast<unsigned char>(i)});
+        ASSERT_EQ(::send(remotes[i], frame.data(), frame.size(), 0), static_cast<ssize_t>(frame.size()));
+    }
+
+    ASSERT_TRUE(waitFor([&]() { return received == remotes.size(); }));
+
+    for (size_t i = 0; i < remotes.size(); i++) {
+        unsigned char echo[iotbc::FRAME_HEADER_SIZE + 1];
+        ASSERT_EQ(::recv(remotes[i], echo, sizeof(echo), MSG_WAITALL), static_cast<ssize_t>(sizeof(echo)));
+        ASSERT_EQ(echo[iotbc::FRAME_HEADER_SIZE], static_cast<unsigned char>(i));
+        ::close(remotes[i]);
+    }
+
+    ASSERT_TRUE(waitFor([&]() { return closed == remotes.size(); }));
+
+    loop.stop();
+    thread.join();
+}
+
+TEST(EventLoop, ConnectionDropsSlowAndMisbehavingPeers)
+{
+    iotbc::EventLoop loop;
+    std::thread thread([&]() { loop.run(); });
+
+    // A peer not reading its messages is disconnected once they fill the send buffer
+    auto [local, remote] = socketPair();
+    std::atomic<bool> closed = false;
+    auto slow = std::make_shared<iotbc::Connection>(loop, local, 1024, 1 << 20);
+    slow->start([](iotbc::MessageType, std::span<const unsigned char>) {}, [&]() { closed = true; });
+
+    std::vector<unsigned char> payload(64 << 10);
+    size_t sent = 0;
+    ASSERT_THROW({
+        while (sent < 1000) {
+            slow->send(iotbc::MessageType::Block, payload);
+            sent++;
+        }
+    }, iotbc::NetworkError);
+    ASSERT_GT(sent, 0);
+    ASSERT_LT(sent, 1000);
+    ASSERT_TRUE(waitFor([&]() { return closed.load(); }));
+    ASSERT_THROW(slow->send(iotbc::MessageType::Block, {}), iotbc::NetworkError);
+    ::close(remote);
+
+    // So is a peer announcing a frame larger than allowed
+    auto [otherLocal, otherRemote] = socketPair();
+    std::atomic<bool> otherClosed = false;
+    std::atomic<bool> handled = false;
+    auto oversized = std::make_shared<iotbc::Connection>(loop, otherLocal, 1024, 1 << 20);
+    oversized->start([&](iotbc::MessageType, std::span<const unsigned char>) { handled = true; }, [&]() { otherClosed = true; });
+
+    std::vector<unsigned char> frame = iotbc::encodeFrame(iotbc::MessageType::Block, std::vector<unsigned char>(2048));
+    ASSERT_EQ(::send(otherRemote, frame.data(), frame.size(), 0), static_cast<ssize_t>(frame.size()));
+    ASSERT_TRUE(waitFor([&]() { return otherClosed.load(); }));
+    ASSERT_FALSE(handled);
+    ::close(otherRemote);
+
+    loop.stop();
+    thread.join();
+}
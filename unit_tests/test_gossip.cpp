@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <Node.hpp>
+#include <RollingFilter.hpp>
+#include <testers.hpp>
+
+static iotbc::Hash numberedHash(size_t i)
+{
+    iotbc::Hash hash = iotbc::NULL_HASH;
+    hash[0] = static_cast<unsigned char>(i);
+    hash[1] = static_cast<unsigned char>(i >> 8);
+    hash[2] = static_cast<unsigned char>(i >> 16);
+    return hash;
+}
+
+TEST(Gossip, RollingFilterForgetsOldHashes)
+{
+    iotbc::RollingFilter filter(100);
+
+    for (size_t i = 0; i < 200; i++) {
+        filter.insert(numberedHash(i));
+    }
+
+    // The last capacity hashes are always remembered, the previous generation too
+    for (size_t i = 0; i < 200; i++) {
+        ASSERT_TRUE(filter.contains(numberedHash(i)));
+    }
+
+    for (size_t i = 200; i < 300; i++) {
+        filter.insert(numberedHash(i));
+    }
+
+    size_t remembered = 0;
+    for (size_t i = 0; i < 100; i++) {
+        remembered += filter.contains(numberedHash(i));
+    }
+    ASSERT_EQ(remembered, 0);
+
+    size_t falsePositives = 0;
+    for (size_t i = 1000; i < 11000; i++) {
+        falsePositives += filter.contains(numberedHash(i));
+    }
+    ASSERT_LE(falsePositives, 1);
+
+    filter.clear();
+    ASSERT_FALSE(filter.contains(numberedHash(299)));
+}
+
+TEST(Gossip, TransactionsMessageRoundTrip)
+{
+    iotbc::TransactionsMessage message;
+    message.transactions = signedTransactions(alice, 0, 3);
+
+    iotbc::TransactionsMessage decoded = iotbc::TransactionsMessage::deserialize(message.serialize());
+
+    ASSERT_EQ(decoded.transactions.size(), 3);
+    ASSERT_EQ(decoded.transactions[2].txHash(), message.transactions[2].txHash());
+    ASSERT_EQ(decoded.transactions[2].signature, message.transactions[2].signature);
+
+    std::vector<unsigned char> truncated = message.serialize();
+    truncated.pop_back();
+    ASSERT_THROW(iotbc::TransactionsMessage::deserialize(truncated), iotbc::DeserializationError);
+}
+
+TEST(Gossip, TransactionsReachBlocksMinedByAnotherNode)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(alice, 0, 200);
+
+    iotbc::Blockchain gatewayChain, relayChain, minerChain;
+    iotbc::Mempool gatewayMempool, relayMempool, minerMempool;
+
+    iotbc::Node gateway(gatewayChain, gatewayMempool);
+    iotbc::Node relay(relayChain, relayMempool);
+    iotbc::Node miner(minerChain, minerMempool);
+    relay.connect("127.0.0.1", gateway.port());
+    miner.connect("127.0.0.1", relay.port());
+    ASSERT_TRUE(waitFor([&]() { return gateway.peerCount() == 1 && relay.peerCount() == 2; }));
+
+    for (const auto &tx : txs) {
+        gatewayMempool.submit(tx);
+    }
+
+    ASSERT_TRUE(waitFor([&]() { return minerMempool.size() == txs.size(); }));
+    minerMempool.flush();
+
+    // Hashes are batched, far fewer messages than transactions
+    iotbc::GossipStats sent = gateway.gossipStats();
+    ASSERT_EQ(sent.announced, txs.size());
+    ASSERT_LT(sent.inventoryMessages, 20);
+
+    ASSERT_EQ(relay.gossipStats().requested, txs.size());
+    ASSERT_EQ(miner.gossipStats().requested, txs.size());
+    ASSERT_EQ(miner.gossipStats().received, txs.size());
+
+    // Transactions are not announced back to the peers they came from
+    ASSERT_EQ(gateway.gossipStats().inventoryReceived, 0);
+
+    iotbc::Block block = minerMempool.takeBlockTemplate(iotbc::NULL_HASH, 0, iotbc::NonceIndex());
+    block.mine(0);
+    ASSERT_EQ(block.transactions.size(), txs.size());
+    ASSERT_EQ(miner.publishBlock(block), iotbc::BlockStatus::Connected);
+
+    ASSERT_TRUE(waitFor([&]() {
+        return gateway.withChain([](iotbc::Blockchain &chain) { return chain.chain.size(); }) == 1;
+    }));
+    ASSERT_EQ(gateway.relayStats().transactionsRequested, 0);
+    ASSERT_EQ(gatewayMempool.size(), 0);
+}
+
+TEST(Gossip, RateLimitsPeers)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(bob, 0, 150);
+
+    iotbc::Blockchain sourceChain, limitedChain;
+    iotbc::Mempool sourceMempool, limitedMempool;
+
+    iotbc::NodeOptions options;
+    options.maxTransactionsPerSecond = 50;
+
+    iotbc::Node source(sourceChain, sourceMempool);
+    iotbc::Node limited(limitedChain, limitedMempool, options);
+    limited.connect("127.0.0.1", source.port());
+    ASSERT_TRUE(waitFor([&]() { return source.peerCount() == 1; }));
+
+    for (const auto &tx : txs) {
+        sourceMempool.submit(tx);
+    }
+    sourceMempool.flush();
+
+    // A burst of a second worth is fetched right away, the rest as the peer gets tokens again
+    ASSERT_TRUE(waitFor([&]() { return limited.gossipStats().inventoryReceived == txs.size(); }));
+    iotbc::GossipStats stats = limited.gossipStats();
+    ASSERT_GE(stats.requested, 50);
+    ASSERT_LT(stats.requested, 100);
+    ASSERT_GE(stats.delayed, 50);
+
+    ASSERT_TRUE(waitFor([&]() { return limitedMempool.size() == txs.size(); }));
+    ASSERT_EQ(limited.gossipStats().requested, txs.size());
+    ASSERT_EQ(limited.gossipStats().dropped, 0);
+}
+
+TEST(Gossip, RequestsAgainFromAnotherPeer)
+{
+    iotbc::Transaction tx = signedTx(alice, 0);
+
+    iotbc::Blockchain targetChain, sourceChain;
+    iotbc::Mempool targetMempool, sourceMempool;
+
+    iotbc::NodeOptions options;
+    options.transactionRequestTimeout = std::chrono::milliseconds(200);
+
+    iotbc::Node target(targetChain, targetMempool, options);
+
+    // A peer announcing the transaction, then never answering
+    int silent = rawPeer(target);
+    ASSERT_GE(silent, 0);
+
+    iotbc::InventoryMessage inventory;
+    inventory.hashes.push_back(tx.id());
+    ASSERT_TRUE(sendRaw(silent, iotbc::MessageType::TransactionInventory, inventory.serialize()));
+    ASSERT_TRUE(waitFor([&]() { return target.gossipStats().requested == 1; }));
+
+    // Another peer announcing it is asked once the first one timed out
+    iotbc::Node source(sourceChain, sourceMempool);
+    target.connect("127.0.0.1", source.port());
+    ASSERT_TRUE(waitFor([&]() { return source.peerCount() == 1; }));
+    sourceMempool.submit(tx);
+
+    ASSERT_TRUE(waitFor([&]() { return targetMempool.size() == 1; }));
+    iotbc::GossipStats stats = target.gossipStats();
+    ASSERT_EQ(stats.requested, 2);
+    ASSERT_EQ(stats.rerequested, 1);
+    ASSERT_EQ(stats.received, 1);
+
+    ::close(silent);
+}
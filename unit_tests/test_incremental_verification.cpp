@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include <Blockchain.hpp>
+#include <testers.hpp>
+
+TEST(IncrementalVerification, AddedBlocksAreVerified)
+{
+    iotbc::Blockchain chain;
+    ASSERT_FALSE(chain.verifiedHeight().has_value());
+
+    for (size_t i = 0; i < 3; i++) {
+        chain.addBlock(nextBlock(chain));
+    }
+
+    ASSERT_EQ(chain.verifiedHeight(), 2);
+
+    chain.verifyNewBlocks();
+    ASSERT_EQ(chain.verifiedHeight(), 2);
+}
+
+TEST(IncrementalVerification, OnlyVerifiesNewBlocks)
+{
+    iotbc::Blockchain chain = builtChain(4);
+
+    // The signature is not part of the block hash, so the verified prefix still links
+    chain.chain[1].transactions[0].signature[0] ^= 0xFF;
+
+    chain.verifyNewBlocks();
+    ASSERT_THROW(chain.verifyExistingChain(), iotbc::InvalidBlockchainSave);
+
+    iotbc::Block block = nextBlock(chain);
+    block.transactions[0].signature[0] ^= 0xFF;
+    chain.chain.push_back(block);
+
+    ASSERT_THROW(chain.verifyNewBlocks(), iotbc::InvalidBlockchainSave);
+    ASSERT_EQ(chain.verifiedHeight(), 3);
+}
+
+TEST(IncrementalVerification, VerifiesBlocksAppendedDirectly)
+{
+    iotbc::Blockchain chain = builtChain(2);
+    iotbc::Blockchain other = chain;
+
+    for (size_t i = 0; i < 3; i++) {
+        other.addBlock(nextBlock(other));
+        chain.chain.push_back(other.chain.back());
+    }
+
+    ASSERT_EQ(chain.verifiedHeight(), 1);
+
+    chain.verifyNewBlocks();
+
+    ASSERT_EQ(chain.verifiedHeight(), 4);
+    ASSERT_EQ(chain.nextNonce(alice.address), 5);
+}
+
+TEST(IncrementalVerification, ReplacedBlocksAreVerifiedAgain)
+{
+    iotbc::Blockchain chain = builtChain(3);
+
+    // A different chain of the same length does not extend the verified blocks
+    iotbc::Blockchain other;
+    for (size_t i = 0; i < 3; i++) {
+        iotbc::Block block(other.empty() ? iotbc::NULL_HASH : other.chain.back().blockHash(), other.chain.size());
+
+        iotbc::Transaction tx(bob, other.nextNonce(bob.address), {0x01, static_cast<unsigned char>(i)});
+        tx.sign(bob);
+        block.addTransaction(tx);
+
+        block.mine(0);
+        other.addBlock(block);
+    }
+
+    chain.chain = other.chain;
+    chain.chain[0].transactions[0].signature[0] ^= 0xFF;
+
+    ASSERT_THROW(chain.verifyNewBlocks(), iotbc::InvalidBlockchainSave);
+    ASSERT_FALSE(chain.verifiedHeight().has_value());
+}
+
+TEST(IncrementalVerification, LoadingSetsTheVerifiedHeight)
+{
+    std::string folder = "/tmp/iotbc_test_incremental_verification";
+    std::filesystem::remove_all(folder);
+
+    builtChain(5).saveBlocks(folder);
+
+    iotbc::Blockchain unverified;
+    unverified.loadExistingBlocks(folder);
+    ASSERT_FALSE(unverified.verifiedHeight().has_value());
+
+    unverified.verifyNewBlocks();
+    ASSERT_EQ(unverified.verifiedHeight(), 4);
+
+    iotbc::LoadOptions options;
+    options.verify = true;
+
+    iotbc::Blockchain verified;
+    verified.loadExistingBlocks(folder, options);
+    ASSERT_EQ(verified.verifiedHeight(), 4);
+
+    verified.addBlock(nextBlock(verified));
+    ASSERT_EQ(verified.verifiedHeight(), 5);
+
+    std::filesystem::remove_all(folder);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <thread>
+
+#include <unistd.h>
+
+#include <IngestClient.hpp>
+#include <IngestServer.hpp>
+#include <testers.hpp>
+
+/// @brief Path of a socket unique to the test process
+static std::string socketPath(const std::string &name)
+{
+    return "/tmp/iotbc_" + name + "_" + std::to_string(getpid()) + ".sock";
+}
+
+/// @brief Receive results until every transaction got one
+static std::map<iotbc::Hash, iotbc::IngestStatus> receiveAll(iotbc::IngestClient &client, size_t count)
+{
+    std::map<iotbc::Hash, iotbc::IngestStatus> results;
+
+    while (results.size() < count) {
+        for (const auto &result : client.receive()) {
+            EXPECT_TRUE(results.emplace(result.txId, result.status).second);
+        }
+    }
+
+    return results;
+}
+
+TEST(Ingest, ResultsMessageRoundTrip)
+{
+    iotbc::IngestResultsMessage message;
+    message.results.push_back({signedTransactions(alice, 0, 1)[0].id(), iotbc::IngestStatus::Verified});
+    message.results.push_back({iotbc::NULL_HASH, iotbc::IngestStatus::Full});
+
+    iotbc::IngestResultsMessage decoded = iotbc::IngestResultsMessage::deserialize(message.serialize());
+
+    ASSERT_EQ(decoded.results.size(), 2);
+    ASSERT_EQ(decoded.results[0].txId, message.results[0].txId);
+    ASSERT_EQ(decoded.results[0].status, iotbc::IngestStatus::Verified);
+    ASSERT_EQ(decoded.results[1].status, iotbc::IngestStatus::Full);
+
+    std::vector<unsigned char> invalid = message.serialize();
+    invalid.back() = 4;
+    ASSERT_THROW(iotbc::IngestResultsMessage::deserialize(invalid), iotbc::DeserializationError);
+}
+
+TEST(Ingest, AcknowledgesVerifiedTransactions)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(alice, 0, 300);
+
+    iotbc::Mempool mempool;
+    iotbc::IngestServer server(mempool, socketPath("ingest_verified"));
+    iotbc::IngestClient client(server.path());
+
+    for (size_t start = 0; start < txs.size(); start += 100) {
+        client.submit(std::vector<iotbc::Transaction>(txs.begin() + start, txs.begin() + start + 100));
+    }
+
+    std::map<iotbc::Hash, iotbc::IngestStatus> results = receiveAll(client, txs.size());
+
+    for (const auto &tx : txs) {
+        ASSERT_EQ(results.at(tx.id()), iotbc::IngestStatus::Verified);
+    }
+    ASSERT_EQ(mempool.readyCount(), txs.size());
+
+    iotbc::IngestStats stats = server.stats();
+    ASSERT_EQ(stats.producers, 1);
+    ASSERT_EQ(stats.submitted, txs.size());
+    ASSERT_EQ(stats.verified, txs.size());
+}
+
+TEST(Ingest, ReportsRefusedTransactions)
+{
+    std::vector<iotbc::Transaction> txs = signedTransactions(bob, 0, 4);
+
+    // Signed, then altered
+    iotbc::Transaction forged = signedTransactions(bob, 10, 1)[0];
+    forged.data[0] = 0x01;
+
+    iotbc::MempoolPolicy policy;
+    policy.capacity = 3;
+    iotbc::Mempool mempool(policy);
+    iotbc::IngestServer server(mempool, socketPath("ingest_refused"));
+    iotbc::IngestClient client(server.path());
+
+    client.submit({txs[0], txs[1], forged});
+    std::map<iotbc::Hash, iotbc::IngestStatus> results = receiveAll(client, 3);
+    ASSERT_EQ(results.at(txs[0].id()), iotbc::IngestStatus::Verified);
+    ASSERT_EQ(results.at(txs[1].id()), iotbc::IngestStatus::Verified);
+    ASSERT_EQ(results.at(forged.id()), iotbc::IngestStatus::Invalid);
+
+    // The forged transaction freed its slot, only one more fits
+    client.submit({txs[0], txs[2], txs[3]});
+    results = receiveAll(client, 3);
+    ASSERT_EQ(results.at(txs[0].id()), iotbc::IngestStatus::Duplicate);
+    ASSERT_EQ(results.at(txs[2].id()), iotbc::IngestStatus::Verified);
+    ASSERT_EQ(results.at(txs[3].id()), iotbc::IngestStatus::Full);
+
+    iotbc::IngestStats stats = server.stats();
+    ASSERT_EQ(stats.submitted, 6);
+    ASSERT_EQ(stats.verified, 3);
+    ASSERT_EQ(stats.invalid, 1);
+    ASSERT_EQ(stats.duplicates, 1);
+    ASSERT_EQ(stats.full, 1);
+}
+
+TEST(Ingest, ServesManyProducers)
+{
+    constexpr size_t producers = 8;
+    constexpr size_t perProducer = 250;
+
+    iotbc::Mempool mempool;
+    iotbc::IngestServer server(mempool, socketPath("ingest_many"));
+
+    std::vector<std::thread> threads;
+    std::vector<size_t> verified(producers, 0);
+
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            std::vector<iotbc::Transaction> txs = signedTransactions(p % 2 ? alice : bob, p * perProducer, perProducer);
+            iotbc::IngestClient client(server.path());
+
+            for (size_t start = 0; start < txs.size(); start += 50) {
+                client.submit(std::vector<iotbc::Transaction>(txs.begin() + start, txs.begin() + start + 50));
+            }
+
+            for (const auto &[hash, status] : receiveAll(client, txs.size())) {
+                verified[p] += status == iotbc::IngestStatus::Verified;
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (size_t p = 0; p < producers; p++) {
+        ASSERT_EQ(verified[p], perProducer);
+    }
+    ASSERT_EQ(mempool.readyCount(), producers * perProducer);
+    ASSERT_EQ(server.stats().verified, producers * perProducer);
+}
+
+TEST(Ingest, OwnsItsSocket)
+{
+    iotbc::Mempool mempool;
+    std::string path = socketPath("ingest_owned");
+
+    {
+        iotbc::IngestServer server(mempool, path);
+        ASSERT_THROW(iotbc::IngestServer(mempool, path), iotbc::NetworkError);
+        ASSERT_EQ(access(path.c_str(), F_OK), 0);
+    }
+
+    ASSERT_NE(access(path.c_str(), F_OK), 0);
+    ASSERT_THROW(iotbc::IngestClient client(path), iotbc::NetworkError);
+}
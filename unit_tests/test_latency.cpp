@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <thread>
+
+#include <Blockchain.hpp>
+#include <Latency.hpp>
+#include <Mempool.hpp>
+#include <testers.hpp>
+
+TEST(Latency, BucketsKeepARelativePrecision)
+{
+    for (uint64_t value = 0; value < 32; value++) {
+        ASSERT_EQ(iotbc::LatencyHistogram::bucketHighest(iotbc::LatencyHistogram::bucketIndex(value)), value);
+    }
+
+    size_t previous = 0;
+    for (uint64_t value = 32; value < (uint64_t(1) << 62); value += value / 7 + 1) {
+        size_t index = iotbc::LatencyHistogram::bucketIndex(value);
+        uint64_t highest = iotbc::LatencyHistogram::bucketHighest(index);
+
+        ASSERT_GE(index, previous);
+        ASSERT_GE(highest, value);
+        ASSERT_LE(highest - value, value / 32);
+        previous = index;
+    }
+
+    ASSERT_EQ(iotbc::LatencyHistogram::bucketIndex(UINT64_MAX), iotbc::LatencyHistogram::BUCKETS - 1);
+    ASSERT_EQ(iotbc::LatencyHistogram::bucketHighest(iotbc::LatencyHistogram::BUCKETS - 1), UINT64_MAX);
+}
+
+TEST(Latency, ReportsPercentiles)
+{
+    iotbc::LatencyHistogram histogram;
+    ASSERT_EQ(histogram.summary().count, 0);
+    ASSERT_EQ(histogram.percentile(99), 0);
+
+    for (uint64_t value = 1; value <= 100000; value++) {
+        histogram.record(value);
+    }
+    histogram.record(std::chrono::milliseconds(5));
+
+    iotbc::LatencySummary summary = histogram.summary();
+    ASSERT_EQ(summary.count, 100001);
+    ASSERT_EQ(summary.max, 5000000);
+    ASSERT_EQ(summary.mean, (uint64_t(100000) * 100001 / 2 + 5000000) / 100001);
+    ASSERT_NEAR(summary.p50, 50000, 50000 / 32);
+    ASSERT_NEAR(summary.p90, 90000, 90000 / 32);
+    ASSERT_NEAR(summary.p99, 99000, 99000 / 32);
+    ASSERT_NEAR(summary.p999, 99900, 99900 / 32);
+    ASSERT_EQ(histogram.percentile(100), 5000000);
+
+    histogram.reset();
+    ASSERT_EQ(histogram.summary().count, 0);
+    ASSERT_EQ(histogram.summary().max, 0);
+}
+
+TEST(Latency, RecordsFromManyThreads)
+{
+    iotbc::LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+
+    for (uint64_t t = 0; t < 8; t++) {
+        threads.emplace_back([&histogram, t]() {
+            for (uint64_t i = 0; i < 100000; i++) {
+                histogram.record(t * 1000 + i % 1000);
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    iotbc::LatencySummary summary = histogram.summary();
+    ASSERT_EQ(summary.count, 800000);
+    ASSERT_EQ(summary.max, 7999);
+}
+
+TEST(Latency, RecordsEveryPipelineStage)
+{
+    iotbc::PipelineMetrics &metrics = iotbc::pipelineMetrics();
+    metrics.reset();
+
+    iotbc::Mempool mempool;
+    iotbc::Transaction tx(alice, 0, {0x01, 0x02});
+    tx.sign(alice);
+    ASSERT_EQ(mempool.submit(tx), iotbc::SubmitResult::Accepted);
+    mempool.flush();
+
+    iotbc::Blockchain chain;
+    iotbc::Block block(iotbc::NULL_HASH, 0);
+    block.addTransaction(tx);
+    block.mine(0);
+    chain.addBlock(block);
+
+    std::string folder = "/tmp/iotbc_test_latency";
+    std::filesystem::remove_all(folder);
+    chain.saveBlocks(folder);
+    std::filesystem::remove_all(folder);
+
+    std::string report = metrics.report();
+
+    for (size_t i = 0; i < static_cast<size_t>(iotbc::PipelineStage::Count); i++) {
+        auto stage = static_cast<iotbc::PipelineStage>(i);
+        ASSERT_GT(metrics.stage(stage).summary().count, 0) << iotbc::stageName(stage);
+        ASSERT_NE(report.find(iotbc::stageName(stage)), std::string::npos);
+    }
+
+    // The mempool and the block both checked the signature
+    ASSERT_GE(metrics.stage(iotbc::PipelineStage::Verify).summary().count, 2);
+    ASSERT_EQ(metrics.stage(iotbc::PipelineStage::Admission).summary().count, 1);
+    ASSERT_EQ(metrics.stage(iotbc::PipelineStage::Persistence).summary().count, 1);
+}
@@ -32,7 +32,7 @@ TEST(LayersTest, TestTransactionCount)
 
     chain.addBlock(block1);
 
-    iotbc::Block block2(block1.blockHash());
+    iotbc::Block block2(block1.blockHash(), 1);
 
     iotbc::Transaction tx2(alice.public_key, 1, {0x01, 0x02, 0x03});
     tx2.sign(alice);
@@ -46,4 +46,28 @@ TEST(LayersTest, TestTransactionCount)
     chain.verifyExistingChain();
 
     ASSERT_EQ(layer->transactionCount, 2);
-}
\ No newline at end of file
+}
+// A layer failing on every block, as one parsing payloads it does not understand
+class FailingLayer : public iotbc::ILayer {
+    public:
+        void processBlock(const iotbc::Block &) override {
+            throw std::runtime_error("Unexpected payload");
+        }
+};
+
+TEST(LayersTest, FailingLayerDoesNotStopTheChain)
+{
+    iotbc::Blockchain chain;
+
+    std::shared_ptr<TransactionCountLayer> layer = std::make_shared<TransactionCountLayer>();
+    chain.addLayer(std::make_shared<FailingLayer>());
+    chain.addLayer(layer);
+
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}));
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}));
+
+    // The indices and the chain agree, and the other layers still ran
+    ASSERT_EQ(chain.chain.size(), 2);
+    ASSERT_EQ(chain.nextNonce(alice.address), 2);
+    ASSERT_EQ(layer->transactionCount, 2);
+}
@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <Mempool.hpp>
+#include <testers.hpp>
+
+TEST(Mempool, DeduplicatesById)
+{
+    iotbc::Mempool mempool;
+
+    ASSERT_EQ(mempool.submit(signedTx(alice, 0)), iotbc::SubmitResult::Accepted);
+    ASSERT_EQ(mempool.submit(signedTx(alice, 0)), iotbc::SubmitResult::Duplicate);
+    ASSERT_EQ(mempool.submit(signedTx(alice, 1)), iotbc::SubmitResult::Accepted);
+
+    mempool.flush();
+
+    ASSERT_EQ(mempool.size(), 2);
+    ASSERT_EQ(mempool.readyCount(), 2);
+}
+
+TEST(Mempool, SameReadingFromTwoSendersIsNotADuplicate)
+{
+    iotbc::Mempool mempool;
+
+    // Same nonce and data, so the same transaction hash but not the same id
+    iotbc::Transaction fromAlice(alice, 0, {0x00, 0x05});
+    fromAlice.sign(alice);
+    iotbc::Transaction fromBob(bob, 0, {0x00, 0x05});
+    fromBob.sign(bob);
+    ASSERT_EQ(fromAlice.txHash(), fromBob.txHash());
+    ASSERT_NE(fromAlice.id(), fromBob.id());
+
+    ASSERT_EQ(mempool.submit(fromAlice), iotbc::SubmitResult::Accepted);
+    ASSERT_EQ(mempool.submit(fromBob), iotbc::SubmitResult::Accepted);
+
+    mempool.flush();
+
+    ASSERT_EQ(mempool.readyCount(), 2);
+    ASSERT_TRUE(mempool.contains(fromAlice.id()));
+    ASSERT_TRUE(mempool.contains(fromBob.id()));
+    ASSERT_EQ(mempool.find({fromBob.id()}).at(0).from, bob.public_key);
+}
+
+TEST(Mempool, DropsInvalidTransactions)
+{
+    iotbc::Mempool mempool;
+
+    iotbc::Transaction tx(bob, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+
+    ASSERT_EQ(mempool.submit(tx), iotbc::SubmitResult::Accepted);
+    ASSERT_EQ(mempool.submit(signedTx(alice, 0)), iotbc::SubmitResult::Accepted);
+
+    mempool.flush();
+
+    ASSERT_EQ(mempool.readyCount(), 1);
+    ASSERT_EQ(mempool.rejectedCount(), 1);
+}
+
+TEST(Mempool, RejectsWhenFull)
+{
+    iotbc::MempoolPolicy policy;
+    policy.capacity = 1;
+    iotbc::Mempool mempool(policy);
+
+    ASSERT_EQ(mempool.submit(signedTx(alice, 0)), iotbc::SubmitResult::Accepted);
+    ASSERT_EQ(mempool.submit(signedTx(alice, 1)), iotbc::SubmitResult::Full);
+}
+
+TEST(Mempool, TemplateReadyByCount)
+{
+    iotbc::MempoolPolicy policy;
+    policy.maxTransactions = 4;
+    policy.maxAge = std::chrono::hours(1);
+    iotbc::Mempool mempool(policy);
+
+    for (iotbc::Nonce i = 0; i < 3; i++) {
+        mempool.submit(signedTx(alice, i));
+    }
+    mempool.flush();
+
+    ASSERT_FALSE(mempool.templateReady(iotbc::NonceIndex()));
+
+    for (iotbc::Nonce i = 3; i < 6; i++) {
+        mempool.submit(signedTx(alice, i));
+    }
+
+    ASSERT_TRUE(mempool.waitForTemplate(std::chrono::seconds(5), iotbc::NonceIndex()));
+    mempool.flush();
+
+    iotbc::Block block = mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, iotbc::NonceIndex());
+
+    ASSERT_EQ(block.transactions.size(), 4);
+    ASSERT_EQ(mempool.readyCount(), 2);
+
+    block.verifyTransactions();
+}
+
+TEST(Mempool, TemplateReadyByAge)
+{
+    iotbc::MempoolPolicy policy;
+    policy.maxAge = std::chrono::milliseconds(50);
+    iotbc::Mempool mempool(policy);
+
+    ASSERT_FALSE(mempool.waitForTemplate(std::chrono::milliseconds(10), iotbc::NonceIndex()));
+
+    mempool.submit(signedTx(alice, 0));
+
+    ASSERT_TRUE(mempool.waitForTemplate(std::chrono::seconds(5), iotbc::NonceIndex()));
+    ASSERT_EQ(mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, iotbc::NonceIndex()).transactions.size(), 1);
+    ASSERT_EQ(mempool.size(), 0);
+}
+
+TEST(Mempool, TemplateRespectsMaxBytes)
+{
+    iotbc::MempoolPolicy policy;
+    policy.maxBytes = 2 * signedTx(alice, 0).size(iotbc::WireFormat::V2);
+    iotbc::Mempool mempool(policy);
+
+    for (iotbc::Nonce i = 0; i < 5; i++) {
+        mempool.submit(signedTx(alice, i));
+    }
+
+    ASSERT_TRUE(mempool.waitForTemplate(std::chrono::seconds(5), iotbc::NonceIndex()));
+    mempool.flush();
+
+    ASSERT_EQ(mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, iotbc::NonceIndex()).transactions.size(), 2);
+}
+
+TEST(Mempool, ConcurrentProducers)
+{
+    iotbc::MempoolPolicy policy;
+    policy.verifyBatchSize = 8;
+    policy.workers = 4;
+    iotbc::Mempool mempool(policy);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; p++) {
+        producers.emplace_back([&mempool, p]() {
+            for (iotbc::Nonce i = 0; i < 50; i++) {
+                // Producers overlap on half of their transactions
+                mempool.submit(signedTx(p % 2 ? alice : bob, i));
+            }
+        });
+    }
+
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    mempool.flush();
+
+    ASSERT_EQ(mempool.readyCount(), 100);
+    ASSERT_EQ(mempool.rejectedCount(), 0);
+}
+
+TEST(Mempool, TemplateOrdersNoncesAndKeepsGaps)
+{
+    iotbc::Mempool mempool;
+
+    for (iotbc::Nonce nonce : {3, 1, 0, 5, 2}) {
+        mempool.submit(signedTx(alice, nonce));
+    }
+    mempool.flush();
+
+    iotbc::NonceIndex nonces;
+    iotbc::Block block = mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, nonces);
+
+    ASSERT_EQ(block.transactions.size(), 4);
+    for (iotbc::Nonce i = 0; i < 4; i++) {
+        ASSERT_EQ(block.transactions[i].nonce, i);
+    }
+
+    // Nonce 5 waits for nonce 4
+    ASSERT_EQ(mempool.readyCount(), 1);
+}
+
+TEST(Mempool, TemplateDropsUsedNonces)
+{
+    iotbc::Mempool mempool;
+
+    iotbc::Block mined(iotbc::NULL_HASH);
+    mined.addTransaction(signedTx(alice, 0));
+    mined.addTransaction(signedTx(alice, 1));
+
+    iotbc::NonceIndex nonces;
+    nonces.apply(mined);
+
+    for (iotbc::Nonce nonce = 0; nonce < 3; nonce++) {
+        mempool.submit(signedTx(alice, nonce));
+    }
+    mempool.flush();
+
+    iotbc::Block block = mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, nonces);
+
+    ASSERT_EQ(block.transactions.size(), 1);
+    ASSERT_EQ(block.transactions[0].nonce, 2);
+    ASSERT_EQ(mempool.size(), 0);
+}
+
+TEST(Mempool, GappedTransactionsAreNotReadyAndExpire)
+{
+    iotbc::MempoolPolicy policy;
+    policy.maxAge = std::chrono::milliseconds(10);
+    policy.gapTimeout = std::chrono::milliseconds(100);
+    policy.capacity = 2;
+    iotbc::Mempool mempool(policy);
+    iotbc::NonceIndex nonces;
+
+    // Nonce 0 never comes
+    ASSERT_EQ(mempool.submit(signedTx(alice, 1)), iotbc::SubmitResult::Accepted);
+    mempool.flush();
+
+    ASSERT_FALSE(mempool.waitForTemplate(std::chrono::milliseconds(50), nonces));
+    ASSERT_FALSE(mempool.templateReady(nonces));
+    ASSERT_EQ(mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, nonces).transactions.size(), 0);
+    ASSERT_EQ(mempool.readyCount(), 1);
+
+    // Other senders are not held back by the gap
+    ASSERT_EQ(mempool.submit(signedTx(bob, 0)), iotbc::SubmitResult::Accepted);
+    ASSERT_TRUE(mempool.waitForTemplate(std::chrono::seconds(5), nonces));
+    ASSERT_EQ(mempool.takeBlockTemplate(iotbc::NULL_HASH, 0, nonces).transactions.size(), 1);
+
+    ASSERT_FALSE(mempool.waitForTemplate(std::chrono::milliseconds(200), nonces));
+    ASSERT_EQ(mempool.size(), 0);
+    ASSERT_EQ(mempool.expiredCount(), 1);
+
+    // The capacity the gapped transaction held is available again
+    ASSERT_EQ(mempool.submit(signedTx(alice, 0)), iotbc::SubmitResult::Accepted);
+    ASSERT_EQ(mempool.submit(signedTx(alice, 1)), iotbc::SubmitResult::Accepted);
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include <Node.hpp>
+#include <testers.hpp>
+
+static void expectSameChain(const iotbc::Blockchain &a, const iotbc::Blockchain &b)
+{
+    ASSERT_EQ(a.chain.size(), b.chain.size());
+    for (size_t i = 0; i < a.chain.size(); i++) {
+        ASSERT_EQ(a.chain[i].blockHash(), b.chain[i].blockHash());
+    }
+}
+
+TEST(Node, MessagesRoundTrip)
+{
+    iotbc::Blockchain chain = builtChain(3);
+
+    iotbc::GetHeadersMessage getHeaders;
+    getHeaders.locator = iotbc::chainLocator(chain.chain);
+    getHeaders.maxHeaders = 42;
+
+    iotbc::GetHeadersMessage decoded = iotbc::GetHeadersMessage::deserialize(getHeaders.serialize());
+    ASSERT_EQ(decoded.maxHeaders, 42);
+    ASSERT_EQ(decoded.locator.size(), 3);
+    ASSERT_EQ(decoded.locator[0].height, 2);
+    ASSERT_EQ(decoded.locator[0].hash, chain.chain[2].blockHash());
+
+    iotbc::HeadersMessage headers = iotbc::HeadersMessage::deserialize(iotbc::HeadersMessage::serialize(chain.chain));
+    ASSERT_EQ(headers.headers.size(), 3);
+    ASSERT_EQ(headers.headers[1].blockHash(), chain.chain[1].blockHash());
+    ASSERT_TRUE(headers.headers[1].transactions.empty());
+
+    iotbc::InventoryMessage inventory;
+    inventory.hashes = {chain.chain[0].blockHash(), chain.chain[1].blockHash()};
+    ASSERT_EQ(iotbc::InventoryMessage::deserialize(inventory.serialize()).hashes, inventory.hashes);
+
+    std::vector<unsigned char> truncated = getHeaders.serialize();
+    truncated.pop_back();
+    ASSERT_THROW(iotbc::GetHeadersMessage::deserialize(truncated), iotbc::DeserializationError);
+
+    std::vector<unsigned char> frame = iotbc::encodeFrame(iotbc::MessageType::Headers, {0x01, 0x02, 0x03});
+    ASSERT_EQ(frame.size(), iotbc::FRAME_HEADER_SIZE + 3);
+    ASSERT_EQ(iotbc::framePayloadSize(frame.data()), 3);
+}
+
+TEST(Node, LocatorStepsBackExponentially)
+{
+    iotbc::Blockchain chain = builtChain(100);
+    std::vector<iotbc::BlockRef> locator = iotbc::chainLocator(chain.chain);
+
+    ASSERT_EQ(locator.front().height, 99);
+    ASSERT_EQ(locator[9].height, 90);
+    ASSERT_EQ(locator.back().height, 0);
+    ASSERT_LT(locator.size(), 20);
+
+    ASSERT_TRUE(iotbc::chainLocator({}).empty());
+}
+
+TEST(Node, SyncsAnEmptyChainFromAPeer)
+{
+    iotbc::Blockchain source = builtChain(30);
+    iotbc::Blockchain target;
+
+    iotbc::NodeOptions options;
+    options.maxHeadersPerMessage = 8;
+
+    iotbc::Node server(source, options);
+    iotbc::Node client(target, options);
+    client.connect("127.0.0.1", server.port());
+
+    iotbc::SyncStats stats = client.sync();
+
+    ASSERT_EQ(stats.peers, 1);
+    ASSERT_EQ(stats.headers, 30);
+    ASSERT_EQ(stats.blocks, 30);
+    ASSERT_GT(stats.bytes, 0);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        expectSameChain(chain, source);
+        ASSERT_EQ(chain.nextNonce(alice.address), 30);
+    });
+
+    // Nothing left to download
+    ASSERT_EQ(client.sync().blocks, 0);
+}
+
+TEST(Node, CapsTheHeadersOfASync)
+{
+    iotbc::Blockchain source = builtChain(30);
+    iotbc::Blockchain copy = source;
+    iotbc::Blockchain target;
+
+    iotbc::NodeOptions options;
+    options.maxHeadersPerMessage = 8;
+    options.maxHeadersPerPeer = 20;
+
+    iotbc::Node server(source, options);
+    iotbc::Node client(target, options);
+    client.connect("127.0.0.1", server.port());
+
+    // The next sync continues after the headers of the previous one
+    iotbc::SyncStats stats = client.sync();
+    ASSERT_EQ(stats.headers, 20);
+    ASSERT_EQ(stats.blocks, 20);
+
+    stats = client.sync();
+    ASSERT_EQ(stats.headers, 10);
+    ASSERT_EQ(stats.blocks, 10);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        expectSameChain(chain, source);
+    });
+
+    // Peers share the headers of a sync
+    iotbc::Blockchain other;
+    options.maxHeadersPerSync = 12;
+
+    iotbc::Node second(copy, options);
+    iotbc::Node shared(other, options);
+    shared.connect("127.0.0.1", server.port());
+    shared.connect("127.0.0.1", second.port());
+
+    stats = shared.sync();
+    ASSERT_EQ(stats.headers, 12);
+    ASSERT_GT(stats.blocks, 0);
+    ASSERT_LE(stats.blocks, 12);
+}
+
+TEST(Node, DownloadsBlocksFromSeveralPeers)
+{
+    iotbc::Blockchain first = builtChain(40);
+    iotbc::Blockchain second = first;
+    iotbc::Blockchain target;
+
+    iotbc::NodeOptions options;
+    options.blocksPerRequest = 2;
+    options.maxRequestsPerPeer = 2;
+
+    iotbc::Node a(first, options);
+    iotbc::Node b(second, options);
+    iotbc::Node client(target, options);
+    client.connect("127.0.0.1", a.port());
+    client.connect("127.0.0.1", b.port());
+    ASSERT_EQ(client.peerCount(), 2);
+
+    iotbc::SyncStats stats = client.sync();
+
+    ASSERT_EQ(stats.peers, 2);
+    ASSERT_EQ(stats.blocks, 40);
+    ASSERT_EQ(stats.peersUsed, 2);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        expectSameChain(chain, first);
+    });
+}
+
+TEST(Node, ReorganizesToThePeerBranchWithMoreWork)
+{
+    iotbc::Blockchain source = builtChain(10);
+
+    // The local chain forks after 5 blocks with a shorter branch of its own
+    iotbc::Blockchain target;
+    for (size_t i = 0; i < 5; i++) {
+        target.addBlock(source.chain[i]);
+    }
+    target.addBlock(nextBlock(target, bob));
+    target.addBlock(nextBlock(target, bob));
+
+    iotbc::Node server(source);
+    iotbc::Node client(target);
+    client.connect("127.0.0.1", server.port());
+
+    iotbc::SyncStats stats = client.sync();
+    ASSERT_EQ(stats.blocks, 5);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        expectSameChain(chain, source);
+        ASSERT_EQ(chain.nextNonce(bob.address), 0);
+        ASSERT_EQ(chain.sideBlockCount(), 2);
+    });
+
+    // A node ahead of its peers has nothing to download
+    iotbc::Blockchain ahead = source;
+    ahead.addBlock(nextBlock(ahead, bob));
+
+    iotbc::Node other(ahead);
+    other.connect("127.0.0.1", server.port());
+    ASSERT_EQ(other.sync().blocks, 0);
+}
+
+TEST(Node, FetchesPrunedBlocksFromAnotherPeer)
+{
+    std::string folder = "/tmp/iotbc_test_node_pruned";
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain full = builtChain(12);
+    iotbc::Blockchain pruned = full;
+    pruned.saveBlocks(folder);
+    pruned.pruning.keepBlocks = 4;
+    ASSERT_EQ(pruned.pruneBlocks(folder), 8);
+
+    iotbc::Blockchain target;
+
+    iotbc::Node a(pruned);
+    iotbc::Node client(target);
+    client.connect("127.0.0.1", a.port());
+
+    // The pruned peer alone cannot serve the first blocks
+    ASSERT_EQ(client.sync().blocks, 0);
+
+    iotbc::Node b(full);
+    client.connect("127.0.0.1", b.port());
+
+    iotbc::SyncStats stats = client.sync();
+    ASSERT_EQ(stats.blocks, 12);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        expectSameChain(chain, full);
+    });
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Node, RejectsInvalidBlocks)
+{
+    iotbc::Blockchain source = builtChain(4);
+
+    // The signature is not part of the block hash, so the headers still link
+    source.chain[2].transactions[0].signature[0] ^= 0xFF;
+
+    iotbc::Blockchain target;
+    iotbc::Node server(source);
+    iotbc::Node client(target);
+    client.connect("127.0.0.1", server.port());
+
+    ASSERT_THROW(client.sync(), iotbc::InvalidBlock);
+
+    client.withChain([&](iotbc::Blockchain &chain) {
+        ASSERT_EQ(chain.chain.size(), 2);
+    });
+}
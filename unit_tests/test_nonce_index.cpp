@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <Block.hpp>
+#include <Blockchain.hpp>
+#include <NonceIndex.hpp>
+#include <Utils.hpp>
+#include <testers.hpp>
+
+TEST(NonceIndex, TracksNextNoncePerSender)
+{
+    iotbc::Blockchain chain;
+
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 0), signedTx(alice, 1), signedTx(bob, 0)}));
+
+    ASSERT_EQ(chain.nextNonce(alice.address), 2);
+    ASSERT_EQ(chain.nextNonce(bob.address), 1);
+    ASSERT_EQ(chain.nextNonce(iotbc::Address()), 0);
+}
+
+TEST(NonceIndex, RejectsReplayedTransaction)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Transaction tx = signedTx(alice, 0);
+    chain.addBlock(minedBlock(chain, {tx}));
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {tx})), iotbc::InvalidBlock);
+    ASSERT_EQ(chain.chain.size(), 1);
+    ASSERT_EQ(chain.nextNonce(alice.address), 1);
+}
+
+TEST(NonceIndex, RejectsDuplicateInSameBlock)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Transaction tx = signedTx(alice, 0);
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {tx, tx})), iotbc::InvalidBlock);
+    ASSERT_EQ(chain.nextNonce(alice.address), 0);
+}
+
+TEST(NonceIndex, RejectsSkippedNonce)
+{
+    iotbc::Blockchain chain;
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {signedTx(alice, 1)})), iotbc::InvalidBlock);
+}
+
+TEST(NonceIndex, SerializationRoundTrip)
+{
+    iotbc::NonceIndex index;
+
+    iotbc::Block block(iotbc::NULL_HASH);
+    block.transactions.push_back(signedTx(alice, 0));
+    block.transactions.push_back(signedTx(bob, 300));
+    index.apply(block);
+
+    auto deserialized = iotbc::NonceIndex::deserialize(index.serialize());
+
+    ASSERT_EQ(deserialized.size(), 2);
+    ASSERT_EQ(deserialized.next(alice.address), 1);
+    ASSERT_EQ(deserialized.next(bob.address), 301);
+}
+
+TEST(NonceIndex, PersistedWithTheStore)
+{
+    std::string folder = "/tmp/iotbc_test_nonce_index";
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain chain;
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 0)}));
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 1), signedTx(bob, 0)}));
+    chain.saveBlocks(folder);
+
+    ASSERT_TRUE(std::filesystem::exists(folder + "/nonces"));
+
+    iotbc::Blockchain loaded;
+    loaded.loadExistingBlocks(folder);
+
+    ASSERT_EQ(loaded.chain.size(), 2);
+    ASSERT_EQ(loaded.nextNonce(alice.address), 2);
+    ASSERT_EQ(loaded.nextNonce(bob.address), 1);
+    loaded.verifyExistingChain();
+
+    // A missing index is rebuilt from the blocks
+    std::filesystem::remove(folder + "/nonces");
+
+    iotbc::Blockchain rebuilt;
+    rebuilt.loadExistingBlocks(folder);
+
+    ASSERT_EQ(rebuilt.nextNonce(alice.address), 2);
+    ASSERT_EQ(rebuilt.nextNonce(bob.address), 1);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(NonceIndex, LoadsStoreWrittenBeforeNonces)
+{
+    std::string folder = "/tmp/iotbc_test_nonce_index_legacy";
+    std::filesystem::remove_all(folder);
+    std::filesystem::create_directory(folder);
+
+    // Stores written before nonce sequencing hold V1 blocks whose transactions all use nonce 0
+    iotbc::Hash prevHash = iotbc::NULL_HASH;
+    for (size_t i = 0; i < 3; i++) {
+        iotbc::Block block(prevHash);
+        block.version = iotbc::BLOCK_VERSION_LEGACY;
+        block.addTransaction(signedTx(alice, 0));
+        block.mine(0);
+
+        std::ofstream file(folder + "/" + iotbc::hashToString(block.blockHash()), std::ios::binary);
+        auto serialized = block.serialize(iotbc::WireFormat::V1);
+        file.write(reinterpret_cast<const char *>(serialized.data()), serialized.size());
+
+        prevHash = block.blockHash();
+    }
+
+    // Same settings as the simulation, the legacy headers have no difficulty to check
+    iotbc::ChainParams params;
+    params.initialDifficulty = 12;
+    params.targetBlockInterval = std::chrono::seconds(5);
+
+    iotbc::Blockchain chain(params);
+    iotbc::LoadOptions options;
+    options.verify = true;
+    chain.loadExistingBlocks(folder, options);
+
+    ASSERT_EQ(chain.chain.size(), 3);
+    ASSERT_EQ(chain.nextNonce(alice.address), 0);
+    chain.verifyExistingChain();
+
+    // New blocks continue with sequenced nonces, and legacy blocks are not accepted anymore
+    iotbc::Block next(chain.chain.back().blockHash(), chain.chain.size());
+    next.addTransaction(signedTx(alice, 0));
+    next.mine(chain.requiredDifficulty());
+    chain.addBlock(next);
+    ASSERT_EQ(chain.nextNonce(alice.address), 1);
+
+    iotbc::Block legacy(chain.chain.back().blockHash());
+    legacy.version = iotbc::BLOCK_VERSION_LEGACY;
+    legacy.addTransaction(signedTx(alice, 1));
+    legacy.mine(0);
+    ASSERT_THROW(chain.addBlock(legacy), iotbc::InvalidBlock);
+
+    std::filesystem::remove_all(folder);
+}
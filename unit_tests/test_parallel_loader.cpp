@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <Blockchain.hpp>
+#include <Utils.hpp>
+#include <testers.hpp>
+
+static std::string savedChain(const std::string &name, size_t size)
+{
+    std::string folder = "/tmp/iotbc_test_loader_" + name;
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain chain;
+    for (size_t i = 0; i < size; i++) {
+        chain.addBlock(minedBlock(chain, {nextTx(chain, alice), nextTx(chain, bob)}));
+    }
+    chain.compression = {iotbc::Codec::Lz, 1};
+    chain.saveBlocks(folder);
+
+    return folder;
+}
+
+static iotbc::LoadOptions verifying(size_t threads)
+{
+    iotbc::LoadOptions options;
+    options.threads = threads;
+    options.verify = true;
+    return options;
+}
+
+TEST(ParallelLoader, LoadsTheSameChainWithAnyThreadCount)
+{
+    std::string folder = savedChain("threads", 20);
+
+    iotbc::Blockchain sequential;
+    iotbc::LoadStats stats = sequential.loadExistingBlocks(folder, verifying(1));
+
+    ASSERT_EQ(stats.files, 20);
+    ASSERT_EQ(stats.blocks, 20);
+
+    iotbc::Blockchain parallel;
+    parallel.loadExistingBlocks(folder, verifying(4));
+
+    ASSERT_EQ(parallel.chain.size(), sequential.chain.size());
+    for (size_t i = 0; i < parallel.chain.size(); i++) {
+        ASSERT_EQ(parallel.chain[i].blockHash(), sequential.chain[i].blockHash());
+        ASSERT_EQ(parallel.chain[i].height, i);
+    }
+
+    ASSERT_EQ(parallel.nextNonce(alice.address), 20);
+    ASSERT_EQ(parallel.nextNonce(bob.address), 20);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(ParallelLoader, VerifyDetectsInvalidSignature)
+{
+    std::string folder = savedChain("signature", 8);
+
+    iotbc::Blockchain chain;
+    chain.loadExistingBlocks(folder);
+
+    // The signature is not covered by the block hash, so the block still links
+    iotbc::Block tampered = chain.chain[5];
+    tampered.transactions[0].signature[0] ^= 0xFF;
+
+    std::ofstream file(folder + "/" + iotbc::hashToString(tampered.blockHash()), std::ios::binary | std::ios::trunc);
+    auto serialized = tampered.serialize();
+    file.write(reinterpret_cast<const char *>(serialized.data()), serialized.size());
+    file.close();
+
+    iotbc::Blockchain unverified;
+    ASSERT_EQ(unverified.loadExistingBlocks(folder).blocks, 8);
+
+    iotbc::Blockchain verified;
+    ASSERT_ANY_THROW(verified.loadExistingBlocks(folder, verifying(4)));
+    ASSERT_TRUE(verified.empty());
+    ASSERT_EQ(verified.prunedHeight(), 0);
+
+    // Nothing of the failed load is left behind
+    ASSERT_EQ(verified.loadExistingBlocks(folder).blocks, 8);
+    ASSERT_EQ(verified.chain.size(), 8);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(ParallelLoader, UndecodableBlockIsAnInvalidSave)
+{
+    std::string folder = savedChain("undecodable", 8);
+
+    iotbc::Blockchain chain;
+    chain.loadExistingBlocks(folder);
+    std::string name = iotbc::hashToString(chain.chain[5].blockHash());
+    std::filesystem::resize_file(folder + "/" + name, 10);
+
+    iotbc::Blockchain loaded;
+    try {
+        loaded.loadExistingBlocks(folder, verifying(4));
+        FAIL() << "The truncated block was loaded";
+    } catch (const iotbc::InvalidBlockchainSave &e) {
+        ASSERT_NE(std::string(e.what()).find(name), std::string::npos);
+    }
+    ASSERT_TRUE(loaded.empty());
+    ASSERT_EQ(loaded.prunedHeight(), 0);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(ParallelLoader, RejectsMissingGenesis)
+{
+    std::string folder = savedChain("genesis", 4);
+
+    iotbc::Blockchain chain;
+    chain.loadExistingBlocks(folder);
+    std::filesystem::remove(folder + "/" + iotbc::hashToString(chain.chain[0].blockHash()));
+
+    iotbc::Blockchain loaded;
+    ASSERT_THROW(loaded.loadExistingBlocks(folder), iotbc::InvalidBlockchainSave);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(ParallelLoader, EmptyFolder)
+{
+    std::string folder = "/tmp/iotbc_test_loader_empty";
+    std::filesystem::remove_all(folder);
+    std::filesystem::create_directory(folder);
+
+    iotbc::Blockchain chain;
+    iotbc::LoadStats stats = chain.loadExistingBlocks(folder);
+
+    ASSERT_EQ(stats.files, 0);
+    ASSERT_TRUE(chain.empty());
+
+    std::filesystem::remove_all(folder);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+
+#include <Block.hpp>
+#include <Blockchain.hpp>
+#include <Consensus.hpp>
+#include <testers.hpp>
+
+static iotbc::Block blockTemplate(const iotbc::Blockchain &chain)
+{
+    iotbc::Block block(chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash(), chain.chain.size());
+
+    iotbc::Transaction tx(alice, chain.nextNonce(alice.address), {0x00, 0x01, 0x02});
+    tx.sign(alice);
+    block.addTransaction(tx);
+
+    return block;
+}
+
+static iotbc::Blockchain authorityChain(const iotbc::Signer &sealer)
+{
+    iotbc::Blockchain chain;
+    chain.consensus = std::make_shared<iotbc::ProofOfAuthority>(std::vector<iotbc::Address>{alice.address}, sealer);
+    return chain;
+}
+
+TEST(ProofOfAuthority, AcceptsSealedBlocks)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    for (int i = 0; i < 3; i++) {
+        iotbc::Block block = blockTemplate(chain);
+        chain.sealBlock(block);
+
+        ASSERT_TRUE(block.sealer.has_value());
+        ASSERT_TRUE(block.hasValidSeal());
+
+        chain.addBlock(block);
+    }
+
+    ASSERT_EQ(chain.chain.size(), 3);
+    chain.verifyExistingChain();
+}
+
+TEST(ProofOfAuthority, SignerOutsideTheSetCannotSeal)
+{
+    iotbc::Blockchain chain = authorityChain(bob);
+
+    iotbc::Block block = blockTemplate(chain);
+
+    ASSERT_THROW(chain.sealBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, RejectsBlockSealedByAnotherKey)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    iotbc::Block block = blockTemplate(chain);
+    block.sealWith(bob);
+
+    ASSERT_TRUE(block.hasValidSeal());
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, RejectsForgedSeal)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    iotbc::Block block = blockTemplate(chain);
+    block.sealWith(bob);
+
+    // Claim alice sealed it with bob's signature
+    block.sealer = alice.public_key;
+
+    ASSERT_FALSE(block.hasValidSeal());
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, RejectsMinedBlocks)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    iotbc::Block block = blockTemplate(chain);
+    block.mine(4);
+
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, RejectsSealedBlocksWithADifficulty)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    // An authority sealing a block claiming a lot of work
+    iotbc::Block block = blockTemplate(chain);
+    chain.sealBlock(block);
+    block.difficulty = 40;
+    block.seal = alice.sign(block.blockHash());
+
+    ASSERT_TRUE(block.hasValidSeal());
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, ProofOfWorkRejectsSealedBlocks)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Block block = blockTemplate(chain);
+    block.sealWith(alice);
+
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfAuthority, SealSurvivesSerialization)
+{
+    iotbc::Blockchain chain = authorityChain(alice);
+
+    iotbc::Block block = blockTemplate(chain);
+    chain.sealBlock(block);
+
+    iotbc::Block deserialized = iotbc::Block::deserialize(block.serialize());
+
+    ASSERT_EQ(deserialized.sealer, block.sealer);
+    ASSERT_EQ(deserialized.seal, block.seal);
+    ASSERT_EQ(deserialized.blockHash(), block.blockHash());
+
+    chain.addBlock(deserialized);
+}
+
+TEST(ProofOfAuthority, ValidatorOnlyEngineVerifies)
+{
+    iotbc::Blockchain sealer = authorityChain(alice);
+
+    iotbc::Block block = blockTemplate(sealer);
+    sealer.sealBlock(block);
+
+    iotbc::Blockchain validator;
+    validator.consensus = std::make_shared<iotbc::ProofOfAuthority>(std::vector<iotbc::Address>{alice.address});
+
+    validator.addBlock(block);
+
+    iotbc::Block next = blockTemplate(validator);
+    ASSERT_THROW(validator.sealBlock(next), iotbc::InvalidBlock);
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <Block.hpp>
+#include <Blockchain.hpp>
+#include <testers.hpp>
+
+TEST(ProofOfWork, AcceptsMinedBlocks)
+{
+    iotbc::ChainParams params;
+    params.minDifficulty = 4;
+    iotbc::Blockchain chain(params);
+
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 0)}, 4));
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 1)}, 6));
+
+    ASSERT_EQ(chain.chain.size(), 2);
+    chain.verifyExistingChain();
+}
+
+TEST(ProofOfWork, RejectsBlockBelowRequiredDifficulty)
+{
+    iotbc::ChainParams params;
+    params.minDifficulty = 8;
+    iotbc::Blockchain chain(params);
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {signedTx(alice, 0)}, 4)), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfWork, RejectsUnminedBlock)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Block block = minedBlock(chain, {signedTx(alice, 0)}, 0);
+
+    // Claim a difficulty the hash does not meet
+    block.difficulty = 64;
+
+    ASSERT_FALSE(block.hasValidProofOfWork());
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfWork, RejectsTamperedTransactions)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Block block = minedBlock(chain, {signedTx(alice, 0)}, 0);
+
+    iotbc::Transaction tx(alice, 1, {0x03});
+    tx.sign(alice);
+    block.transactions.push_back(tx);
+
+    ASSERT_FALSE(block.hasValidMerkleRoot());
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
+
+TEST(ProofOfWork, HeaderIsCheckedBeforeSignatures)
+{
+    iotbc::ChainParams params;
+    params.minDifficulty = 8;
+    iotbc::Blockchain chain(params);
+
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(bob, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice); // Invalid signature
+    block.transactions.push_back(tx);
+
+    block.mine(0);
+
+    try {
+        chain.addBlock(block);
+        FAIL() << "Block should have been rejected";
+    } catch (const iotbc::InvalidBlock &e) {
+        ASSERT_NE(std::string(e.what()).find("difficulty"), std::string::npos);
+    }
+}
+
+TEST(ProofOfWork, VerifyExistingChainDetectsTampering)
+{
+    iotbc::Blockchain chain;
+
+    chain.addBlock(minedBlock(chain, {signedTx(alice, 0)}, 0));
+
+    iotbc::Transaction tx(alice, 0, {0x04});
+    tx.sign(alice);
+    chain.chain[0].transactions[0] = tx;
+
+    ASSERT_THROW(chain.verifyExistingChain(), iotbc::InvalidBlockchainSave);
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <Blockchain.hpp>
+#include <Utils.hpp>
+#include <testers.hpp>
+
+/// @brief Build a chain of 10 blocks, the first one registering a sensor, and save it
+static iotbc::Blockchain savedChain(const std::string &folder)
+{
+    std::filesystem::remove_all(folder);
+
+    iotbc::Blockchain chain;
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice, iotbc::SensorDictionary::registrationPayload("door"))}));
+
+    for (unsigned char i = 1; i < 10; i++) {
+        chain.addBlock(minedBlock(chain, {nextTx(chain, alice, {0x00, i})}));
+    }
+
+    chain.saveBlocks(folder);
+    return chain;
+}
+
+static size_t countBlockFiles(const std::string &folder)
+{
+    size_t count = 0;
+
+    for (const auto &entry : std::filesystem::directory_iterator(folder)) {
+        if (entry.path().filename().string().size() == sizeof(iotbc::Hash) * 2) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static std::vector<unsigned char> readBytes(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+class PinningLayer : public iotbc::ILayer {
+public:
+    explicit PinningLayer(uint64_t pin) : pin(pin) {}
+
+    void processBlock(const iotbc::Block &) override {}
+
+    std::optional<uint64_t> pinnedHeight() const override
+    {
+        return pin;
+    }
+
+private:
+    uint64_t pin;
+};
+
+TEST(Pruning, MerkleProofs)
+{
+    for (size_t count = 1; count <= 7; count++) {
+        iotbc::Block block(iotbc::NULL_HASH);
+
+        for (size_t i = 0; i < count; i++) {
+            iotbc::Transaction tx(alice, i, {0x00, static_cast<unsigned char>(i)});
+            tx.sign(alice);
+            block.addTransaction(tx);
+        }
+        block.mine(0);
+
+        for (size_t i = 0; i < count; i++) {
+            iotbc::MerkleProof proof = block.merkleProof(i);
+            iotbc::Hash txHash = block.transactions[i].txHash();
+
+            ASSERT_TRUE(proof.verify(txHash, block.merkleRoot));
+
+            if (count > 1) {
+                ASSERT_FALSE(proof.verify(block.transactions[(i + 1) % count].txHash(), block.merkleRoot));
+
+                iotbc::MerkleProof tampered = proof;
+                tampered.siblings[0][0] ^= 0xFF;
+                ASSERT_FALSE(tampered.verify(txHash, block.merkleRoot));
+            }
+        }
+
+        ASSERT_THROW(block.merkleProof(count), iotbc::InvalidTransaction);
+    }
+}
+
+TEST(Pruning, HeaderSerialization)
+{
+    iotbc::Block block(iotbc::NULL_HASH, 3);
+    iotbc::Transaction tx(alice, 0, {0x00, 0x01});
+    tx.sign(alice);
+    block.addTransaction(tx);
+    block.mine(0);
+
+    iotbc::Block header = iotbc::Block::deserializeHeader(block.serializeHeader());
+
+    ASSERT_TRUE(header.transactions.empty());
+    ASSERT_EQ(header.height, 3);
+    ASSERT_EQ(header.merkleRoot, block.merkleRoot);
+    ASSERT_EQ(header.blockHash(), block.blockHash());
+}
+
+TEST(Pruning, KeepsTheLastBlocks)
+{
+    std::string folder = "/tmp/iotbc_test_pruning_last";
+    iotbc::Blockchain chain = savedChain(folder);
+
+    iotbc::MerkleProof proof = chain.chain[2].merkleProof(0);
+    iotbc::Hash txHash = chain.chain[2].transactions[0].txHash();
+
+    chain.pruning.keepBlocks = 3;
+
+    ASSERT_EQ(chain.pruneBlocks(folder), 7);
+    ASSERT_EQ(chain.prunedHeight(), 7);
+    ASSERT_FALSE(chain.hasBody(6));
+    ASSERT_TRUE(chain.hasBody(7));
+    ASSERT_TRUE(chain.chain[2].transactions.empty());
+    ASSERT_EQ(countBlockFiles(folder), 3);
+
+    // The headers still prove what the pruned blocks held
+    ASSERT_TRUE(proof.verify(txHash, chain.chain[2].merkleRoot));
+    chain.verifyExistingChain();
+
+    ASSERT_EQ(chain.pruneBlocks(folder), 0);
+
+    iotbc::LoadOptions options;
+    options.verify = true;
+
+    iotbc::Blockchain loaded;
+    loaded.loadExistingBlocks(folder, options);
+
+    ASSERT_EQ(loaded.chain.size(), 10);
+    ASSERT_EQ(loaded.prunedHeight(), 7);
+    ASSERT_EQ(loaded.chain.back().blockHash(), chain.chain.back().blockHash());
+    ASSERT_EQ(loaded.nextNonce(alice.address), 10);
+    ASSERT_EQ(loaded.sensorDictionary.find("door"), 0);
+
+    loaded.addBlock(minedBlock(loaded, {nextTx(loaded, alice, {0x00, 0x0A})}));
+    loaded.verifyExistingChain();
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Pruning, AppendsTheNewHeaders)
+{
+    std::string folder = "/tmp/iotbc_test_pruning_append";
+    iotbc::Blockchain chain = savedChain(folder);
+    std::string headersPath = folder + "/headers";
+
+    chain.pruning.keepBlocks = 5;
+    ASSERT_EQ(chain.pruneBlocks(folder), 5);
+
+    std::vector<unsigned char> before = readBytes(headersPath);
+
+    chain.addBlock(minedBlock(chain, {nextTx(chain, alice, {0x00, 0x0A})}));
+    chain.saveBlocks(folder);
+    ASSERT_EQ(readBytes(headersPath), before);
+
+    ASSERT_EQ(chain.pruneBlocks(folder), 1);
+
+    std::vector<unsigned char> after = readBytes(headersPath);
+    ASSERT_GT(after.size(), before.size());
+    ASSERT_TRUE(std::equal(before.begin(), before.end(), after.begin()));
+
+    // Headers appended by a pruning interrupted before its snapshot are ignored, then overwritten
+    std::ofstream(headersPath, std::ios::binary | std::ios::app) << "interrupted";
+
+    iotbc::LoadOptions options;
+    options.verify = true;
+
+    iotbc::Blockchain loaded;
+    loaded.loadExistingBlocks(folder, options);
+    ASSERT_EQ(loaded.prunedHeight(), 6);
+    ASSERT_EQ(loaded.chain.size(), 11);
+
+    loaded.pruning.keepBlocks = 4;
+    ASSERT_EQ(loaded.pruneBlocks(folder), 1);
+
+    iotbc::Blockchain reloaded;
+    reloaded.loadExistingBlocks(folder, options);
+    ASSERT_EQ(reloaded.prunedHeight(), 7);
+    ASSERT_EQ(reloaded.chain.back().blockHash(), chain.chain.back().blockHash());
+    ASSERT_EQ(reloaded.nextNonce(alice.address), 11);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Pruning, KeepsTheLastBytes)
+{
+    std::string folder = "/tmp/iotbc_test_pruning_bytes";
+    iotbc::Blockchain chain = savedChain(folder);
+
+    size_t bodySize = chain.chain.back().transactions[0].size(iotbc::WireFormat::V2);
+    chain.pruning.keepBytes = bodySize * 2;
+
+    ASSERT_EQ(chain.pruneBlocks(folder), 8);
+    ASSERT_EQ(countBlockFiles(folder), 2);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Pruning, ArchivesPrunedBlocks)
+{
+    std::string folder = "/tmp/iotbc_test_pruning_archive";
+    std::string archive = "/tmp/iotbc_test_pruning_archived";
+    std::filesystem::remove_all(archive);
+
+    iotbc::Blockchain chain = savedChain(folder);
+    chain.pruning.keepBlocks = 4;
+    chain.pruning.archiveFolder = archive;
+
+    ASSERT_EQ(chain.pruneBlocks(folder), 6);
+    ASSERT_EQ(countBlockFiles(folder), 4);
+    ASSERT_EQ(countBlockFiles(archive), 6);
+    ASSERT_TRUE(std::filesystem::exists(archive + "/" + iotbc::hashToString(chain.chain[0].blockHash())));
+
+    std::filesystem::remove_all(folder);
+    std::filesystem::remove_all(archive);
+}
+
+TEST(Pruning, RespectsPinsAndUnverifiedBlocks)
+{
+    std::string folder = "/tmp/iotbc_test_pruning_pins";
+    savedChain(folder);
+
+    iotbc::Blockchain unverified;
+    unverified.loadExistingBlocks(folder);
+    unverified.pruning.keepBlocks = 2;
+
+    ASSERT_EQ(unverified.pruneBlocks(folder), 0);
+
+    unverified.verifyNewBlocks();
+    unverified.addLayer(std::make_shared<PinningLayer>(4));
+
+    ASSERT_EQ(unverified.pruneBlocks(folder), 4);
+    ASSERT_EQ(unverified.prunedHeight(), 4);
+
+    std::filesystem::remove_all(folder);
+}
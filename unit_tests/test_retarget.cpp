@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <Blockchain.hpp>
+#include <Utils.hpp>
+#include <testers.hpp>
+
+/// Timestamps of the test chains start in the past, so none of them is in the future
+static const uint64_t START = iotbc::currentTimestamp() - 3600 * 1000;
+
+static iotbc::ChainParams retargetParams()
+{
+    iotbc::ChainParams params;
+    params.initialDifficulty = 4;
+    params.targetBlockInterval = std::chrono::seconds(1);
+    params.retargetWindow = 4;
+    return params;
+}
+
+/// @brief Extend a chain with blocks mined at the required difficulty, a fixed interval apart
+static void extend(iotbc::Blockchain &chain, size_t count, uint64_t interval)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t timestamp = chain.empty() ? START : chain.chain.back().timestamp + interval;
+        chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}, chain.requiredDifficulty(), timestamp));
+    }
+}
+
+TEST(Retarget, DisabledUsesMinDifficulty)
+{
+    iotbc::ChainParams params;
+    params.minDifficulty = 3;
+    iotbc::Blockchain chain(params);
+
+    extend(chain, 5, 1);
+
+    ASSERT_EQ(chain.requiredDifficulty(), 3);
+}
+
+TEST(Retarget, InitialDifficultyUntilAnIntervalIsKnown)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    ASSERT_EQ(chain.requiredDifficulty(), 4);
+    extend(chain, 1, 0);
+    ASSERT_EQ(chain.requiredDifficulty(), 4);
+}
+
+TEST(Retarget, FastBlocksRaiseDifficulty)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 2, 10);
+
+    // 100 times faster than the target, limited by the maximum step
+    ASSERT_EQ(chain.requiredDifficulty(), 4 + 2);
+}
+
+TEST(Retarget, SlowBlocksLowerDifficulty)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 2, 4000);
+
+    ASSERT_EQ(chain.requiredDifficulty(), 2);
+}
+
+TEST(Retarget, OnTargetKeepsDifficulty)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 8, 1000);
+
+    ASSERT_EQ(chain.requiredDifficulty(), 4);
+}
+
+TEST(Retarget, ConvergesWithinBounds)
+{
+    iotbc::ChainParams params = retargetParams();
+    params.minDifficulty = 1;
+    params.maxDifficulty = 8;
+    iotbc::Blockchain chain(params);
+
+    extend(chain, 8, 1);
+
+    ASSERT_EQ(chain.requiredDifficulty(), 8);
+    chain.verifyExistingChain();
+}
+
+TEST(Retarget, RejectsBlockBelowRetargetedDifficulty)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 2, 10);
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}, 4, chain.chain.back().timestamp + 10)), iotbc::InvalidBlock);
+}
+
+TEST(Retarget, RejectsTimestampBeforeParent)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 2, 1000);
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}, 8, chain.chain.back().timestamp - 1)), iotbc::InvalidBlock);
+}
+
+TEST(Retarget, RejectsTimestampInTheFuture)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    uint64_t future = iotbc::currentTimestamp() + 3600 * 1000;
+
+    ASSERT_THROW(chain.addBlock(minedBlock(chain, {nextTx(chain, alice)}, 4, future)), iotbc::InvalidBlock);
+}
+
+TEST(Retarget, RejectsOlderHeaderVersion)
+{
+    iotbc::Blockchain chain(retargetParams());
+
+    extend(chain, 1, 0);
+
+    iotbc::Block block = minedBlock(chain, {nextTx(chain, alice)}, 4, chain.chain.back().timestamp);
+    block.version = iotbc::BLOCK_VERSION_DIFFICULTY;
+    block.nonce = 0;
+    block.mine(4);
+
+    ASSERT_THROW(chain.addBlock(block), iotbc::InvalidBlock);
+}
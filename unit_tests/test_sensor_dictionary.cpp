@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <Block.hpp>
+#include <Blockchain.hpp>
+#include <SensorDictionary.hpp>
+#include <testers.hpp>
+
+TEST(SensorDictionary, RegistersSensorsInChainOrder)
+{
+    iotbc::Blockchain chain;
+
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(alice, 0, iotbc::SensorDictionary::registrationPayload("3f2504e0-4f89-11d3-9a0c-0305e82c3301"));
+    tx.sign(alice);
+    block.addTransaction(tx);
+
+    iotbc::Transaction tx2(alice, 1, iotbc::SensorDictionary::registrationPayload("thermostat"));
+    tx2.sign(alice);
+    block.addTransaction(tx2);
+
+    block.mine(0);
+
+    chain.addBlock(block);
+
+    ASSERT_EQ(chain.sensorDictionary.size(), 2);
+    ASSERT_EQ(chain.sensorDictionary.find("3f2504e0-4f89-11d3-9a0c-0305e82c3301"), 0);
+    ASSERT_EQ(chain.sensorDictionary.find("thermostat"), 1);
+    ASSERT_EQ(chain.sensorDictionary.name(1), "thermostat");
+    ASSERT_EQ(chain.sensorDictionary.find("unknown"), std::nullopt);
+}
+
+TEST(SensorDictionary, DuplicateRegistrationIsIgnored)
+{
+    iotbc::SensorDictionary dictionary;
+
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(alice, 0, iotbc::SensorDictionary::registrationPayload("door"));
+    tx.sign(alice);
+    block.addTransaction(tx);
+    block.addTransaction(tx);
+
+    dictionary.processBlock(block);
+
+    ASSERT_EQ(dictionary.size(), 1);
+}
+
+TEST(SensorDictionary, IgnoresRegularPayloads)
+{
+    iotbc::SensorDictionary dictionary;
+
+    iotbc::Block block(iotbc::NULL_HASH);
+
+    iotbc::Transaction tx(alice, 0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+    block.addTransaction(tx);
+
+    // Tag followed by a length that does not match the payload
+    iotbc::Transaction tx2(alice, 1, {iotbc::SensorDictionary::REGISTRATION_TAG, 0x05, 'a'});
+    tx2.sign(alice);
+    block.addTransaction(tx2);
+
+    dictionary.processBlock(block);
+
+    ASSERT_EQ(dictionary.size(), 0);
+}
+
+TEST(SensorDictionary, ReadingPayloadRoundTrip)
+{
+    auto payload = iotbc::SensorDictionary::readingPayload(300, "{\"open\":true}");
+
+    // Tag (1) + varint index (2) + reading (13)
+    ASSERT_EQ(payload.size(), 1 + 2 + 13);
+
+    iotbc::SensorIndex index = 0;
+    size_t offset = 0;
+
+    ASSERT_TRUE(iotbc::SensorDictionary::parseReading(payload, index, offset));
+    ASSERT_EQ(index, 300);
+    ASSERT_EQ(std::string(payload.begin() + offset, payload.end()), "{\"open\":true}");
+}
+
+TEST(SensorDictionary, ParseReadingRejectsOtherPayloads)
+{
+    iotbc::SensorIndex index = 0;
+    size_t offset = 0;
+    std::string legacy = "{\"id\":\"door\",\"data\":{}}";
+
+    ASSERT_FALSE(iotbc::SensorDictionary::parseReading({legacy.begin(), legacy.end()}, index, offset));
+    ASSERT_FALSE(iotbc::SensorDictionary::parseReading({}, index, offset));
+    ASSERT_FALSE(iotbc::SensorDictionary::parseReading({iotbc::SensorDictionary::READING_TAG, 0x80}, index, offset));
+}
@@ -0,0 +1,283 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <RingIngest.hpp>
+#include <SharedRing.hpp>
+#include <testers.hpp>
+
+/// @brief Shared memory name unique to the test process
+static std::string ringName(const std::string &name)
+{
+    return "/iotbc_" + name + "_" + std::to_string(getpid());
+}
+
+/// @brief Record holding its producer and sequence number, padded to a size depending on them
+static std::vector<unsigned char> numberedRecord(uint32_t producer, uint32_t sequence)
+{
+    std::vector<unsigned char> record(8 + (producer * 7 + sequence) % 50, static_cast<unsigned char>(sequence));
+    std::memcpy(record.data(), &producer, sizeof(producer));
+    std::memcpy(record.data() + 4, &sequence, sizeof(sequence));
+    return record;
+}
+
+static std::pair<uint32_t, uint32_t> recordNumbers(std::span<const unsigned char> record)
+{
+    uint32_t producer, sequence;
+    std::memcpy(&producer, record.data(), sizeof(producer));
+    std::memcpy(&sequence, record.data() + 4, sizeof(sequence));
+    EXPECT_EQ(std::vector<unsigned char>(record.begin(), record.end()), numberedRecord(producer, sequence));
+    return {producer, sequence};
+}
+
+TEST(SharedRing, KeepsRecordsInOrderAcrossWraps)
+{
+    iotbc::SharedRing ring(ringName("ring_order"), 4096);
+
+    ASSERT_FALSE(ring.push(std::vector<unsigned char>(ring.maxRecordSize() + 1)));
+    ASSERT_TRUE(ring.push(std::vector<unsigned char>()));
+    ASSERT_EQ(ring.consume(10, [](std::span<const unsigned char> record) { ASSERT_TRUE(record.empty()); }), 1);
+
+    uint32_t pushed = 0;
+    uint32_t consumed = 0;
+
+    for (int round = 0; round < 200; round++) {
+        // Fill the ring up, then drain part of it
+        while (ring.push(numberedRecord(0, pushed))) {
+            pushed++;
+        }
+
+        ring.consume(round % 3 == 0 ? SIZE_MAX : 17, [&](std::span<const unsigned char> record) {
+            ASSERT_EQ(recordNumbers(record).second, consumed);
+            consumed++;
+        });
+    }
+
+    ring.consume(SIZE_MAX, [&](std::span<const unsigned char> record) {
+        ASSERT_EQ(recordNumbers(record).second, consumed);
+        consumed++;
+    });
+    ASSERT_EQ(consumed, pushed);
+    ASSERT_GT(pushed, 4096);
+    ASSERT_FALSE(ring.wait(std::chrono::milliseconds(1)));
+}
+
+TEST(SharedRing, TakesRecordsFromConcurrentProducers)
+{
+    constexpr uint32_t producers = 4;
+    constexpr uint32_t perProducer = 20000;
+
+    iotbc::SharedRing ring(ringName("ring_concurrent"), 1 << 16);
+
+    // The producers share the consumer's mapping, so thread sanitizers see the slots being given back,
+    // another mapping is exercised across processes below
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < perProducer; i++) {
+                while (!ring.push(numberedRecord(p, i))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Each producer's records come in the order it pushed them
+    std::vector<uint32_t> next(producers, 0);
+    size_t total = 0;
+    while (total < producers * perProducer) {
+        if (!ring.wait(std::chrono::seconds(5))) {
+            break;
+        }
+
+        total += ring.consume(256, [&](std::span<const unsigned char> record) {
+            auto [producer, sequence] = recordNumbers(record);
+            ASSERT_EQ(sequence, next[producer]);
+            next[producer]++;
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(total, producers * perProducer);
+}
+
+TEST(SharedRing, OnlyWakesUpASleepingConsumer)
+{
+    iotbc::SharedRing ring(ringName("ring_wakeup"), 1 << 16);
+
+    // Nobody waits, pushing costs no syscall
+    for (uint32_t i = 0; i < 1000; i++) {
+        ASSERT_TRUE(ring.push(numberedRecord(0, i)));
+    }
+    ASSERT_EQ(ring.wakeups(), 0);
+    ASSERT_TRUE(ring.wait(std::chrono::seconds(1)));
+    ASSERT_EQ(ring.consume(SIZE_MAX, [](std::span<const unsigned char>) {}), 1000);
+
+    bool woken = false;
+    std::thread consumer([&]() { woken = ring.wait(std::chrono::seconds(5)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_TRUE(ring.push(numberedRecord(0, 0)));
+    ASSERT_TRUE(ring.push(numberedRecord(0, 1)));
+    consumer.join();
+
+    ASSERT_TRUE(woken);
+    ASSERT_EQ(ring.wakeups(), 1);
+}
+
+TEST(SharedRing, TakesRecordsFromAnotherProcess)
+{
+    std::string name = ringName("ring_process");
+    iotbc::SharedRing ring(name, 1 << 16);
+
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+
+    if (child == 0) {
+        iotbc::SharedRing producerRing(name);
+
+        for (uint32_t i = 0; i < 1000; i++) {
+            while (!producerRing.push(numberedRecord(1, i))) {
+                std::this_thread::yield();
+            }
+        }
+        _exit(0);
+    }
+
+    uint32_t next = 0;
+    while (next < 1000 && ring.wait(std::chrono::seconds(5))) {
+        ring.consume(SIZE_MAX, [&](std::span<const unsigned char> record) {
+            ASSERT_EQ(recordNumbers(record).second, next);
+            next++;
+        });
+    }
+
+    int status;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_EQ(next, 1000);
+
+    ASSERT_THROW(iotbc::SharedRing(ringName("ring_missing")), iotbc::IoError);
+    ASSERT_THROW(iotbc::SharedRing(name, 5000), iotbc::IoError);
+}
+
+TEST(SharedRing, RejectsInvalidRecordHeaders)
+{
+    std::string name = ringName("ring_corrupt");
+    iotbc::SharedRing ring(name, 4096);
+
+    // A producer process writing garbage over a record header, found right before its payload
+    std::vector<unsigned char> marker(16, 0xA5);
+    ASSERT_TRUE(ring.push(numberedRecord(0, 0)));
+    ASSERT_TRUE(ring.push(marker));
+
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    struct stat st;
+    ASSERT_EQ(::fstat(fd, &st), 0);
+    auto *memory = static_cast<unsigned char *>(::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    ::close(fd);
+    ASSERT_NE(memory, MAP_FAILED);
+
+    unsigned char *payload = std::search(memory, memory + st.st_size, marker.begin(), marker.end());
+    ASSERT_NE(payload, memory + st.st_size);
+    uint64_t forged = (uint64_t(1) << 40) | 1;
+    std::memcpy(payload - sizeof(uint64_t), &forged, sizeof(forged));
+
+    // The record before it is still handed out, then the ring is given up
+    size_t consumed = 0;
+    ASSERT_THROW(ring.consume(SIZE_MAX, [&](std::span<const unsigned char> record) {
+        ASSERT_EQ(recordNumbers(record), std::make_pair(0u, 0u));
+        consumed++;
+    }), iotbc::IoError);
+    ASSERT_EQ(consumed, 1);
+    ASSERT_THROW(ring.consume(SIZE_MAX, [](std::span<const unsigned char>) {}), iotbc::IoError);
+
+    ::munmap(memory, st.st_size);
+}
+
+TEST(SharedRing, FeedsTheMempool)
+{
+    iotbc::Mempool mempool;
+    iotbc::RingIngestOptions options;
+    options.capacity = 1 << 16;
+    iotbc::RingIngest ingest(mempool, ringName("ring_ingest"), options);
+
+    std::vector<unsigned char> buf;
+    for (size_t i = 0; i < 500; i++) {
+        iotbc::Transaction tx(alice, i, {0x00, static_cast<unsigned char>(i), 0x42});
+        tx.sign(alice);
+
+        buf.clear();
+        tx.serializeInto(buf, iotbc::WireFormat::V2);
+        while (!ingest.ring().push(buf)) {
+            std::this_thread::yield();
+        }
+    }
+
+    buf.pop_back();
+    ASSERT_TRUE(ingest.ring().push(buf));
+
+    for (int i = 0; i < 500 && ingest.stats().received < 501; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    mempool.flush();
+
+    iotbc::RingIngestStats stats = ingest.stats();
+    ASSERT_EQ(stats.received, 501);
+    ASSERT_EQ(stats.malformed, 1);
+    ASSERT_EQ(stats.refused, 0);
+    ASSERT_EQ(mempool.readyCount(), 500);
+}
+
+TEST(SharedRing, FullMempoolFillsTheRing)
+{
+    iotbc::MempoolPolicy policy;
+    policy.capacity = 8;
+    iotbc::Mempool mempool(policy);
+
+    iotbc::RingIngestOptions options;
+    options.capacity = 4096;
+    iotbc::RingIngest ingest(mempool, ringName("ring_full"), options);
+
+    // Producers are refused once the mempool and the ring are full, nothing is dropped
+    std::vector<iotbc::Transaction> txs = signedTransactions(alice, 0, 200);
+    std::vector<unsigned char> buf;
+    size_t pushed = 0;
+
+    for (; pushed < txs.size(); pushed++) {
+        buf.clear();
+        txs[pushed].serializeInto(buf, iotbc::WireFormat::V2);
+        if (!ingest.ring().push(buf) && !waitFor([&]() { return ingest.ring().push(buf); })) {
+            break;
+        }
+    }
+
+    ASSERT_GT(pushed, 8);
+    ASSERT_LT(pushed, txs.size());
+    ASSERT_EQ(mempool.size(), 8);
+    ASSERT_GT(ingest.stats().stalls, 0);
+    ASSERT_EQ(ingest.stats().received, 8);
+
+    // The ring drains as the mempool gets room again
+    mempool.flush();
+    iotbc::Block block(iotbc::NULL_HASH, 0);
+    for (size_t i = 0; i < 8; i++) {
+        block.addTransaction(txs[i]);
+    }
+    ASSERT_EQ(mempool.removeIncluded(block), 8);
+
+    ASSERT_TRUE(waitFor([&]() { return ingest.stats().received == 16; }));
+    ASSERT_EQ(ingest.stats().refused, 0);
+    ASSERT_EQ(mempool.size(), 8);
+}
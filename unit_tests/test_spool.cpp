@@ -0,0 +1,336 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <Spool.hpp>
+#include <testers.hpp>
+
+/// @brief Empty folder unique to a test
+static std::string spoolFolder(const std::string &name)
+{
+    std::string folder = "/tmp/iotbc_test_spool_" + name;
+    std::filesystem::remove_all(folder);
+    return folder;
+}
+
+/// @brief Records of a block, one per device
+static std::vector<iotbc::SpoolEntry> blockEntries(uint64_t height, uint32_t count)
+{
+    std::vector<iotbc::SpoolEntry> entries;
+
+    for (uint32_t i = 0; i < count; i++) {
+        iotbc::SpoolEntry entry;
+        entry.height = height;
+        entry.index = i;
+        entry.timestamp = 1700000000000 + height * 1000 + i;
+        entry.key = "sensor-" + std::to_string(i);
+        entry.value = "{\"reading\":" + std::to_string(height * 100 + i) + "}";
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+static size_t segmentCount(const std::string &folder)
+{
+    size_t count = 0;
+    for (const auto &file : std::filesystem::directory_iterator(folder)) {
+        count += file.path().extension() == ".spool";
+    }
+    return count;
+}
+
+TEST(Spool, ReadsRecordsBackInOrderAcrossSegments)
+{
+    std::string folder = spoolFolder("order");
+    iotbc::SpoolOptions options;
+    options.segmentSize = 512;
+
+    {
+        iotbc::Spool spool(folder, options);
+        for (uint64_t height = 0; height < 20; height++) {
+            spool.append(blockEntries(height, 5));
+        }
+    }
+    ASSERT_GT(segmentCount(folder), 1);
+
+    // Read back after reopening, in small batches
+    iotbc::Spool spool(folder, options);
+    iotbc::SpoolCursor cursor = spool.cursor("dashboard");
+    std::vector<iotbc::SpoolEntry> all;
+
+    while (true) {
+        iotbc::SpoolCursor next;
+        std::vector<iotbc::SpoolEntry> entries = spool.read(cursor, 7, next);
+        if (entries.empty()) {
+            break;
+        }
+        ASSERT_LE(entries.size(), 7);
+        ASSERT_EQ(next.height, entries.back().height);
+        ASSERT_EQ(next.index, entries.back().index);
+        all.insert(all.end(), entries.begin(), entries.end());
+        cursor = next;
+    }
+
+    ASSERT_EQ(all.size(), 100);
+    ASSERT_EQ(cursor.offset, spool.end());
+    for (size_t i = 0; i < all.size(); i++) {
+        iotbc::SpoolEntry expected = blockEntries(i / 5, 5)[i % 5];
+        ASSERT_EQ(all[i].height, expected.height);
+        ASSERT_EQ(all[i].index, expected.index);
+        ASSERT_EQ(all[i].timestamp, expected.timestamp);
+        ASSERT_EQ(all[i].key, expected.key);
+        ASSERT_EQ(all[i].value, expected.value);
+    }
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Spool, KeepsSegmentsUntilEveryDestinationIsPast)
+{
+    std::string folder = spoolFolder("cursors");
+    iotbc::SpoolOptions options;
+    options.segmentSize = 256;
+
+    iotbc::SpoolCursor fastCursor;
+    {
+        iotbc::Spool spool(folder, options);
+        for (uint64_t height = 0; height < 20; height++) {
+            spool.append(blockEntries(height, 4));
+        }
+
+        iotbc::SpoolCursor next;
+        spool.commit("slow", spool.cursor("slow"));
+        ASSERT_EQ(spool.read(spool.cursor("fast"), 60, next).size(), 60);
+        spool.commit("fast", next);
+        fastCursor = next;
+
+        // The slow destination did not read anything yet
+        ASSERT_EQ(spool.read(spool.cursor("slow"), 1, next).front().height, 0);
+    }
+
+    size_t segments = segmentCount(folder);
+
+    // Cursors are saved, and the slow destination starts over where it stopped
+    iotbc::Spool spool(folder, options);
+    ASSERT_EQ(spool.cursor("fast").offset, fastCursor.offset);
+    ASSERT_EQ(spool.cursor("fast").height, 14);
+    ASSERT_EQ(spool.cursor("fast").index, 3);
+
+    iotbc::SpoolCursor next;
+    std::vector<iotbc::SpoolEntry> entries = spool.read(spool.cursor("slow"), 80, next);
+    ASSERT_EQ(entries.size(), 80);
+    ASSERT_EQ(entries.front().height, 0);
+    ASSERT_EQ(segmentCount(folder), segments);
+
+    // Once it caught up, the segments both are past are deleted
+    spool.commit("slow", next);
+    ASSERT_LT(segmentCount(folder), segments);
+    ASSERT_EQ(spool.read(spool.cursor("fast"), 100, next).size(), 20);
+    ASSERT_EQ(spool.read(spool.cursor("slow"), 100, next).size(), 0);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Spool, DropsATornRecordWhenReopened)
+{
+    std::string folder = spoolFolder("torn");
+    uint64_t end;
+
+    {
+        iotbc::Spool spool(folder);
+        spool.append(blockEntries(0, 3));
+        end = spool.end();
+    }
+
+    // A crash in the middle of an append leaves part of a record
+    std::filesystem::path segment = std::filesystem::directory_iterator(folder)->path();
+    {
+        std::ofstream file(segment, std::ios::binary | std::ios::app);
+        file.write("\x40\x00\x00\x00\x12\x34", 6);
+    }
+
+    iotbc::Spool spool(folder);
+    ASSERT_EQ(spool.end(), end);
+    ASSERT_EQ(std::filesystem::file_size(segment), end);
+
+    spool.append(blockEntries(1, 3));
+    iotbc::SpoolCursor next;
+    std::vector<iotbc::SpoolEntry> entries = spool.read(spool.cursor("dashboard"), 100, next);
+    ASSERT_EQ(entries.size(), 6);
+    ASSERT_EQ(entries[3].height, 1);
+    ASSERT_EQ(entries[3].index, 0);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Spool, DrainRetriesUntilDelivered)
+{
+    std::string folder = spoolFolder("drain");
+    iotbc::Spool spool(folder);
+
+    std::mutex mutex;
+    std::vector<iotbc::SpoolEntry> delivered;
+    std::atomic<int> attempts = 0;
+
+    iotbc::SpoolDrainOptions options;
+    options.maxBatch = 16;
+    options.retryDelay = std::chrono::milliseconds(1);
+
+    {
+        // The destination is down for the first attempts
+        iotbc::SpoolDrain drain(spool, "dashboard", [&](const std::vector<iotbc::SpoolEntry> &entries) {
+            if (attempts++ < 3) {
+                return false;
+            }
+            EXPECT_LE(entries.size(), 16);
+            std::lock_guard<std::mutex> lock(mutex);
+            delivered.insert(delivered.end(), entries.begin(), entries.end());
+            return true;
+        }, options);
+
+        for (uint64_t height = 0; height < 10; height++) {
+            spool.append(blockEntries(height, 10));
+        }
+
+        ASSERT_TRUE(waitFor([&]() { return drain.position().offset == spool.end(); }));
+        ASSERT_EQ(drain.stats().delivered, 100);
+        ASSERT_EQ(drain.stats().failures, 3);
+    }
+
+    ASSERT_EQ(delivered.size(), 100);
+    for (size_t i = 0; i < delivered.size(); i++) {
+        ASSERT_EQ(delivered[i].height, i / 10);
+        ASSERT_EQ(delivered[i].index, i % 10);
+    }
+    ASSERT_EQ(spool.cursor("dashboard").offset, spool.end());
+
+    std::filesystem::remove_all(folder);
+}
+
+/// @brief Offsets of the records of a segment file
+static std::vector<uint64_t> recordOffsets(const std::filesystem::path &segment)
+{
+    std::ifstream file(segment, std::ios::binary);
+    std::vector<uint64_t> offsets;
+    unsigned char header[8];
+
+    while (file.read(reinterpret_cast<char *>(header), sizeof(header))) {
+        offsets.push_back(static_cast<uint64_t>(file.tellg()) - sizeof(header));
+        file.seekg(header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24), std::ios::cur);
+    }
+
+    return offsets;
+}
+
+/// @brief Overwrite bytes of a segment file in place
+static void overwrite(const std::filesystem::path &segment, uint64_t offset, const std::string &bytes)
+{
+    std::fstream file(segment, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(bytes.data(), bytes.size());
+}
+
+TEST(Spool, DrainSkipsDamagedRecords)
+{
+    std::string folder = spoolFolder("damaged");
+    iotbc::SpoolOptions options;
+    options.segmentSize = 512;
+    iotbc::Spool spool(folder, options);
+
+    for (uint64_t height = 0; height < 20; height++) {
+        spool.append(blockEntries(height, 5));
+    }
+
+    std::vector<std::filesystem::path> segments;
+    for (const auto &file : std::filesystem::directory_iterator(folder)) {
+        segments.push_back(file.path());
+    }
+    std::sort(segments.begin(), segments.end());
+    ASSERT_GT(segments.size(), 2);
+
+    // The content of a record in the middle of the first segment is damaged, its size still leads to the next record
+    std::vector<uint64_t> first = recordOffsets(segments[0]);
+    ASSERT_GT(first.size(), 4);
+    overwrite(segments[0], first[2] + 10, "XX");
+
+    // The size of a record in the middle of the second segment is damaged, the rest of the segment is lost
+    std::vector<uint64_t> second = recordOffsets(segments[1]);
+    ASSERT_GT(second.size(), 4);
+    overwrite(segments[1], second[2], std::string("\x00\x00\x01\x00", 4));
+    size_t lost = 1 + second.size() - 2;
+
+    std::mutex mutex;
+    std::vector<iotbc::SpoolEntry> delivered;
+
+    {
+        iotbc::SpoolDrain drain(spool, "dashboard", [&](const std::vector<iotbc::SpoolEntry> &entries) {
+            std::lock_guard<std::mutex> lock(mutex);
+            delivered.insert(delivered.end(), entries.begin(), entries.end());
+            return true;
+        });
+
+        ASSERT_TRUE(waitFor([&]() { return drain.position().offset == spool.end(); }));
+        ASSERT_EQ(drain.stats().skipped, 2);
+        ASSERT_EQ(drain.stats().delivered, 100 - lost);
+        ASSERT_EQ(drain.stats().failures, 0);
+    }
+
+    // Every record around the damaged ones got delivered, in order
+    ASSERT_EQ(delivered.size(), 100 - lost);
+    ASSERT_EQ(delivered[1].height, 0);
+    ASSERT_EQ(delivered[1].index, 1);
+    ASSERT_EQ(delivered[2].height, 0);
+    ASSERT_EQ(delivered[2].index, 3);
+    ASSERT_EQ(delivered.back().height, 19);
+    ASSERT_EQ(delivered.back().index, 4);
+
+    std::filesystem::remove_all(folder);
+}
+
+TEST(Spool, AppendsDoNotWaitForTheDestination)
+{
+    std::string folder = spoolFolder("slow");
+    iotbc::Spool spool(folder);
+
+    std::atomic<bool> released = false;
+    std::atomic<size_t> delivered = 0;
+
+    iotbc::SpoolDrainOptions options;
+    options.retryDelay = std::chrono::milliseconds(1);
+
+    {
+        iotbc::SpoolDrain drain(spool, "dashboard", [&](const std::vector<iotbc::SpoolEntry> &entries) {
+            if (!released) {
+                return false;
+            }
+            delivered += entries.size();
+            return true;
+        }, options);
+
+        for (uint64_t height = 0; height < 50; height++) {
+            spool.append(blockEntries(height, 20));
+        }
+        ASSERT_EQ(delivered, 0);
+
+        released = true;
+        ASSERT_TRUE(waitFor([&]() { return delivered == 1000; }));
+    }
+
+    // Picked up from the saved cursor by the next drain, nothing is delivered twice
+    {
+        iotbc::SpoolDrain drain(spool, "dashboard", [&](const std::vector<iotbc::SpoolEntry> &entries) {
+            delivered += entries.size();
+            return true;
+        }, options);
+
+        spool.append(blockEntries(50, 20));
+        ASSERT_TRUE(waitFor([&]() { return delivered == 1020; }));
+    }
+
+    std::filesystem::remove_all(folder);
+}
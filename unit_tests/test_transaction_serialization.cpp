@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <Types.hpp>
+#include <Varint.hpp>
 
 #include <testers.hpp>
 
@@ -8,7 +9,7 @@ TEST(Transaction, SerializationWorks)
 {
     iotbc::Transaction tx(alice.public_key, 42, {0x00, 0x01, 0x02});
 
-    auto serialized = tx.serialize();
+    auto serialized = tx.serialize(iotbc::WireFormat::V1);
 
     // Size is : public_key (64) + nonce (8) + data size (8) + data (3) + signature (64)
     ASSERT_EQ(serialized.size(), 147);
@@ -80,3 +81,67 @@ TEST(Transaction, DeserializationFailsIfDataOverflows)
 
     ASSERT_THROW(iotbc::Transaction::deserialize(data), iotbc::DeserializationError);
 }
+
+TEST(Transaction, SerializationV2Works)
+{
+    iotbc::Transaction tx(alice.public_key, 300, {0x00, 0x01, 0x02});
+
+    auto serialized = tx.serialize();
+
+    // Size is : magic (4) + format (1) + public_key (64) + nonce (2) + data size (1) + data (3) + signature (64)
+    ASSERT_EQ(serialized.size(), 139);
+
+    ASSERT_EQ(memcmp(serialized.data(), "IOTB\x02", 5), 0);
+    ASSERT_EQ(memcmp(serialized.data() + 5, alice.public_key.data(), 64), 0);
+
+    // Nonce as LEB128
+    ASSERT_EQ(serialized[5 + 64], 0xAC);
+    ASSERT_EQ(serialized[5 + 64 + 1], 0x02);
+
+    // Data size
+    ASSERT_EQ(serialized[5 + 64 + 2], 3);
+}
+
+TEST(Transaction, DeserializationReadsBothFormats)
+{
+    iotbc::Transaction tx(alice.public_key, 0x123456789abcdef0, {0x00, 0x01, 0x02});
+    tx.sign(alice);
+
+    for (auto format : {iotbc::WireFormat::V1, iotbc::WireFormat::V2}) {
+        auto deserialized = iotbc::Transaction::deserialize(tx.serialize(format));
+
+        ASSERT_EQ(deserialized.from, tx.from);
+        ASSERT_EQ(deserialized.nonce, tx.nonce);
+        ASSERT_EQ(deserialized.data, tx.data);
+        ASSERT_EQ(deserialized.signature, tx.signature);
+    }
+}
+
+TEST(Transaction, DeserializationV2FailsIfDataOverflows)
+{
+    iotbc::Transaction tx(alice.public_key, 0, {0x00, 0x01, 0x02});
+
+    auto serialized = tx.serialize();
+
+    // Claim more data than available
+    serialized[5 + 64 + 1] = 100;
+
+    ASSERT_THROW(iotbc::Transaction::deserialize(serialized), iotbc::DeserializationError);
+}
+
+TEST(Transaction, VarintRejectsValuesPast64Bits)
+{
+    std::vector<unsigned char> buf;
+    iotbc::writeVarint(buf, UINT64_MAX);
+    ASSERT_EQ(buf.size(), 10);
+    ASSERT_EQ(buf.back(), 0x01);
+
+    size_t cur = 0;
+    ASSERT_EQ(iotbc::readVarint(buf.data(), buf.size(), cur), UINT64_MAX);
+
+    for (unsigned char last : {0x02, 0x7F, 0x81}) {
+        buf.back() = last;
+        cur = 0;
+        ASSERT_THROW(iotbc::readVarint(buf.data(), buf.size(), cur), iotbc::DeserializationError);
+    }
+}
@@ -1,5 +1,18 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Blockchain.hpp>
+#include <Node.hpp>
+
 static constexpr iotbc::PrivateKey alice_pkey = {
     0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
     0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
@@ -17,3 +30,110 @@ static constexpr iotbc::PrivateKey bob_pkey = {
 };
 
 static const iotbc::Signer bob(bob_pkey);
+
+/// @brief Transaction of a signer, signed
+[[maybe_unused]] static iotbc::Transaction signedTx(const iotbc::Signer &signer, iotbc::Nonce nonce,
+                                                    const std::vector<unsigned char> &data = {0x00, 0x01, 0x02})
+{
+    iotbc::Transaction tx(signer, nonce, data);
+    tx.sign(signer);
+    return tx;
+}
+
+/// @brief Consecutive transactions of a signer, each one carrying a different reading
+[[maybe_unused]] static std::vector<iotbc::Transaction> signedTransactions(const iotbc::Signer &signer, iotbc::Nonce first, size_t count)
+{
+    std::vector<iotbc::Transaction> txs;
+
+    for (size_t i = 0; i < count; i++) {
+        txs.push_back(signedTx(signer, first + i, {0x00, static_cast<unsigned char>(i), 0x42}));
+    }
+
+    return txs;
+}
+
+/// @brief Transaction of a signer at its next nonce on a chain
+[[maybe_unused]] static iotbc::Transaction nextTx(const iotbc::Blockchain &chain, const iotbc::Signer &signer,
+                                                  const std::vector<unsigned char> &data = {0x00, 0x01, 0x02})
+{
+    return signedTx(signer, chain.nextNonce(signer.address), data);
+}
+
+/// @brief Block on top of a chain holding transactions, mined at a difficulty
+/// @param timestamp Timestamp of the block, the current time if not set
+[[maybe_unused]] static iotbc::Block minedBlock(const iotbc::Blockchain &chain, const std::vector<iotbc::Transaction> &txs,
+                                                int difficulty = 0, std::optional<uint64_t> timestamp = std::nullopt)
+{
+    iotbc::Block block(chain.empty() ? iotbc::NULL_HASH : chain.chain.back().blockHash(), chain.chain.size());
+    if (timestamp) {
+        block.timestamp = *timestamp;
+    }
+
+    for (const auto &tx : txs) {
+        block.addTransaction(tx);
+    }
+
+    block.mine(difficulty);
+    return block;
+}
+
+/// @brief Block on top of a chain holding the next transaction of a signer, tagged with the height
+[[maybe_unused]] static iotbc::Block nextBlock(const iotbc::Blockchain &chain, const iotbc::Signer &signer = alice)
+{
+    return minedBlock(chain, {nextTx(chain, signer, {0x00, static_cast<unsigned char>(chain.chain.size())})});
+}
+
+/// @brief Chain of blocks each holding the next transaction of alice
+[[maybe_unused]] static iotbc::Blockchain builtChain(size_t size)
+{
+    iotbc::Blockchain chain;
+
+    for (size_t i = 0; i < size; i++) {
+        chain.addBlock(nextBlock(chain));
+    }
+
+    return chain;
+}
+
+/// @brief Wait until a condition holds, for up to 5 seconds
+template <typename F>
+static bool waitFor(F &&condition)
+{
+    for (int i = 0; i < 500; i++) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return false;
+}
+
+/// @brief Connect a node to a raw socket playing its peer, the test speaks the protocol itself
+/// @return The socket, to close once done, or -1 if the node could not connect
+[[maybe_unused]] static int rawPeer(iotbc::Node &node)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+
+    int peer = -1;
+    if (listener >= 0 && ::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 && ::listen(listener, 1) == 0 &&
+        ::getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) == 0) {
+        node.connect("127.0.0.1", ntohs(addr.sin_port));
+        peer = ::accept(listener, nullptr, nullptr);
+    }
+
+    ::close(listener);
+    return peer;
+}
+
+/// @brief Send a message to a node over a raw socket, see rawPeer
+/// @return True if the whole frame got written
+[[maybe_unused]] static bool sendRaw(int peer, iotbc::MessageType type, const std::vector<unsigned char> &payload)
+{
+    std::vector<unsigned char> frame = iotbc::encodeFrame(type, payload);
+    return ::send(peer, frame.data(), frame.size(), 0) == static_cast<ssize_t>(frame.size());
+}